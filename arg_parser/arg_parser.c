@@ -40,22 +40,37 @@ static void * ap_resize_buffer( void * buf, const int min_size )
   }
 
 
+/* grow 'buf' geometrically to hold at least 'size' elements of 'elsize' */
+static void * ap_grow_buffer( void * buf, int * const capacity,
+                              const int size, const int elsize )
+  {
+  int new_capacity = *capacity ? *capacity : 16;
+  while( new_capacity < size ) new_capacity *= 2;
+  if( new_capacity == *capacity ) return buf;
+  buf = ap_resize_buffer( buf, new_capacity * elsize );
+  if( buf ) *capacity = new_capacity;
+  return buf;
+  }
+
+
 static char push_back_record( struct Arg_parser * const ap,
                               const int code, const char * const argument )
   {
-  const int len = strlen( argument );
   struct ap_Record * p;
-  void * tmp = ap_resize_buffer( ap->data,
-                 ( ap->data_size + 1 ) * sizeof (struct ap_Record) );
+  void * tmp = ap_grow_buffer( ap->data, &ap->data_capacity,
+                 ap->data_size + 1, sizeof (struct ap_Record) );
   if( !tmp ) return 0;
   ap->data = (struct ap_Record *)tmp;
   p = &(ap->data[ap->data_size]);
   p->code = code;
-  p->argument = 0;
-  tmp = ap_resize_buffer( p->argument, len + 1 );
-  if( !tmp ) return 0;
-  p->argument = (char *)tmp;
-  strncpy( p->argument, argument, len + 1 );
+  if( ap->in_argv ) p->argument = (char *)argument;	/* a part of argv */
+  else
+    {
+    const int len = strlen( argument );
+    p->argument = (char *)malloc( len + 1 );
+    if( !p->argument ) return 0;
+    memcpy( p->argument, argument, len + 1 );
+    }
   ++ap->data_size;
   return 1;
   }
@@ -76,9 +91,11 @@ static char add_error( struct Arg_parser * const ap, const char * const msg )
 static void free_data( struct Arg_parser * const ap )
   {
   int i;
-  for( i = 0; i < ap->data_size; ++i ) free( ap->data[i].argument );
+  if( !ap->in_argv )
+    for( i = 0; i < ap->data_size; ++i ) free( ap->data[i].argument );
   if( ap->data ) { free( ap->data ); ap->data = 0; }
   ap->data_size = 0;
+  ap->data_capacity = 0;
   }
 
 
@@ -204,19 +221,23 @@ static char parse_short_option( struct Arg_parser * const ap,
   }
 
 
-char ap_init( struct Arg_parser * const ap,
-              const int argc, const char * const argv[],
-              const struct ap_Option options[], const char in_order )
+static char ap_init_records( struct Arg_parser * const ap,
+                            const int argc, const char * const argv[],
+                            const struct ap_Option options[],
+                            const char in_order, const char in_argv )
   {
   const char ** non_options = 0;	/* skipped non-options */
   int non_options_size = 0;		/* number of skipped non-options */
+  int non_options_capacity = 0;
   int argind = 1;			/* index in argv */
   int i;
 
   ap->data = 0;
   ap->error = 0;
   ap->data_size = 0;
+  ap->data_capacity = 0;
   ap->error_size = 0;
+  ap->in_argv = in_argv;
   if( argc < 2 || !argv || !options ) return 1;
 
   while( argind < argc )
@@ -240,8 +261,8 @@ char ap_init( struct Arg_parser * const ap,
       {
       if( !in_order )
         {
-        void * tmp = ap_resize_buffer( non_options,
-                       ( non_options_size + 1 ) * sizeof *non_options );
+        void * tmp = ap_grow_buffer( non_options, &non_options_capacity,
+                       non_options_size + 1, sizeof *non_options );
         if( !tmp ) return 0;
         non_options = (const char **)tmp;
         non_options[non_options_size++] = argv[argind++];
@@ -262,6 +283,18 @@ char ap_init( struct Arg_parser * const ap,
   }
 
 
+char ap_init( struct Arg_parser * const ap,
+              const int argc, const char * const argv[],
+              const struct ap_Option options[], const char in_order )
+  { return ap_init_records( ap, argc, argv, options, in_order, 0 ); }
+
+
+char ap_init_argv( struct Arg_parser * const ap,
+                   const int argc, const char * const argv[],
+                   const struct ap_Option options[], const char in_order )
+  { return ap_init_records( ap, argc, argv, options, in_order, 1 ); }
+
+
 void ap_free( struct Arg_parser * const ap )
   {
   free_data( ap );
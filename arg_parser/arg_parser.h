@@ -75,7 +75,9 @@ struct Arg_parser
   struct ap_Record * data;
   char * error;
   int data_size;
+  int data_capacity;
   int error_size;
+  char in_argv;			/* arguments point into argv */
   };
 
 
@@ -83,6 +85,13 @@ char ap_init( struct Arg_parser * const ap,
               const int argc, const char * const argv[],
               const struct ap_Option options[], const char in_order );
 
+    /* Same as 'ap_init', but the arguments point into 'argv' instead of
+       being copied, so 'argv' must outlive 'ap'. With the records growing
+       geometrically it's meant for thousands of non-option arguments. */
+char ap_init_argv( struct Arg_parser * const ap,
+                   const int argc, const char * const argv[],
+                   const struct ap_Option options[], const char in_order );
+
 void ap_free( struct Arg_parser * const ap );
 
 const char * ap_error( const struct Arg_parser * const ap );
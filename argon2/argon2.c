@@ -0,0 +1,543 @@
+//argon2: Argon2id, RFC 9106
+//
+//Memory is split in `lanes' rows of 1KiB blocks, every pass fills each row
+//in four slices. Within a slice the lanes don't reference each other's
+//current segment, so they run on separate threads, joined at each slice
+//boundary (the synchronization points).
+//
+//The compression function G is the BLAKE2b round with the multiplications
+//of BlaMka, fBlaMka(x, y) = x + y + 2 * lo32(x) * lo32(y). Besides the
+//portable kernel there's an SSE2 one, two 64 bit words per register.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "blake2b.h"
+#include "argon2.h"
+
+#define ARGON2_ID             2
+#define ARGON2_BLOCK_WORDS  128
+#define ARGON2_BLOCK_SIZE  1024
+#define ARGON2_PREHASH_LEN   64
+#define ARGON2_ADDRESSES    ARGON2_BLOCK_WORDS
+
+typedef struct { uint64_t v[ARGON2_BLOCK_WORDS]; } block;
+
+struct instance {
+    const struct argon2_kernel *kernel;
+    block   *memory;
+    uint32_t passes;
+    uint32_t memory_blocks;
+    uint32_t segment_length;
+    uint32_t lane_length;
+    uint32_t lanes;
+};
+
+//the lanes of one slice a thread fills, lanes first, first + stride, ...
+struct segments {
+    const struct instance *instance;
+    uint32_t pass;
+    uint32_t slice;
+    uint32_t first;
+    uint32_t stride;
+};
+
+static void store32(uint8_t *p, uint32_t v) {
+    int i;
+    for (i = 0; i < 4; i++, v >>= 8) p[i] = (uint8_t) v;
+}
+
+static uint64_t load64(const uint8_t *p) {
+    uint64_t v = 0;
+    int i;
+    for (i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static void store64(uint8_t *p, uint64_t v) {
+    int i;
+    for (i = 0; i < 8; i++, v >>= 8) p[i] = (uint8_t) v;
+}
+
+static uint64_t rotr64(const uint64_t w, const unsigned c) {
+    return (w >> c) | (w << (64 - c));
+}
+
+static uint64_t fBlaMka(const uint64_t x, const uint64_t y) {
+    const uint64_t m = 0xFFFFFFFFULL;
+    return x + y + 2 * ((x & m) * (y & m));
+}
+
+#define GB(a, b, c, d)                 \
+    do {                               \
+        a = fBlaMka(a, b);             \
+        d = rotr64(d ^ a, 32);         \
+        c = fBlaMka(c, d);             \
+        b = rotr64(b ^ c, 24);         \
+        a = fBlaMka(a, b);             \
+        d = rotr64(d ^ a, 16);         \
+        c = fBlaMka(c, d);             \
+        b = rotr64(b ^ c, 63);         \
+    } while (0)
+
+#define BLAKE2_ROUND_NOMSG(v0, v1, v2, v3, v4, v5, v6, v7,            \
+                           v8, v9, v10, v11, v12, v13, v14, v15)      \
+    do {                                                              \
+        GB(v0, v4, v8, v12);                                          \
+        GB(v1, v5, v9, v13);                                          \
+        GB(v2, v6, v10, v14);                                         \
+        GB(v3, v7, v11, v15);                                         \
+        GB(v0, v5, v10, v15);                                         \
+        GB(v1, v6, v11, v12);                                         \
+        GB(v2, v7, v8, v13);                                          \
+        GB(v3, v4, v9, v14);                                          \
+    } while (0)
+
+//next = G(prev, ref), or next ^= G(prev, ref) with with_xor
+static void fill_block_portable(const uint64_t *prev, const uint64_t *ref,
+                                uint64_t *next, int with_xor) {
+    uint64_t R[ARGON2_BLOCK_WORDS], Z[ARGON2_BLOCK_WORDS];
+    uint64_t *v = Z;
+    int i;
+
+    for (i = 0; i < ARGON2_BLOCK_WORDS; i++) {
+        R[i] = ref[i] ^ prev[i];
+        Z[i] = R[i];
+    }
+    if (with_xor)
+        for (i = 0; i < ARGON2_BLOCK_WORDS; i++) R[i] ^= next[i];
+
+    //rows of 16 words, then columns of 2 word pairs
+    for (i = 0; i < 8; i++)
+        BLAKE2_ROUND_NOMSG(
+            v[16 * i],      v[16 * i + 1],  v[16 * i + 2],  v[16 * i + 3],
+            v[16 * i + 4],  v[16 * i + 5],  v[16 * i + 6],  v[16 * i + 7],
+            v[16 * i + 8],  v[16 * i + 9],  v[16 * i + 10], v[16 * i + 11],
+            v[16 * i + 12], v[16 * i + 13], v[16 * i + 14], v[16 * i + 15]);
+    for (i = 0; i < 8; i++)
+        BLAKE2_ROUND_NOMSG(
+            v[2 * i],       v[2 * i + 1],   v[2 * i + 16],  v[2 * i + 17],
+            v[2 * i + 32],  v[2 * i + 33],  v[2 * i + 48],  v[2 * i + 49],
+            v[2 * i + 64],  v[2 * i + 65],  v[2 * i + 80],  v[2 * i + 81],
+            v[2 * i + 96],  v[2 * i + 97],  v[2 * i + 112], v[2 * i + 113]);
+
+    for (i = 0; i < ARGON2_BLOCK_WORDS; i++) next[i] = Z[i] ^ R[i];
+}
+
+#if defined(__SSE2__)
+static __m128i fBlaMka_sse2(const __m128i x, const __m128i y) {
+    const __m128i z = _mm_mul_epu32(x, y);
+    return _mm_add_epi64(_mm_add_epi64(x, y), _mm_add_epi64(z, z));
+}
+
+#define ROTR32(x) _mm_shuffle_epi32((x), _MM_SHUFFLE(2, 3, 0, 1))
+#define ROTR(x, c) _mm_xor_si128(_mm_srli_epi64((x), (c)), \
+                                 _mm_slli_epi64((x), 64 - (c)))
+
+#define G1_SSE2(A0, B0, C0, D0, A1, B1, C1, D1)                  \
+    do {                                                          \
+        A0 = fBlaMka_sse2(A0, B0); A1 = fBlaMka_sse2(A1, B1);     \
+        D0 = ROTR32(_mm_xor_si128(D0, A0));                       \
+        D1 = ROTR32(_mm_xor_si128(D1, A1));                       \
+        C0 = fBlaMka_sse2(C0, D0); C1 = fBlaMka_sse2(C1, D1);     \
+        B0 = ROTR(_mm_xor_si128(B0, C0), 24);                     \
+        B1 = ROTR(_mm_xor_si128(B1, C1), 24);                     \
+    } while (0)
+
+#define G2_SSE2(A0, B0, C0, D0, A1, B1, C1, D1)                  \
+    do {                                                          \
+        A0 = fBlaMka_sse2(A0, B0); A1 = fBlaMka_sse2(A1, B1);     \
+        D0 = ROTR(_mm_xor_si128(D0, A0), 16);                     \
+        D1 = ROTR(_mm_xor_si128(D1, A1), 16);                     \
+        C0 = fBlaMka_sse2(C0, D0); C1 = fBlaMka_sse2(C1, D1);     \
+        B0 = ROTR(_mm_xor_si128(B0, C0), 63);                     \
+        B1 = ROTR(_mm_xor_si128(B1, C1), 63);                     \
+    } while (0)
+
+#define DIAGONALIZE_SSE2(A0, B0, C0, D0, A1, B1, C1, D1)                 \
+    do {                                                                  \
+        __m128i t0 = D0, t1 = B0;                                         \
+        D0 = C0; C0 = C1; C1 = D0;                                        \
+        D0 = _mm_unpackhi_epi64(D1, _mm_unpacklo_epi64(t0, t0));          \
+        D1 = _mm_unpackhi_epi64(t0, _mm_unpacklo_epi64(D1, D1));          \
+        B0 = _mm_unpackhi_epi64(B0, _mm_unpacklo_epi64(B1, B1));          \
+        B1 = _mm_unpackhi_epi64(B1, _mm_unpacklo_epi64(t1, t1));          \
+    } while (0)
+
+#define UNDIAGONALIZE_SSE2(A0, B0, C0, D0, A1, B1, C1, D1)               \
+    do {                                                                  \
+        __m128i t0 = C0, t1;                                              \
+        C0 = C1; C1 = t0;                                                 \
+        t0 = B0; t1 = D0;                                                 \
+        B0 = _mm_unpackhi_epi64(B1, _mm_unpacklo_epi64(B0, B0));          \
+        B1 = _mm_unpackhi_epi64(t0, _mm_unpacklo_epi64(B1, B1));          \
+        D0 = _mm_unpackhi_epi64(D0, _mm_unpacklo_epi64(D1, D1));          \
+        D1 = _mm_unpackhi_epi64(D1, _mm_unpacklo_epi64(t1, t1));          \
+    } while (0)
+
+#define BLAKE2_ROUND_SSE2(A0, A1, B0, B1, C0, C1, D0, D1)                \
+    do {                                                                  \
+        G1_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);                          \
+        G2_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);                          \
+        DIAGONALIZE_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);                 \
+        G1_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);                          \
+        G2_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);                          \
+        UNDIAGONALIZE_SSE2(A0, B0, C0, D0, A1, B1, C1, D1);               \
+    } while (0)
+
+static void fill_block_sse2(const uint64_t *prev, const uint64_t *ref,
+                            uint64_t *next, int with_xor) {
+    __m128i s[64], R[64];
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        s[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) prev + i),
+                             _mm_loadu_si128((const __m128i *) ref + i));
+        R[i] = s[i];
+    }
+    if (with_xor)
+        for (i = 0; i < 64; i++)
+            R[i] = _mm_xor_si128(R[i], _mm_loadu_si128((const __m128i *) next + i));
+
+    for (i = 0; i < 8; i++)
+        BLAKE2_ROUND_SSE2(s[8 * i], s[8 * i + 1], s[8 * i + 2], s[8 * i + 3],
+                          s[8 * i + 4], s[8 * i + 5], s[8 * i + 6], s[8 * i + 7]);
+    for (i = 0; i < 8; i++)
+        BLAKE2_ROUND_SSE2(s[i], s[8 + i], s[16 + i], s[24 + i],
+                          s[32 + i], s[40 + i], s[48 + i], s[56 + i]);
+
+    for (i = 0; i < 64; i++)
+        _mm_storeu_si128((__m128i *) next + i, _mm_xor_si128(s[i], R[i]));
+}
+#endif
+
+const struct argon2_kernel argon2_kernels[] = {
+    { "portable", fill_block_portable },
+#if defined(__SSE2__)
+    { "sse2",     fill_block_sse2 },
+#endif
+    { NULL,       NULL }
+};
+
+//the last kernel is the fastest one, set back to the portable one by
+//argon2_selftest() if it fails
+static const struct argon2_kernel *selected;
+
+const struct argon2_kernel *argon2_kernel(void) {
+    int i;
+
+    if (selected) return selected;
+    for (i = 0; argon2_kernels[i + 1].name; i++);
+    return &argon2_kernels[i];
+}
+
+//the pseudo random block indexes of the data independent passes
+static void next_addresses(const struct instance *instance, block *address,
+                           block *input, const block *zero) {
+    input->v[6]++;
+    instance->kernel->fill_block(zero->v, input->v, address->v, 0);
+    instance->kernel->fill_block(zero->v, address->v, address->v, 0);
+}
+
+//RFC 9106 section 3.4.1.2, map J_1 to a block of the reference set
+static uint32_t index_alpha(const struct instance *instance,
+                            const uint32_t pass, const uint32_t slice,
+                            const uint32_t index, const uint32_t pseudo_rand,
+                            const int same_lane) {
+    uint32_t area, start = 0;
+    uint64_t relative;
+
+    if (pass == 0) {
+        if (slice == 0)
+            area = index - 1;
+        else if (same_lane)
+            area = slice * instance->segment_length + index - 1;
+        else
+            area = slice * instance->segment_length - (index == 0 ? 1 : 0);
+    } else {
+        if (same_lane)
+            area = instance->lane_length - instance->segment_length + index - 1;
+        else
+            area = instance->lane_length - instance->segment_length -
+                   (index == 0 ? 1 : 0);
+    }
+
+    relative = pseudo_rand;
+    relative = relative * relative >> 32;
+    relative = area - 1 - ((uint64_t) area * relative >> 32);
+
+    if (pass != 0 && slice != ARGON2_SYNC_POINTS - 1)
+        start = (slice + 1) * instance->segment_length;
+
+    return (uint32_t) ((start + relative) % instance->lane_length);
+}
+
+static void fill_segment(const struct instance *instance, const uint32_t pass,
+                         const uint32_t lane, const uint32_t slice) {
+    block address, input, zero;
+    block *ref, *curr, *prev;
+    uint64_t pseudo_rand;
+    uint32_t i, start = 0, curr_offset, prev_offset, ref_lane, ref_index;
+    //Argon2id: Argon2i for the first half of the first pass, Argon2d after
+    const int independent = pass == 0 && slice < ARGON2_SYNC_POINTS / 2;
+
+    if (independent) {
+        memset(&zero, 0, sizeof(zero));
+        memset(&input, 0, sizeof(input));
+        input.v[0] = pass;
+        input.v[1] = lane;
+        input.v[2] = slice;
+        input.v[3] = instance->memory_blocks;
+        input.v[4] = instance->passes;
+        input.v[5] = ARGON2_ID;
+    }
+
+    //the first two blocks of each lane are set from H0
+    if (pass == 0 && slice == 0) {
+        start = 2;
+        if (independent) next_addresses(instance, &address, &input, &zero);
+    }
+
+    curr_offset = lane * instance->lane_length +
+                  slice * instance->segment_length + start;
+    if (curr_offset % instance->lane_length == 0)
+        prev_offset = curr_offset + instance->lane_length - 1;
+    else
+        prev_offset = curr_offset - 1;
+
+    for (i = start; i < instance->segment_length;
+         i++, curr_offset++, prev_offset++) {
+        if (curr_offset % instance->lane_length == 1)
+            prev_offset = curr_offset - 1;
+
+        if (independent) {
+            if (i % ARGON2_ADDRESSES == 0)
+                next_addresses(instance, &address, &input, &zero);
+            pseudo_rand = address.v[i % ARGON2_ADDRESSES];
+        } else
+            pseudo_rand = instance->memory[prev_offset].v[0];
+
+        ref_lane = (uint32_t) ((pseudo_rand >> 32) % instance->lanes);
+        if (pass == 0 && slice == 0) ref_lane = lane;
+
+        ref_index = index_alpha(instance, pass, slice, i,
+                                (uint32_t) pseudo_rand, ref_lane == lane);
+        ref  = instance->memory + (size_t) instance->lane_length * ref_lane +
+               ref_index;
+        curr = instance->memory + curr_offset;
+        prev = instance->memory + prev_offset;
+        //version 1.3 XORs the new block into the old one after pass 0
+        instance->kernel->fill_block(prev->v, ref->v, curr->v, pass != 0);
+    }
+}
+
+static void *fill_segments(void *arg) {
+    const struct segments *s = arg;
+    uint32_t lane;
+
+    for (lane = s->first; lane < s->instance->lanes; lane += s->stride)
+        fill_segment(s->instance, s->pass, lane, s->slice);
+    return NULL;
+}
+
+//one slice of every lane, worker 0 runs in the calling thread and a worker
+//whose thread can't be started runs there too
+static void fill_slice(const struct instance *instance, const uint32_t pass,
+                       const uint32_t slice, const uint32_t threads,
+                       struct segments *workers, pthread_t *tids,
+                       int *started) {
+    uint32_t t;
+
+    for (t = 0; t < threads; t++) {
+        workers[t].instance = instance;
+        workers[t].pass     = pass;
+        workers[t].slice    = slice;
+        workers[t].first    = t;
+        workers[t].stride   = threads;
+        started[t]          = t > 0 &&
+            pthread_create(&tids[t], NULL, fill_segments, &workers[t]) == 0;
+    }
+    for (t = 0; t < threads; t++)
+        if (!started[t]) fill_segments(&workers[t]);
+    for (t = 1; t < threads; t++)
+        if (started[t]) pthread_join(tids[t], NULL);
+}
+
+static void initial_hash(uint8_t *h0, const struct argon2_params *params,
+                         const uint32_t outlen, const uint8_t *pwd,
+                         const size_t pwdlen, const uint8_t *salt,
+                         const size_t saltlen) {
+    blake2b_state S;
+    uint8_t le[4];
+
+    blake2b_init(&S, ARGON2_PREHASH_LEN);
+#define UPDATE32(x) do { store32(le, (uint32_t) (x)); \
+                         blake2b_update(&S, le, sizeof(le)); } while (0)
+    UPDATE32(params->lanes);
+    UPDATE32(outlen);
+    UPDATE32(params->m_cost);
+    UPDATE32(params->t_cost);
+    UPDATE32(ARGON2_VERSION);
+    UPDATE32(ARGON2_ID);
+    UPDATE32(pwdlen);
+    blake2b_update(&S, pwd, pwdlen);
+    UPDATE32(saltlen);
+    blake2b_update(&S, salt, saltlen);
+    UPDATE32(params->secretlen);
+    if (params->secretlen) blake2b_update(&S, params->secret, params->secretlen);
+    UPDATE32(params->adlen);
+    if (params->adlen) blake2b_update(&S, params->ad, params->adlen);
+#undef UPDATE32
+    blake2b_final(&S, h0);
+}
+
+static void wipe(void *p, size_t len) {
+    volatile uint8_t *v = p;
+    while (len--) *v++ = 0;
+}
+
+int argon2id_kernel(const struct argon2_kernel *kernel,
+                    const struct argon2_params *params, const uint8_t *pwd,
+                    size_t pwdlen, const uint8_t *salt, size_t saltlen,
+                    uint8_t *out, size_t outlen) {
+    uint8_t h0[ARGON2_PREHASH_LEN + 8], bytes[ARGON2_BLOCK_SIZE];
+    struct instance instance;
+    struct segments *workers = NULL;
+    pthread_t *tids          = NULL;
+    int *started             = NULL;
+    void *memory             = NULL;
+    block final, *first;
+    uint32_t threads, lane, pass, slice, i, j;
+    int err;
+
+    if (!params || !out || (!pwd && pwdlen) || !salt ||
+        outlen < ARGON2_MIN_OUTLEN || outlen > UINT32_MAX ||
+        saltlen < ARGON2_MIN_SALTLEN || saltlen > UINT32_MAX ||
+        pwdlen > UINT32_MAX || params->t_cost == 0 ||
+        params->lanes == 0 || params->lanes > ARGON2_MAX_LANES ||
+        params->m_cost < 8 * params->lanes) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    instance.kernel         = kernel;
+    instance.passes         = params->t_cost;
+    instance.lanes          = params->lanes;
+    instance.segment_length = params->m_cost / (params->lanes * ARGON2_SYNC_POINTS);
+    instance.lane_length    = instance.segment_length * ARGON2_SYNC_POINTS;
+    instance.memory_blocks  = instance.lane_length * params->lanes;
+
+    threads = params->threads ? params->threads : 1;
+    if (threads > params->lanes) threads = params->lanes;
+
+    if (SIZE_MAX / ARGON2_BLOCK_SIZE < instance.memory_blocks) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if ((err = posix_memalign(&memory, 64,
+                              (size_t) instance.memory_blocks * ARGON2_BLOCK_SIZE))) {
+        errno = err;
+        return -1;
+    }
+    instance.memory = memory;
+    if ((workers = calloc(threads, sizeof(*workers))) == NULL ||
+        (tids = calloc(threads, sizeof(*tids))) == NULL ||
+        (started = calloc(threads, sizeof(*started))) == NULL) {
+        free(workers);
+        free(tids);
+        free(memory);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    //B[i][0] = H'(H0 || LE32(0) || LE32(i)), B[i][1] = H'(H0 || LE32(1) || LE32(i))
+    initial_hash(h0, params, (uint32_t) outlen, pwd, pwdlen, salt, saltlen);
+    for (lane = 0; lane < instance.lanes; lane++) {
+        for (i = 0; i < 2; i++) {
+            store32(h0 + ARGON2_PREHASH_LEN, i);
+            store32(h0 + ARGON2_PREHASH_LEN + 4, lane);
+            blake2b_long(bytes, ARGON2_BLOCK_SIZE, h0, sizeof(h0));
+            first = &instance.memory[(size_t) lane * instance.lane_length + i];
+            for (j = 0; j < ARGON2_BLOCK_WORDS; j++)
+                first->v[j] = load64(bytes + 8 * j);
+        }
+    }
+
+    for (pass = 0; pass < instance.passes; pass++)
+        for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+            fill_slice(&instance, pass, slice, threads, workers, tids, started);
+
+    //C = B[0][q-1] ^ B[1][q-1] ^ ..., tag = H'(C)
+    final = instance.memory[instance.lane_length - 1];
+    for (lane = 1; lane < instance.lanes; lane++)
+        for (i = 0; i < ARGON2_BLOCK_WORDS; i++)
+            final.v[i] ^= instance.memory[(size_t) lane * instance.lane_length +
+                                          instance.lane_length - 1].v[i];
+    for (i = 0; i < ARGON2_BLOCK_WORDS; i++)
+        store64(bytes + 8 * i, final.v[i]);
+    blake2b_long(out, outlen, bytes, ARGON2_BLOCK_SIZE);
+
+    wipe(h0, sizeof(h0));
+    wipe(bytes, sizeof(bytes));
+    wipe(&final, sizeof(final));
+    wipe(memory, (size_t) instance.memory_blocks * ARGON2_BLOCK_SIZE);
+    free(memory);
+    free(workers);
+    free(tids);
+    free(started);
+    return 0;
+}
+
+int argon2id(const struct argon2_params *params, const uint8_t *pwd,
+             size_t pwdlen, const uint8_t *salt, size_t saltlen,
+             uint8_t *out, size_t outlen) {
+    return argon2id_kernel(argon2_kernel(), params, pwd, pwdlen, salt,
+                           saltlen, out, outlen);
+}
+
+//RFC 9106 section 5.3
+static const uint8_t rfc9106_tag[32] = {
+    0x0d, 0x64, 0x0d, 0xf5, 0x8d, 0x78, 0x76, 0x6c,
+    0x08, 0xc0, 0x37, 0xa3, 0x4a, 0x8b, 0x53, 0xc9,
+    0xd0, 0x1e, 0xf0, 0x45, 0x2d, 0x75, 0xb6, 0x5e,
+    0xb5, 0x25, 0x20, 0xe9, 0x6b, 0x01, 0xe6, 0x59
+};
+
+int argon2_selftest(void) {
+    uint8_t pwd[32], salt[16], secret[8], ad[12], tag[32];
+    struct argon2_params params;
+    int i, disabled = 0;
+
+    memset(pwd, 0x01, sizeof(pwd));
+    memset(salt, 0x02, sizeof(salt));
+    memset(secret, 0x03, sizeof(secret));
+    memset(ad, 0x04, sizeof(ad));
+    memset(&params, 0, sizeof(params));
+    params.t_cost    = 3;
+    params.m_cost    = 32;
+    params.lanes     = 4;
+    params.threads   = 4;
+    params.secret    = secret;
+    params.secretlen = sizeof(secret);
+    params.ad        = ad;
+    params.adlen     = sizeof(ad);
+
+    for (i = 0; argon2_kernels[i].name; i++) {
+        if (argon2id_kernel(&argon2_kernels[i], &params, pwd, sizeof(pwd),
+                            salt, sizeof(salt), tag, sizeof(tag)) == 0 &&
+            memcmp(tag, rfc9106_tag, sizeof(tag)) == 0)
+            continue;
+        if (i == 0) {
+            errno = EDOM;
+            return -1;
+        }
+        selected = &argon2_kernels[0];
+        disabled = 1;
+    }
+    return disabled;
+}
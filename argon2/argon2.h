@@ -0,0 +1,66 @@
+#ifndef _ARGON2_H_
+#define _ARGON2_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARGON2_VERSION       0x13
+#define ARGON2_SYNC_POINTS      4
+#define ARGON2_MIN_OUTLEN       4
+#define ARGON2_MIN_SALTLEN      8
+#define ARGON2_MAX_LANES   0xFFFFFF
+
+/**
+ * Argon2id costs: m_cost in KiB (at least 8 * lanes), t_cost passes over the
+ * memory. Lanes are part of the output, threads only change how many of them
+ * run at once. secret and ad are the optional K and X inputs.
+ */
+struct argon2_params {
+    uint32_t t_cost;
+    uint32_t m_cost;
+    uint32_t lanes;
+    uint32_t threads;
+    const uint8_t *secret;
+    size_t   secretlen;
+    const uint8_t *ad;
+    size_t   adlen;
+};
+
+/* A compression function G implementation, see argon2_kernels[] */
+struct argon2_kernel {
+    const char *name;
+    void (*fill_block)(const uint64_t *prev, const uint64_t *ref,
+                       uint64_t *next, int with_xor);
+};
+
+/* NULL terminated, the first one is the portable kernel */
+extern const struct argon2_kernel argon2_kernels[];
+
+/**
+ * argon2id(params, pwd, pwdlen, salt, saltlen, out, outlen):
+ * Argon2id version 1.3 (RFC 9106) with the fastest kernel that passed
+ * argon2_selftest(). Return 0 on success; or -1 on error with errno set.
+ */
+int argon2id(const struct argon2_params *params, const uint8_t *pwd,
+             size_t pwdlen, const uint8_t *salt, size_t saltlen,
+             uint8_t *out, size_t outlen);
+
+/* argon2id() with the given kernel */
+int argon2id_kernel(const struct argon2_kernel *kernel,
+                    const struct argon2_params *params, const uint8_t *pwd,
+                    size_t pwdlen, const uint8_t *salt, size_t saltlen,
+                    uint8_t *out, size_t outlen);
+
+/**
+ * argon2_selftest():
+ * Check every kernel against the RFC 9106 Argon2id vector, argon2id() falls
+ * back to the portable kernel if the SIMD one fails. Call it before other
+ * threads start deriving. Return 0 if all passed, 1 if a kernel was disabled,
+ * or -1 if the portable kernel is broken.
+ */
+int argon2_selftest(void);
+
+/* The kernel argon2id() uses */
+const struct argon2_kernel *argon2_kernel(void);
+
+#endif /* _ARGON2_H_ */
@@ -0,0 +1,183 @@
+//blake2b: BLAKE2b as used by Argon2, see RFC 7693
+
+#include <string.h>
+
+#include "blake2b.h"
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+static uint64_t load64(const uint8_t *p) {
+    return (uint64_t) p[0]       | (uint64_t) p[1] << 8  |
+           (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24 |
+           (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 |
+           (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static void store64(uint8_t *p, uint64_t v) {
+    int i;
+    for (i = 0; i < 8; i++, v >>= 8) p[i] = (uint8_t) v;
+}
+
+static void store32(uint8_t *p, uint32_t v) {
+    int i;
+    for (i = 0; i < 4; i++, v >>= 8) p[i] = (uint8_t) v;
+}
+
+static uint64_t rotr64(const uint64_t w, const unsigned c) {
+    return (w >> c) | (w << (64 - c));
+}
+
+#define G(r, i, a, b, c, d)                          \
+    do {                                             \
+        a = a + b + m[blake2b_sigma[r][2 * i]];      \
+        d = rotr64(d ^ a, 32);                       \
+        c = c + d;                                   \
+        b = rotr64(b ^ c, 24);                       \
+        a = a + b + m[blake2b_sigma[r][2 * i + 1]];  \
+        d = rotr64(d ^ a, 16);                       \
+        c = c + d;                                   \
+        b = rotr64(b ^ c, 63);                       \
+    } while (0)
+
+static void compress(blake2b_state *S, const uint8_t *block, const int last) {
+    uint64_t m[16], v[16];
+    int i, r;
+
+    for (i = 0; i < 16; i++) m[i] = load64(block + 8 * i);
+    for (i = 0; i < 8; i++) {
+        v[i]     = S->h[i];
+        v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= S->t[0];
+    v[13] ^= S->t[1];
+    if (last) v[14] = ~v[14];
+
+    for (r = 0; r < 12; r++) {
+        G(r, 0, v[0], v[4], v[ 8], v[12]);
+        G(r, 1, v[1], v[5], v[ 9], v[13]);
+        G(r, 2, v[2], v[6], v[10], v[14]);
+        G(r, 3, v[3], v[7], v[11], v[15]);
+        G(r, 4, v[0], v[5], v[10], v[15]);
+        G(r, 5, v[1], v[6], v[11], v[12]);
+        G(r, 6, v[2], v[7], v[ 8], v[13]);
+        G(r, 7, v[3], v[4], v[ 9], v[14]);
+    }
+
+    for (i = 0; i < 8; i++) S->h[i] ^= v[i] ^ v[i + 8];
+}
+
+static void increment(blake2b_state *S, const uint64_t inc) {
+    S->t[0] += inc;
+    if (S->t[0] < inc) S->t[1]++;
+}
+
+int blake2b_init(blake2b_state *S, size_t outlen) {
+    int i;
+
+    if (outlen == 0 || outlen > BLAKE2B_OUTBYTES) return -1;
+    memset(S, 0, sizeof(*S));
+    for (i = 0; i < 8; i++) S->h[i] = blake2b_iv[i];
+    //parameter block: digest length, no key, fanout = depth = 1
+    S->h[0] ^= 0x01010000ULL ^ outlen;
+    S->outlen = outlen;
+    return 0;
+}
+
+void blake2b_update(blake2b_state *S, const void *in, size_t inlen) {
+    const uint8_t *p = in;
+    size_t fill;
+
+    //the last block is kept back, it has to be compressed as the final one
+    while (inlen > 0) {
+        if (S->buflen == BLAKE2B_BLOCKBYTES) {
+            increment(S, BLAKE2B_BLOCKBYTES);
+            compress(S, S->buf, 0);
+            S->buflen = 0;
+        }
+        fill = BLAKE2B_BLOCKBYTES - S->buflen;
+        if (fill > inlen) fill = inlen;
+        memcpy(S->buf + S->buflen, p, fill);
+        S->buflen += fill;
+        p         += fill;
+        inlen     -= fill;
+    }
+}
+
+void blake2b_final(blake2b_state *S, uint8_t *out) {
+    uint8_t buf[BLAKE2B_OUTBYTES];
+    int i;
+
+    increment(S, S->buflen);
+    memset(S->buf + S->buflen, 0, BLAKE2B_BLOCKBYTES - S->buflen);
+    compress(S, S->buf, 1);
+
+    for (i = 0; i < 8; i++) store64(buf + 8 * i, S->h[i]);
+    memcpy(out, buf, S->outlen);
+    memset(S, 0, sizeof(*S));
+}
+
+int blake2b(uint8_t *out, size_t outlen, const void *in, size_t inlen) {
+    blake2b_state S;
+
+    if (blake2b_init(&S, outlen)) return -1;
+    blake2b_update(&S, in, inlen);
+    blake2b_final(&S, out);
+    return 0;
+}
+
+int blake2b_long(uint8_t *out, size_t outlen, const void *in, size_t inlen) {
+    uint8_t outlen_le[4], v[BLAKE2B_OUTBYTES];
+    blake2b_state S;
+
+    if (outlen == 0 || outlen > UINT32_MAX) return -1;
+    store32(outlen_le, (uint32_t) outlen);
+
+    if (outlen <= BLAKE2B_OUTBYTES) {
+        blake2b_init(&S, outlen);
+        blake2b_update(&S, outlen_le, sizeof(outlen_le));
+        blake2b_update(&S, in, inlen);
+        blake2b_final(&S, out);
+        return 0;
+    }
+
+    //V_1 = H^64(LE32(T) || A), then V_i = H^64(V_{i-1}), the first half of
+    //each one is output until the last, which is output whole
+    blake2b_init(&S, BLAKE2B_OUTBYTES);
+    blake2b_update(&S, outlen_le, sizeof(outlen_le));
+    blake2b_update(&S, in, inlen);
+    blake2b_final(&S, v);
+    memcpy(out, v, BLAKE2B_OUTBYTES / 2);
+    out    += BLAKE2B_OUTBYTES / 2;
+    outlen -= BLAKE2B_OUTBYTES / 2;
+
+    while (outlen > BLAKE2B_OUTBYTES) {
+        blake2b(v, BLAKE2B_OUTBYTES, v, BLAKE2B_OUTBYTES);
+        memcpy(out, v, BLAKE2B_OUTBYTES / 2);
+        out    += BLAKE2B_OUTBYTES / 2;
+        outlen -= BLAKE2B_OUTBYTES / 2;
+    }
+    blake2b(v, outlen, v, BLAKE2B_OUTBYTES);
+    memcpy(out, v, outlen);
+    memset(v, 0, sizeof(v));
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef _BLAKE2B_H_
+#define _BLAKE2B_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLAKE2B_BLOCKBYTES 128
+#define BLAKE2B_OUTBYTES    64
+
+typedef struct {
+    uint64_t h[8];
+    uint64_t t[2];
+    uint8_t  buf[BLAKE2B_BLOCKBYTES];
+    size_t   buflen;
+    size_t   outlen;
+} blake2b_state;
+
+/* Unkeyed BLAKE2b (RFC 7693) with a 1-64 byte digest, return 0 or -1 */
+int blake2b_init(blake2b_state *S, size_t outlen);
+void blake2b_update(blake2b_state *S, const void *in, size_t inlen);
+void blake2b_final(blake2b_state *S, uint8_t *out);
+int blake2b(uint8_t *out, size_t outlen, const void *in, size_t inlen);
+
+/**
+ * blake2b_long(out, outlen, in, inlen):
+ * The variable length hash H' of Argon2 (RFC 9106 section 3.3), outlen may
+ * be larger than 64 bytes.
+ */
+int blake2b_long(uint8_t *out, size_t outlen, const void *in, size_t inlen);
+
+#endif /* _BLAKE2B_H_ */
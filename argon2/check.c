@@ -0,0 +1,105 @@
+//check: Argon2id known answers and kernel / thread differential test
+//usage: check [iterations [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blake2b.h"
+#include "argon2.h"
+
+static uint64_t rng_state;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t rng_range(const uint32_t lo, const uint32_t hi) {
+    return lo + (uint32_t) (rng() % (hi - lo + 1));
+}
+
+static void print_hex(const char *label, const uint8_t *buf, const size_t len) {
+    size_t i;
+    printf("  %-8s ", label);
+    for (i = 0; i < len; i++) printf("%02x", buf[i]);
+    printf("\n");
+}
+
+//BLAKE2b-512("abc"), RFC 7693 appendix A
+static int check_blake2b(void) {
+    const uint8_t expected[8] = {0xba, 0x80, 0xa5, 0x3f, 0x98, 0x1c, 0x4d, 0x0d};
+    uint8_t out[64];
+
+    blake2b(out, sizeof(out), "abc", 3);
+    if (memcmp(out, expected, sizeof(expected)) != 0) {
+        printf("BLAKE2b: MISMATCH\n");
+        return 1;
+    }
+    printf("BLAKE2b: ok\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const struct argon2_kernel *k;
+    struct argon2_params params;
+    uint8_t pwd[64], salt[32], ref[256], out[256];
+    unsigned long iterations = 50, i;
+    uint64_t seed            = (uint64_t) time(NULL);
+    size_t pwdlen, saltlen, outlen, j;
+    uint32_t threads;
+
+    if (argc > 1) iterations = strtoul(argv[1], NULL, 10);
+    if (argc > 2) seed = strtoull(argv[2], NULL, 0);
+
+    if (check_blake2b()) return EXIT_FAILURE;
+    if (argon2_selftest() != 0) {
+        printf("RFC 9106: MISMATCH, kernel %s in use\n", argon2_kernel()->name);
+        return EXIT_FAILURE;
+    }
+    printf("RFC 9106: ok\n");
+
+    printf("seed 0x%llx, %lu iterations\n", (unsigned long long) seed, iterations);
+    rng_state = seed ? seed : 1;
+    for (i = 0; i < iterations; i++) {
+        memset(&params, 0, sizeof(params));
+        params.t_cost = rng_range(1, 3);
+        params.lanes  = rng_range(1, 6);
+        params.m_cost = rng_range(8 * params.lanes, 512);
+        pwdlen        = rng_range(0, sizeof(pwd));
+        saltlen       = rng_range(8, sizeof(salt));
+        outlen        = rng_range(4, sizeof(out));
+        for (j = 0; j < pwdlen; j++) pwd[j] = (uint8_t) rng();
+        for (j = 0; j < saltlen; j++) salt[j] = (uint8_t) rng();
+
+        params.threads = 1;
+        if (argon2id_kernel(&argon2_kernels[0], &params, pwd, pwdlen, salt,
+                            saltlen, ref, outlen)) {
+            printf("portable kernel failed\n");
+            return EXIT_FAILURE;
+        }
+        for (k = argon2_kernels; k->name; k++) {
+            for (threads = 1; threads <= params.lanes; threads++) {
+                params.threads = threads;
+                if (argon2id_kernel(k, &params, pwd, pwdlen, salt, saltlen,
+                                    out, outlen) == 0 &&
+                    memcmp(ref, out, outlen) == 0)
+                    continue;
+                printf("MISMATCH: kernel %s, threads %u, t = %u, m = %u, "
+                       "lanes = %u, outlen = %zu, rerun with %lu 0x%llx\n",
+                       k->name, threads, params.t_cost, params.m_cost,
+                       params.lanes, outlen, i + 1, (unsigned long long) seed);
+                print_hex("pwd", pwd, pwdlen);
+                print_hex("salt", salt, saltlen);
+                print_hex("expected", ref, outlen);
+                print_hex("got", out, outlen);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    printf("check: all kernels match\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,576 @@
+//bench: libscrypt and encoders micro benchmarks
+//usage: bench [option]...
+
+//example: make bench
+//         make bench-baseline  #store the results as bench/baseline.json
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../arg_parser/arg_parser.h"
+#include "../libscrypt/libscrypt.h"
+#include "../libscrypt/sha256.h"
+#include "../libscrypt/crypto_scrypt-internal.h"
+#include "../encoders/encoders.h"
+#include "../argon2/argon2.h"
+#include "../perf/perf.h"
+
+#define MIN_TIME_MS      100
+#define THRESHOLD_PCT     10
+#define MAX_RESULTS      256
+#define ENCODE_BUF_LEN   (16 * 1024)
+#define SDT_THRESHOLD_PCT  5
+#define SDT_ROUNDS         9
+
+//crypto_scrypt-nosse.c built again with LIBSCRYPT_NO_SDT, see the Makefile
+int nosdt_scrypt(const uint8_t *, size_t, const uint8_t *, size_t, uint64_t,
+                 uint32_t, uint32_t, uint8_t *, size_t);
+
+struct result {
+    char     name[64];
+    uint64_t iterations;
+    double   ns_per_op;
+    double   bytes_per_sec;
+    double   cycles_per_byte; //TSC cycles, 0 when not available
+    double   baseline_ns;     //0 when not in the baseline
+};
+
+//a benchmark runs iterations operations over bytes bytes each
+struct bench {
+    char     name[64];
+    size_t   bytes;
+    void   (*run)(struct bench *b, uint64_t iterations);
+    size_t   r;
+    uint64_t N;
+    uint32_t p;
+    const struct encoder *encoder;
+    const struct argon2_kernel *kernel;
+};
+
+static struct result results[MAX_RESULTS];
+static int nresults;
+static double min_time = MIN_TIME_MS / 1e3;
+static const char *filter;
+static int perf;
+
+static uint8_t  *buf_B;
+static uint32_t *buf_V;
+static uint32_t *buf_XY;
+static char     *buf_out;
+
+void usage(int status) {
+    const char *usage_message="Usage: bench [option]...\n\
+    \b\b\b\bTime the libscrypt primitives and the password encoders.\
+      \n\
+      \n  -f, --filter STRING       only run benchmarks whose name contains STRING\
+      \n  -t, --min-time MS         minimum time per benchmark, \"100\" by default\
+      \n  -j, --json                JSON output\
+      \n  -o, --output FILE         also write the JSON output to FILE\
+      \n  -b, --baseline FILE       compare against the JSON results in FILE\
+      \n  -T, --threshold PCT       fail on regressions over PCT%, \"10\" by default\
+      \n  -P, --perf                hardware counters of the smix phases\
+      \n  -h, --help                show this help message and exit\n";
+    if (status != EXIT_SUCCESS) fprintf(stderr, "%s", usage_message);
+    else fprintf(stdout, "%s", usage_message);
+    exit(status);
+}
+
+void die(const char * const msg) {
+    fprintf(stderr, "bench: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//benchmarks, the data dependency between iterations keeps the compiler
+//from dropping any of them
+static void run_salsa20_8(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        libscrypt_salsa20_8(buf_XY);
+}
+
+static void run_blockmix(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    uint32_t *X = buf_XY, *Y = &buf_XY[32 * b->r], *Z = &buf_XY[64 * b->r];
+    for (i = 0; i < iterations; i += 2) {
+        libscrypt_blockmix_salsa8(X, Y, Z, b->r);
+        libscrypt_blockmix_salsa8(Y, X, Z, b->r);
+    }
+}
+
+static void run_smix(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        libscrypt_smix(buf_B, b->r, b->N, buf_V, buf_XY);
+}
+
+static void run_scrypt(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        if (libscrypt_scrypt((uint8_t *) "password", 8, buf_B, 16, b->N,
+                             b->r, b->p, buf_B, 32))
+            die("libscrypt_scrypt() failed");
+}
+
+static void run_scrypt_nosdt(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        if (nosdt_scrypt((uint8_t *) "password", 8, buf_B, 16, b->N,
+                         b->r, b->p, buf_B, 32))
+            die("nosdt_scrypt() failed");
+}
+
+static void run_yescrypt(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        if (libscrypt_yescrypt((uint8_t *) "password", 8, buf_B, 16, b->N,
+                               b->r, b->p, 0, LIBSCRYPT_YESCRYPT_DEFAULTS, 1,
+                               buf_B, 32))
+            die("libscrypt_yescrypt() failed");
+}
+
+//three blocks of buf_V: prev, ref and next
+static void run_argon2_fill_block(struct bench *b, uint64_t iterations) {
+    uint64_t i, *blocks = (uint64_t *) buf_V;
+    for (i = 0; i < iterations; i++)
+        b->kernel->fill_block(blocks, blocks + 128, blocks + 256, 1);
+}
+
+static void run_argon2id(struct bench *b, uint64_t iterations) {
+    struct argon2_params params;
+    uint64_t i;
+
+    memset(&params, 0, sizeof(params));
+    params.t_cost  = 1;
+    params.m_cost  = (uint32_t) b->N;
+    params.lanes   = b->p;
+    params.threads = 1;
+    for (i = 0; i < iterations; i++)
+        if (argon2id_kernel(b->kernel, &params, (uint8_t *) "password", 8,
+                            buf_B, 16, buf_B, 32))
+            die("argon2id() failed");
+}
+
+static void run_pbkdf2(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        libscrypt_PBKDF2_SHA256((uint8_t *) "password", 8, buf_B, 16, 1,
+                                (uint8_t *) buf_out, b->bytes);
+}
+
+static void run_encode(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++) {
+        if (b->encoder->encode(buf_B, b->bytes, buf_out, ENCODE_BUF_LEN) == -1)
+            die("encoder failed");
+        buf_B[0] ^= buf_out[0];
+    }
+}
+
+//buf_out holds the encoding of b->bytes of buf_B
+static void run_decode(struct bench *b, uint64_t iterations) {
+    uint64_t i;
+    for (i = 0; i < iterations; i++)
+        if (b->encoder->decode(buf_out, (uint8_t *) buf_V, ENCODE_BUF_LEN) == -1)
+            die("decoder failed");
+}
+
+static void perf_hook(int event, void *arg) {
+    const struct bench *b = arg;
+    switch (event) {
+        case LIBSCRYPT_EV_SMIX_FILL_BEGIN: perf_phase(b->name, "fill", 1); break;
+        case LIBSCRYPT_EV_SMIX_FILL_END:   perf_phase(b->name, "fill", 0); break;
+        case LIBSCRYPT_EV_SMIX_MIX_BEGIN:  perf_phase(b->name, "mix",  1); break;
+        case LIBSCRYPT_EV_SMIX_MIX_END:    perf_phase(b->name, "mix",  0); break;
+    }
+}
+
+static void measure(struct bench *b) {
+    struct result *res = NULL;
+    uint64_t iterations = 2, c0;
+    double t0, elapsed = 0;
+
+    if (filter && strstr(b->name, filter) == NULL) return;
+    if (nresults == MAX_RESULTS) die("too many benchmarks");
+
+    //warm up, then double the iterations until min_time is reached
+    b->run(b, 2);
+    for (;;) {
+        c0 = cycles();
+        t0 = now();
+        b->run(b, iterations);
+        elapsed = now() - t0;
+        c0 = cycles() - c0;
+        if (elapsed >= min_time) break;
+        iterations *= 2;
+    }
+
+    //counted on a separate run, the hook isn't free for small N
+    if (perf) {
+        libscrypt_set_hook(perf_hook, b);
+        b->run(b, 1);
+        libscrypt_set_hook(NULL, NULL);
+    }
+
+    res = &results[nresults++];
+    snprintf(res->name, sizeof(res->name), "%s", b->name);
+    res->iterations      = iterations;
+    res->ns_per_op       = elapsed * 1e9 / iterations;
+    res->bytes_per_sec   = (double) b->bytes * iterations / elapsed;
+    res->cycles_per_byte = (double) c0 / iterations / b->bytes;
+}
+
+static void run_all(void) {
+    const size_t rs[]       = {1, 8, 16};
+    const uint32_t ps[]     = {1, 4, 16};
+    const size_t dklens[]   = {32, 64, 1024, 16384};
+    const size_t keylens[]  = {8, 32, 128, 512, 1024};
+    const struct encoder *e;
+    struct bench b;
+    size_t i, j;
+    uint32_t cost;
+
+    memset(&b, 0, sizeof(b));
+    snprintf(b.name, sizeof(b.name), "salsa20_8");
+    b.bytes = 64;
+    b.run   = run_salsa20_8;
+    measure(&b);
+
+    for (i = 0; i < sizeof(rs) / sizeof(rs[0]); i++) {
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "blockmix_salsa8/r=%zu", rs[i]);
+        b.bytes = 128 * rs[i];
+        b.r     = rs[i];
+        b.run   = run_blockmix;
+        measure(&b);
+    }
+
+    //smix reads and writes V once: 2N BlockMix over 128r bytes
+    for (i = 0; i < sizeof(rs) / sizeof(rs[0]); i++) {
+        for (cost = 10; cost <= 16; cost += 2) {
+            memset(&b, 0, sizeof(b));
+            snprintf(b.name, sizeof(b.name), "smix/N=2^%u/r=%zu", cost, rs[i]);
+            b.r     = rs[i];
+            b.N     = (uint64_t) 1 << cost;
+            b.bytes = 2 * 128 * b.r * b.N;
+            b.run   = run_smix;
+            measure(&b);
+        }
+    }
+
+    for (i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "scrypt/N=2^14/r=8/p=%u", ps[i]);
+        b.r     = 8;
+        b.N     = (uint64_t) 1 << 14;
+        b.p     = ps[i];
+        b.bytes = 2 * 128 * b.r * b.N * b.p;
+        b.run   = run_scrypt;
+        measure(&b);
+    }
+
+    //yescrypt fills 128rN bytes once whatever p is, rated by memory filled
+    for (i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "yescrypt/N=2^14/r=8/p=%u", ps[i]);
+        b.r     = 8;
+        b.N     = (uint64_t) 1 << 14;
+        b.p     = ps[i];
+        b.bytes = 128 * b.r * b.N;
+        b.run   = run_yescrypt;
+        measure(&b);
+    }
+
+    //a 1KiB block is read twice and written once per G
+    for (i = 0; argon2_kernels[i].name; i++) {
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "argon2_fill_block/%s",
+                 argon2_kernels[i].name);
+        b.bytes  = 1024;
+        b.kernel = &argon2_kernels[i];
+        b.run    = run_argon2_fill_block;
+        measure(&b);
+
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "argon2id/m=2^14/t=1/%s",
+                 argon2_kernels[i].name);
+        b.N      = (uint64_t) 1 << 14;
+        b.p      = 4;
+        b.bytes  = 1024 * b.N;
+        b.kernel = &argon2_kernels[i];
+        b.run    = run_argon2id;
+        measure(&b);
+    }
+
+    for (i = 0; i < sizeof(dklens) / sizeof(dklens[0]); i++) {
+        memset(&b, 0, sizeof(b));
+        snprintf(b.name, sizeof(b.name), "pbkdf2_sha256/dklen=%zu", dklens[i]);
+        b.bytes = dklens[i];
+        b.run   = run_pbkdf2;
+        measure(&b);
+    }
+
+    for (e = encoders; e->name; e++) {
+        for (j = 0; j < sizeof(keylens) / sizeof(keylens[0]); j++) {
+            memset(&b, 0, sizeof(b));
+            snprintf(b.name, sizeof(b.name), "encode/%s/keylen=%zu",
+                     e->name, keylens[j]);
+            b.bytes   = keylens[j];
+            b.encoder = e;
+            b.run     = run_encode;
+            measure(&b);
+        }
+    }
+
+    for (e = encoders; e->name; e++) {
+        for (j = 0; e->decode && j < sizeof(keylens) / sizeof(keylens[0]); j++) {
+            memset(&b, 0, sizeof(b));
+            snprintf(b.name, sizeof(b.name), "decode/%s/keylen=%zu",
+                     e->name, keylens[j]);
+            b.bytes   = keylens[j];
+            b.encoder = e;
+            b.run     = run_decode;
+            if (e->encode(buf_B, b.bytes, buf_out, ENCODE_BUF_LEN) == -1)
+                die("encoder failed");
+            measure(&b);
+        }
+    }
+}
+
+//a disabled probe is a nop, time scrypt with and without them compiled in.
+//Every lane fires two probes, p = 16 and a small N make them as frequent as
+//they get. The builds run alternately, the fastest round of each is kept so
+//frequency scaling and noise hit both sides alike.
+static int check_sdt(void) {
+    struct bench probes, none;
+    uint64_t iterations = 1;
+    double t0, t, best_probes = 0, best_none = 0, overhead;
+    int i;
+
+    if (filter && strstr("sdt", filter) == NULL) return 0;
+
+    memset(&probes, 0, sizeof(probes));
+    probes.r   = 8;
+    probes.N   = (uint64_t) 1 << 10;
+    probes.p   = 16;
+    probes.run = run_scrypt;
+    none       = probes;
+    none.run   = run_scrypt_nosdt;
+
+    probes.run(&probes, 2);
+    none.run(&none, 2);
+    for (;;) {
+        t0 = now();
+        probes.run(&probes, iterations);
+        if (now() - t0 >= min_time / 4) break;
+        iterations *= 2;
+    }
+
+    for (i = 0; i < SDT_ROUNDS; i++) {
+        t0 = now();
+        probes.run(&probes, iterations);
+        t = now() - t0;
+        if (i == 0 || t < best_probes) best_probes = t;
+        t0 = now();
+        none.run(&none, iterations);
+        t = now() - t0;
+        if (i == 0 || t < best_none) best_none = t;
+    }
+
+    overhead = (best_probes / best_none - 1) * 100;
+    fprintf(stderr, "bench: sdt probes %.1f ns/op, compiled out %.1f ns/op, "
+            "overhead %+.2f%%\n", best_probes * 1e9 / iterations,
+            best_none * 1e9 / iterations, overhead);
+    if (overhead > SDT_THRESHOLD_PCT) {
+        fprintf(stderr, "bench: sdt probe overhead over %d%%\n",
+                SDT_THRESHOLD_PCT);
+        return 1;
+    }
+    return 0;
+}
+
+//the baseline is a previous --json output, one benchmark per line
+static void load_baseline(const char *file) {
+    char line[512], name[64], *p, *q;
+    FILE *fp = NULL;
+    int i;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "bench: couldn't open baseline '%s': %s\n", file,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if ((p = strstr(line, "\"name\": \"")) == NULL) continue;
+        p += 9;
+        if ((q = strchr(p, '"')) == NULL || q - p >= (long) sizeof(name))
+            continue;
+        memcpy(name, p, q - p);
+        name[q - p] = '\0';
+        if ((p = strstr(q, "\"ns_per_op\": ")) == NULL) continue;
+        for (i = 0; i < nresults; i++)
+            if (strcmp(results[i].name, name) == 0)
+                results[i].baseline_ns = strtod(p + 13, NULL);
+    }
+    fclose(fp);
+}
+
+static void print_json(FILE *fp) {
+    int i;
+
+    fprintf(fp, "{\"benchmarks\": [\n");
+    for (i = 0; i < nresults; i++)
+        fprintf(fp, "  {\"name\": \"%s\", \"iterations\": %llu, "
+                "\"ns_per_op\": %.3f, \"bytes_per_sec\": %.0f, "
+                "\"cycles_per_byte\": %.3f}%s\n", results[i].name,
+                (unsigned long long) results[i].iterations,
+                results[i].ns_per_op, results[i].bytes_per_sec,
+                results[i].cycles_per_byte, i + 1 < nresults ? "," : "");
+    fprintf(fp, "]}\n");
+}
+
+static const char *human_rate(double bytes_per_sec, char *buf, size_t buflen) {
+    const char *units[] = {"B/s", "KB/s", "MB/s", "GB/s"};
+    int i = 0;
+
+    while (bytes_per_sec >= 1000 && i < 3) { bytes_per_sec /= 1000; i++; }
+    snprintf(buf, buflen, "%.1f %s", bytes_per_sec, units[i]);
+    return buf;
+}
+
+static void print_table(FILE *fp, const int baseline) {
+    char rate[32], diff[32];
+    int i;
+
+    fprintf(fp, "%-32s %14s %14s %12s%s\n", "benchmark", "ns/op", "bytes/s",
+            "cycles/byte", baseline ? "    baseline" : "");
+    for (i = 0; i < nresults; i++) {
+        diff[0] = '\0';
+        if (baseline && results[i].baseline_ns > 0)
+            snprintf(diff, sizeof(diff), "  %+9.1f%%",
+                     (results[i].ns_per_op / results[i].baseline_ns - 1) * 100);
+        else if (baseline)
+            snprintf(diff, sizeof(diff), "  %10s", "new");
+        fprintf(fp, "%-32s %14.1f %14s %12.2f%s\n", results[i].name,
+                results[i].ns_per_op,
+                human_rate(results[i].bytes_per_sec, rate, sizeof(rate)),
+                results[i].cycles_per_byte, diff);
+    }
+}
+
+int main(const int argc, const char * const argv[]) {
+    const char *output   = NULL;
+    const char *baseline = NULL;
+    double threshold     = THRESHOLD_PCT;
+    char perf_error[256] = {0};
+    int json             = 0;
+    int regressions      = 0;
+    int sdt_failed       = 0;
+    int argi, i;
+    FILE *fp             = NULL;
+
+    struct Arg_parser parser;
+    const struct ap_Option options[] = {
+      { 'f', "filter",              ap_yes },
+      { 't', "min-time",            ap_yes },
+      { 'j', "json",                ap_no  },
+      { 'o', "output",              ap_yes },
+      { 'b', "baseline",            ap_yes },
+      { 'T', "threshold",           ap_yes },
+      { 'P', "perf",                ap_no  },
+      { 'h', "help",                ap_no  },
+      {   0, 0,                     ap_no  } };
+
+    if (!ap_init(&parser, argc, argv, options, 0)) die("not enough memory.");
+    if (ap_error(&parser)) {
+        fprintf(stderr, "bench: %s\n", ap_error(&parser));
+        usage(EXIT_FAILURE);
+    }
+
+    for (argi = 0; argi < ap_arguments(&parser); ++argi) {
+        const int code = ap_code(&parser, argi);
+        const char * const arg = ap_argument(&parser, argi);
+        switch (code) {
+            case 'f': filter   = arg; break;
+            case 't': min_time = strtod(arg, NULL) / 1e3; break;
+            case 'j': json     = 1; break;
+            case 'o': output   = arg; break;
+            case 'b': baseline = arg; break;
+            case 'T': threshold = strtod(arg, NULL); break;
+            case 'P': perf     = 1; break;
+            case 'h': usage(EXIT_SUCCESS); break;
+            default : usage(EXIT_FAILURE);
+        }
+    }
+    if (min_time <= 0 || threshold <= 0) usage(EXIT_FAILURE);
+
+    //sized for the largest smix and scrypt runs, N = 2^16, r = 16, p = 16
+    if (posix_memalign((void **) &buf_B, 64, 128 * 16 * 16) ||
+        posix_memalign((void **) &buf_V, 64, (size_t) 128 * 16 << 16) ||
+        posix_memalign((void **) &buf_XY, 64, 256 * 16 + 64) ||
+        (buf_out = calloc(1, ENCODE_BUF_LEN)) == NULL)
+        die("not enough memory.");
+    memset(buf_XY, 0, 256 * 16 + 64);
+    for (i = 0; i < 128 * 16 * 16; i++)
+        buf_B[i] = (uint8_t) (i * 131 + 7);
+
+    if (perf && perf_open(perf_error, sizeof(perf_error)) == 0) {
+        fprintf(stderr, "bench: hardware counters unavailable, %s\n", perf_error);
+        perf = 0;
+    }
+
+    run_all();
+    sdt_failed = check_sdt();
+
+    if (baseline) load_baseline(baseline);
+    if (json) print_json(stdout);
+    else print_table(stdout, baseline != NULL);
+    if (perf) {
+        fprintf(json ? stderr : stdout, "\n");
+        perf_print(json ? stderr : stdout);
+        perf_close();
+    }
+
+    if (output) {
+        if ((fp = fopen(output, "w")) == NULL) {
+            fprintf(stderr, "bench: couldn't write '%s': %s\n", output,
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+        print_json(fp);
+        fclose(fp);
+    }
+
+    fflush(stdout);
+    for (i = 0; baseline && i < nresults; i++) {
+        if (results[i].baseline_ns > 0 &&
+            results[i].ns_per_op > results[i].baseline_ns * (1 + threshold / 100)) {
+            fprintf(stderr, "bench: regression in %s, %.1f ns/op vs %.1f ns/op baseline\n",
+                    results[i].name, results[i].ns_per_op, results[i].baseline_ns);
+            regressions++;
+        }
+    }
+
+    ap_free(&parser);
+    free(buf_B); free(buf_V); free(buf_XY); free(buf_out);
+    return regressions || sdt_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
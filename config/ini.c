@@ -21,7 +21,7 @@ https://github.com/benhoyt/inih
 #include <stdlib.h>
 #endif
 
-#define MAX_SECTION 50
+#define MAX_SECTION 272 /* [site "NAME"], up to 264 characters long */
 #define MAX_NAME 50
 
 /* Strip whitespace chars off end of given string, in place. Return s. */
@@ -61,11 +61,21 @@ static char* find_chars_or_comment(const char* s, const char* chars)
     return (char*)s;
 }
 
+/* Zero size bytes of s, volatile so it isn't dropped as a dead store. */
+static void wipe(void* s, size_t size)
+{
+    volatile char* p = (volatile char*)s;
+    while (size--)
+        *p++ = '\0';
+}
+
 /* Version of strncpy that ensures dest (size bytes) is null-terminated. */
 static char* strncpy0(char* dest, const char* src, size_t size)
 {
-    strncpy(dest, src, size);
-    dest[size - 1] = '\0';
+    size_t len = strnlen(src, size - 1);
+
+    memcpy(dest, src, len);
+    dest[len] = '\0';
     return dest;
 }
 
@@ -166,6 +176,10 @@ int ini_parse_stream(ini_reader reader, void* stream, ini_handler handler,
 #endif
     }
 
+    /* Values may be secrets, leave no copy of them behind */
+    wipe(line, INI_MAX_LINE);
+    wipe(section, sizeof(section));
+    wipe(prev_name, sizeof(prev_name));
 #if !INI_USE_STACK
     free(line);
 #endif
@@ -183,12 +197,16 @@ int ini_parse_file(FILE* file, ini_handler handler, void* user)
 int ini_parse(const char* filename, ini_handler handler, void* user)
 {
     FILE* file;
+    char buf[BUFSIZ];
     int error;
 
     file = fopen(filename, "r");
     if (!file)
         return -1;
+    /* Read through buf rather than a malloc()ed stdio buffer, to wipe it */
+    setvbuf(file, buf, _IOFBF, sizeof(buf));
     error = ini_parse_file(file, handler, user);
     fclose(file);
+    wipe(buf, sizeof(buf));
     return error;
 }
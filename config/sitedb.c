@@ -0,0 +1,292 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sitedb.h"
+
+#define SITEDB_MAGIC   "GPSITEDB"
+#define SITEDB_VERSION 1
+#define HEADER_LEN     32
+#define FIELDS         4                  /* site, keylen, cost, encoding */
+#define ENTRY_LEN      (4 * (1 + FIELDS)) /* the hash and the fields */
+
+struct sitedb {
+    unsigned char *map;
+    size_t size;
+    uint32_t nbuckets;
+    uint32_t nentries;
+    const unsigned char *buckets;
+    const unsigned char *entries;
+    const char *strings;
+    uint32_t stringslen;
+};
+
+static uint32_t get32(const unsigned char *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 |
+           (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void put32(unsigned char *p, const uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+/* FNV-1a, 32 bits */
+static uint32_t hash(const char *s) {
+    uint32_t h = 2166136261u;
+
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const char **fields(struct site_profile *p, const char *v[FIELDS]) {
+    v[0] = p->site;
+    v[1] = p->keylen;
+    v[2] = p->cost;
+    v[3] = p->encoding;
+    return v;
+}
+
+/* Set the values of src over the ones of dst, the site is the same */
+static void merge(struct site_profile *dst, const struct site_profile *src) {
+    if (src->keylen)   dst->keylen   = src->keylen;
+    if (src->cost)     dst->cost     = src->cost;
+    if (src->encoding) dst->encoding = src->encoding;
+}
+
+/* Write all of buf into a new file replacing path */
+static int write_file(const char *path, const unsigned char *buf, size_t len) {
+    char tmpfile[4096];
+    ssize_t n;
+    int fd, saved, err = 0;
+
+    if ((size_t) snprintf(tmpfile, sizeof tmpfile, "%s.XXXXXX", path) >=
+        sizeof tmpfile) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((fd = mkstemp(tmpfile)) == -1) return -1;
+    while (len && !err) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno != EINTR) err = 1;
+            continue;
+        }
+        buf += n;
+        len -= (size_t) n;
+    }
+    err = err || fsync(fd) != 0;
+    err = close(fd) != 0 || err;
+    if (err || rename(tmpfile, path) != 0) {
+        saved = errno;
+        unlink(tmpfile);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+int sitedb_write(const char *path, const struct site_profile *profiles,
+                 size_t n) {
+    struct site_profile *merged = NULL;
+    uint32_t *buckets           = NULL, *hashes = NULL;
+    unsigned char *image        = NULL, *p;
+    const char *v[FIELDS];
+    uint32_t nbuckets           = 2, nentries = 0, b, h, off;
+    uint64_t stringslen         = 1, size;
+    size_t i, j, len;
+    int retval                  = -1;
+
+    if (n > UINT32_MAX / 4) {
+        errno = EFBIG;
+        return -1;
+    }
+    while (nbuckets < 2 * n) nbuckets <<= 1;
+
+    if ((buckets = calloc(nbuckets, sizeof(*buckets))) == NULL ||
+        (hashes  = malloc((n ? n : 1) * sizeof(*hashes))) == NULL ||
+        (merged  = malloc((n ? n : 1) * sizeof(*merged))) == NULL)
+        goto out;
+
+    //the same table as the file, later sections of a site merge into it
+    for (i = 0; i < n; i++) {
+        h = hash(profiles[i].site);
+        for (b = h & (nbuckets - 1); buckets[b]; b = (b + 1) & (nbuckets - 1))
+            if (hashes[buckets[b] - 1] == h &&
+                strcmp(merged[buckets[b] - 1].site, profiles[i].site) == 0)
+                break;
+        if (buckets[b]) {
+            merge(&merged[buckets[b] - 1], &profiles[i]);
+            continue;
+        }
+        merged[nentries] = profiles[i];
+        hashes[nentries] = h;
+        buckets[b]       = ++nentries;
+    }
+
+    for (i = 0; i < nentries; i++)
+        for (fields(&merged[i], v), j = 0; j < FIELDS; j++)
+            if (v[j] && v[j][0]) stringslen += strlen(v[j]) + 1;
+    size = HEADER_LEN + 4 * (uint64_t) nbuckets +
+           ENTRY_LEN * (uint64_t) nentries + stringslen;
+    if (size > UINT32_MAX || size > SIZE_MAX) {
+        errno = EFBIG;
+        goto out;
+    }
+    if ((image = calloc(1, (size_t) size)) == NULL) goto out;
+
+    memcpy(image, SITEDB_MAGIC, 8);
+    put32(image + 8,  SITEDB_VERSION);
+    put32(image + 12, nbuckets);
+    put32(image + 16, nentries);
+    put32(image + 20, (uint32_t) (size - stringslen));
+    put32(image + 24, (uint32_t) stringslen);
+    for (b = 0; b < nbuckets; b++)
+        put32(image + HEADER_LEN + 4 * b, buckets[b]);
+
+    //offset 0 of the strings is the empty string, the unset values
+    p   = image + HEADER_LEN + 4 * (size_t) nbuckets;
+    off = 1;
+    for (i = 0; i < nentries; i++, p += ENTRY_LEN) {
+        put32(p, hashes[i]);
+        for (fields(&merged[i], v), j = 0; j < FIELDS; j++) {
+            if (!v[j] || !v[j][0]) continue;
+            len = strlen(v[j]) + 1;
+            memcpy(image + size - stringslen + off, v[j], len);
+            put32(p + 4 + 4 * j, off);
+            off += (uint32_t) len;
+        }
+    }
+
+    retval = write_file(path, image, (size_t) size);
+
+out:
+    free(image);
+    free(merged);
+    free(hashes);
+    free(buckets);
+    return retval;
+}
+
+sitedb *sitedb_open(const char *path) {
+    sitedb *db = NULL;
+    struct stat st;
+    unsigned char *map;
+    uint64_t stringsoff;
+    int fd, err;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return NULL;
+    if (fstat(fd, &st) != 0) goto fail;
+    if (st.st_size < HEADER_LEN || (uint64_t) st.st_size > UINT32_MAX) {
+        errno = EINVAL;
+        goto fail;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) goto fail;
+    close(fd);
+    fd = -1;
+#ifdef MADV_RANDOM
+    (void) madvise(map, (size_t) st.st_size, MADV_RANDOM);
+#endif
+
+    if ((db = calloc(1, sizeof(*db))) == NULL) {
+        err = errno;
+        munmap(map, (size_t) st.st_size);
+        errno = err;
+        return NULL;
+    }
+    db->map        = map;
+    db->size       = (size_t) st.st_size;
+    db->nbuckets   = get32(map + 12);
+    db->nentries   = get32(map + 16);
+    db->stringslen = get32(map + 24);
+    stringsoff     = get32(map + 20);
+
+    //every offset of a lookup is checked against these, and the strings
+    //end with a NUL, so a string can't run past the mapping
+    if (memcmp(map, SITEDB_MAGIC, 8) != 0 ||
+        get32(map + 8) != SITEDB_VERSION ||
+        db->nbuckets < 2 || (db->nbuckets & (db->nbuckets - 1)) != 0 ||
+        db->nentries > db->nbuckets / 2 ||
+        stringsoff != HEADER_LEN + 4 * (uint64_t) db->nbuckets +
+                      ENTRY_LEN * (uint64_t) db->nentries ||
+        db->stringslen == 0 || stringsoff + db->stringslen != db->size ||
+        map[db->size - 1] != '\0') {
+        sitedb_close(db);
+        errno = EINVAL;
+        return NULL;
+    }
+    db->buckets = map + HEADER_LEN;
+    db->entries = db->buckets + 4 * (size_t) db->nbuckets;
+    db->strings = (const char *) map + stringsoff;
+    return db;
+
+fail:
+    err = errno;
+    if (fd != -1) close(fd);
+    errno = err;
+    return NULL;
+}
+
+size_t sitedb_count(const sitedb *db) {
+    return db->nentries;
+}
+
+/* The values of entry e, 0 if its site is out of bounds */
+static int entry(const sitedb *db, const unsigned char *e,
+                 struct site_profile *profile) {
+    const char *v[FIELDS];
+    uint32_t i, off;
+
+    for (i = 0; i < FIELDS; i++) {
+        off  = get32(e + 4 + 4 * i);
+        v[i] = off && off < db->stringslen ? db->strings + off : NULL;
+    }
+    if (!v[0]) return 0;
+    profile->site     = v[0];
+    profile->keylen   = v[1];
+    profile->cost     = v[2];
+    profile->encoding = v[3];
+    return 1;
+}
+
+int sitedb_profile(const sitedb *db, size_t i, struct site_profile *profile) {
+    if (i >= db->nentries) return 0;
+    return entry(db, db->entries + ENTRY_LEN * i, profile);
+}
+
+int sitedb_lookup(const sitedb *db, const char *site,
+                  struct site_profile *profile) {
+    const uint32_t h    = hash(site);
+    const uint32_t mask = db->nbuckets - 1;
+    const unsigned char *e;
+    uint32_t b, i, probes, off;
+
+    //at least half of the buckets are empty, probing always ends
+    for (b = h & mask, probes = 0; probes < db->nbuckets; b = (b + 1) & mask,
+         probes++) {
+        if ((i = get32(db->buckets + 4 * b)) == 0 || i > db->nentries)
+            return 0;
+        e = db->entries + ENTRY_LEN * (size_t) (i - 1);
+        if (get32(e) != h || (off = get32(e + 4)) >= db->stringslen ||
+            strcmp(db->strings + off, site) != 0)
+            continue;
+        return entry(db, e, profile);
+    }
+    return 0;
+}
+
+void sitedb_close(sitedb *db) {
+    if (!db) return;
+    munmap(db->map, db->size);
+    free(db);
+}
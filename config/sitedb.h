@@ -0,0 +1,62 @@
+#ifndef _SITEDB_H_
+#define _SITEDB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A [site "NAME"] section of the configuration file, the per site password
+ * rules. Values are kept as written, NULL when unset.
+ */
+struct site_profile {
+    const char *site;
+    const char *keylen;
+    const char *cost;
+    const char *encoding;
+};
+
+/*
+ * Compiled site profiles, a read only mapping of a file holding an open
+ * addressing hash table of the sites and their values:
+ *
+ *   header   "GPSITEDB", version, buckets, entries, strings offset and
+ *            length, all uint32 little endian
+ *   buckets  entry index + 1, 0 when empty, a power of 2 at least twice
+ *            the entries
+ *   entries  FNV-1a hash of the site, then the string offsets of the site,
+ *            keylen, cost and encoding, 0 (an empty string) when unset
+ *   strings  NUL terminated
+ */
+typedef struct sitedb sitedb;
+
+/*
+ * Write the n profiles into path as a compiled database, replacing it
+ * atomically. Later profiles of the same site override the values of
+ * earlier ones. Return 0 on success; or -1 on error (errno is set).
+ */
+int sitedb_write(const char *path, const struct site_profile *profiles,
+                 size_t n);
+
+/* Map the database at path, NULL on error (errno EINVAL if malformed) */
+sitedb *sitedb_open(const char *path);
+
+/* The number of sites in db */
+size_t sitedb_count(const sitedb *db);
+
+/*
+ * Fill profile with the values of site, pointing into the mapping, and
+ * return 1; or return 0 if site isn't in db.
+ */
+int sitedb_lookup(const sitedb *db, const char *site,
+                  struct site_profile *profile);
+
+/*
+ * Fill profile with the values of the i-th site of db, i < sitedb_count(),
+ * pointing into the mapping, and return 1; or return 0 on a bad entry.
+ */
+int sitedb_profile(const sitedb *db, size_t i, struct site_profile *profile);
+
+/* Unmap db */
+void sitedb_close(sitedb *db);
+
+#endif
@@ -1,2 +1,4 @@
+#include <stddef.h>
+
 int	libscrypt_b10_encode(unsigned char const *src, size_t srclength,
         /*@out@*/ char *target, size_t targetsize);
@@ -3,11 +3,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <sys/types.h>
 
 #include "b64.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define B64_SIMD
+#endif
+
 static const char Base64Compliant[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64Compliant = '=';
@@ -79,19 +85,258 @@ static const char Pad64 = '\0';
 	   characters followed by one "=" padding character.
 */
 
+/*
+ * The vectorized kernels only ever handle a prefix of the input: whole
+ * 3 byte groups on encode, whole 4 character groups of the alphabet proper
+ * on decode.  They stop wherever the scalar code has something to decide
+ * (the tail, padding, whitespace, any character outside the alphabet) and
+ * return how much input they consumed, the scalar code carries on from
+ * there, so validation and error reporting stay in one place.  Each store
+ * is a whole vector, they also stop when the target has no room for one.
+ * The table is "portable" first, libscrypt_b64_kernel() picks the last one
+ * the CPU supports.
+ */
+#ifdef B64_SIMD
+
+#define B64_ENC_SHUFFLE \
+	10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+/* Offsets from a 6 bit value to its character, see enc_offsets */
+#define B64_ENC_LUT(a) \
+	'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+	'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+	(a)[62] - 62, (a)[63] - 63, 'A', 0, 0
+#define B64_DEC_SHUFFLE \
+	2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+static int
+supported_ssse3(void)
+{
+
+	return (__builtin_cpu_supports("ssse3"));
+}
+
+static int
+supported_avx2(void)
+{
+
+	return (__builtin_cpu_supports("avx2"));
+}
+
+/*
+ * 4 groups of 3 bytes, spread over 32 bit lanes by B64_ENC_SHUFFLE, to
+ * their 6 bit values, then to characters: 0-25 map to 13, 26-51 to 0 and
+ * 52-63 to 1-12, which index the offsets of B64_ENC_LUT.
+ */
+__attribute__((target("ssse3")))
+static __m128i
+enc_ssse3(__m128i in, __m128i lut)
+{
+	__m128i t0, t1, idx, r;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(B64_ENC_SHUFFLE));
+	t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+	    _mm_set1_epi32(0x04000040));
+	t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+	    _mm_set1_epi32(0x01000010));
+	idx = _mm_or_si128(t0, t1);
+
+	r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26),
+	    idx), _mm_set1_epi8(13)));
+	return (_mm_add_epi8(_mm_shuffle_epi8(lut, r), idx));
+}
+
+__attribute__((target("ssse3")))
+static size_t
+encode_ssse3(const unsigned char * src, size_t srclength, char * target,
+    size_t targsize, const char * alphabet)
+{
+	const __m128i lut = _mm_setr_epi8(B64_ENC_LUT(alphabet));
+	size_t i = 0, o = 0;
+
+	/* 16 bytes loaded, 12 used */
+	while (srclength - i >= 16 && targsize - o >= 16) {
+		_mm_storeu_si128((__m128i *)(target + o),
+		    enc_ssse3(_mm_loadu_si128((const __m128i *)(src + i)), lut));
+		i += 12;
+		o += 16;
+	}
+	return (i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+encode_avx2(const unsigned char * src, size_t srclength, char * target,
+    size_t targsize, const char * alphabet)
+{
+	const __m256i lut = _mm256_broadcastsi128_si256(
+	    _mm_setr_epi8(B64_ENC_LUT(alphabet)));
+	const __m256i shuf = _mm256_broadcastsi128_si256(
+	    _mm_set_epi8(B64_ENC_SHUFFLE));
+	__m256i in, t0, t1, idx, r;
+	size_t i = 0, o = 0;
+
+	/* 12 bytes in each 128 bit lane */
+	while (srclength - i >= 28 && targsize - o >= 32) {
+		in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+		    _mm_loadu_si128((const __m128i *)(src + i))),
+		    _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+		in = _mm256_shuffle_epi8(in, shuf);
+		t0 = _mm256_mulhi_epu16(_mm256_and_si256(in,
+		    _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		t1 = _mm256_mullo_epi16(_mm256_and_si256(in,
+		    _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		idx = _mm256_or_si256(t0, t1);
+
+		r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(
+		    _mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+		_mm256_storeu_si256((__m256i *)(target + o), _mm256_add_epi8(
+		    _mm256_shuffle_epi8(lut, r), idx));
+		i += 24;
+		o += 32;
+	}
+	/* the tail is legacy SSE code, avoid the AVX to SSE transition */
+	_mm256_zeroupper();
+	return (i + encode_ssse3(src + i, srclength - i, target + o,
+	    targsize - o, alphabet));
+}
+
+/*
+ * Characters to their 6 bit values, strictly: the mask of the characters
+ * in the alphabet has to be full, otherwise the block is left to the
+ * scalar code.  Then 4 values to 3 bytes in each 32 bit lane.
+ */
+#define B64_DEC_BLOCK(W, S, in, alphabet, ok, out)			\
+	do {								\
+		__m##W##i up, lo, dg, c62, c63, off;			\
+									\
+		up = _mm##S##_and_si##W(_mm##S##_cmpgt_epi8(in,		\
+		    _mm##S##_set1_epi8('A' - 1)), _mm##S##_cmpgt_epi8(	\
+		    _mm##S##_set1_epi8('Z' + 1), in));			\
+		lo = _mm##S##_and_si##W(_mm##S##_cmpgt_epi8(in,		\
+		    _mm##S##_set1_epi8('a' - 1)), _mm##S##_cmpgt_epi8(	\
+		    _mm##S##_set1_epi8('z' + 1), in));			\
+		dg = _mm##S##_and_si##W(_mm##S##_cmpgt_epi8(in,		\
+		    _mm##S##_set1_epi8('0' - 1)), _mm##S##_cmpgt_epi8(	\
+		    _mm##S##_set1_epi8('9' + 1), in));			\
+		c62 = _mm##S##_cmpeq_epi8(in,				\
+		    _mm##S##_set1_epi8((alphabet)[62]));		\
+		c63 = _mm##S##_cmpeq_epi8(in,				\
+		    _mm##S##_set1_epi8((alphabet)[63]));		\
+		ok = _mm##S##_or_si##W(_mm##S##_or_si##W(up, lo),	\
+		    _mm##S##_or_si##W(_mm##S##_or_si##W(dg, c62), c63));	\
+		off = _mm##S##_or_si##W(_mm##S##_or_si##W(		\
+		    _mm##S##_and_si##W(up, _mm##S##_set1_epi8(-'A')),	\
+		    _mm##S##_and_si##W(lo, _mm##S##_set1_epi8(26 - 'a'))), \
+		    _mm##S##_or_si##W(_mm##S##_or_si##W(		\
+		    _mm##S##_and_si##W(dg, _mm##S##_set1_epi8(52 - '0')), \
+		    _mm##S##_and_si##W(c62,				\
+		    _mm##S##_set1_epi8(62 - (alphabet)[62]))),		\
+		    _mm##S##_and_si##W(c63,				\
+		    _mm##S##_set1_epi8(63 - (alphabet)[63]))));		\
+		out = _mm##S##_add_epi8(in, off);			\
+		out = _mm##S##_maddubs_epi16(out,			\
+		    _mm##S##_set1_epi32(0x01400140));			\
+		out = _mm##S##_madd_epi16(out,				\
+		    _mm##S##_set1_epi32(0x00011000));			\
+	} while (0)
+
+__attribute__((target("ssse3")))
+static size_t
+decode_ssse3(const char * src, size_t srclength, unsigned char * target,
+    size_t targsize, const char * alphabet)
+{
+	__m128i in, ok, out;
+	size_t i = 0, o = 0;
+
+	/* 16 characters to 12 bytes, 16 stored */
+	while (srclength - i >= 16 && targsize - o >= 16) {
+		in = _mm_loadu_si128((const __m128i *)(src + i));
+		B64_DEC_BLOCK(128, , in, alphabet, ok, out);
+		if (_mm_movemask_epi8(ok) != 0xffff)
+			break;
+		_mm_storeu_si128((__m128i *)(target + o), _mm_shuffle_epi8(out,
+		    _mm_setr_epi8(B64_DEC_SHUFFLE)));
+		i += 16;
+		o += 12;
+	}
+	return (i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+decode_avx2(const char * src, size_t srclength, unsigned char * target,
+    size_t targsize, const char * alphabet)
+{
+	const __m256i shuf = _mm256_broadcastsi128_si256(
+	    _mm_setr_epi8(B64_DEC_SHUFFLE));
+	__m256i in, ok, out;
+	size_t i = 0, o = 0;
+
+	/* 32 characters to 24 bytes, 32 stored */
+	while (srclength - i >= 32 && targsize - o >= 32) {
+		in = _mm256_loadu_si256((const __m256i *)(src + i));
+		B64_DEC_BLOCK(256, 256, in, alphabet, ok, out);
+		if ((uint32_t)_mm256_movemask_epi8(ok) != 0xffffffffU)
+			break;
+		out = _mm256_shuffle_epi8(out, shuf);
+		out = _mm256_permutevar8x32_epi32(out,
+		    _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256((__m256i *)(target + o), out);
+		i += 32;
+		o += 24;
+	}
+	_mm256_zeroupper();
+	return (i + decode_ssse3(src + i, srclength - i, target + o,
+	    targsize - o, alphabet));
+}
+
+#endif /* B64_SIMD */
+
+const struct libscrypt_b64_kernel libscrypt_b64_kernels[] = {
+	{ "portable", NULL, NULL, NULL },
+#ifdef B64_SIMD
+	{ "ssse3", supported_ssse3, encode_ssse3, decode_ssse3 },
+	{ "avx2", supported_avx2, encode_avx2, decode_avx2 },
+#endif
+	{ NULL, NULL, NULL, NULL }
+};
+
+const struct libscrypt_b64_kernel *
+libscrypt_b64_kernel(void)
+{
+	const struct libscrypt_b64_kernel * k, * best = libscrypt_b64_kernels;
+
+	for (k = libscrypt_b64_kernels + 1; k->name != NULL; k++)
+		if (k->supported())
+			best = k;
+	return (best);
+}
+
 int
-libscrypt_b64_encode(src, srclength, target, targsize)
+libscrypt_b64_encode_with(k, compliant, src, srclength, target, targsize)
+	const struct libscrypt_b64_kernel *k;
+	int compliant;
 	unsigned char const *src;
 	size_t srclength;
 	char *target;
 	size_t targsize;
 {
+	const char *alphabet = compliant ? Base64Compliant : Base64;
+	const char pad = compliant ? Pad64Compliant : Pad64;
 	size_t datalength = 0;
 	unsigned char input[3];
 	unsigned char output[4];
 	unsigned int i;
 
-	memset(target, 0, targsize);
+	if (k->encode != NULL) {
+		datalength = k->encode(src, srclength, target, targsize,
+		    alphabet);
+		src += datalength;
+		srclength -= datalength;
+		datalength = datalength / 3 * 4;
+	}
 
 	while (2 < srclength) {
 		input[0] = *src++;
@@ -105,11 +350,11 @@ libscrypt_b64_encode(src, srclength, target, targsize)
 		output[3] = input[2] & 0x3f;
 
 		if (datalength + 4 > targsize)
-			return (-1);
-		target[datalength++] = Base64[output[0]];
-		target[datalength++] = Base64[output[1]];
-		target[datalength++] = Base64[output[2]];
-		target[datalength++] = Base64[output[3]];
+			goto toosmall;
+		target[datalength++] = alphabet[output[0]];
+		target[datalength++] = alphabet[output[1]];
+		target[datalength++] = alphabet[output[2]];
+		target[datalength++] = alphabet[output[3]];
 	}
 
 	/* Now we worry about padding. */
@@ -124,79 +369,93 @@ libscrypt_b64_encode(src, srclength, target, targsize)
 		output[2] = ((input[1] & 0x0f) << 2) + (input[2] >> 6);
 
 		if (datalength + 4 > targsize)
-			return (-1);
-		target[datalength++] = Base64[output[0]];
-		target[datalength++] = Base64[output[1]];
+			goto toosmall;
+		target[datalength++] = alphabet[output[0]];
+		target[datalength++] = alphabet[output[1]];
 		if (srclength == 1)
-			target[datalength++] = Pad64;
+			target[datalength++] = pad;
 		else
-			target[datalength++] = Base64[output[2]];
-		target[datalength++] = Pad64;
+			target[datalength++] = alphabet[output[2]];
+		target[datalength++] = pad;
 	}
 	if (datalength >= targsize)
-		return (-1);
-	target[datalength] = '\0';	/* Returned value doesn't count \0. */
+		goto toosmall;
+	/* Returned value doesn't count \0, the rest of target is zeroed. */
+	memset(target + datalength, 0, targsize - datalength);
 	return (int)(datalength);
+
+toosmall:
+	memset(target, 0, targsize);
+	return (-1);
 }
 
 int
-libscrypt_b64_encode_compliant(src, srclength, target, targsize)
+libscrypt_b64_encode(src, srclength, target, targsize)
 	unsigned char const *src;
 	size_t srclength;
 	char *target;
 	size_t targsize;
 {
-	size_t datalength = 0;
-	unsigned char input[3];
-	unsigned char output[4];
-	unsigned int i;
 
-	memset(target, 0, targsize);
+	return (libscrypt_b64_encode_with(libscrypt_b64_kernel(), 0, src,
+	    srclength, target, targsize));
+}
 
-	while (2 < srclength) {
-		input[0] = *src++;
-		input[1] = *src++;
-		input[2] = *src++;
-		srclength -= 3;
+int
+libscrypt_b64_encode_compliant(src, srclength, target, targsize)
+	unsigned char const *src;
+	size_t srclength;
+	char *target;
+	size_t targsize;
+{
 
-		output[0] = input[0] >> 2;
-		output[1] = ((input[0] & 0x03) << 4) + (input[1] >> 4);
-		output[2] = ((input[1] & 0x0f) << 2) + (input[2] >> 6);
-		output[3] = input[2] & 0x3f;
+	return (libscrypt_b64_encode_with(libscrypt_b64_kernel(), 1, src,
+	    srclength, target, targsize));
+}
 
-		if (datalength + 4 > targsize)
-			return (-1);
-		target[datalength++] = Base64Compliant[output[0]];
-		target[datalength++] = Base64Compliant[output[1]];
-		target[datalength++] = Base64Compliant[output[2]];
-		target[datalength++] = Base64Compliant[output[3]];
-	}
+/* The reverse of libscrypt_b64_encode(), the output isn't padded so the
+   input ends after any number of characters but one past a multiple of 4,
+   the bits left over must be zero.  Returns the number of bytes stored at
+   the target, or -1 on error.
+ */
 
-	/* Now we worry about padding. */
-	if (0 != srclength) {
-		/* Get what's left. */
-		input[0] = input[1] = input[2] = '\0';
-		for (i = 0; i < srclength; i++)
-			input[i] = *src++;
+static int
+b64_decode(k, src, target, targsize)
+	const struct libscrypt_b64_kernel *k;
+	char const *src;
+	unsigned char *target;
+	size_t targsize;
+{
+	size_t tarindex = 0;
+	unsigned int acc = 0, bits = 0;
+	char *pos;
+	int ch;
 
-		output[0] = input[0] >> 2;
-		output[1] = ((input[0] & 0x03) << 4) + (input[1] >> 4);
-		output[2] = ((input[1] & 0x0f) << 2) + (input[2] >> 6);
+	if (k->decode != NULL) {
+		tarindex = k->decode(src, strlen(src), target, targsize, Base64);
+		src += tarindex;
+		tarindex = tarindex / 4 * 3;
+	}
 
-		if (datalength + 4 > targsize)
+	while ((ch = (unsigned char)*src++) != '\0') {
+		pos = strchr(Base64, ch);
+		if (pos == 0)		/* A non-base64 character. */
 			return (-1);
-		target[datalength++] = Base64Compliant[output[0]];
-		target[datalength++] = Base64Compliant[output[1]];
-		if (srclength == 1)
-			target[datalength++] = Pad64Compliant;
-		else
-			target[datalength++] = Base64Compliant[output[2]];
-		target[datalength++] = Pad64Compliant;
+
+		acc = (acc << 6) | (unsigned int)(pos - Base64);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (tarindex >= targsize)
+				return (-1);
+			target[tarindex++] = (unsigned char)(acc >> bits);
+			acc &= (1u << bits) - 1;
+		}
 	}
-	if (datalength >= targsize)
+	if (bits >= 6 || acc != 0)
 		return (-1);
-	target[datalength] = '\0';	/* Returned value doesn't count \0. */
-	return (int)(datalength);
+
+	return ((int)tarindex);
 }
 
 /* skips all whitespace anywhere.
@@ -205,20 +464,28 @@ libscrypt_b64_encode_compliant(src, srclength, target, targsize)
    it returns the number of data bytes stored at the target, or -1 on error.
  */
 
-int
-libscrypt_b64_decode_compliant(src, target, targsize)
+static int
+b64_decode_compliant(k, src, target, targsize)
+	const struct libscrypt_b64_kernel *k;
 	char const *src;
 	unsigned char *target;
 	size_t targsize;
 {
 	int state, ch;
-    unsigned int tarindex;
+	size_t tarindex;
 	unsigned char nextbyte;
 	char *pos;
 
 	state = 0;
 	tarindex = 0;
 
+	if (target && k->decode != NULL) {
+		tarindex = k->decode(src, strlen(src), target, targsize,
+		    Base64Compliant);
+		src += tarindex;
+		tarindex = tarindex / 4 * 3;
+	}
+
 	while ((ch = (unsigned char)*src++) != '\0') {
 		if (isspace(ch))	/* Skip whitespace anywhere. */
 			continue;
@@ -331,5 +598,40 @@ libscrypt_b64_decode_compliant(src, target, targsize)
 			return (-1);
 	}
 
-	return (tarindex);
+	return ((int)tarindex);
+}
+
+int
+libscrypt_b64_decode_with(k, compliant, src, target, targsize)
+	const struct libscrypt_b64_kernel *k;
+	int compliant;
+	char const *src;
+	unsigned char *target;
+	size_t targsize;
+{
+
+	if (compliant)
+		return (b64_decode_compliant(k, src, target, targsize));
+	return (b64_decode(k, src, target, targsize));
+}
+
+int
+libscrypt_b64_decode(src, target, targsize)
+	char const *src;
+	unsigned char *target;
+	size_t targsize;
+{
+
+	return (b64_decode(libscrypt_b64_kernel(), src, target, targsize));
+}
+
+int
+libscrypt_b64_decode_compliant(src, target, targsize)
+	char const *src;
+	unsigned char *target;
+	size_t targsize;
+{
+
+	return (b64_decode_compliant(libscrypt_b64_kernel(), src, target,
+	    targsize));
 }
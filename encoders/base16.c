@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "crypto_scrypt-hexconvert.h"
+
+static const char hexdigits[] = "0123456789abcdef";
+
 /* The hexconvert function is only used to test reference vectors against
  * known answers. The contents of this file are therefore a component
  * to assist with test harnesses only
@@ -11,27 +15,51 @@
 int libscrypt_hexconvert(const unsigned char * buf, size_t s, char *outbuf, size_t obs)
 {
     size_t i;
-    int len = 0;
 
     if (!buf || s < 1 || obs < (s * 2 + 1))
         return 0;
 
-    memset(outbuf, 0, obs);
-
-    for(i=0; i<=(s-1); i++)
+    /* a digit table rather than sprintf("%02x"), no locale and no state */
+    for(i=0; i<s; i++)
     {
-        /* snprintf(outbuf, s,"%s...", outbuf....) has undefined results
-         * and can't be used. Using offests like this makes snprintf
-         * nontrivial. we therefore have use inescure sprintf() and
-         * lengths checked elsewhere (start of function) */
-        /*@ -bufferoverflowhigh @*/
-        len += sprintf(outbuf+len, "%02x", (unsigned int) buf[i]);
+        outbuf[2*i]   = hexdigits[buf[i] >> 4];
+        outbuf[2*i+1] = hexdigits[buf[i] & 0x0f];
     }
+    memset(outbuf + 2*s, 0, obs - 2*s);
 
     return 1;
 }
 
 int libscrypt_hex_encode(const unsigned char * buf, size_t s, char *outbuf, size_t obs)
 {
-    return libscrypt_hexconvert(buf, s, outbuf, obs);
+    if (!libscrypt_hexconvert(buf, s, outbuf, obs))
+        return -1;
+    return (int)(s * 2);
+}
+
+static int hexval(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int libscrypt_hex_decode(const char *src, unsigned char *target, size_t targsize)
+{
+    size_t i, len;
+    int hi, lo;
+
+    if (!src || (len = strlen(src)) % 2 != 0 || targsize < len / 2)
+        return -1;
+
+    for(i=0; i<len/2; i++)
+    {
+        if ((hi = hexval((unsigned char)src[2*i])) < 0 ||
+            (lo = hexval((unsigned char)src[2*i+1])) < 0)
+            return -1;
+        target[i] = (unsigned char)(hi << 4 | lo);
+    }
+
+    return (int)(len / 2);
 }
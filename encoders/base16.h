@@ -6,4 +6,7 @@
  * outbuf must have size of at least buf * 2 + 1.
  */
 int libscrypt_hexconvert(const unsigned char * buf, size_t s, char *outbuf, size_t obs);
+/* Same as libscrypt_hexconvert(), returns the output length or -1 on error */
 int libscrypt_hex_encode(const unsigned char * buf, size_t s, char *outbuf, size_t obs);
+/* The reverse, either case, returns the number of bytes or -1 on error */
+int libscrypt_hex_decode(const char *src, unsigned char *target, size_t targsize);
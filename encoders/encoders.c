@@ -1,17 +1,24 @@
 #include <string.h>
+#include <strings.h>
 
 #include "encoders.h"
 
+extern const unsigned char dectab[256]; //base91.c
+
 int base91_glue_encode(unsigned char const *src, size_t srclength,
-                       void *target, size_t targsize) {
-    static struct basE91 b91;
+                       char *target, size_t targsize) {
+    struct basE91 b91;
     size_t s;
     int total_size = 0;
 
+    // 2 characters per 13 bits at worst, up to 2 more at the end and '\0'
+    if (targsize < 2 * (8 * srclength / 13) + 3)
+        return -1;
+
     // zero the output buffer
     memset(target,'\0',targsize);
 
-    // setup the base91 struct
+    // setup the base91 struct, on the stack so calls don't share it
     basE91_init(&b91);
 
     // encode most of it and keep the size
@@ -19,9 +26,170 @@ int base91_glue_encode(unsigned char const *src, size_t srclength,
     total_size += s;
 
     // pickup anything left and keep the size
-    s = basE91_encode_end(&b91, (void*)(target+s));
+    s = basE91_encode_end(&b91, target + s);
     total_size += s;
 
     // return the total size
     return total_size;
-}
\ No newline at end of file
+}
+
+int base91_glue_decode(char const *src, unsigned char *target, size_t targsize) {
+    struct basE91 b91;
+    size_t len, i, s;
+
+    // basE91_decode() skips what isn't in the alphabet, be strict instead
+    len = strlen(src);
+    for (i = 0; i < len; i++)
+        if (dectab[(unsigned char) src[i]] == 91)
+            return -1;
+
+    // 7 bits per character at most, and a byte left at the end
+    if (targsize < len * 7 / 8 + 1)
+        return -1;
+
+    basE91_init(&b91);
+    s  = basE91_decode(&b91, src, len, target);
+    s += basE91_decode_end(&b91, target + s);
+    return (int) s;
+}
+
+static size_t b10_bound(size_t n)  { return 3 * n + 1; }
+static size_t hex_bound(size_t n)  { return 2 * n + 1; }
+static size_t b64_bound(size_t n)  { return b64_encode_len(n); }
+static size_t z85_bound(size_t n)  { return Z85_encode_with_padding_bound(n) + 1; }
+static size_t skey_bound(size_t n) { return skey_encode_len(n) + (n == 0); }
+static size_t b91_bound(size_t n)  { return 2 * (8 * n / 13) + 3; }
+
+static const char * const b10_aliases[]  = {"decimal", "b10", NULL};
+static const char * const hex_aliases[]  = {"base16", "b16", NULL};
+static const char * const b64_aliases[]  = {"b64", NULL};
+static const char * const b91_aliases[]  = {"base91", NULL};
+
+// the z85 header depends on the total length, basE91 carries bits over
+static char *z85_begin(struct encoder_stream *st, char *target) {
+    if (st->left > SIZE_MAX) return NULL;
+    return Z85_encode_stream_begin(&st->z85, (size_t) st->left, target);
+}
+
+static char *z85_update(struct encoder_stream *st, const unsigned char *src,
+                        size_t srclength, char *target) {
+    return Z85_encode_stream_update(&st->z85, (const char *) src, srclength,
+                                    target);
+}
+
+static char *z85_end(struct encoder_stream *st, char *target) {
+    return Z85_encode_stream_end(&st->z85, target);
+}
+
+static char *b91_update(struct encoder_stream *st, const unsigned char *src,
+                        size_t srclength, char *target) {
+    return target + basE91_encode(&st->b91, src, srclength, target);
+}
+
+static char *b91_end(struct encoder_stream *st, char *target) {
+    return target + basE91_encode_end(&st->b91, target);
+}
+
+static const struct encoder_streaming bytes_stream = {1, "",  NULL, NULL, NULL};
+static const struct encoder_streaming b64_stream   = {3, "",  NULL, NULL, NULL};
+static const struct encoder_streaming skey_stream  = {8, " ", NULL, NULL, NULL};
+static const struct encoder_streaming z85_stream   = {1, "",  z85_begin,
+                                                      z85_update, z85_end};
+static const struct encoder_streaming b91_stream   = {1, "",  NULL,
+                                                      b91_update, b91_end};
+
+const struct encoder encoders[] = {
+    {"dec",    b10_aliases, b10_bound,  libscrypt_b10_encode,  NULL,                  &bytes_stream},
+    {"hex",    hex_aliases, hex_bound,  libscrypt_hex_encode,  libscrypt_hex_decode,  &bytes_stream},
+    {"base64", b64_aliases, b64_bound,  libscrypt_b64_encode,  libscrypt_b64_decode,  &b64_stream},
+    {"z85",    NULL,        z85_bound,  libscrypt_z85_encode,  libscrypt_z85_decode,  &z85_stream},
+    {"skey",   NULL,        skey_bound, libscrypt_skey_encode, libscrypt_skey_decode, &skey_stream},
+    {"b91",    b91_aliases, b91_bound,  base91_glue_encode,    base91_glue_decode,    &b91_stream},
+    {NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+const struct encoder *encoder_find(const char *name) {
+    const struct encoder *e;
+    const char * const *alias;
+
+    if (name == NULL) return NULL;
+    for (e = encoders; e->name; e++) {
+        if (strcasecmp(name, e->name) == 0) return e;
+        for (alias = e->aliases; alias && *alias; alias++)
+            if (strcasecmp(name, *alias) == 0) return e;
+    }
+    return NULL;
+}
+
+// the held bytes of a group, the header and a separator fit in the
+// worst case of 8 more bytes
+size_t encoder_stream_bound(const struct encoder *e, size_t srclength) {
+    return e->bound(srclength + 8) + 8;
+}
+
+char *encoder_stream_begin(struct encoder_stream *st, const struct encoder *e,
+                           uint64_t total, char *target) {
+    memset(st, 0, sizeof(*st));
+    st->e    = e;
+    st->left = total;
+    basE91_init(&st->b91);
+    return e->stream->begin ? e->stream->begin(st, target) : target;
+}
+
+// whole groups of src with encode(), separated from the previous ones
+static char *encode_groups(struct encoder_stream *st, const unsigned char *src,
+                           size_t srclength, char *target) {
+    const struct encoder *e = st->e;
+    const char *sep;
+    int len;
+
+    if (st->started)
+        for (sep = e->stream->sep; *sep; sep++) *target++ = *sep;
+    if ((len = e->encode(src, srclength, target, e->bound(srclength))) < 0)
+        return NULL;
+    st->started = 1;
+    return target + len;
+}
+
+char *encoder_stream_update(struct encoder_stream *st, const unsigned char *src,
+                            size_t srclength, char *target) {
+    const struct encoder_streaming *stream = st->e->stream;
+    size_t n;
+
+    if (srclength > st->left) return NULL;
+    st->left -= srclength;
+    if (stream->update) return stream->update(st, src, srclength, target);
+
+    //complete the held group first, then encode the whole ones straight
+    if (st->held) {
+        n = stream->group - st->held;
+        if (n > srclength) n = srclength;
+        memcpy(st->group + st->held, src, n);
+        st->held += n;
+        src += n;
+        srclength -= n;
+        if (st->held < stream->group) return target;
+        if ((target = encode_groups(st, st->group, stream->group, target)) == NULL)
+            return NULL;
+        st->held = 0;
+    }
+    n = srclength - srclength % stream->group;
+    if (n && (target = encode_groups(st, src, n, target)) == NULL)
+        return NULL;
+    memcpy(st->group, src + n, srclength - n);
+    st->held = srclength - n;
+    return target;
+}
+
+char *encoder_stream_end(struct encoder_stream *st, char *target) {
+    const struct encoder_streaming *stream = st->e->stream;
+
+    if (st->left) return NULL;
+    if (stream->end) return stream->end(st, target);
+    if (st->held) {
+        target = encode_groups(st, st->group, st->held, target);
+        memset(st->group, 0, sizeof(st->group));
+        st->held = 0;
+    }
+    return target;
+}
@@ -1,6 +1,9 @@
 #ifndef _ENCODERS_H_
 #define _ENCODERS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "b10.h"
 #include "b64.h"
 #include "base91.h"
@@ -10,6 +13,70 @@
 
 /* encode stuff using basE91 internal functions */
 int base91_glue_encode(unsigned char const *src, size_t srclength,
-				  	   void *target, size_t targsize);
+				  	   char *target, size_t targsize);
+int base91_glue_decode(char const *src, unsigned char *target, size_t targsize);
+
+struct encoder;
+
+/*
+ * An encoding fed in pieces, see encoder_stream_begin(). Groups of the
+ * input are encoded with encode() and separated by sep, unless the codec
+ * needs state of its own and brings its update and end.
+ */
+struct encoder_stream {
+    const struct encoder *e;
+    uint64_t left;                      /* input bytes still to come */
+    size_t held;                        /* of group, waiting for more */
+    unsigned char group[8];
+    int started;                        /* a group was written */
+    struct basE91 b91;
+    Z85_stream z85;
+};
+
+struct encoder_streaming {
+    size_t group;                       /* input bytes encoded at once */
+    const char *sep;                    /* between groups of two calls */
+    char *(*begin)(struct encoder_stream *st, char *target); /* or NULL */
+    char *(*update)(struct encoder_stream *st, const unsigned char *src,
+                    size_t srclength, char *target);    /* NULL for encode() */
+    char *(*end)(struct encoder_stream *st, char *target);
+};
+
+/*
+ * A password encoding. All of them are stateless and safe to call from
+ * several threads at once; encode returns the output length without the
+ * '\0' and decode the number of bytes, both -1 on error.
+ */
+struct encoder {
+    const char *name;
+    const char * const *aliases;        /* NULL terminated, or NULL */
+    size_t (*bound)(size_t srclength);  /* worst case targsize, '\0' included */
+    int (*encode)(unsigned char const *src, size_t srclength,
+                  char *target, size_t targsize);
+    int (*decode)(char const *src, unsigned char *target,
+                  size_t targsize);     /* NULL if it's one way */
+    const struct encoder_streaming *stream;
+};
+
+/* The encodings, terminated by an entry with a NULL name */
+extern const struct encoder encoders[];
+
+/* The encoding called name or one of its aliases, ignoring case; or NULL */
+const struct encoder *encoder_find(const char *name);
+
+/*
+ * Encode total bytes coming in pieces: the output of begin, every update
+ * and end, one after the other, is what encode() gives for the whole
+ * input, without the '\0'. Each call writes at most
+ * encoder_stream_bound(e, srclength) characters (srclength 0 for begin
+ * and end) and returns the end of its output; or NULL if the stream is
+ * given more or fewer than total bytes.
+ */
+size_t encoder_stream_bound(const struct encoder *e, size_t srclength);
+char *encoder_stream_begin(struct encoder_stream *st, const struct encoder *e,
+                           uint64_t total, char *target);
+char *encoder_stream_update(struct encoder_stream *st, const unsigned char *src,
+                            size_t srclength, char *target);
+char *encoder_stream_end(struct encoder_stream *st, char *target);
 
-#endif
\ No newline at end of file
+#endif
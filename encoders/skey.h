@@ -1,2 +1,9 @@
+#include <stddef.h>
+
+/* Characters libscrypt_skey_encode() needs for A bytes, '\0' included */
+#define skey_encode_len(A) (((A) + 7) / 8 * 30)
+
 int	libscrypt_skey_encode(unsigned char const *src, size_t srclength,
         /*@out@*/ char *target, size_t targetsize);
+int	libscrypt_skey_decode(char const *src,
+        /*@out@*/ unsigned char *target, size_t targetsize);
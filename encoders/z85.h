@@ -177,6 +177,113 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest);
  */
 char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest);
 
+/*******************************************************************************
+ * ZeroMQ Base-85 streaming encoding/decoding with custom padding              *
+ *******************************************************************************/
+
+/*
+ * The output of Z85_encode_with_padding() for input coming in chunks of any
+ * size, and back.  The stream keeps the partial frame between calls, whole
+ * frames are converted straight from the caller's chunk.
+ */
+typedef struct Z85_stream
+{
+   size_t left;      // encoding: bytes still expected
+   size_t tailBytes; // decoding: the tail bytes count, 0 before the first symbol
+   size_t pending;   // bytes or symbols of the partial frame in 'buf'
+   char   buf[5];
+} Z85_stream;
+
+/**
+ * @brief Starts encoding 'inputSize' bytes, writes the tail bytes count into 'dest'.
+ *
+ * @param stream out, stream state
+ * @param inputSize in, total number of bytes the stream will be given
+ * @param dest out, output buffer, at least 1 symbol
+ * @return a pointer immediately after last symbol written into the 'dest'
+ */
+char* Z85_encode_stream_begin(Z85_stream* stream, size_t inputSize, char* dest);
+
+/**
+ * @brief Encodes the next 'size' bytes of the stream.
+ *
+ * @param stream in/out, stream state
+ * @param source in, input buffer
+ * @param size in, number of bytes in 'source'
+ * @param dest out, output buffer, at least Z85_encode_bound(size + 3) symbols
+ * @return a pointer immediately after last symbol written into the 'dest'
+ *         or NULL if the stream is given more than 'inputSize' bytes
+ */
+char* Z85_encode_stream_update(Z85_stream* stream, const char* source, size_t size, char* dest);
+
+/**
+ * @brief Writes the padded tail.
+ *
+ * @param stream in/out, stream state
+ * @param dest out, output buffer, at least 5 symbols
+ * @return a pointer immediately after last symbol written into the 'dest'
+ *         or NULL if the stream was given less than 'inputSize' bytes
+ */
+char* Z85_encode_stream_end(Z85_stream* stream, char* dest);
+
+/**
+ * @brief Starts decoding a string encoded with Z85_encode_with_padding().
+ *
+ * @param stream out, stream state
+ */
+void Z85_decode_stream_begin(Z85_stream* stream);
+
+/**
+ * @brief Decodes the next 'size' symbols of the stream.  The last frame is
+ *        held back until Z85_decode_stream_end().
+ *
+ * @param stream in/out, stream state
+ * @param source in, input buffer
+ * @param size in, number of symbols in 'source'
+ * @param dest out, output buffer, at least Z85_decode_bound(size + 5) bytes
+ * @return a pointer immediately after last byte written into the 'dest'
+ *         or NULL if the tail bytes count is wrong
+ */
+char* Z85_decode_stream_update(Z85_stream* stream, const char* source, size_t size, char* dest);
+
+/**
+ * @brief Decodes the tail.
+ *
+ * @param stream in/out, stream state
+ * @param dest out, output buffer, at least 4 bytes
+ * @return a pointer immediately after last byte written into the 'dest'
+ *         or NULL if the stream doesn't end on a whole frame
+ */
+char* Z85_decode_stream_end(Z85_stream* stream, char* dest);
+
+
+
+/*******************************************************************************
+ * Vectorized kernels                                                          *
+ *******************************************************************************/
+
+/*
+ * A kernel converts a prefix of whole frames and returns how many it did,
+ * the unsafe functions above finish the range.
+ */
+struct Z85_kernel
+{
+   const char* name;
+   int (*supported)(void); // NULL for the portable kernel
+   size_t (*encode)(const unsigned char* src, size_t frames, char* dst);
+   size_t (*decode)(const char* src, size_t frames, unsigned char* dst);
+};
+
+// NULL terminated, the first one is the portable (scalar only) kernel
+extern const struct Z85_kernel Z85_kernels[];
+
+// The fastest kernel the CPU supports, the one the functions above use
+const struct Z85_kernel* Z85_kernel(void);
+
+// Z85_encode_unsafe() and Z85_decode_unsafe() with kernel 'k'
+char* Z85_encode_unsafe_with(const struct Z85_kernel* k, const char* source, const char* sourceEnd, char* dest);
+char* Z85_decode_unsafe_with(const struct Z85_kernel* k, const char* source, const char* sourceEnd, char* dest);
+
 #if defined (__cplusplus)
 }
 #endif
@@ -1,5 +1,5 @@
 //genpass: stateless password generator
-//usage: genpass [option]... [site]
+//usage: genpass [option]... [site]...
 
 //example: genpass github.com
 //Name: John Doe
@@ -8,35 +8,51 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 #include "poison/poison.h"
 #include "arg_parser/arg_parser.h"
 #include "config/ini.h"
+#include "config/sitedb.h"
 #include "readpass/readpass.h"
-#include "libscrypt/libscrypt.h"
-#include "encoders/encoders.h"
+#include "secmem/secmem.h"
+#include "timings/timings.h"
+#include "perf/perf.h"
+#include "libgenpass/libgenpass.h"
 
 #define VERSION "2016.10.30"
 
-// libscrypt/libscrypt.h:57
-#undef  SCRYPT_HASH_LEN
-#define SCRYPT_HASH_LEN       32 //or 256 bits
-#define SCRYPT_HASH_LEN_MAX 1024
-#define SCRYPT_HASH_LEN_MIN    8
-#define SCRYPT_CACHE_COST     20
-#define SCRYPT_COST           14
-#define SCRYPT_SAFE_N         30
-#define SCRYPT_r               8
-#define SCRYPT_SAFE_r       9999
-#define SCRYPT_p              16
-#define SCRYPT_SAFE_p      99999
-
-#define DEFAULT_ENCODING   "z85"
+#define KEYRING_SAFE_TIMEOUT 31536000
+
+//default --calibrate targets in seconds, first and second level
+#define CALIBRATE_CACHE_TIME 60
+#define CALIBRATE_TIME       0.5
+
+//--warm, idle cpu and i/o priority, see sched(7) and ioprio_set(2)
+#ifdef __linux__
+#ifndef SCHED_IDLE
+#define SCHED_IDLE 5
+#endif
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+//--stream upper bound, what PBKDF2-SHA256 can give
+#define STREAM_LEN_MAX ((((uint64_t) 1 << 32) - 1) * 32)
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -52,6 +68,20 @@ typedef struct config_params {
     char *site;
     char *encoding;
     char *cache_file;
+    char *keyring;
+    char *keyring_timeout;
+    char *threads;
+    char *timings;
+    char *stats_file;
+    char *kdf;
+    char *argon2_t;
+    char *argon2_lanes;
+    char *cache_chain;
+    char *scheme;
+    char *db;
+    struct site_profile *profiles;  //[site "NAME"] sections, in file order
+    size_t nprofiles;
+    size_t profiles_cap;
 } configuration;
 
 void version(void) {
@@ -61,7 +91,7 @@ void version(void) {
 }
 
 void usage(int status) {
-    const char *usage_message="Usage: genpass [option]... [site]\n\
+    const char *usage_message="Usage: genpass [option]... [site]...\n\
     \b\b\b\bStateless password generator.\
       \n\
       \n  -n, --name \"Full Name\"    name\
@@ -69,16 +99,41 @@ void usage(int status) {
       \n  -s, --site \"site.tld\"     site login\
       \n  -r, --registration-mode   ask twice for master password\
       \n  -f, --file FILE           use|write cache key from|to FILE\
-      \n  -l, --key-length 8-1024   key length in bytes, \""TOSTRING(SCRYPT_HASH_LEN)"\" by default\
-      \n  -C, --cache-cost 1-30     cpu/memory cost for cache key, \""TOSTRING(SCRYPT_CACHE_COST)"\" by default\
-      \n  -c, --cost 1-30           cpu/memory cost for final key, \""TOSTRING(SCRYPT_COST)"\" by default\
-      \n      --scrypt-r 1-9999     block size, \""TOSTRING(SCRYPT_r)"\" by default (advanced)\
-      \n      --scrypt-p 1-99999    parallelization, \""TOSTRING(SCRYPT_p)"\" by default (advanced)\
+      \n  -l, --key-length 8-1024   key length in bytes, \""TOSTRING(GENPASS_HASH_LEN)"\" by default\
+      \n  -C, --cache-cost 1-30     cpu/memory cost for cache key, \""TOSTRING(GENPASS_CACHE_COST)"\" by default\
+      \n      --cache-chain 1-30    chain the cache key from this cost, raising -C then\
+      \n                              only computes the missing steps (advanced)\
+      \n  -c, --cost 1-30           cpu/memory cost for final key, \""TOSTRING(GENPASS_COST)"\" by default\
+      \n      --scrypt-r 1-9999     block size, \""TOSTRING(GENPASS_r)"\" by default (advanced)\
+      \n      --scrypt-p 1-99999    parallelization, \""TOSTRING(GENPASS_p)"\" by default (advanced)\
+      \n      --kdf KDF             key derivation function, \""GENPASS_KDF"\" by default\
+      \n                              KDF: scrypt|yescrypt|argon2id, argon2id costs are log2(KiB)\
+      \n      --argon2-t 1-1000     argon2id passes, \""TOSTRING(GENPASS_ARGON2_T)"\" by default (advanced)\
+      \n      --argon2-lanes 1-255  argon2id parallelism, \""TOSTRING(GENPASS_ARGON2_LANES)"\" by default (advanced)\
+      \n      --scheme 1-2          derivation scheme, \""TOSTRING(GENPASS_SCHEME)"\" by default, 2 derives the site\
+      \n                              keys with HKDF-SHA256 from a cached root key (advanced)\
       \n  -N, --dry-run             perform a trial run with no changes made\
-      \n  -e, --encoding ENCODING   password encoding output, \""DEFAULT_ENCODING"\" by default\
-      \n                              ENCODING: dec|hex|base64|z85|skey\
+      \n  -e, --encoding ENCODING   password encoding output, \""GENPASS_ENCODING"\" by default\
+      \n                              ENCODING: dec|hex|base64|z85|skey|b91, raw with --stream\
       \n  -1, --single              use single function derivation\
+      \n      --stream BYTES        derive BYTES of key material (K, M or G suffixed), the first\
+      \n                              -l of them are the key, scrypt and scheme 1 only\
+      \n      --output FILE         write the --stream output to FILE instead of stdout\
+      \n      --name-fd N           read the name from file descriptor N instead of -n or the prompt\
+      \n      --password-fd N       read the master password from file descriptor N\
       \n      --config FILE         configuration file\
+      \n      --compile-db FILE     compile the [site \"NAME\"] sections of --config into FILE\
+      \n      --db FILE             per site keylen, cost and encoding from compiled FILE\
+      \n      --keyring             use|write cache key from|to the session keyring\
+      \n      --keyring-timeout SEC keyring cache key lifetime, \""TOSTRING(GENPASS_KEYRING_TIMEOUT)"\" by default, 0 to disable\
+      \n  -j, --threads 1-256       scrypt/yescrypt/argon2id lanes computed at once, \""TOSTRING(GENPASS_THREADS)"\" by default\
+      \n      --timings             print the time and resources used per stage\
+      \n      --stats-file FILE     append the stage timings to FILE as JSON lines\
+      \n      --perf                print hardware counters of the smix phases\
+      \n      --warm[=MiB]          compute the missing cache keys of the config at idle priority,\
+      \n                              several at once within MiB, half of the free RAM by default\
+      \n      --calibrate[=C[:S]]   recommend costs and threads for C:S seconds levels,\
+      \n                              \""TOSTRING(CALIBRATE_CACHE_TIME)":"TOSTRING(CALIBRATE_TIME)"\" by default, saved with --config FILE\
       \n\
       \n  -v, --verbose             verbose mode\
       \n  -V, --version             show version and exit\
@@ -103,13 +158,6 @@ void verbose(const char * const msg, const int verbose_lvl) {
             fprintf(stderr, "[verbose] %s\n", msg);
 }
 
-uint64_t _pow(const unsigned int a, const unsigned int b) {
-    int i, pow = 1;
-    for (i = 0; i < b; i++)
-        pow *= a;
-    return pow;
-}
-
 const char * optname(const int code, const struct ap_Option options[]) {
     static char buf[2] = "?";
     int i;
@@ -126,26 +174,75 @@ const char * optname(const int code, const struct ap_Option options[]) {
     return buf;
 }
 
-void zerostring(char *s) {
-     while(*s) *s++ = 0;
-}
-
-int encode(char const *encoding, unsigned char const *src,
-           size_t srclength, char *target, size_t targsize) {
-    if (strcmp(encoding, "z85") == 0)
-        return libscrypt_z85_encode(src, srclength, target, targsize);
-    else if (strcmp(encoding, "base64") == 0)
-        return libscrypt_b64_encode(src, srclength, target, targsize);
-    else if (strcmp(encoding, "hex") == 0)
-        return libscrypt_hex_encode(src, srclength, target, targsize);
-    else if (strcmp(encoding, "dec") == 0)
-        return libscrypt_b10_encode(src, srclength, target, targsize);
-    else if (strcmp(encoding, "skey") == 0)
-        return libscrypt_skey_encode(src, srclength, target, targsize);
-    else if (strcmp(encoding, "b91") == 0)
-        return base91_glue_encode(src, srclength, target, targsize);
+//a secret of the command line into the arena, its argv copy wiped to leave
+//no trace of it in /proc/PID/cmdline once parsed
+static char *secret_arg(const char *arg) {
+    char *s, *p;
+
+    if ((s = secmem_strdup(arg)) == NULL) die("not enough memory.", 0, 0);
+    for (p = (char *) arg; *p; p++) *p = 0;
+    return s;
+}
+
+void genpass_log(int level, const char *msg, void *arg) {
+    if (level == GENPASS_LOG_WARNING) fprintf(stderr, "%s\n", msg);
+    else verbose(msg, *(char *) arg);
+}
+
+//the last kdf stage, perf rows are per kdf stage and smix phase
+static const char *kdf_stage = "";
+
+//stages go to the timings, the per lane smix phases to perf only
+void stage_span(const char *name, int begin, void *arg) {
+    if (strcmp(name, "smix-fill") == 0)
+        perf_phase(kdf_stage, "fill", begin);
+    else if (strcmp(name, "smix-mix") == 0)
+        perf_phase(kdf_stage, "mix", begin);
+    else {
+        if (begin && strncmp(name, "kdf-", 4) == 0) kdf_stage = name;
+        timings_span(name, begin, arg);
+    }
+}
+
+//[site "NAME"] sections, the lines of a section go to the same profile, a
+//site seen again gets another one which overrides it when looked up
+static int site_handler(configuration *pconfig, const char *section,
+                        const char *name, const char *value) {
+    const size_t len = strlen(section);
+    struct site_profile *p = NULL, *profiles;
+    char *site;
+
+    if (len < 8 || section[len - 1] != '"') return 0;
+    if (pconfig->nprofiles) p = &pconfig->profiles[pconfig->nprofiles - 1];
+
+    if (!p || strncmp(p->site, section + 6, len - 7) != 0 ||
+        p->site[len - 7] != '\0') {
+        if (pconfig->nprofiles == pconfig->profiles_cap) {
+            pconfig->profiles_cap = pconfig->profiles_cap ?
+                                    2 * pconfig->profiles_cap : 16;
+            profiles = realloc(pconfig->profiles,
+                               pconfig->profiles_cap * sizeof(*profiles));
+            if (profiles == NULL) die("not enough memory.", 0, 0);
+            pconfig->profiles = profiles;
+        }
+        p = &pconfig->profiles[pconfig->nprofiles++];
+        memset(p, 0, sizeof(*p));
+        if ((site = secmem_alloc(len - 6)) == NULL)
+            die("not enough memory.", 0, 0);
+        memcpy(site, section + 6, len - 7);
+        site[len - 7] = '\0';
+        p->site = site;
+    }
+
+    if (strcmp(name, "keylen") == 0)
+        p->keylen = secmem_strdup(value);
+    else if (strcmp(name, "cost") == 0)
+        p->cost = secmem_strdup(value);
+    else if (strcmp(name, "encoding") == 0)
+        p->encoding = secmem_strdup(value);
     else
-        return -1;
+        return 0;  /* unknown name, error */
+    return 1;
 }
 
 static int config_handler (void* user, const char* section, const char* name,
@@ -154,25 +251,49 @@ static int config_handler (void* user, const char* section, const char* name,
 
     #define MATCH(s, n) strcmp(section, s) == 0 && strcmp(name, n) == 0
     if (MATCH("user", "name")) {
-        pconfig->name = strdup(value);
+        pconfig->name = secmem_strdup(value);
     } else if (MATCH("user", "site")) {
-        pconfig->site = strdup(value);
+        pconfig->site = secmem_strdup(value);
     } else if (MATCH("user", "password")) {
-        pconfig->password = strdup(value);
+        pconfig->password = secmem_strdup(value);
     } else if (MATCH("general", "cache_file")) {
-        pconfig->cache_file = strdup(value);
+        pconfig->cache_file = secmem_strdup(value);
     } else if (MATCH("general", "keylen")) {
-        pconfig->keylen = strdup(value);
+        pconfig->keylen = secmem_strdup(value);
     } else if (MATCH("general", "cache_cost")) {
-        pconfig->cache_cost = strdup(value);
+        pconfig->cache_cost = secmem_strdup(value);
     } else if (MATCH("general", "cost")) {
-        pconfig->cost = strdup(value);
+        pconfig->cost = secmem_strdup(value);
     } else if (MATCH("general", "scrypt_r")) {
-        pconfig->scrypt_r = strdup(value);
+        pconfig->scrypt_r = secmem_strdup(value);
     } else if (MATCH("general", "scrypt_p")) {
-        pconfig->scrypt_p = strdup(value);
+        pconfig->scrypt_p = secmem_strdup(value);
     } else if (MATCH("general", "encoding")) {
-        pconfig->encoding = strdup(value);
+        pconfig->encoding = secmem_strdup(value);
+    } else if (MATCH("general", "keyring")) {
+        pconfig->keyring = secmem_strdup(value);
+    } else if (MATCH("general", "keyring_timeout")) {
+        pconfig->keyring_timeout = secmem_strdup(value);
+    } else if (MATCH("general", "threads")) {
+        pconfig->threads = secmem_strdup(value);
+    } else if (MATCH("general", "timings")) {
+        pconfig->timings = secmem_strdup(value);
+    } else if (MATCH("general", "stats_file")) {
+        pconfig->stats_file = secmem_strdup(value);
+    } else if (MATCH("general", "kdf")) {
+        pconfig->kdf = secmem_strdup(value);
+    } else if (MATCH("general", "argon2_t")) {
+        pconfig->argon2_t = secmem_strdup(value);
+    } else if (MATCH("general", "argon2_lanes")) {
+        pconfig->argon2_lanes = secmem_strdup(value);
+    } else if (MATCH("general", "cache_chain")) {
+        pconfig->cache_chain = secmem_strdup(value);
+    } else if (MATCH("general", "scheme")) {
+        pconfig->scheme = secmem_strdup(value);
+    } else if (MATCH("general", "db")) {
+        pconfig->db = secmem_strdup(value);
+    } else if (strncmp(section, "site \"", 6) == 0) {
+        return site_handler(pconfig, section, name, value);
     }
     else {
         return 0;  /* unknown section/name, error */
@@ -183,7 +304,8 @@ static int config_handler (void* user, const char* section, const char* name,
 void check_option(int choice, const char * const arg, int *option_value) {
     char error_msg[256] = {0};
     if (arg[0]) {
-        if (strtol(arg, NULL, 10) <= 0) {
+        if (strtol(arg, NULL, 10) <= 0 &&
+            !(choice == 204 && strcmp(arg, "0") == 0)) {
             if (choice == 200)
                 snprintf(error_msg, sizeof error_msg,
                          "option '--scrypt-r' requires a numerical argument, '%s'",
@@ -192,6 +314,27 @@ void check_option(int choice, const char * const arg, int *option_value) {
                 snprintf(error_msg, sizeof error_msg,
                          "option '--scrypt-p' requires a numerical argument, '%s'",
                          arg);
+            else if (choice == 204)
+                snprintf(error_msg, sizeof error_msg,
+                         "option '--keyring-timeout' requires a numerical argument, '%s'",
+                         arg);
+            else if (choice == 210)
+                snprintf(error_msg, sizeof error_msg,
+                         "option '--argon2-t' requires a numerical argument, '%s'",
+                         arg);
+            else if (choice == 211)
+                snprintf(error_msg, sizeof error_msg,
+                         "option '--argon2-lanes' requires a numerical argument, '%s'",
+                         arg);
+            else if (choice == 212)
+                snprintf(error_msg, sizeof error_msg,
+                         "option '--cache-chain' requires a numerical argument, '%s'",
+                         arg);
+            else if (choice == 213)
+                snprintf(error_msg, sizeof error_msg,
+                         "option '--scheme' requires a numerical argument, '%s'",
+                         arg);
+
             else
                 snprintf(error_msg, sizeof error_msg,
                          "option '-%c' requires a numerical argument, '%s'",
@@ -204,43 +347,91 @@ void check_option(int choice, const char * const arg, int *option_value) {
 
             switch (choice) {
             case 'l':
-                if (*option_value < SCRYPT_HASH_LEN_MIN ||
-                    *option_value > SCRYPT_HASH_LEN_MAX) {
+                if (*option_value < GENPASS_HASH_LEN_MIN ||
+                    *option_value > GENPASS_HASH_LEN_MAX) {
                     snprintf(error_msg, sizeof error_msg,
                              "option '-l' numerical value must be between %d-%d, '%d'",
-                             SCRYPT_HASH_LEN_MIN, SCRYPT_HASH_LEN_MAX, *option_value);
+                             GENPASS_HASH_LEN_MIN, GENPASS_HASH_LEN_MAX, *option_value);
                     die(error_msg, 0, 1);
                 }
                 break;
             case 'c':
-                if (*option_value > SCRYPT_SAFE_N) {
+                if (*option_value > GENPASS_SAFE_N) {
                     snprintf(error_msg, sizeof error_msg,
                              "option '-c' numerical value must be between 1-%d, '%d'",
-                             SCRYPT_SAFE_N, *option_value);
+                             GENPASS_SAFE_N, *option_value);
                     die(error_msg, 0, 1);
                 }
                 break;
             case 'C':
-                if (*option_value > SCRYPT_SAFE_N) {
+                if (*option_value > GENPASS_SAFE_N) {
                     snprintf(error_msg, sizeof error_msg,
                              "option '-C' numerical value must be between 1-%d, '%d'",
-                             SCRYPT_SAFE_N, *option_value);
+                             GENPASS_SAFE_N, *option_value);
                     die(error_msg, 0, 1);
                 }
                 break;
             case 200:
-                if (*option_value > SCRYPT_SAFE_r) {
+                if (*option_value > GENPASS_SAFE_r) {
                     snprintf(error_msg, sizeof error_msg,
                              "option '--scrypt-r' numerical value must be between 1-%d, '%d'",
-                             SCRYPT_SAFE_r, *option_value);
+                             GENPASS_SAFE_r, *option_value);
                     die(error_msg, 0, 1);
                 }
                 break;
             case 201:
-                if (*option_value > SCRYPT_SAFE_p) {
+                if (*option_value > GENPASS_SAFE_p) {
                     snprintf(error_msg, sizeof error_msg,
                              "option '--scrypt-p' numerical value must be between 1-%d, '%d'",
-                             SCRYPT_SAFE_p, *option_value);
+                             GENPASS_SAFE_p, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 'j':
+                if (*option_value > GENPASS_SAFE_THREADS) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '-j' numerical value must be between 1-%d, '%d'",
+                             GENPASS_SAFE_THREADS, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 210:
+                if (*option_value > GENPASS_SAFE_ARGON2_T) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '--argon2-t' numerical value must be between 1-%d, '%d'",
+                             GENPASS_SAFE_ARGON2_T, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 211:
+                if (*option_value > GENPASS_SAFE_ARGON2_LANES) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '--argon2-lanes' numerical value must be between 1-%d, '%d'",
+                             GENPASS_SAFE_ARGON2_LANES, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 212:
+                if (*option_value > GENPASS_SAFE_N) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '--cache-chain' numerical value must be between 1-%d, '%d'",
+                             GENPASS_SAFE_N, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 213:
+                if (*option_value > GENPASS_SCHEME_V2) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '--scheme' numerical value must be between 1-%d, '%d'",
+                             GENPASS_SCHEME_V2, *option_value);
+                    die(error_msg, 0, 1);
+                }
+                break;
+            case 204:
+                if (*option_value > KEYRING_SAFE_TIMEOUT) {
+                    snprintf(error_msg, sizeof error_msg,
+                             "option '--keyring-timeout' numerical value must be between 0-%d, '%d'",
+                             KEYRING_SAFE_TIMEOUT, *option_value);
                     die(error_msg, 0, 1);
                 }
                 break;
@@ -249,45 +440,538 @@ void check_option(int choice, const char * const arg, int *option_value) {
     }
 }
 
-void check_encoding(int choice, const char * const arg) {
-    int valid_encoding = 0, i = 0;
+void check_encoding(const char * const arg, const char **encoding) {
     char error_msg[256] = {0};
-    char *encoding = NULL;
-    const char *encodings[] = {"dec", "hex", "base64", "z85",
-                               "skey", "b91", NULL };
 
     if (arg[0]) {
-        encoding = (char *) arg;
-        char * orig_encoding_input = malloc(1 + strlen(encoding));
-
-        if (orig_encoding_input)
-            for (i = 0; encoding[i]; ++i) //strcpy
-                orig_encoding_input[i] = encoding[i];
-        else  {
-            snprintf(error_msg, sizeof error_msg, "malloc() error: %s",
-                     strerror(errno));
-            die(error_msg, 0, 0);
+        //only --stream writes raw bytes, checked once the options are read
+        if (strcasecmp(arg, "raw") == 0)
+            *encoding = "raw";
+        else if ((*encoding = genpass_encoding(arg)) == NULL) {
+            snprintf(error_msg, sizeof error_msg,                       \
+                     "invalid text encoding '%s'", arg);
+            die(error_msg, 0, 1);
         }
+    }
+}
 
-        for (i = 0; encoding[i]; ++i)
-            encoding[i] = tolower(encoding[i]);
+//BYTES with an optional K, M or G (binary) suffix
+void check_stream(const char * const arg, uint64_t *stream_len) {
+    char error_msg[256] = {0};
+    char *end           = NULL;
+    unsigned long long len;
+    int shift           = 0;
 
-        const char ** pencodings = encodings;
+    if (arg[0]) {
+        errno = 0;
+        len   = strtoull(arg, &end, 10);
+        switch (*end) {
+            case 'k': case 'K': shift = 10; end++; break;
+            case 'm': case 'M': shift = 20; end++; break;
+            case 'g': case 'G': shift = 30; end++; break;
+        }
+        if (!isdigit((unsigned char) arg[0]) || *end || errno || len == 0 ||
+            len > (STREAM_LEN_MAX >> shift)) {
+            snprintf(error_msg, sizeof error_msg,
+                     "option '--stream' requires a length of 1-%llu bytes, '%s'",
+                     (unsigned long long) STREAM_LEN_MAX, arg);
+            die(error_msg, 0, 1);
+        }
+        *stream_len = (uint64_t) len << shift;
+    }
+}
+
+//write everything, --stream output comes in large chunks
+static int write_stream(const char *buf, size_t len, void *arg) {
+    const int fd = *(const int *) arg;
+    ssize_t n;
 
-        while(*pencodings != NULL) {
-            if (strcmp(encoding, *pencodings) == 0)
-                valid_encoding = 1;
-            pencodings++;
+    while (len) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
         }
+        buf += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
 
-        if(!valid_encoding) {
-            snprintf(error_msg, sizeof error_msg,                       \
-                     "invalid text encoding '%s'", orig_encoding_input);
+//a profile overrides the [general] and command line values
+void apply_profile(const struct site_profile *profile, int *keylen, int *cost,
+                   const char **encoding) {
+    if (profile->keylen)   check_option('l', profile->keylen, keylen);
+    if (profile->cost)     check_option('c', profile->cost, cost);
+    if (profile->encoding) check_encoding(profile->encoding, encoding);
+}
+
+sitedb *open_db(const char *db_file) {
+    char error_msg[256] = {0};
+    sitedb *db;
+
+    if ((db = sitedb_open(db_file)) == NULL) {
+        snprintf(error_msg, sizeof error_msg,
+                 "couldn't load site database '%s': %s", db_file,
+                 errno == EINVAL ? "not a compiled site database" :
+                 strerror(errno));
+        die(error_msg, 0, 0);
+    }
+    return db;
+}
+
+//the compiled profile of site, then the [site] sections of the config, the
+//values point into db while it's open
+int find_profile(const sitedb *db, const configuration *conf,
+                 const char *site, struct site_profile *profile) {
+    size_t i;
+    int found = 0;
+
+    memset(profile, 0, sizeof(*profile));
+    if (db) found = sitedb_lookup(db, site, profile);
+    for (i = 0; i < conf->nprofiles; i++) {
+        if (strcmp(conf->profiles[i].site, site) != 0) continue;
+        if (conf->profiles[i].keylen)   profile->keylen   = conf->profiles[i].keylen;
+        if (conf->profiles[i].cost)     profile->cost     = conf->profiles[i].cost;
+        if (conf->profiles[i].encoding) profile->encoding = conf->profiles[i].encoding;
+        found = 1;
+    }
+    return found;
+}
+
+//a cache file holds a single key, a site whose profile changes the key
+//length (or the cost, for the scheme 2 root key) keeps its own next to the
+//one of the others instead of replacing it: FILE.KEYLEN (FILE.KEYLEN.COST)
+const char *site_cache_file(const char *file, const int scheme,
+                            const int keylen, const int cost,
+                            const int site_keylen, const int site_cost,
+                            char *buf, const size_t size) {
+    const int v2  = scheme == GENPASS_SCHEME_V2 && site_cost != cost;
+    int len;
+
+    if (!file || (site_keylen == keylen && !v2)) return file;
+    if (v2) len = snprintf(buf, size, "%s.%d.%d", file, site_keylen, site_cost);
+    else    len = snprintf(buf, size, "%s.%d", file, site_keylen);
+    if (len < 0 || (size_t) len >= size) die("cache file path too long.", 0, 0);
+    return buf;
+}
+
+void check_warm(const char * const arg, uint64_t *budget) {
+    char error_msg[256] = {0};
+    char *end           = NULL;
+    unsigned long long mib;
+
+    if (arg[0]) {
+        errno = 0;
+        mib   = strtoull(arg, &end, 10);
+        if (!isdigit((unsigned char) arg[0]) || *end || errno || mib == 0 ||
+            mib > (UINT64_MAX >> 20)) {
+            snprintf(error_msg, sizeof error_msg,
+                     "option '--warm' requires a memory budget in MiB, '%s'", arg);
             die(error_msg, 0, 1);
-        } free(orig_encoding_input);
+        }
+        *budget = (uint64_t) mib << 20;
     }
 }
 
+void check_fd(const char * const option, const char * const arg, int *fd) {
+    char error_msg[256] = {0};
+    char *end           = NULL;
+    long n;
+
+    errno = 0;
+    n     = strtol(arg, &end, 10);
+    if (!isdigit((unsigned char) arg[0]) || *end || errno || n > INT_MAX ||
+        fcntl((int) n, F_GETFD) == -1) {
+        snprintf(error_msg, sizeof error_msg,
+                 "option '%s' requires an open file descriptor, '%s'",
+                 option, arg);
+        die(error_msg, 0, 1);
+    }
+    *fd = (int) n;
+}
+
+//the values given by descriptor, then prompts for the ones still missing,
+//all of them in a single terminal session. site is NULL when not needed
+static void read_missing(char **name, char **site, char **password,
+                         const int name_fd, const int password_fd,
+                         const char registration_mode) {
+    struct tarsnap_tty tty;
+
+    //in this order, both may come through the same descriptor
+    if (name_fd != -1 && tarsnap_readfd(name, name_fd))
+        die("tarsnap_readfd() error.", 0, 0);
+    if (password_fd != -1 && tarsnap_readfd(password, password_fd))
+        die("tarsnap_readfd() error.", 0, 0);
+
+    if (*name && (!site || *site) && *password) return;
+    if (tarsnap_tty_open(&tty, 1))
+        die("tarsnap_tty_open() error.", 0, 0);
+    if (*name == NULL)
+        if (tarsnap_readinput_tty(&tty, name, "Name", NULL))
+            die("tarsnap_readinput() error.", 0, 0);
+    if (site && *site == NULL)
+        if (tarsnap_readinput_tty(&tty, site, "Site", NULL))
+            die("tarsnap_readinput() error.", 0, 0);
+    if (*password == NULL)
+        if (tarsnap_readpass_tty(&tty, password, "Master password",
+                                 registration_mode ? "repeat again" : NULL))
+            die("tarsnap_readpass() error.", 0, 0);
+    tarsnap_tty_close(&tty);
+}
+
+//--warm runs next to interactive use, it gets the cpu and the disk only
+//when nothing else wants them
+static void lower_priority(void) {
+#ifdef __linux__
+    struct sched_param sp = {0};
+
+    (void) sched_setscheduler(0, SCHED_IDLE, &sp);
+    (void) syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                   IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+    (void) setpriority(PRIO_PROCESS, 0, 19);
+}
+
+//--warm, the cache key of params and the ones of the site profiles using
+//another key length (or cost, for the scheme 2 root key), each in its file
+static void warm_cache_keys(const char *name, const char *password,
+                            const struct genpass_params *params,
+                            const struct genpass_cache *cache,
+                            const configuration *conf, const sitedb *db,
+                            const uint64_t budget, char *verbose_lvl) {
+    char error_msg[512]          = {0};
+    struct genpass_warm_job *jobs = NULL;
+    struct site_profile profile;
+    const size_t ndb             = db ? sitedb_count(db) : 0;
+    const size_t nsites          = ndb + conf->nprofiles;
+    const int v2                 = params->scheme == GENPASS_SCHEME_V2;
+    const char *site, *encoding, *file;
+    char path[PATH_MAX];
+    size_t i, j, njobs           = 1;
+    int keylen, cost, failed;
+
+    if ((jobs = calloc(nsites + 1, sizeof(*jobs))) == NULL)
+        die("not enough memory.", 0, 0);
+    jobs[0].params = *params;
+    jobs[0].cache  = *cache;
+
+    for (i = 0; i < nsites; i++) {
+        //the merged values of each site, as a derivation for it would see
+        if (i < ndb) {
+            if (!sitedb_profile(db, i, &profile)) continue;
+            site = profile.site;
+        } else
+            site = conf->profiles[i - ndb].site;
+        if (!find_profile(db, conf, site, &profile)) continue;
+        keylen   = (int) params->keylen;
+        cost     = (int) params->cost;
+        encoding = GENPASS_ENCODING;
+        apply_profile(&profile, &keylen, &cost, &encoding);
+        if (!v2) cost = (int) params->cost;
+
+        for (j = 0; j < njobs; j++)
+            if (jobs[j].params.keylen == (size_t) keylen &&
+                jobs[j].params.cost   == (uint32_t) cost)
+                break;
+        if (j < njobs) continue;
+
+        file = site_cache_file(cache->file, params->scheme,
+                               (int) params->keylen, (int) params->cost,
+                               keylen, cost, path, sizeof path);
+        jobs[njobs].params        = *params;
+        jobs[njobs].params.keylen = (size_t) keylen;
+        jobs[njobs].params.cost   = (uint32_t) cost;
+        jobs[njobs].cache         = *cache;
+        if ((jobs[njobs].cache.file = strdup(file)) == NULL)
+            die("not enough memory.", 0, 0);
+        njobs++;
+    }
+
+    if ((failed = genpass_warm(name, password, jobs, njobs, budget,
+                               genpass_log, verbose_lvl)) == -1) {
+        snprintf(error_msg, sizeof error_msg, "genpass_warm() failed: %s",
+                 strerror(errno));
+        die(error_msg, 0, 0);
+    }
+    for (i = 0; i < njobs && failed; i++) {
+        if (jobs[i].status == 0) continue;
+        snprintf(error_msg, sizeof error_msg,
+                 "couldn't warm the key length %zu cache key: %s",
+                 jobs[i].params.keylen, strerror(jobs[i].errnum));
+        die(error_msg, 0, 0);
+    }
+    fprintf(stderr, "Warmed %zu cache key(s)\n", njobs);
+    for (i = 1; i < njobs; i++) free((char *) jobs[i].cache.file);
+    free(jobs);
+}
+
+void check_kdf(const char * const arg, int *kdf) {
+    char error_msg[256] = {0};
+
+    if (arg[0]) {
+        if (strcmp(arg, "scrypt") == 0)
+            *kdf = GENPASS_KDF_SCRYPT;
+        else if (strcmp(arg, "yescrypt") == 0)
+            *kdf = GENPASS_KDF_YESCRYPT;
+        else if (strcmp(arg, "argon2id") == 0)
+            *kdf = GENPASS_KDF_ARGON2ID;
+        else {
+            snprintf(error_msg, sizeof error_msg,
+                     "invalid key derivation function '%s'", arg);
+            die(error_msg, 0, 1);
+        }
+    }
+}
+
+//argon2id needs 8 KiB per lane, the costs are log2(KiB)
+void check_argon2_cost(const char *option, const int cost, const int lanes) {
+    char error_msg[256] = {0};
+    int min = 1;
+
+    while ((1 << min) < 8 * lanes) min++;
+    if (cost < min) {
+        snprintf(error_msg, sizeof error_msg,
+                 "option '%s' numerical value must be at least %d with "
+                 "--kdf argon2id and %d lane(s), '%d'", option, min, lanes, cost);
+        die(error_msg, 0, 1);
+    }
+}
+
+//the yescrypt lanes split N, each one needs 2 blocks at least
+void check_yescrypt_cost(const char *option, const int cost, const int p) {
+    char error_msg[256] = {0};
+    int min = 1;
+
+    while ((1LL << min) < 2LL * p) min++;
+    if (cost < min) {
+        snprintf(error_msg, sizeof error_msg,
+                 "option '%s' numerical value must be at least %d with "
+                 "--kdf yescrypt and --scrypt-p %d, '%d'", option, min, p, cost);
+        die(error_msg, 0, 1);
+    }
+}
+
+void check_calibrate(const char * const arg, double *cache_target,
+                     double *target) {
+    char error_msg[256] = {0};
+    char *end           = NULL;
+
+    if (arg[0]) {
+        *cache_target = strtod(arg, &end);
+        if (end != arg && *end == ':')
+            *target = strtod(end + 1, &end);
+        if (*end || *cache_target <= 0 || *target <= 0) {
+            snprintf(error_msg, sizeof error_msg,
+                     "option '--calibrate' requires CACHE_SECONDS:SECONDS, '%s'",
+                     arg);
+            die(error_msg, 0, 1);
+        }
+    }
+}
+
+static const char * human_size(uint64_t bytes, char *buf, size_t buflen) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double size = bytes;
+    int i = 0;
+
+    while (size >= 1024 && i < 4) { size /= 1024; i++; }
+    snprintf(buf, buflen, "%.1f %s", size, units[i]);
+    return buf;
+}
+
+void print_calibration(const struct genpass_calibration *cal) {
+    const struct genpass_level *levels[] = { &cal->cache, &cal->site };
+    const char *names[]                  = { "cache", "site" };
+    char size[32], measured[32];
+    int i;
+
+    fprintf(stdout, "host      %d cpu(s), %s available, %s scrypt core\n",
+            cal->host.ncpu, human_size(cal->host.ram_avail, size, sizeof size),
+            cal->host.kernel);
+    fprintf(stdout, "blockmix  %.1f MB/s per thread\n", cal->host.blockmix_mbs);
+    fprintf(stdout, "memory    %.1f MB/s copy\n\n", cal->host.membw_mbs);
+
+    fprintf(stdout, "%-6s %8s %5s %4s %5s %8s %10s %10s %9s\n", "level",
+            "target", "cost", "r", "p", "threads", "memory", "estimated",
+            "measured");
+    for (i = 0; i < 2; i++) {
+        if (levels[i]->measured > 0)
+            snprintf(measured, sizeof measured, "%.2fs", levels[i]->measured);
+        else
+            snprintf(measured, sizeof measured, "-");
+        fprintf(stdout, "%-6s %7.2fs %5u %4u %5u %8u %10s %9.2fs %9s\n",
+                names[i], levels[i]->target, levels[i]->cost, cal->scrypt_r,
+                cal->scrypt_p, levels[i]->threads,
+                human_size(levels[i]->memory, size, sizeof size),
+                levels[i]->estimated, measured);
+    }
+
+    fprintf(stdout, "\n[general]\ncache_cost = %u\ncost       = %u\n"
+            "scrypt_r   = %u\nscrypt_p   = %u\nthreads    = %u\n",
+            cal->cache.cost, cal->site.cost, cal->scrypt_r, cal->scrypt_p,
+            cal->cache.threads);
+}
+
+//rewrite (or add) the calibrated keys of the [general] section of
+//config_file, other lines are kept as they are
+int save_calibration(const char *config_file,
+                     const struct genpass_calibration *cal) {
+    const char *keys[] = {"cache_cost", "cost", "scrypt_r", "scrypt_p", "threads"};
+    unsigned int values[5];
+    int written[5]          = {0};
+    char target[PATH_MAX]   = {0};
+    char tmpfile[PATH_MAX]  = {0};
+    char *line              = NULL;
+    char *p, *q;
+    FILE *in = NULL, *out = NULL;
+    struct stat st;
+    int fd, i, err, in_general = 0, seen_general = 0, eol = 1;
+    size_t len, cap         = 0;
+    ssize_t n;
+
+    values[0] = cal->cache.cost;
+    values[1] = cal->site.cost;
+    values[2] = cal->scrypt_r;
+    values[3] = cal->scrypt_p;
+    values[4] = cal->cache.threads;
+
+    //a symlinked config is updated where it points to, keeping its mode; a
+    //new one is created 0600, it may hold the password
+    if (realpath(config_file, target) == NULL) {
+        if (errno != ENOENT) return -1;
+        if ((size_t) snprintf(target, sizeof target, "%s", config_file) >=
+            sizeof target) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+    }
+    if ((size_t) snprintf(tmpfile, sizeof tmpfile, "%s.XXXXXX", target) >=
+        sizeof tmpfile) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((fd = mkstemp(tmpfile)) == -1) return -1;
+    if ((stat(target, &st) == 0 && fchmod(fd, st.st_mode & 07777) != 0) ||
+        (out = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(tmpfile);
+        return -1;
+    }
+    in = fopen(target, "r");
+
+    while (in && (n = getline(&line, &cap, in)) > 0) {
+        for (p = line; *p == ' ' || *p == '\t'; p++);
+        if (*p == '[') {
+            if (in_general)
+                for (i = 0; i < 5; i++)
+                    if (!written[i])
+                        written[i] = fprintf(out, "%-10s = %u\n", keys[i], values[i]);
+            in_general   = (strncmp(p, "[general]", 9) == 0);
+            seen_general = seen_general || in_general;
+        } else if (in_general) {
+            for (i = 0; i < 5; i++) {
+                len = strlen(keys[i]);
+                if (strncmp(p, keys[i], len) != 0) continue;
+                for (q = p + len; *q == ' ' || *q == '\t'; q++);
+                if (*q != '=' && *q != ':') continue;
+                //keep inline comments
+                q = strpbrk(q, ";#");
+                if (q)
+                    written[i] = fprintf(out, "%-10s = %-16u %s", keys[i],
+                                         values[i], q);
+                else
+                    written[i] = fprintf(out, "%-10s = %u\n", keys[i], values[i]);
+                break;
+            }
+            if (i < 5) continue;
+        }
+        fputs(line, out);
+        eol = line[n - 1] == '\n';
+    }
+    free(line);
+
+    if (!eol) fputc('\n', out);
+    if (!seen_general) fprintf(out, "\n[general]\n");
+    if (in_general || !seen_general)
+        for (i = 0; i < 5; i++)
+            if (!written[i])
+                fprintf(out, "%-10s = %u\n", keys[i], values[i]);
+
+    if (in) fclose(in);
+    err  = fflush(out) != 0 || fsync(fd) != 0;
+    err |= fclose(out) != 0;
+    if (err || rename(tmpfile, target) != 0) {
+        unlink(tmpfile);
+        return -1;
+    }
+    return 0;
+}
+
+//the profile of site over its keylen, cost and encoding, if there's one
+static void site_values(const sitedb *db, const configuration *conf,
+                        const char *site, int *keylen, int *cost,
+                        const char **encoding, const int kdf,
+                        const int argon2_lanes, const int scrypt_p,
+                        const char verbose_lvl) {
+    char msg[512] = {0};
+    struct site_profile profile;
+
+    if ((!db && !conf->nprofiles) || !find_profile(db, conf, site, &profile))
+        return;
+    apply_profile(&profile, keylen, cost, encoding);
+    if (kdf == GENPASS_KDF_ARGON2ID)
+        check_argon2_cost("-c", *cost, argon2_lanes);
+    else if (kdf == GENPASS_KDF_YESCRYPT)
+        check_yescrypt_cost("-c", *cost, scrypt_p);
+    snprintf(msg, sizeof msg, "Using the site profile of '%s' ...", site);
+    verbose(msg, verbose_lvl);
+}
+
+void die_derive(const int retval, const int derive_errno, const int kdf,
+                const char *encoding, const char *output_file) {
+    char error_msg[512] = {0};
+
+    if (retval == GENPASS_ERR_KDF) {
+        snprintf(error_msg, sizeof error_msg, "%s() failed: %s",
+            kdf == GENPASS_KDF_ARGON2ID ? "argon2id" :
+            kdf == GENPASS_KDF_YESCRYPT ? "libscrypt_yescrypt" : "libscrypt_scrypt",
+            strerror(derive_errno));
+        die(error_msg, 0, 0);
+    } else if (retval == GENPASS_ERR_ENCODING) {
+        snprintf(error_msg, sizeof error_msg, \
+            "encode(%s) failed: %s", encoding, strerror(derive_errno));
+        die(error_msg, 0, 0);
+    } else if (retval == GENPASS_ERR_OUTPUT) {
+        snprintf(error_msg, sizeof error_msg, "couldn't write to '%s': %s",
+            output_file ? output_file : "stdout", strerror(derive_errno));
+        die(error_msg, 0, 0);
+    }
+}
+
+void print_stats(const char timings, const char perf, const char *stats_file) {
+    char error_msg[512] = {0};
+
+    if (timings || perf) fflush(stdout);
+    if (timings) timings_print(stderr);
+    if (perf) {
+        perf_print(stderr);
+        perf_close();
+    }
+    if (stats_file && timings_append_json(stats_file, VERSION)) {
+        snprintf(error_msg, sizeof error_msg,
+                 "couldn't append to stats file '%s': %s", stats_file,
+                 strerror(errno));
+        die(error_msg, 0, 0);
+    }
+}
+
+//a context per key length and cost the site profiles ask for
+struct site_ctx {
+    size_t       keylen;
+    uint32_t     cost;
+    genpass_ctx *ctx;
+};
+
 int main(const int argc, const char * const argv[]) {
     char * name                                 = NULL;
     char * password                             = NULL;
@@ -295,30 +979,57 @@ int main(const int argc, const char * const argv[]) {
     char * config_file                          = NULL;
     char registration_mode                      = 0;
     const char * cache_file                     = NULL;
-    int  keylen                                 = SCRYPT_HASH_LEN;
-    int  cache_cost                             = SCRYPT_CACHE_COST;
-    int  cost                                   = SCRYPT_COST;
-    int  scrypt_r                               = SCRYPT_r;
-    int  scrypt_p                               = SCRYPT_p;
+    int  keylen                                 = GENPASS_HASH_LEN;
+    int  cache_cost                             = GENPASS_CACHE_COST;
+    int  cost                                   = GENPASS_COST;
+    int  scrypt_r                               = GENPASS_r;
+    int  scrypt_p                               = GENPASS_p;
     char dry_run                                = 0;
-    char * encoding                             = DEFAULT_ENCODING;
+    const char * encoding                       = GENPASS_ENCODING;
     char single_function_derivation             = 0;
     char verbose_lvl                            = 0;
+    char use_keyring                            = 0;
+    int  keyring_timeout                        = GENPASS_KEYRING_TIMEOUT;
+    int  threads                                = GENPASS_THREADS;
+    int  kdf                                    = GENPASS_KDF_SCRYPT;
+    int  argon2_t                               = GENPASS_ARGON2_T;
+    int  argon2_lanes                           = GENPASS_ARGON2_LANES;
+    int  cache_chain                            = 0;
+    int  scheme                                 = GENPASS_SCHEME;
+    char calibrate                              = 0;
+    char timings                                = 0;
+    const char * stats_file                     = NULL;
+    char perf                                   = 0;
+    double cache_target                         = CALIBRATE_CACHE_TIME;
+    double target                               = CALIBRATE_TIME;
+    uint64_t stream_len                         = 0;
+    const char * output_file                    = NULL;
+    int   output_fd                             = STDOUT_FILENO;
+    const char * compile_db                     = NULL;
+    const char * db_file                        = NULL;
+    sitedb *db                                  = NULL;
+    const char ** sites                         = NULL;
+    size_t nsites                               = 0;
+    struct site_ctx *ctxs                       = NULL;
+    size_t i, j, nctxs                          = 0;
+    char  warm                                  = 0;
+    int   name_fd                               = -1;
+    int   password_fd                           = -1;
+    uint64_t warm_budget                        = 0;
 
-    char cache_hash_in_file                     = 0;
-    char b64buf[SCRYPT_HASH_LEN_MAX * 2]        = {0};
+    char * b64buf                               = NULL;
     char fpath[256]                             = {0};
+    char site_file[PATH_MAX]                    = {0};
     char error_msg[256]                         = {0};
-    char verbose_msg[SCRYPT_HASH_LEN_MAX + 256] = {0};
-    char mix_name_site[2032]                    = {0};
     const char * homedir                        = NULL;
-    FILE  *fp                                   = NULL;
-    int   i, readbytes, argi                    = 0;
-    uint64_t cache_scrypt_n                     = 0;
-    uint64_t scrypt_n                           = 0;
+    int   argi                                  = 0;
+    int   retval                                = 0;
+    int   derive_errno                          = 0;
 
-    uint8_t cache_hashbuf[SCRYPT_HASH_LEN_MAX]  = {0};
-    uint8_t hashbuf[SCRYPT_HASH_LEN_MAX]        = {0};
+    struct genpass_params params;
+    struct genpass_cache  cache;
+    struct genpass_calibration calibration;
+    genpass_ctx          *ctx                   = NULL;
 
     configuration conf                          = {0};
     bool is_config                              = false;
@@ -337,6 +1048,25 @@ int main(const int argc, const char * const argv[]) {
       { 200, "scrypt-r",            ap_yes },
       { 201, "scrypt-p",            ap_yes },
       { 202, "config",              ap_yes },
+      { 203, "keyring",             ap_no  },
+      { 204, "keyring-timeout",     ap_yes },
+      { 205, "calibrate",           ap_maybe },
+      { 'j', "threads",             ap_yes },
+      { 206, "timings",             ap_no  },
+      { 207, "stats-file",          ap_yes },
+      { 208, "perf",                ap_no  },
+      { 209, "kdf",                 ap_yes },
+      { 210, "argon2-t",            ap_yes },
+      { 211, "argon2-lanes",        ap_yes },
+      { 212, "cache-chain",         ap_yes },
+      { 213, "scheme",              ap_yes },
+      { 214, "stream",              ap_yes },
+      { 215, "output",              ap_yes },
+      { 216, "compile-db",          ap_yes },
+      { 217, "db",                  ap_yes },
+      { 218, "warm",                ap_maybe },
+      { 219, "name-fd",             ap_yes },
+      { 220, "password-fd",         ap_yes },
       { 'N', "dry-run",             ap_no  },
       { 'e', "encoding",            ap_yes },
       { '1', "single",              ap_no  },
@@ -349,26 +1079,62 @@ int main(const int argc, const char * const argv[]) {
     getrlimit(RLIMIT_CORE, &rlim);
     rlim.rlim_max = rlim.rlim_cur = 0;
     if (setrlimit(RLIMIT_CORE, &rlim)) exit(EXIT_FAILURE);
+    //and names, passwords and outputs go to a locked arena, wiped at exit
+    if (secmem_init(SECMEM_SIZE) ||
+        (b64buf = secmem_alloc(GENPASS_ENCODED_LEN_MAX)) == NULL)
+        die("couldn't map the secret arena.", 0, 0);
+    //the contexts hold name, password and keys, never freed before exit
+    genpass_set_allocator(secmem_alloc, NULL);
     //---------------------------------------------------
 
     //process options
-    if (!ap_init(&parser, argc, argv, options, 0))
+    //the arguments stay in argv, xargs may pass thousands of sites
+    if (!ap_init_argv(&parser, argc, argv, options, 0))
         die("not enough memory.", 0, 0);
     //unrecognized option
     if (ap_error(&parser)) die(ap_error(&parser), 0, 1);
+    if ((sites = malloc((ap_arguments(&parser) + 1) * sizeof(*sites))) == NULL)
+        die("not enough memory.", 0, 0);
 
     for (argi = 0; argi < ap_arguments (&parser); ++argi) {
         const int code = ap_code(&parser, argi);
         const char * const arg = ap_argument(&parser, argi);
         if (code) {
             switch (code) {
-                case 'n': if (arg[0]) { name     = (char *) arg; } break;
-                case 'p': if (arg[0]) { password = (char *) arg; } break;
+                case 'n': if (arg[0]) { name     = secret_arg(arg); } break;
+                case 'p': if (arg[0]) { password = secret_arg(arg); } break;
                 case 's': if (arg[0]) { site     = (char *) arg; } break;
                 case 202: if (arg[0]) {
                     is_config   = true;
                     config_file = (char *) arg;
                 } break;
+                case 203: use_keyring = 1; break;
+                case 204: check_option(code, arg, &keyring_timeout);
+                    break;
+                case 205: calibrate = 1;
+                    check_calibrate(arg, &cache_target, &target);
+                    break;
+                case 'j': check_option(code, arg, &threads);
+                    break;
+                case 206: timings = 1; break;
+                case 207: if (arg[0]) { stats_file = arg; } break;
+                case 208: perf = 1; break;
+                case 209: check_kdf(arg, &kdf); break;
+                case 210: check_option(code, arg, &argon2_t);
+                    break;
+                case 211: check_option(code, arg, &argon2_lanes);
+                    break;
+                case 212: check_option(code, arg, &cache_chain);
+                    break;
+                case 213: check_option(code, arg, &scheme);
+                    break;
+                case 214: check_stream(arg, &stream_len); break;
+                case 215: if (arg[0]) { output_file = arg; } break;
+                case 216: if (arg[0]) { compile_db = arg; } break;
+                case 217: if (arg[0]) { db_file = arg; } break;
+                case 218: warm = 1; check_warm(arg, &warm_budget); break;
+                case 219: check_fd("--name-fd", arg, &name_fd); break;
+                case 220: check_fd("--password-fd", arg, &password_fd); break;
                 case 'r': registration_mode = 1; break;
                 case 'f': if (arg[0]) { cache_file = arg; } break;
                 case 'l': check_option(code, arg, &keylen);
@@ -382,8 +1148,7 @@ int main(const int argc, const char * const argv[]) {
                 case 201: check_option(code, arg, &scrypt_p);
                     break;
                 case 'N': dry_run = 1; break;
-                case 'e': check_encoding(code, arg);
-                    encoding = (char *) arg;
+                case 'e': check_encoding(arg, &encoding);
                     break;
                 case '1': single_function_derivation = 1; break;
                 case 'v': verbose_lvl += 1; break;
@@ -391,16 +1156,25 @@ int main(const int argc, const char * const argv[]) {
                 case 'h': usage(EXIT_SUCCESS); break;
                 default : die("uncaught option.", 0, 1);
             }
-        } else { if (arg[0]) site = (char *) arg; }
+        } else if (arg[0]) {
+            site            = (char *) arg;
+            sites[nsites++] = arg;
+        }
     }
 
+    //spans are cheap, record them anyway as the config file may still
+    //enable --timings or --stats-file
+    timings_enable();
+
     //check if configuration file is provided
     if (is_config) {
+        timings_span("config", 1, NULL);
         if (ini_parse(config_file, config_handler, &conf) < 0) {
             snprintf(error_msg, sizeof error_msg,
                      "couldn't load config file '%s'", config_file);
             die(error_msg, 0, 1);
         }
+        timings_span("config", 0, NULL);
 
         if (conf.name)       {name = conf.name;}
         if (conf.site)       {site = conf.site;}
@@ -417,27 +1191,112 @@ int main(const int argc, const char * const argv[]) {
             check_option(200, (const char * const) conf.scrypt_r, &scrypt_r);
         if (conf.scrypt_p)
             check_option(201, (const char * const) conf.scrypt_p, &scrypt_p);
-        if (conf.encoding) {
-            check_encoding('e', (const char * const) conf.encoding);
-            encoding = conf.encoding;
+        if (conf.encoding)
+            check_encoding((const char * const) conf.encoding, &encoding);
+        if (conf.keyring)
+            use_keyring = (strcmp(conf.keyring, "yes") == 0 ||
+                           strcmp(conf.keyring, "1")   == 0);
+        if (conf.keyring_timeout)
+            check_option(204, (const char * const) conf.keyring_timeout, &keyring_timeout);
+        if (conf.threads)
+            check_option('j', (const char * const) conf.threads, &threads);
+        if (conf.timings)
+            timings = (strcmp(conf.timings, "yes") == 0 ||
+                       strcmp(conf.timings, "1")   == 0);
+        if (conf.stats_file && stats_file == NULL)
+            stats_file = conf.stats_file;
+        if (conf.kdf)
+            check_kdf((const char * const) conf.kdf, &kdf);
+        if (conf.argon2_t)
+            check_option(210, (const char * const) conf.argon2_t, &argon2_t);
+        if (conf.argon2_lanes)
+            check_option(211, (const char * const) conf.argon2_lanes, &argon2_lanes);
+        if (conf.cache_chain)
+            check_option(212, (const char * const) conf.cache_chain, &cache_chain);
+        if (conf.scheme)
+            check_option(213, (const char * const) conf.scheme, &scheme);
+        if (conf.db && db_file == NULL)
+            db_file = conf.db;
+    }
+
+    if (compile_db) {
+        if (!is_config)
+            die("option '--compile-db' requires '--config FILE'", 0, 1);
+        //invalid values fail now rather than when the site is used
+        for (i = 0; i < conf.nprofiles; i++) {
+            int profile_keylen = keylen, profile_cost = cost;
+            const char *profile_encoding = encoding;
+            apply_profile(&conf.profiles[i], &profile_keylen, &profile_cost,
+                          &profile_encoding);
+        }
+        if (sitedb_write(compile_db, conf.profiles, conf.nprofiles)) {
+            snprintf(error_msg, sizeof error_msg,
+                     "couldn't write site database '%s': %s", compile_db,
+                     strerror(errno));
+            die(error_msg, 0, 0);
         }
+        fprintf(stderr, "Compiled %zu site section(s) into '%s'\n",
+                conf.nprofiles, compile_db);
+        return 0;
     }
 
-    //initialize missing options
-    if (name == NULL)
-        if (tarsnap_readinput(&name, "Name", NULL, 1))
-            die("tarsnap_readinput() error.", 0, 0);
-    if (site == NULL)
-        if (tarsnap_readinput(&site, "Site", NULL, 1))
-            die("tarsnap_readinput() error.", 0, 0);
-    if (password == NULL) {
-        if (registration_mode) {
-            if (tarsnap_readpass(&password, "Master password", "repeat again", 1))
-                die("tarsnap_readpass() error.", 0, 0);
-        } else {
-            if (tarsnap_readpass(&password, "Master password", NULL, 1))
-                die("tarsnap_readpass() error.", 0, 0);
+    if (kdf == GENPASS_KDF_ARGON2ID) {
+        check_argon2_cost("-c", cost, argon2_lanes);
+        if (!single_function_derivation)
+            check_argon2_cost("-C", cache_cost, argon2_lanes);
+        if (!single_function_derivation && cache_chain)
+            check_argon2_cost("--cache-chain", cache_chain, argon2_lanes);
+    } else if (kdf == GENPASS_KDF_YESCRYPT) {
+        check_yescrypt_cost("-c", cost, scrypt_p);
+        if (!single_function_derivation)
+            check_yescrypt_cost("-C", cache_cost, scrypt_p);
+        if (!single_function_derivation && cache_chain)
+            check_yescrypt_cost("--cache-chain", cache_chain, scrypt_p);
+    }
+
+    //the chain can only grow from its base up to the cache cost
+    if (!single_function_derivation && cache_chain > cache_cost) {
+        snprintf(error_msg, sizeof error_msg,
+                 "option '--cache-chain' numerical value must not exceed the "
+                 "cache cost %d, '%d'", cache_cost, cache_chain);
+        die(error_msg, 0, 1);
+    }
+
+    if (stream_len && (kdf != GENPASS_KDF_SCRYPT || scheme != GENPASS_SCHEME_V1))
+        die("option '--stream' only supports '--kdf scrypt' and '--scheme 1'", 0, 1);
+    if (stream_len && nsites > 1)
+        die("option '--stream' takes a single site", 0, 1);
+    if (!stream_len && output_file)
+        die("option '--output' requires '--stream'", 0, 1);
+    if (!stream_len && strcmp(encoding, "raw") == 0)
+        die("encoding 'raw' requires '--stream'", 0, 1);
+
+    if (calibrate) {
+        if (kdf != GENPASS_KDF_SCRYPT)
+            die("option '--calibrate' only supports '--kdf scrypt'", 0, 1);
+        fprintf(stderr, "Calibrating, this takes a few seconds ...\n");
+        if (genpass_calibrate(cache_target, target, scrypt_r, scrypt_p,
+                              &calibration, genpass_log, &verbose_lvl)) {
+            snprintf(error_msg, sizeof error_msg,
+                     "genpass_calibrate() failed: %s", strerror(errno));
+            die(error_msg, 0, 0);
+        }
+        print_calibration(&calibration);
+        fflush(stdout);
+        if (calibration.cache.cost != (uint32_t) cache_cost ||
+            calibration.site.cost  != (uint32_t) cost)
+            fprintf(stderr, "Warning: new cost values change every generated "
+                            "password, update your accounts before using them\n");
+        if (is_config && !dry_run) {
+            if (save_calibration(config_file, &calibration)) {
+                snprintf(error_msg, sizeof error_msg,
+                         "couldn't save config file '%s': %s", config_file,
+                         strerror(errno));
+                die(error_msg, 0, 0);
+            }
+            fprintf(stderr, "Saved calibration to '%s'\n", config_file);
         }
+        return 0;
     }
 
     if (cache_file == NULL) {
@@ -451,141 +1310,174 @@ int main(const int argc, const char * const argv[]) {
         }
     }
 
-    //Scheme: https://www.cs.utexas.edu/~bwaters/publications/papers/www2005.pdf
-    //
-    //This scheme uses two levels of hash computations (although with the -1
-    //parameter it can use only one). The first level is executed once when a
-    //user begins to use a new machine for the first time. This computation is
-    //parameterized to take a relatively long time (around 60 seconds on this
-    //implementation) and its result are cached for future password
-    //calculations by the same user. The next level is used to compute
-    //site-specific passwords. It takes as input the calculation produced from
-    //the first level as well as the name of the site or account for which the
-    //user is interested in generating a password, the computation time is
-    //parameterized to be fast (around .1 seconds in our implementation).
-    //
-    //Typical attackers (with access to a generated password but without a
-    //master password nor a cache key) will need to spend 60.1 seconds on
-    //average per try and with little room for parallelization while legitimate
-    //users will require 0.1s. This way the scheme strives for the best balance
-    //between security and usability.
-    //
-    //The scheme has been updated to use a key derivation function specifically
-    //designed to be computationally intensive on CPU, RAM and custom hardware
-    //attacks, scrypt[0]. The original paper uses a sha1 iteration logarithm
-    //which can be parallelized and is fast on modern hardware[1](2010), fast
-    //is bad on key derived functions.
-    //
-    //[0] http://www.tarsnap.com/scrypt/scrypt.pdf
-    //[1] https://software.intel.com/en-us/articles/improving-the-performance-of-the-secure-hash-algorithm-1
-
-    cache_scrypt_n = _pow(2,cache_cost);
-    scrypt_n       = _pow(2,cost);
-
-    if (!single_function_derivation && !dry_run) {
-        fp = fopen(cache_file, "rb");
-        snprintf(verbose_msg, sizeof(verbose_msg), "Trying to open %s", cache_file);
-        verbose(verbose_msg, verbose_lvl);
-        if (fp!=NULL) {
-            verbose("File open, attempting to read cache key", verbose_lvl);
-
-            //probably it'll be a better to use a modular crypt format (mcf)
-            //when it's defined for scrypt
-            //http://mail.tarsnap.com/scrypt/msg00218.html
-
-            //basic attempt to find a valid key by size
-            fseek(fp, 0, SEEK_END);
-            if (ftell(fp) == (keylen*(cache_cost+scrypt_r+scrypt_p))) {
-                rewind(fp);
-                readbytes = 0; for (i = 0; i < (cache_cost+scrypt_r+scrypt_p); i++)
-                    readbytes = fread(cache_hashbuf,1,keylen,fp);
-                if (readbytes != keylen) {
-                    fprintf(stderr, "Warning: error while reading %s, ", cache_file);
-                    fprintf(stderr, "falling to --dry-mode ...\n");
-                    dry_run = 1;
-                } else {
-                    if (libscrypt_b64_encode_compliant(cache_hashbuf, keylen, \
-                        b64buf, sizeof(b64buf)) == -1) {
-                        snprintf(b64buf, sizeof(b64buf), "0");
-                    }
-                    verbose("Loaded valid cache key value", verbose_lvl);
-                    cache_hash_in_file = 1;
-                }
-            } else verbose("Invalid cache key value", verbose_lvl);
-            fclose(fp);
-        } else if (errno == ENOENT) verbose("No such file", verbose_lvl);
-        else verbose("Permission denied", verbose_lvl);
-    }
-
-    if (!single_function_derivation) {
-        if (libscrypt_b64_decode_compliant(b64buf, cache_hashbuf, keylen) <= 0) {
-            cache_hash_in_file = 0;
-            verbose("Generating new cache key ...", verbose_lvl);
-            if (libscrypt_scrypt((uint8_t *) password, (size_t) strlen(password), \
-                    (uint8_t *) name, (size_t) strlen(name), \
-                    cache_scrypt_n, scrypt_r, scrypt_p,      \
-                    cache_hashbuf, keylen))   {
-                snprintf(error_msg, sizeof error_msg,        \
-                    "libscrypt_scrypt() failed: %s", strerror(errno));
-                die(error_msg, 0, 0);
-            }
-        }
+    genpass_params_init(&params);
+    params.keylen     = keylen;
+    params.cache_cost = cache_cost;
+    params.cost       = cost;
+    params.scrypt_r   = scrypt_r;
+    params.scrypt_p   = scrypt_p;
+    params.threads    = threads;
+    params.single     = single_function_derivation;
+    params.kdf        = kdf;
+    params.argon2_t   = argon2_t;
+    params.argon2_lanes = argon2_lanes;
+    params.cache_chain  = cache_chain;
+    params.scheme       = scheme;
+
+    cache.file            = cache_file;
+    cache.flags           = GENPASS_CACHE_FILE;
+    cache.keyring_timeout = keyring_timeout;
+    if (use_keyring) cache.flags |= GENPASS_CACHE_KEYRING;
+    if (dry_run)     cache.flags |= GENPASS_CACHE_DRY_RUN;
+
+    if (warm) {
+        if (single_function_derivation)
+            die("option '--warm' has no cache key to compute with '--single'", 0, 1);
+        if (dry_run)
+            die("option '--warm' can't save cache keys with '--dry-run'", 0, 1);
+        timings_span("prompt", 1, NULL);
+        read_missing(&name, NULL, &password, name_fd, password_fd,
+                     registration_mode);
+        timings_span("prompt", 0, NULL);
+
+        if (db_file) db = open_db(db_file);
+        lower_priority();
+        warm_cache_keys(name, password, &params, &cache, &conf, db,
+                        warm_budget, &verbose_lvl);
+        sitedb_close(db);
+        return 0;
     }
 
-    if (!single_function_derivation && !dry_run && !cache_hash_in_file) {
-        snprintf(verbose_msg, sizeof(verbose_msg), \
-            "Attempting to save cache key to %s", cache_file);
-        verbose(verbose_msg, verbose_lvl);
-        fp = fopen(cache_file, "wb");
-        if (fp!=NULL) {
-            for (i = 0; i < (cache_cost+scrypt_r+scrypt_p); i++) {
-                if (fwrite(&cache_hashbuf, keylen, 1, fp) != 1) {
-                    fprintf(stderr, "Warning: error while writing %s, ", cache_file);
-                    fprintf(stderr, "falling to --dry-mode ...\n");
-                    dry_run = 1;
+    //initialize missing options
+    timings_span("prompt", 1, NULL);
+    read_missing(&name, &site, &password, name_fd, password_fd,
+                 registration_mode);
+    timings_span("prompt", 0, NULL);
+
+    if (db_file) db = open_db(db_file);
+
+    //several sites, a password per line in their order
+    if (nsites > 1) {
+        if ((ctxs = calloc(nsites, sizeof(*ctxs))) == NULL)
+            die("not enough memory.", 0, 0);
+        if (perf && perf_open(error_msg, sizeof error_msg) == 0) {
+            fprintf(stderr, "Warning: hardware counters unavailable, %s\n", error_msg);
+            perf = 0;
+        }
+        for (i = 0; i < nsites && retval == 0; i++) {
+            int site_keylen           = keylen;
+            int site_cost             = cost;
+            const char *site_encoding = encoding;
+            struct genpass_cache site_cache = cache;
+
+            site_values(db, &conf, sites[i], &site_keylen, &site_cost,
+                        &site_encoding, kdf, argon2_lanes, scrypt_p,
+                        verbose_lvl);
+            if (strcmp(site_encoding, "raw") == 0)
+                die("encoding 'raw' requires '--stream'", 0, 1);
+
+            for (j = 0; j < nctxs; j++)
+                if (ctxs[j].keylen == (size_t) site_keylen &&
+                    ctxs[j].cost   == (uint32_t) site_cost)
                     break;
+            if (j == nctxs) {
+                params.keylen   = site_keylen;
+                params.cost     = site_cost;
+                site_cache.file = site_cache_file(cache.file, scheme, keylen,
+                                                  cost, site_keylen, site_cost,
+                                                  site_file, sizeof site_file);
+                if ((ctxs[j].ctx = genpass_ctx_new(name, password, &params,
+                                                   &site_cache)) == NULL) {
+                    snprintf(error_msg, sizeof error_msg, \
+                        "genpass_ctx_new() failed: %s", strerror(errno));
+                    die(error_msg, 0, 0);
                 }
+                genpass_ctx_set_log(ctxs[j].ctx, genpass_log, &verbose_lvl);
+                genpass_ctx_set_span(ctxs[j].ctx, stage_span, NULL);
+                ctxs[j].keylen = params.keylen;
+                ctxs[j].cost   = params.cost;
+                nctxs++;
             }
-            fclose(fp);
-            cache_hash_in_file = 1;
-        } else verbose("Permission denied", verbose_lvl);
-    }
-
-    if (single_function_derivation) {
-        verbose("Generating single derived key ...", verbose_lvl);
-        snprintf(mix_name_site, sizeof(mix_name_site), "%s%s", name, site);
-        name = mix_name_site;
-    } else {
-        if (libscrypt_b64_encode_compliant(cache_hashbuf, keylen, b64buf, sizeof(b64buf)) == -1) {
-            snprintf(error_msg, sizeof error_msg, \
-                "libscrypt_b64_encode_compliant() failed: %s", strerror(errno));
+
+            retval = genpass_derive(ctxs[j].ctx, sites[i], site_encoding,
+                                    b64buf, GENPASS_ENCODED_LEN_MAX);
+            derive_errno = errno;
+            if (retval == 0) fprintf(stdout, "%s\n", b64buf);
+            else encoding = site_encoding;
+        }
+        for (j = 0; j < nctxs; j++) genpass_ctx_free(ctxs[j].ctx);
+        free(ctxs);
+        sitedb_close(db);
+
+        die_derive(retval, derive_errno, kdf, encoding, NULL);
+
+        print_stats(timings, perf, stats_file);
+        return 0;
+    }
+
+    site_values(db, &conf, site, &keylen, &cost, &encoding, kdf,
+                argon2_lanes, scrypt_p, verbose_lvl);
+    if (!stream_len && strcmp(encoding, "raw") == 0)
+        die("encoding 'raw' requires '--stream'", 0, 1);
+    sitedb_close(db);
+    cache.file    = site_cache_file(cache.file, scheme, (int) params.keylen,
+                                    (int) params.cost, keylen, cost,
+                                    site_file, sizeof site_file);
+    params.keylen = keylen;
+    params.cost   = cost;
+
+    //before the kdf, a bad path shouldn't cost a derivation
+    if (output_file) {
+        if ((output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC |
+                              O_CLOEXEC, 0600)) == -1) {
+            snprintf(error_msg, sizeof error_msg, "couldn't open '%s': %s",
+                     output_file, strerror(errno));
             die(error_msg, 0, 0);
         }
-        snprintf(verbose_msg, sizeof(verbose_msg), "Cache key: %s", b64buf);
-        verbose(verbose_msg, verbose_lvl);
-        verbose("Generating double derived key ...", verbose_lvl);
-        snprintf(mix_name_site, sizeof(mix_name_site), "%s%s%s", cache_hashbuf, site, name);
-        name = mix_name_site;
+    } else if (stream_len && strcmp(encoding, "raw") == 0 &&
+               isatty(STDOUT_FILENO)) {
+        die("refusing to write raw key material to a terminal, use "
+            "'--output FILE'", 0, 0);
     }
 
-    if (libscrypt_scrypt((uint8_t *) password, (size_t) strlen(password), \
-            (uint8_t *) name, (size_t) strlen(name), \
-            scrypt_n, scrypt_r, scrypt_p, hashbuf, keylen)) {
+    if ((ctx = genpass_ctx_new(name, password, &params, &cache)) == NULL) {
         snprintf(error_msg, sizeof error_msg, \
-            "libscrypt_scrypt() failed: %s", strerror(errno));
+            "genpass_ctx_new() failed: %s", strerror(errno));
         die(error_msg, 0, 0);
     }
+    genpass_ctx_set_log(ctx, genpass_log, &verbose_lvl);
+    genpass_ctx_set_span(ctx, stage_span, NULL);
 
-    zerostring(name);
-    zerostring(site);
-    zerostring(password);
+    if (perf && perf_open(error_msg, sizeof error_msg) == 0) {
+        fprintf(stderr, "Warning: hardware counters unavailable, %s\n", error_msg);
+        perf = 0;
+    }
 
-    if (encode(encoding, hashbuf, keylen, b64buf, sizeof(b64buf)) == -1) {
-        snprintf(error_msg, sizeof error_msg, \
-            "encode(%s) failed: %s", encoding, strerror(errno));
-        die(error_msg, 0, 0);
+    if (stream_len) {
+        retval = genpass_derive_stream(ctx, site,
+                     strcmp(encoding, "raw") == 0 ? NULL : encoding,
+                     stream_len, write_stream, &output_fd);
+        //the text ends as the regular output does
+        if (retval == 0 && strcmp(encoding, "raw") != 0 &&
+            write_stream("\n", 1, &output_fd))
+            retval = GENPASS_ERR_OUTPUT;
+    } else
+        retval = genpass_derive(ctx, site, encoding, b64buf, GENPASS_ENCODED_LEN_MAX);
+    derive_errno = errno;
+    genpass_ctx_free(ctx);
+
+    if (output_file && (retval || close(output_fd))) {
+        if (retval == 0) {
+            retval       = GENPASS_ERR_OUTPUT;
+            derive_errno = errno;
+        }
+        unlink(output_file);
     }
 
-    fprintf(stdout, "%s\n", b64buf);
+    die_derive(retval, derive_errno, kdf, encoding, output_file);
+
+    if (!stream_len) fprintf(stdout, "%s\n", b64buf);
+
+    print_stats(timings, perf, stats_file);
     return 0;
 }
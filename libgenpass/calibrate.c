@@ -0,0 +1,252 @@
+//calibrate: pick scrypt costs for a target latency on this host
+//
+//The default costs are hand-picked constants which get outdated as
+//hardware changes. Here the host is measured instead:
+//
+// - BlockMix_salsa20/8 throughput, running smix with a cache resident V
+// - memory copy bandwidth and available RAM
+// - short probe derivations with all the lane threads running at once,
+//   large enough to be memory bound as the real derivations are
+//
+//smix time is linear in N once V is out of the caches, so a level takes
+//ceil(p / threads) * probe * 2^(cost - probe_cost) seconds. The largest cost
+//under the target is picked, the second level is confirmed with a real
+//derivation.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libscrypt/libscrypt.h"
+#include "libgenpass.h"
+
+#define PROBE_COST        16 //64MiB per lane with r = 8
+#define BLOCKMIX_COST      8 //256KiB per lane with r = 8, fits in L2
+#define MEMBW_SIZE        (64 * 1024 * 1024)
+#define MIN_SAMPLE_TIME   0.2
+
+struct probe {
+    uint32_t threads;
+    uint32_t cost;
+    double   seconds; //one round of `threads' lanes running at once
+};
+
+static void logmsg(genpass_log_fn log, void *arg, const char *msg) {
+    if (log && msg && msg[0]) log(GENPASS_LOG_VERBOSE, msg, arg);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t genpass_ram_available(void) {
+    char line[128];
+    unsigned long long kb = 0;
+    FILE *fp              = NULL;
+
+    if ((fp = fopen("/proc/meminfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), fp))
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1)
+                break;
+        fclose(fp);
+        if (kb) return (uint64_t) kb * 1024;
+    }
+#ifdef _SC_AVPHYS_PAGES
+    return (uint64_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+#else
+    return (uint64_t) 1 << 30;
+#endif
+}
+
+static uint64_t lane_memory(const uint32_t r, const uint32_t cost) {
+    return (uint64_t) 128 * r << cost;
+}
+
+static double time_derive(const uint32_t cost, const uint32_t r,
+                          const uint32_t p, const uint32_t threads) {
+    uint8_t buf[GENPASS_HASH_LEN];
+    double start = now();
+
+    if (libscrypt_scrypt_mt((const uint8_t *) "calibrate", 9,
+            (const uint8_t *) "genpass", 7, (uint64_t) 1 << cost, r,
+            p, threads, buf, sizeof(buf)))
+        return -1;
+    return now() - start;
+}
+
+static double blockmix_throughput(const uint32_t r) {
+    double elapsed = 0, t;
+    uint64_t rounds = 0;
+
+    //smix runs 2N BlockMix over 128r bytes, V stays in the cache
+    while (elapsed < MIN_SAMPLE_TIME) {
+        if ((t = time_derive(BLOCKMIX_COST, r, 1, 1)) < 0) return -1;
+        elapsed += t;
+        rounds++;
+    }
+    return (double) rounds * 2 * ((uint64_t) 1 << BLOCKMIX_COST) * 128 * r /
+           elapsed / 1e6;
+}
+
+static double memory_bandwidth(void) {
+    double start, elapsed = 0;
+    uint64_t copies = 0;
+    char *src = NULL, *dst = NULL;
+
+    if ((src = malloc(MEMBW_SIZE)) == NULL ||
+        (dst = malloc(MEMBW_SIZE)) == NULL) {
+        free(src);
+        return -1;
+    }
+    memset(src, 0x5c, MEMBW_SIZE);
+    memset(dst, 0x36, MEMBW_SIZE);
+
+    start = now();
+    while (elapsed < MIN_SAMPLE_TIME) {
+        memcpy(dst, src, MEMBW_SIZE);
+        src[copies % MEMBW_SIZE] = dst[(copies * 4099) % MEMBW_SIZE];
+        copies++;
+        elapsed = now() - start;
+    }
+    free(src);
+    free(dst);
+    return (double) copies * MEMBW_SIZE / elapsed / 1e6;
+}
+
+//fewest rounds of lanes first, then the fewest threads for those rounds
+static uint32_t best_threads(const uint32_t p, const int ncpu) {
+    uint32_t cpus   = ncpu > 0 ? (uint32_t) ncpu : 1;
+    uint32_t rounds = 0;
+
+    if (cpus > GENPASS_SAFE_THREADS) cpus = GENPASS_SAFE_THREADS;
+    if (cpus > p) cpus = p;
+    rounds = (p + cpus - 1) / cpus;
+    return (p + rounds - 1) / rounds;
+}
+
+//time one round, p == threads so every thread runs exactly one lane
+static double probe_round(struct probe *probes, const uint32_t threads,
+                          const uint32_t r, const uint64_t budget,
+                          genpass_log_fn log, void *arg) {
+    char msg[128];
+    uint32_t cost = PROBE_COST;
+
+    if (probes[threads].seconds > 0) return probes[threads].seconds;
+
+    while (cost > BLOCKMIX_COST && threads * lane_memory(r, cost) > budget)
+        cost--;
+    snprintf(msg, sizeof(msg), "Probing N = 2^%u with %u thread(s) ...",
+             cost, threads);
+    logmsg(log, arg, msg);
+
+    probes[threads].threads = threads;
+    probes[threads].cost    = cost;
+    probes[threads].seconds = time_derive(cost, r, threads, threads);
+    return probes[threads].seconds;
+}
+
+static int calibrate_level(struct genpass_level *level, const double target,
+                           const uint32_t r, const uint32_t p,
+                           const struct genpass_host *host,
+                           const uint64_t budget, struct probe *probes,
+                           genpass_log_fn log, void *arg) {
+    uint32_t cost, threads, rounds;
+    double   round, estimated;
+
+    memset(level, 0, sizeof(*level));
+    level->target = target;
+
+    for (cost = 1; cost <= GENPASS_SAFE_N; cost++) {
+        if (lane_memory(r, cost) > budget) break;
+
+        threads = best_threads(p, host->ncpu);
+        while (threads > 1 && threads * lane_memory(r, cost) > budget)
+            threads--;
+        rounds = (p + threads - 1) / threads;
+
+        if ((round = probe_round(probes, threads, r, budget, log, arg)) < 0)
+            return -1;
+        if (cost >= probes[threads].cost)
+            estimated = rounds * round *
+                        (double) ((uint64_t) 1 << (cost - probes[threads].cost));
+        else
+            estimated = rounds * round /
+                        (double) ((uint64_t) 1 << (probes[threads].cost - cost));
+
+        if (cost > 1 && estimated > target) break;
+
+        level->cost      = cost;
+        level->threads   = threads;
+        level->memory    = threads * lane_memory(r, cost);
+        level->estimated = estimated;
+    }
+    return 0;
+}
+
+int genpass_calibrate(double cache_target, double target, uint32_t scrypt_r,
+                      uint32_t scrypt_p, struct genpass_calibration *cal,
+                      genpass_log_fn log, void *arg) {
+    struct probe *probes = NULL;
+    struct genpass_level *site;
+    uint64_t budget;
+    char msg[128];
+    double t;
+
+    if (!cal || scrypt_r == 0 || scrypt_p == 0 ||
+        cache_target <= 0 || target <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(cal, 0, sizeof(*cal));
+    cal->scrypt_r = scrypt_r;
+    cal->scrypt_p = scrypt_p;
+
+    cal->host.ncpu      = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (cal->host.ncpu < 1) cal->host.ncpu = 1;
+    cal->host.ram_avail = genpass_ram_available();
+    cal->host.kernel    = "portable C";
+    budget              = cal->host.ram_avail / 2;
+
+    logmsg(log, arg, "Measuring BlockMix_salsa20/8 throughput ...");
+    if ((cal->host.blockmix_mbs = blockmix_throughput(scrypt_r)) < 0)
+        return -1;
+    logmsg(log, arg, "Measuring memory bandwidth ...");
+    if ((cal->host.membw_mbs = memory_bandwidth()) < 0)
+        return -1;
+
+    if ((probes = calloc(GENPASS_SAFE_THREADS + 1, sizeof(*probes))) == NULL)
+        return -1;
+    if (calibrate_level(&cal->cache, cache_target, scrypt_r, scrypt_p,
+                        &cal->host, budget, probes, log, arg) ||
+        calibrate_level(&cal->site, target, scrypt_r, scrypt_p,
+                        &cal->host, budget, probes, log, arg)) {
+        free(probes);
+        return -1;
+    }
+    free(probes);
+
+    //the second level is cheap enough to be confirmed, step down while a
+    //real derivation misses the target
+    site = &cal->site;
+    while (site->cost > 0) {
+        snprintf(msg, sizeof(msg), "Confirming N = 2^%u with %u thread(s) ...",
+                 site->cost, site->threads);
+        logmsg(log, arg, msg);
+        if ((t = time_derive(site->cost, scrypt_r, scrypt_p,
+                             site->threads)) < 0)
+            return -1;
+        site->measured = t;
+        if (site->measured <= target || site->cost == 1) break;
+        site->cost--;
+        site->memory    /= 2;
+        site->estimated /= 2;
+    }
+
+    return 0;
+}
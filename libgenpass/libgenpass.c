@@ -0,0 +1,1144 @@
+//libgenpass: two level stateless password derivation
+//
+//Scheme: https://www.cs.utexas.edu/~bwaters/publications/papers/www2005.pdf
+//
+//This scheme uses two levels of hash computations (although with the -1
+//parameter it can use only one). The first level is executed once when a
+//user begins to use a new machine for the first time. This computation is
+//parameterized to take a relatively long time (around 60 seconds on this
+//implementation) and its result are cached for future password
+//calculations by the same user. The next level is used to compute
+//site-specific passwords. It takes as input the calculation produced from
+//the first level as well as the name of the site or account for which the
+//user is interested in generating a password, the computation time is
+//parameterized to be fast (around .1 seconds in our implementation).
+//
+//Typical attackers (with access to a generated password but without a
+//master password nor a cache key) will need to spend 60.1 seconds on
+//average per try and with little room for parallelization while legitimate
+//users will require 0.1s. This way the scheme strives for the best balance
+//between security and usability.
+//
+//The scheme has been updated to use a key derivation function specifically
+//designed to be computationally intensive on CPU, RAM and custom hardware
+//attacks, scrypt[0]. The original paper uses a sha1 iteration logarithm
+//which can be parallelized and is fast on modern hardware[1](2010), fast
+//is bad on key derived functions.
+//
+//[0] http://www.tarsnap.com/scrypt/scrypt.pdf
+//[1] https://software.intel.com/en-us/articles/improving-the-performance-of-the-secure-hash-algorithm-1
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/keyctl.h>
+#endif
+
+#include "../libscrypt/libscrypt.h"
+#include "../libscrypt/libscrypt-sdt.h"
+#include "../libscrypt/sha256.h"
+#include "../encoders/encoders.h"
+#include "../argon2/argon2.h"
+#include "libgenpass.h"
+
+#define CACHE_PATH_MAX  256
+#define CACHE_HEADER_MAX 96
+//argon2id wants 8+ byte salts, names may be shorter
+#define ARGON2_SALT_PREFIX "genpass:"
+//scheme 2 domain separation, the root kdf salt prefix and the HKDF salt
+#define ROOT_SALT_PREFIX   "genpass:root:"
+#define HKDF_SALT          "genpass:v2"
+#define HKDF_PRK_LEN       32
+
+//usdt:genpass:* probes, see ../libscrypt/libscrypt-sdt.h, the first
+//argument of cache_hit and cache_write is the cache source
+#define GENPASS_PROBE1(name, a1)     LIBSCRYPT_PROBE1(genpass, name, a1)
+#define GENPASS_PROBE2(name, a1, a2) LIBSCRYPT_PROBE2(genpass, name, a1, a2)
+#define PROBE_CACHE_FILE    1
+#define PROBE_CACHE_KEYRING 2
+//kept from the original genpass main(), longer name + site input is
+//truncated, changing it would change the generated passwords
+#define MIX_NAME_SITE_LEN 2032
+
+struct genpass_ctx {
+    char *name;
+    char *password;
+    struct genpass_params params;
+    char cache_file[CACHE_PATH_MAX];
+    int  cache_flags;
+    int  keyring_timeout;
+    genpass_log_fn log;
+    void *log_arg;
+    genpass_span_fn span;
+    void *span_arg;
+    pthread_mutex_t lock;
+    int  loaded;
+    int  selftest;        //self-test result of the selected kdf
+    int  selftest_warned;
+    uint8_t cache_key[GENPASS_HASH_LEN_MAX + 1]; //NUL terminated, see derive
+    uint8_t root_prk[HKDF_PRK_LEN];              //scheme 2, HKDF-Extract(root)
+};
+
+//the kernels are checked once per process, before the first context can
+//derive anything
+static pthread_once_t selftest_once = PTHREAD_ONCE_INIT;
+static int selftest_result;
+static int argon2_selftest_result;
+static int yescrypt_selftest_result;
+static int hkdf_selftest_result;
+
+static void zero(void *s, size_t len) {
+    volatile unsigned char *p = s;
+    while (len--) *p++ = 0;
+}
+
+static void *heap_alloc(size_t len) {
+    return calloc(1, len);
+}
+
+static void heap_release(void *p, size_t len) {
+    (void) len;
+    free(p);
+}
+
+//the contexts, name and password included, see genpass_set_allocator()
+static genpass_alloc_fn   ctx_alloc   = heap_alloc;
+static genpass_release_fn ctx_release = heap_release;
+
+void genpass_set_allocator(genpass_alloc_fn alloc, genpass_release_fn release) {
+    ctx_alloc   = alloc ? alloc   : heap_alloc;
+    ctx_release = alloc ? release : heap_release;
+}
+
+static char *ctx_strdup(const char *s) {
+    const size_t len = strlen(s) + 1;
+    char *p;
+
+    if ((p = ctx_alloc(len)) != NULL) memcpy(p, s, len);
+    return p;
+}
+
+static void ctx_free(void *p, size_t len) {
+    zero(p, len);
+    if (ctx_release) ctx_release(p, len);
+}
+
+//HKDF-Extract (RFC 5869) with HMAC-SHA256
+static void hkdf_extract(const uint8_t *salt, const size_t saltlen,
+                         const uint8_t *ikm, const size_t ikmlen,
+                         uint8_t prk[HKDF_PRK_LEN]) {
+    HMAC_SHA256_CTX hctx;
+
+    libscrypt_HMAC_SHA256_Init(&hctx, salt, saltlen);
+    libscrypt_HMAC_SHA256_Update(&hctx, ikm, ikmlen);
+    libscrypt_HMAC_SHA256_Final(prk, &hctx);
+    zero(&hctx, sizeof(hctx));
+}
+
+//HKDF-Expand (RFC 5869) with HMAC-SHA256, outlen is at most 255 * 32 bytes
+static void hkdf_expand(const uint8_t prk[HKDF_PRK_LEN], const uint8_t *info,
+                        const size_t infolen, uint8_t *out, const size_t outlen) {
+    HMAC_SHA256_CTX hctx;
+    uint8_t t[HKDF_PRK_LEN];
+    uint8_t counter;
+    size_t  n, done = 0;
+
+    for (counter = 1; done < outlen; counter++) {
+        libscrypt_HMAC_SHA256_Init(&hctx, prk, HKDF_PRK_LEN);
+        if (counter > 1) libscrypt_HMAC_SHA256_Update(&hctx, t, sizeof(t));
+        libscrypt_HMAC_SHA256_Update(&hctx, info, infolen);
+        libscrypt_HMAC_SHA256_Update(&hctx, &counter, 1);
+        libscrypt_HMAC_SHA256_Final(t, &hctx);
+        n = outlen - done < sizeof(t) ? outlen - done : sizeof(t);
+        memcpy(out + done, t, n);
+        done += n;
+    }
+
+    zero(&hctx, sizeof(hctx));
+    zero(t, sizeof(t));
+}
+
+//RFC 5869 test case 1, returns 0 if it matches, -1 otherwise
+static int hkdf_selftest(void) {
+    const uint8_t expected[42] = {
+        0x3c, 0xb2, 0x5f, 0x25, 0xfa, 0xac, 0xd5, 0x7a, 0x90, 0x43, 0x4f,
+        0x64, 0xd0, 0x36, 0x2f, 0x2a, 0x2d, 0x2d, 0x0a, 0x90, 0xcf, 0x1a,
+        0x5a, 0x4c, 0x5d, 0xb0, 0x2d, 0x56, 0xec, 0xc4, 0xc5, 0xbf, 0x34,
+        0x00, 0x72, 0x08, 0xd5, 0xb8, 0x87, 0x18, 0x58, 0x65 };
+    uint8_t ikm[22], salt[13], info[10], prk[HKDF_PRK_LEN], okm[42];
+    size_t i;
+
+    memset(ikm, 0x0b, sizeof(ikm));
+    for (i = 0; i < sizeof(salt); i++) salt[i] = (uint8_t) i;
+    for (i = 0; i < sizeof(info); i++) info[i] = (uint8_t) (0xf0 + i);
+    hkdf_extract(salt, sizeof(salt), ikm, sizeof(ikm), prk);
+    hkdf_expand(prk, info, sizeof(info), okm, sizeof(okm));
+    return memcmp(okm, expected, sizeof(okm)) == 0 ? 0 : -1;
+}
+
+static void selftest(void) {
+    selftest_result          = libscrypt_selftest();
+    argon2_selftest_result   = argon2_selftest();
+    yescrypt_selftest_result = libscrypt_yescrypt_selftest();
+    hkdf_selftest_result     = hkdf_selftest();
+}
+
+static void logmsg(const genpass_ctx *ctx, const int level, const char *msg) {
+    if (ctx->log && msg && msg[0]) ctx->log(level, msg, ctx->log_arg);
+}
+
+static void span(const genpass_ctx *ctx, const char *name, const int begin) {
+    if (ctx->span) ctx->span(name, begin, ctx->span_arg);
+}
+
+static void scrypt_hook(int event, void *arg) {
+    const genpass_ctx *ctx = arg;
+    switch (event) {
+        case LIBSCRYPT_EV_PBKDF2_BEGIN: span(ctx, "pbkdf2", 1); break;
+        case LIBSCRYPT_EV_PBKDF2_END:   span(ctx, "pbkdf2", 0); break;
+        case LIBSCRYPT_EV_SMIX_BEGIN:   span(ctx, "smix",   1); break;
+        case LIBSCRYPT_EV_SMIX_END:     span(ctx, "smix",   0); break;
+        case LIBSCRYPT_EV_SMIX_FILL_BEGIN: span(ctx, "smix-fill", 1); break;
+        case LIBSCRYPT_EV_SMIX_FILL_END:   span(ctx, "smix-fill", 0); break;
+        case LIBSCRYPT_EV_SMIX_MIX_BEGIN:  span(ctx, "smix-mix",  1); break;
+        case LIBSCRYPT_EV_SMIX_MIX_END:    span(ctx, "smix-mix",  0); break;
+    }
+}
+
+static uint64_t _pow(const unsigned int a, const unsigned int b) {
+    unsigned int i;
+    uint64_t pow = 1;
+    for (i = 0; i < b; i++)
+        pow *= a;
+    return pow;
+}
+
+//argon2id(passwd, "genpass:" salt, 2^cost KiB)
+static int kdf_argon2id(const genpass_ctx *ctx, const uint8_t *passwd,
+                        const size_t passwdlen, const char *salt,
+                        const uint32_t cost, uint8_t *out, const size_t outlen) {
+    const size_t prefixlen = strlen(ARGON2_SALT_PREFIX);
+    const size_t saltlen   = prefixlen + strlen(salt);
+    struct argon2_params params;
+    uint8_t *prefixed      = NULL;
+    int retval;
+
+    if ((prefixed = malloc(saltlen)) == NULL) return -1;
+    memcpy(prefixed, ARGON2_SALT_PREFIX, prefixlen);
+    memcpy(prefixed + prefixlen, salt, saltlen - prefixlen);
+
+    memset(&params, 0, sizeof(params));
+    params.t_cost  = ctx->params.argon2_t;
+    params.m_cost  = (uint32_t) _pow(2, cost);
+    params.lanes   = ctx->params.argon2_lanes;
+    params.threads = ctx->params.threads;
+    retval = argon2id(&params, passwd, passwdlen, prefixed, saltlen, out, outlen);
+
+    zero(prefixed, saltlen);
+    free(prefixed);
+    return retval;
+}
+
+//scrypt(passwd, salt, 2^cost), yescrypt or argon2id into out, reported as
+//the name stage
+static int kdf_passwd(const genpass_ctx *ctx, const char *name,
+                      const uint8_t *passwd, const size_t passwdlen,
+                      const char *salt, const uint32_t cost, uint8_t *out,
+                      const size_t outlen) {
+    int retval;
+
+    span(ctx, name, 1);
+    if (ctx->params.kdf == GENPASS_KDF_ARGON2ID)
+        retval = kdf_argon2id(ctx, passwd, passwdlen, salt, cost, out, outlen);
+    else if (ctx->params.kdf == GENPASS_KDF_YESCRYPT)
+        retval = libscrypt_yescrypt(passwd, passwdlen,
+                     (uint8_t *) salt, strlen(salt), _pow(2, cost),
+                     ctx->params.scrypt_r, ctx->params.scrypt_p, 0,
+                     LIBSCRYPT_YESCRYPT_DEFAULTS, ctx->params.threads, out, outlen);
+    else {
+        if (ctx->span) libscrypt_set_hook(scrypt_hook, (void *) ctx);
+        retval = libscrypt_scrypt_mt(passwd, passwdlen, \
+                     (uint8_t *) salt, strlen(salt), _pow(2, cost), \
+                     ctx->params.scrypt_r, ctx->params.scrypt_p, \
+                     ctx->params.threads, out, outlen);
+        if (ctx->span) libscrypt_set_hook(NULL, NULL);
+    }
+    span(ctx, name, 0);
+
+    return retval;
+}
+
+//kdf_passwd() with the master password
+static int kdf(const genpass_ctx *ctx, const char *name, const char *salt,
+               const uint32_t cost, uint8_t *out, const size_t outlen) {
+    return kdf_passwd(ctx, name, (const uint8_t *) ctx->password,
+                      strlen(ctx->password), salt, cost, out, outlen);
+}
+
+//hash chained cache key, key_i = kdf(key_i-1, name, i) for i in (from, to],
+//so a key stored at a lower cost is strengthened by paying only the missing
+//steps. key_base itself is the plain kdf(password, name, base) cache key
+static int kdf_chain(const genpass_ctx *ctx, uint8_t *key, const uint32_t from,
+                     const uint32_t to) {
+    char verbose_msg[64]                 = {0};
+    uint8_t next[GENPASS_HASH_LEN_MAX]   = {0};
+    const size_t keylen                  = ctx->params.keylen;
+    uint32_t i;
+    int retval                           = 0;
+
+    for (i = from + 1; i <= to && retval == 0; i++) {
+        snprintf(verbose_msg, sizeof(verbose_msg),
+                 "Strengthening cache key to cost %u ...", i);
+        logmsg(ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+        if ((retval = kdf_passwd(ctx, "kdf-chain", key, keylen, ctx->name, i,
+                                 next, keylen)) == 0)
+            memcpy(key, next, keylen);
+    }
+
+    zero(next, sizeof(next));
+    return retval;
+}
+
+void genpass_params_init(struct genpass_params *params) {
+    params->keylen     = GENPASS_HASH_LEN;
+    params->cache_cost = GENPASS_CACHE_COST;
+    params->cost       = GENPASS_COST;
+    params->scrypt_r   = GENPASS_r;
+    params->scrypt_p   = GENPASS_p;
+    params->threads    = GENPASS_THREADS;
+    params->single     = 0;
+    params->kdf        = GENPASS_KDF_SCRYPT;
+    params->argon2_t   = GENPASS_ARGON2_T;
+    params->argon2_lanes = GENPASS_ARGON2_LANES;
+    params->cache_chain  = 0;
+    params->scheme       = GENPASS_SCHEME;
+}
+
+//the kdf and its cost independent parameters, "scrypt$r=R,p=P",
+//"yescrypt$r=R,p=P" or "argon2id$v=19,t=T,p=LANES"
+static void kdf_params(const genpass_ctx *ctx, char *params, const size_t paramslen) {
+    if (ctx->params.kdf == GENPASS_KDF_ARGON2ID)
+        snprintf(params, paramslen, "argon2id$v=%d,t=%u,p=%u", ARGON2_VERSION,
+                 ctx->params.argon2_t, ctx->params.argon2_lanes);
+    else
+        snprintf(params, paramslen, "%s$r=%u,p=%u",
+                 ctx->params.kdf == GENPASS_KDF_YESCRYPT ? "yescrypt" : "scrypt",
+                 ctx->params.scrypt_r, ctx->params.scrypt_p);
+}
+
+//scrypt cache files are the key repeated cache_cost + r + p times, so the
+//parameters are told apart by size. argon2id and yescrypt ones start with a
+//PHC style header line instead, "$argon2id$v=19$m=KiB,t=T,p=LANES$KEYLEN" or
+//"$yescrypt$N=N,r=R,p=P$KEYLEN", followed by the key. Chained keys record
+//the chain base and the cost reached, "$chain$b=BASE,c=COST$<kdf params>$KEYLEN".
+//Returns the header length, 0 for plain scrypt
+static size_t cache_header(const genpass_ctx *ctx, const uint32_t cost,
+                           const int chain, char *header, const size_t headerlen) {
+    char params[48] = {0};
+
+    header[0] = '\0';
+    if (chain) {
+        kdf_params(ctx, params, sizeof(params));
+        return (size_t) snprintf(header, headerlen, "$chain$b=%u,c=%u$%s$%zu\n",
+                                 ctx->params.cache_chain, cost, params,
+                                 ctx->params.keylen);
+    }
+    if (ctx->params.kdf == GENPASS_KDF_YESCRYPT)
+        return (size_t) snprintf(header, headerlen, "$yescrypt$N=%llu,r=%u,p=%u$%zu\n",
+                                 (unsigned long long) _pow(2, cost),
+                                 ctx->params.scrypt_r, ctx->params.scrypt_p,
+                                 ctx->params.keylen);
+    if (ctx->params.kdf != GENPASS_KDF_ARGON2ID) return 0;
+    return (size_t) snprintf(header, headerlen, "$argon2id$v=%d$m=%llu,t=%u,p=%u$%zu\n",
+                             ARGON2_VERSION, (unsigned long long) _pow(2, cost),
+                             ctx->params.argon2_t, ctx->params.argon2_lanes,
+                             ctx->params.keylen);
+}
+
+//how many copies of the key follow the header
+static int cache_records(const genpass_ctx *ctx, const uint32_t cost,
+                         const int chain) {
+    if (chain || ctx->params.kdf != GENPASS_KDF_SCRYPT) return 1;
+    return cost + ctx->params.scrypt_r + ctx->params.scrypt_p;
+}
+
+const char *genpass_encoding(const char *name) {
+    const struct encoder *e = encoder_find(name);
+    return e ? e->name : NULL;
+}
+
+int genpass_encode(const char *encoding, const uint8_t *src, size_t srclength,
+                   char *target, size_t targsize) {
+    const struct encoder *e = encoder_find(encoding);
+
+    GENPASS_PROBE2(encode, encoding, srclength);
+    if (e == NULL || targsize < e->bound(srclength))
+        return -1;
+    return e->encode(src, srclength, target, targsize);
+}
+
+//returns 1 on a valid cache key, 0 if missing or invalid, -1 on read errors.
+//cost is set to the cost of the loaded key, with chaining it's anything from
+//the chain base (a plain cache key) up to cache_cost
+static int read_cache_key(const genpass_ctx *ctx, uint8_t *cache_hashbuf,
+                          uint32_t *cost, const int quiet) {
+    char verbose_msg[CACHE_PATH_MAX + 32] = {0};
+    char header[CACHE_HEADER_MAX]         = {0};
+    char file_header[CACHE_HEADER_MAX]    = {0};
+    const genpass_ctx *log_ctx            = quiet ? NULL : ctx;
+    const long keylen                     = (long) ctx->params.keylen;
+    const uint32_t base                   = ctx->params.cache_chain;
+    uint32_t file_base                    = 0;
+    uint32_t file_cost                    = 0;
+    FILE *fp                              = NULL;
+    long i, headerlen, readbytes          = 0;
+    int  chain                            = 0;
+    int  status                           = 0;
+
+    *cost = base ? base : ctx->params.cache_cost;
+    fp = fopen(ctx->cache_file, "rb");
+    snprintf(verbose_msg, sizeof(verbose_msg), "Trying to open %s", ctx->cache_file);
+    if (log_ctx) logmsg(log_ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+    if (fp!=NULL) {
+        if (log_ctx)
+            logmsg(log_ctx, GENPASS_LOG_VERBOSE, "File open, attempting to read cache key");
+
+        //probably it'll be a better to use a modular crypt format (mcf)
+        //when it's defined for scrypt
+        //http://mail.tarsnap.com/scrypt/msg00218.html
+
+        //a chained key of the same base can be strengthened, anything else
+        //is tried as the plain key at the base cost
+        if (base && fgets(file_header, sizeof(file_header), fp) != NULL &&
+            sscanf(file_header, "$chain$b=%u,c=%u$", &file_base, &file_cost) == 2 &&
+            file_base == base && file_cost >= base &&
+            file_cost <= ctx->params.cache_cost) {
+            chain = 1;
+            *cost = file_cost;
+        }
+        headerlen = (long) cache_header(ctx, *cost, chain, header, sizeof(header));
+
+        //basic attempt to find a valid key by size (and header)
+        fseek(fp, 0, SEEK_END);
+        if (ftell(fp) == (headerlen + keylen*cache_records(ctx, *cost, chain))) {
+            rewind(fp);
+            if (headerlen && (fread(file_header, 1, headerlen, fp) != (size_t) headerlen ||
+                              memcmp(file_header, header, headerlen) != 0)) {
+                if (log_ctx) logmsg(log_ctx, GENPASS_LOG_VERBOSE, "Invalid cache key header");
+                fclose(fp);
+                return 0;
+            }
+            for (i = 0; i < cache_records(ctx, *cost, chain); i++)
+                readbytes = fread(cache_hashbuf,1,keylen,fp);
+            if (readbytes != keylen) status = -1;
+            else {
+                if (log_ctx)
+                    logmsg(log_ctx, GENPASS_LOG_VERBOSE, "Loaded valid cache key value");
+                status = 1;
+            }
+        } else if (log_ctx) logmsg(log_ctx, GENPASS_LOG_VERBOSE, "Invalid cache key value");
+        fclose(fp);
+    } else if (log_ctx) {
+        if (errno == ENOENT) logmsg(log_ctx, GENPASS_LOG_VERBOSE, "No such file");
+        else logmsg(log_ctx, GENPASS_LOG_VERBOSE, "Permission denied");
+    }
+
+    return status;
+}
+
+//take an exclusive lock on cache_file.lock, concurrent genpass processes
+//wait here while the first one computes and publishes the cache key.
+//Returns the lock descriptor or -1 if locking isn't possible
+static int lock_cache_key(const genpass_ctx *ctx) {
+    char lock_file[CACHE_PATH_MAX + 8] = {0};
+    int  fd                            = -1;
+
+    snprintf(lock_file, sizeof(lock_file), "%s.lock", ctx->cache_file);
+    if ((fd = open(lock_file, O_RDWR | O_CREAT, 0600)) == -1) {
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Unable to create lock file, continuing without it");
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        if (errno != EWOULDBLOCK) {
+            close(fd);
+            return -1;
+        }
+        logmsg(ctx, GENPASS_LOG_WARNING, "Waiting for another genpass process to generate the cache key ...");
+        while (flock(fd, LOCK_EX) == -1) {
+            if (errno != EINTR) {
+                close(fd);
+                return -1;
+            }
+        }
+    }
+
+    return fd;
+}
+
+static void unlock_cache_key(const int fd) {
+    if (fd == -1) return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+//write header and records copies of key to a temporal file in the same
+//directory and rename() it into path, readers will see either the old or the
+//complete new file. Returns 0 on success, -1 if the file can't be created and
+//-2 on write errors
+static int write_key_file(const char *path, const char *header,
+                          const size_t headerlen, const uint8_t *key,
+                          const size_t keylen, const int records) {
+    char tmp_file[CACHE_PATH_MAX + 16] = {0};
+    FILE *fp                           = NULL;
+    int  i, fd                         = -1;
+
+    snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmp_file)) == -1) return -1;
+    if ((fp = fdopen(fd, "wb")) == NULL) {
+        close(fd);
+        unlink(tmp_file);
+        return -1;
+    }
+
+    if (headerlen && fwrite(header, headerlen, 1, fp) != 1) {
+        fclose(fp);
+        unlink(tmp_file);
+        return -2;
+    }
+    for (i = 0; i < records; i++) {
+        if (fwrite(key, keylen, 1, fp) != 1) {
+            fclose(fp);
+            unlink(tmp_file);
+            return -2;
+        }
+    }
+
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        fclose(fp);
+        unlink(tmp_file);
+        return -2;
+    }
+    fclose(fp);
+
+    if (rename(tmp_file, path) != 0) {
+        unlink(tmp_file);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int write_cache_key(const genpass_ctx *ctx, const uint8_t *cache_hashbuf) {
+    char header[CACHE_HEADER_MAX]     = {0};
+    const int chain                   = ctx->params.cache_chain != 0;
+    const size_t headerlen            = cache_header(ctx, ctx->params.cache_cost,
+                                                     chain, header, sizeof(header));
+
+    return write_key_file(ctx->cache_file, header, headerlen, cache_hashbuf,
+                          ctx->params.keylen,
+                          cache_records(ctx, ctx->params.cache_cost, chain));
+}
+
+#ifdef __linux__
+//the description identifies the cache key by its parameters and the file it
+//mirrors, the same way a cache file is reused by size and path
+static void keyring_description(const genpass_ctx *ctx, char *desc,
+                                const size_t desclen) {
+    char prefix[32] = "genpass";
+
+    //chained keys differ from plain ones of the same cost
+    if (ctx->params.cache_chain)
+        snprintf(prefix, sizeof(prefix), "genpass:chain:%u", ctx->params.cache_chain);
+    if (ctx->params.kdf == GENPASS_KDF_ARGON2ID)
+        snprintf(desc, desclen, "%s:argon2id:%d:%d:%d:%d:%s", prefix,
+                 (int) ctx->params.keylen, ctx->params.cache_cost,
+                 ctx->params.argon2_t, ctx->params.argon2_lanes,
+                 ctx->cache_file);
+    else if (ctx->params.kdf == GENPASS_KDF_YESCRYPT)
+        snprintf(desc, desclen, "%s:yescrypt:%d:%d:%d:%d:%s", prefix,
+                 (int) ctx->params.keylen, ctx->params.cache_cost,
+                 ctx->params.scrypt_r, ctx->params.scrypt_p,
+                 ctx->cache_file);
+    else
+        snprintf(desc, desclen, "%s:%d:%d:%d:%d:%s", prefix, (int) ctx->params.keylen,
+                 ctx->params.cache_cost, ctx->params.scrypt_r,
+                 ctx->params.scrypt_p, ctx->cache_file);
+}
+
+//returns 1 if a valid cache key was found in the session keyring, 0 otherwise
+static int read_keyring_key(const char *desc, uint8_t *cache_hashbuf,
+                            const size_t keylen) {
+    long key_id, readbytes;
+
+    key_id = syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_SESSION_KEYRING,
+                     "user", desc, 0);
+    if (key_id == -1) return 0;
+
+    readbytes = syscall(SYS_keyctl, KEYCTL_READ, key_id, cache_hashbuf, keylen);
+    return (readbytes == (long) keylen);
+}
+
+//returns 0 on success, -1 on error
+static int write_keyring_key(const char *desc, const uint8_t *cache_hashbuf,
+                             const size_t keylen, const int timeout) {
+    long keyring_id, key_id;
+
+    //don't let the kernel create a session keyring that would die with this
+    //process, without one the user-session keyring is used instead
+    keyring_id = syscall(SYS_keyctl, KEYCTL_GET_KEYRING_ID,
+                         KEY_SPEC_SESSION_KEYRING, 0);
+    if (keyring_id == -1) return -1;
+
+    key_id = syscall(SYS_add_key, "user", desc, cache_hashbuf, keylen,
+                     keyring_id);
+    if (key_id == -1) return -1;
+
+    if (timeout > 0)
+        if (syscall(SYS_keyctl, KEYCTL_SET_TIMEOUT, key_id, timeout) == -1)
+            return -1;
+    return 0;
+}
+#else
+static void keyring_description(const genpass_ctx *ctx, char *desc,
+                                const size_t desclen) {
+    desc[0] = '\0';
+}
+
+static int read_keyring_key(const char *desc, uint8_t *cache_hashbuf,
+                            const size_t keylen) {
+    return 0;
+}
+
+static int write_keyring_key(const char *desc, const uint8_t *cache_hashbuf,
+                             const size_t keylen, const int timeout) {
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+genpass_ctx *genpass_ctx_new(const char *name, const char *password,
+                             const struct genpass_params *params,
+                             const struct genpass_cache *cache) {
+    genpass_ctx *ctx = NULL;
+
+    if (!name || !password || !params ||
+        (params->scheme != GENPASS_SCHEME_V1 &&
+         params->scheme != GENPASS_SCHEME_V2) ||
+        params->keylen < GENPASS_HASH_LEN_MIN ||
+        params->keylen > GENPASS_HASH_LEN_MAX ||
+        (params->kdf != GENPASS_KDF_SCRYPT &&
+         params->kdf != GENPASS_KDF_ARGON2ID &&
+         params->kdf != GENPASS_KDF_YESCRYPT) ||
+        (params->kdf == GENPASS_KDF_YESCRYPT &&
+         (params->scrypt_p == 0 ||
+          params->cost > 31 || params->cache_cost > 31 ||
+          _pow(2, params->cost) < 2 * (uint64_t) params->scrypt_p ||
+          (!params->single &&
+           _pow(2, params->cache_cost) < 2 * (uint64_t) params->scrypt_p))) ||
+        (params->kdf == GENPASS_KDF_ARGON2ID &&
+         (params->argon2_t == 0 || params->argon2_lanes == 0 ||
+          params->cost > 31 || params->cache_cost > 31 ||
+          _pow(2, params->cost) < 8 * params->argon2_lanes ||
+          (!params->single &&
+           _pow(2, params->cache_cost) < 8 * params->argon2_lanes))) ||
+        (params->cache_chain && !params->single &&
+         (params->cache_chain > params->cache_cost ||
+          (params->kdf == GENPASS_KDF_YESCRYPT &&
+           _pow(2, params->cache_chain) < 2 * (uint64_t) params->scrypt_p) ||
+          (params->kdf == GENPASS_KDF_ARGON2ID &&
+           _pow(2, params->cache_chain) < 8 * params->argon2_lanes)))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((ctx = ctx_alloc(sizeof(*ctx))) == NULL) return NULL;
+    pthread_mutex_init(&ctx->lock, NULL);
+    if ((ctx->name = ctx_strdup(name)) == NULL ||
+        (ctx->password = ctx_strdup(password)) == NULL) {
+        genpass_ctx_free(ctx);
+        return NULL;
+    }
+
+    pthread_once(&selftest_once, selftest);
+    ctx->selftest        = params->kdf == GENPASS_KDF_ARGON2ID ? argon2_selftest_result :
+                           params->kdf == GENPASS_KDF_YESCRYPT ? yescrypt_selftest_result :
+                           selftest_result;
+    ctx->params          = *params;
+    ctx->cache_flags     = GENPASS_CACHE_DRY_RUN;
+    ctx->keyring_timeout = GENPASS_KEYRING_TIMEOUT;
+    if (cache) {
+        ctx->cache_flags     = cache->flags;
+        ctx->keyring_timeout = cache->keyring_timeout;
+        if (cache->file)
+            snprintf(ctx->cache_file, sizeof(ctx->cache_file), "%s", cache->file);
+        else if (ctx->cache_flags & GENPASS_CACHE_FILE)
+            ctx->cache_flags |= GENPASS_CACHE_DRY_RUN;
+    }
+
+    return ctx;
+}
+
+void genpass_ctx_set_log(genpass_ctx *ctx, genpass_log_fn log, void *arg) {
+    ctx->log     = log;
+    ctx->log_arg = arg;
+}
+
+void genpass_ctx_set_span(genpass_ctx *ctx, genpass_span_fn span, void *arg) {
+    ctx->span     = span;
+    ctx->span_arg = arg;
+}
+
+static int load_cache_key(genpass_ctx *ctx) {
+    char b64buf[GENPASS_HASH_LEN_MAX * 2]     = {0};
+    char verbose_msg[GENPASS_HASH_LEN_MAX * 2 + 64] = {0};
+    char keyring_desc[CACHE_PATH_MAX + 64]   = {0};
+    uint8_t *cache_hashbuf                   = ctx->cache_key;
+    const size_t keylen                      = ctx->params.keylen;
+    const uint32_t base                      = ctx->params.cache_chain;
+    uint32_t loaded_cost                     = ctx->params.cache_cost;
+    const int use_file                       = ctx->cache_flags & GENPASS_CACHE_FILE;
+    const int use_keyring                    = ctx->cache_flags & GENPASS_CACHE_KEYRING;
+    int  dry_run                             = ctx->cache_flags & GENPASS_CACHE_DRY_RUN;
+    char cache_hash_in_file                  = 0;
+    char cache_hash_in_keyring               = 0;
+    int  cache_status                        = 0;
+    int  lock_fd                             = -1;
+
+    span(ctx, "cache-read", 1);
+    if (use_keyring) {
+        keyring_description(ctx, keyring_desc, sizeof(keyring_desc));
+        if (read_keyring_key(keyring_desc, cache_hashbuf, keylen) == 1) {
+            logmsg(ctx, GENPASS_LOG_VERBOSE, "Loaded valid cache key value from keyring");
+            if (libscrypt_b64_encode_compliant(cache_hashbuf, keylen, \
+                b64buf, sizeof(b64buf)) == -1) {
+                snprintf(b64buf, sizeof(b64buf), "0");
+            }
+            cache_hash_in_keyring = 1;
+        } else logmsg(ctx, GENPASS_LOG_VERBOSE, "No cache key in keyring");
+    }
+
+    if (use_file && !dry_run && !cache_hash_in_keyring) {
+        cache_status = read_cache_key(ctx, cache_hashbuf, &loaded_cost, 0);
+        if (cache_status == 0 ||
+            (cache_status == 1 && loaded_cost < ctx->params.cache_cost)) {
+            //single-flight, only one process computes a missing (or
+            //strengthens a chained) cache key, the rest wait for the lock
+            //and load the published result
+            span(ctx, "cache-lock", 1);
+            lock_fd = lock_cache_key(ctx);
+            span(ctx, "cache-lock", 0);
+            if (lock_fd != -1) {
+                const int missing = cache_status == 0;
+                cache_status = read_cache_key(ctx, cache_hashbuf, &loaded_cost, 1);
+                if (cache_status == 1 && (missing || loaded_cost == ctx->params.cache_cost))
+                    logmsg(ctx, GENPASS_LOG_VERBOSE, "Loaded cache key published by another process");
+            }
+        }
+
+        if (cache_status == -1) {
+            snprintf(verbose_msg, sizeof(verbose_msg), \
+                "Warning: error while reading %s, falling to --dry-mode ...", ctx->cache_file);
+            logmsg(ctx, GENPASS_LOG_WARNING, verbose_msg);
+            dry_run = 1;
+        } else if (cache_status == 1) {
+            if (libscrypt_b64_encode_compliant(cache_hashbuf, keylen, \
+                b64buf, sizeof(b64buf)) == -1) {
+                snprintf(b64buf, sizeof(b64buf), "0");
+            }
+            cache_hash_in_file = 1;
+        }
+    }
+    span(ctx, "cache-read", 0);
+
+    if (cache_hash_in_keyring) GENPASS_PROBE2(cache_hit, PROBE_CACHE_KEYRING, keylen);
+    else if (cache_hash_in_file) GENPASS_PROBE2(cache_hit, PROBE_CACHE_FILE, keylen);
+
+    if (libscrypt_b64_decode_compliant(b64buf, cache_hashbuf, keylen) <= 0) {
+        cache_hash_in_file    = 0;
+        cache_hash_in_keyring = 0;
+        GENPASS_PROBE1(cache_miss, ctx->params.cache_cost);
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Generating new cache key ...");
+        if (kdf(ctx, "kdf-cache", ctx->name, base ? base : ctx->params.cache_cost, \
+                cache_hashbuf, keylen) ||
+            (base && kdf_chain(ctx, cache_hashbuf, base, ctx->params.cache_cost))) {
+            unlock_cache_key(lock_fd);
+            zero(b64buf, sizeof(b64buf));
+            return GENPASS_ERR_KDF;
+        }
+    } else if (loaded_cost < ctx->params.cache_cost) {
+        //a chained key stored at a lower cost, pay only the missing steps
+        //and save it back
+        cache_hash_in_file = 0;
+        if (kdf_chain(ctx, cache_hashbuf, loaded_cost, ctx->params.cache_cost)) {
+            unlock_cache_key(lock_fd);
+            zero(b64buf, sizeof(b64buf));
+            return GENPASS_ERR_KDF;
+        }
+    }
+
+    span(ctx, "cache-write", 1);
+    if (use_file && !dry_run && !cache_hash_in_file && !cache_hash_in_keyring) {
+        snprintf(verbose_msg, sizeof(verbose_msg), \
+            "Attempting to save cache key to %s", ctx->cache_file);
+        logmsg(ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+        cache_status = write_cache_key(ctx, cache_hashbuf);
+        GENPASS_PROBE2(cache_write, PROBE_CACHE_FILE, cache_status);
+        if (cache_status == -2) {
+            snprintf(verbose_msg, sizeof(verbose_msg), \
+                "Warning: error while writing %s, falling to --dry-mode ...", ctx->cache_file);
+            logmsg(ctx, GENPASS_LOG_WARNING, verbose_msg);
+            dry_run = 1;
+        } else if (cache_status == -1)
+            logmsg(ctx, GENPASS_LOG_VERBOSE, "Permission denied");
+    }
+    unlock_cache_key(lock_fd);
+
+    if (use_keyring && !dry_run && !cache_hash_in_keyring) {
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Attempting to save cache key to keyring");
+        cache_status = write_keyring_key(keyring_desc, cache_hashbuf, keylen,
+                                         ctx->keyring_timeout);
+        GENPASS_PROBE2(cache_write, PROBE_CACHE_KEYRING, cache_status);
+        if (cache_status == -1) {
+            snprintf(verbose_msg, sizeof(verbose_msg), \
+                "Unable to save cache key to keyring: %s", strerror(errno));
+            logmsg(ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+        }
+    }
+    span(ctx, "cache-write", 0);
+
+    if (ctx->log) {
+        if (libscrypt_b64_encode_compliant(cache_hashbuf, keylen, b64buf, sizeof(b64buf)) != -1) {
+            snprintf(verbose_msg, sizeof(verbose_msg), "Cache key: %s", b64buf);
+            logmsg(ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+        }
+        zero(verbose_msg, sizeof(verbose_msg));
+    }
+    zero(b64buf, sizeof(b64buf));
+
+    return 0;
+}
+
+//scheme 2 root key file, "$genpass$v=2$C=CACHE_COST,b=BASE,c=COST$<kdf
+//params>$KEYLEN" followed by the root, stored next to the cache file
+static size_t root_header(const genpass_ctx *ctx, char *header,
+                          const size_t headerlen) {
+    char params[48] = {0};
+
+    kdf_params(ctx, params, sizeof(params));
+    return (size_t) snprintf(header, headerlen, "$genpass$v=%d$C=%u,b=%u,c=%u$%s$%zu\n",
+                             GENPASS_SCHEME_V2, ctx->params.cache_cost,
+                             ctx->params.cache_chain, ctx->params.cost, params,
+                             ctx->params.keylen);
+}
+
+//returns 1 on a valid root key, 0 if missing or invalid
+static int read_root_key(const genpass_ctx *ctx, const char *path, uint8_t *root) {
+    char header[CACHE_HEADER_MAX]      = {0};
+    char file_header[CACHE_HEADER_MAX] = {0};
+    const size_t keylen                = ctx->params.keylen;
+    const size_t headerlen             = root_header(ctx, header, sizeof(header));
+    FILE *fp                           = NULL;
+    int  status                        = 0;
+
+    if ((fp = fopen(path, "rb")) == NULL) return 0;
+    fseek(fp, 0, SEEK_END);
+    if (ftell(fp) == (long) (headerlen + keylen)) {
+        rewind(fp);
+        status = fread(file_header, 1, headerlen, fp) == headerlen &&
+                 memcmp(file_header, header, headerlen) == 0 &&
+                 fread(root, 1, keylen, fp) == keylen;
+    }
+    fclose(fp);
+
+    return status;
+}
+
+//root = kdf(password, cache key "genpass:root:" name, cost) as the scheme 1
+//kdf-site salts the cache key, or without it with single, one memory hard
+//step paid once per machine. The cache file and the name alone don't give
+//it. Only its HKDF-Extract is kept, site keys are expanded from it
+static int load_root_key(genpass_ctx *ctx) {
+    char root_file[CACHE_PATH_MAX + 8]    = {0};
+    char verbose_msg[CACHE_PATH_MAX + 64] = {0};
+    char header[CACHE_HEADER_MAX]         = {0};
+    uint8_t root[GENPASS_HASH_LEN_MAX]    = {0};
+    const size_t keylen                   = ctx->params.keylen;
+    const size_t saltlen                  = keylen + strlen(ROOT_SALT_PREFIX) +
+                                            strlen(ctx->name) + 1;
+    const int use_file                    = !ctx->params.single &&
+                                            (ctx->cache_flags & GENPASS_CACHE_FILE) &&
+                                            !(ctx->cache_flags & GENPASS_CACHE_DRY_RUN);
+    char *salt                            = NULL;
+    int  retval                           = 0;
+
+    snprintf(root_file, sizeof(root_file), "%s.root", ctx->cache_file);
+    if (use_file && read_root_key(ctx, root_file, root) == 1)
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Loaded valid root key value");
+    else {
+        if (!ctx->params.single && (retval = load_cache_key(ctx)) != 0)
+            return retval;
+        if ((salt = malloc(saltlen)) == NULL) return GENPASS_ERR_KDF;
+        //the cache key is used as a C string, it's NUL terminated at keylen
+        snprintf(salt, saltlen, "%s%s%s", ctx->params.single ? "" :
+                 (char *) ctx->cache_key, ROOT_SALT_PREFIX, ctx->name);
+
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Generating new root key ...");
+        retval = kdf(ctx, "kdf-root", salt, ctx->params.cost, root, keylen);
+        zero(salt, saltlen);
+        free(salt);
+        if (retval) {
+            zero(root, sizeof(root));
+            return GENPASS_ERR_KDF;
+        }
+
+        if (use_file &&
+            write_key_file(root_file, header, root_header(ctx, header, sizeof(header)),
+                           root, keylen, 1) != 0) {
+            snprintf(verbose_msg, sizeof(verbose_msg),
+                     "Unable to save root key to %s", root_file);
+            logmsg(ctx, GENPASS_LOG_VERBOSE, verbose_msg);
+        }
+    }
+
+    hkdf_extract((const uint8_t *) HKDF_SALT, strlen(HKDF_SALT), root, keylen,
+                 ctx->root_prk);
+    zero(root, sizeof(root));
+    return 0;
+}
+
+int genpass_ctx_load(genpass_ctx *ctx) {
+    const int v2 = ctx->params.scheme == GENPASS_SCHEME_V2;
+    int retval   = 0;
+
+    if (ctx->params.single && !v2) return 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (!ctx->loaded) {
+        retval = v2 ? load_root_key(ctx) : load_cache_key(ctx);
+        if (retval == 0) ctx->loaded = 1;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return retval;
+}
+
+//refuse to derive on a broken scrypt, a wrong password is worse than none
+static int check_selftest(genpass_ctx *ctx) {
+    const int argon2   = ctx->params.kdf == GENPASS_KDF_ARGON2ID;
+    const int yescrypt = ctx->params.kdf == GENPASS_KDF_YESCRYPT;
+
+    if (ctx->params.scheme == GENPASS_SCHEME_V2 && hkdf_selftest_result) {
+        logmsg(ctx, GENPASS_LOG_WARNING,
+            "Warning: HKDF-SHA256 self-test failed, refusing to derive ...");
+        errno = EDOM;
+        return -1;
+    }
+    if (ctx->selftest == -1) {
+        logmsg(ctx, GENPASS_LOG_WARNING, argon2 ?
+            "Warning: argon2id self-test failed, refusing to derive ..." : yescrypt ?
+            "Warning: yescrypt self-test failed, refusing to derive ..." :
+            "Warning: libscrypt self-test failed, refusing to derive ...");
+        errno = EDOM;
+        return -1;
+    }
+    if (ctx->selftest == 1 && (argon2 || ctx->params.threads > 1)) {
+        pthread_mutex_lock(&ctx->lock);
+        if (!ctx->selftest_warned)
+            logmsg(ctx, GENPASS_LOG_WARNING, argon2 ?
+                "Warning: SIMD argon2id kernel failed its self-test, using the portable one ..." : yescrypt ?
+                "Warning: threaded yescrypt failed its self-test, using a single thread ..." :
+                "Warning: threaded scrypt failed its self-test, using a single thread ...");
+        ctx->selftest_warned = 1;
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    return 0;
+}
+
+//the scheme 1 kdf-site salt, the cache key (unless single), site and name
+static int site_salt(genpass_ctx *ctx, const char *site,
+                     char mix_name_site[MIX_NAME_SITE_LEN]) {
+    if (!ctx->params.single) {
+        if (genpass_ctx_load(ctx)) return GENPASS_ERR_KDF;
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Generating double derived key ...");
+        //the cache key is used as a C string, it's NUL terminated at keylen
+        snprintf(mix_name_site, MIX_NAME_SITE_LEN, "%s%s%s", \
+                 (char *) ctx->cache_key, site, ctx->name);
+    } else {
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Generating single derived key ...");
+        snprintf(mix_name_site, MIX_NAME_SITE_LEN, "%s%s", ctx->name, site);
+    }
+    return 0;
+}
+
+int genpass_derive_raw(genpass_ctx *ctx, const char *site, uint8_t *out) {
+    char mix_name_site[MIX_NAME_SITE_LEN] = {0};
+    int  retval                           = 0;
+
+    if (check_selftest(ctx)) return GENPASS_ERR_KDF;
+
+    if (ctx->params.scheme == GENPASS_SCHEME_V2) {
+        if (genpass_ctx_load(ctx)) return GENPASS_ERR_KDF;
+        logmsg(ctx, GENPASS_LOG_VERBOSE, "Generating HKDF site key ...");
+        span(ctx, "kdf-site", 1);
+        hkdf_expand(ctx->root_prk, (const uint8_t *) site, strlen(site), out,
+                    ctx->params.keylen);
+        span(ctx, "kdf-site", 0);
+        return 0;
+    }
+
+    if (site_salt(ctx, site, mix_name_site)) return GENPASS_ERR_KDF;
+
+    if (kdf(ctx, "kdf-site", mix_name_site, ctx->params.cost, \
+            out, ctx->params.keylen))
+        retval = GENPASS_ERR_KDF;
+
+    zero(mix_name_site, sizeof(mix_name_site));
+    return retval;
+}
+
+int genpass_derive(genpass_ctx *ctx, const char *site, const char *encoding,
+                   char *out, size_t outlen) {
+    uint8_t hashbuf[GENPASS_HASH_LEN_MAX] = {0};
+    int     retval                        = 0;
+
+    if ((retval = genpass_derive_raw(ctx, site, hashbuf)) == 0) {
+        span(ctx, "encode", 1);
+        if (genpass_encode(encoding, hashbuf, ctx->params.keylen, out, outlen) == -1)
+            retval = GENPASS_ERR_ENCODING;
+        span(ctx, "encode", 0);
+    }
+
+    zero(hashbuf, sizeof(hashbuf));
+    return retval;
+}
+
+//genpass_derive_stream() state, the chunks scrypt hands out are encoded
+//into text as they come and passed on
+struct stream_sink {
+    const struct encoder *e;   //NULL for the raw bytes
+    struct encoder_stream st;
+    char  *text;
+    size_t textlen;
+    int    begun;
+    int    retval;             //why the stream stopped, 0 if it didn't
+    genpass_stream_fn out;
+    void  *arg;
+};
+
+static int stream_chunk(const uint8_t *buf, size_t len, void *arg) {
+    struct stream_sink *sink = arg;
+    const size_t need        = sink->e ? encoder_stream_bound(sink->e, 0) +
+                               encoder_stream_bound(sink->e, len) : 0;
+    char *text, *end;
+
+    if (sink->e == NULL) {
+        if (sink->out((const char *) buf, len, sink->arg) == 0) return 0;
+        sink->retval = GENPASS_ERR_OUTPUT;
+        return -1;
+    }
+
+    //the bound is per call, the header goes in front of the first chunk
+    if (need > sink->textlen) {
+        if ((text = malloc(need)) == NULL) {
+            sink->retval = GENPASS_ERR_ENCODING;
+            return -1;
+        }
+        if (sink->text) {
+            zero(sink->text, sink->textlen);
+            free(sink->text);
+        }
+        sink->text    = text;
+        sink->textlen = need;
+    }
+
+    end = sink->text;
+    if (!sink->begun) {
+        end = encoder_stream_begin(&sink->st, sink->e, sink->st.left, end);
+        sink->begun = 1;
+    }
+    if (end) end = encoder_stream_update(&sink->st, buf, len, end);
+    if (end == NULL) {
+        errno = EINVAL;
+        sink->retval = GENPASS_ERR_ENCODING;
+        return -1;
+    }
+    if (sink->out(sink->text, (size_t) (end - sink->text), sink->arg)) {
+        sink->retval = GENPASS_ERR_OUTPUT;
+        return -1;
+    }
+    return 0;
+}
+
+int genpass_derive_stream(genpass_ctx *ctx, const char *site,
+                          const char *encoding, uint64_t len,
+                          genpass_stream_fn out, void *arg) {
+    char mix_name_site[MIX_NAME_SITE_LEN] = {0};
+    char tail[64];
+    struct stream_sink sink;
+    char *end;
+    int retval                            = 0;
+
+    memset(&sink, 0, sizeof(sink));
+    sink.out      = out;
+    sink.arg      = arg;
+    sink.st.left  = len;
+    if (encoding && (sink.e = encoder_find(encoding)) == NULL) {
+        errno = EINVAL;
+        return GENPASS_ERR_ENCODING;
+    }
+
+    if (check_selftest(ctx)) return GENPASS_ERR_KDF;
+
+    //only the scrypt output is PBKDF2, which extends to any length
+    if (ctx->params.kdf != GENPASS_KDF_SCRYPT ||
+        ctx->params.scheme != GENPASS_SCHEME_V1 || len == 0) {
+        errno = ENOTSUP;
+        return GENPASS_ERR_KDF;
+    }
+
+    if (site_salt(ctx, site, mix_name_site)) return GENPASS_ERR_KDF;
+
+    span(ctx, "kdf-site", 1);
+    if (ctx->span) libscrypt_set_hook(scrypt_hook, (void *) ctx);
+    if (libscrypt_scrypt_stream((const uint8_t *) ctx->password,
+            strlen(ctx->password), (const uint8_t *) mix_name_site,
+            strlen(mix_name_site), _pow(2, ctx->params.cost),
+            ctx->params.scrypt_r, ctx->params.scrypt_p, ctx->params.threads,
+            len, stream_chunk, &sink))
+        retval = sink.retval ? sink.retval : GENPASS_ERR_KDF;
+    if (ctx->span) libscrypt_set_hook(NULL, NULL);
+    span(ctx, "kdf-site", 0);
+
+    if (retval == 0 && sink.e) {
+        if ((end = encoder_stream_end(&sink.st, tail)) == NULL) {
+            errno = EINVAL;
+            retval = GENPASS_ERR_ENCODING;
+        } else if (out(tail, (size_t) (end - tail), arg))
+            retval = GENPASS_ERR_OUTPUT;
+    }
+
+    if (sink.text) {
+        zero(sink.text, sink.textlen);
+        free(sink.text);
+    }
+    zero(&sink.st, sizeof(sink.st));
+    zero(tail, sizeof(tail));
+    zero(mix_name_site, sizeof(mix_name_site));
+    return retval;
+}
+
+void genpass_ctx_free(genpass_ctx *ctx) {
+    if (!ctx) return;
+    if (ctx->name) ctx_free(ctx->name, strlen(ctx->name) + 1);
+    if (ctx->password) ctx_free(ctx->password, strlen(ctx->password) + 1);
+    pthread_mutex_destroy(&ctx->lock);
+    ctx_free(ctx, sizeof(*ctx));
+}
@@ -0,0 +1,283 @@
+#ifndef _LIBGENPASS_H_
+#define _LIBGENPASS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Sane default values, see defaults.md for older versions */
+#define GENPASS_HASH_LEN            32 /* or 256 bits */
+#define GENPASS_HASH_LEN_MAX      1024
+#define GENPASS_HASH_LEN_MIN         8
+#define GENPASS_ENCODED_LEN_MAX   3840 /* skey at GENPASS_HASH_LEN_MAX */
+#define GENPASS_CACHE_COST          20
+#define GENPASS_COST                14
+#define GENPASS_SAFE_N              30
+#define GENPASS_r                    8
+#define GENPASS_SAFE_r            9999
+#define GENPASS_p                   16
+#define GENPASS_SAFE_p           99999
+#define GENPASS_THREADS              1
+#define GENPASS_SAFE_THREADS       256
+#define GENPASS_ENCODING         "z85"
+#define GENPASS_KDF           "scrypt"
+#define GENPASS_ARGON2_T             3
+#define GENPASS_SAFE_ARGON2_T     1000
+#define GENPASS_ARGON2_LANES         4
+#define GENPASS_SAFE_ARGON2_LANES  255
+#define GENPASS_KEYRING_TIMEOUT   3600
+#define GENPASS_SCHEME               1
+
+/* Cache backend flags */
+#define GENPASS_CACHE_FILE        0x01 /* use|write cache key from|to file */
+#define GENPASS_CACHE_KEYRING     0x02 /* use|write the session keyring */
+#define GENPASS_CACHE_DRY_RUN     0x04 /* never write any backend */
+
+/* Key derivation functions */
+#define GENPASS_KDF_SCRYPT           0
+#define GENPASS_KDF_ARGON2ID         1
+#define GENPASS_KDF_YESCRYPT         2
+
+/* Derivation schemes, see genpass_params */
+#define GENPASS_SCHEME_V1            1
+#define GENPASS_SCHEME_V2            2
+
+/* Log levels passed to the log callback */
+#define GENPASS_LOG_VERBOSE          1
+#define GENPASS_LOG_WARNING          2
+
+/* genpass_derive() errors, errno is set accordingly */
+#define GENPASS_ERR_KDF             -1
+#define GENPASS_ERR_ENCODING        -2
+#define GENPASS_ERR_OUTPUT          -3 /* the stream callback failed */
+
+/**
+ * Derivation parameters. Costs are log2(N) scrypt values, cache_cost is used
+ * for the first level (cache key) and cost for the site specific level. With
+ * single != 0 only one derivation over name + site is performed. threads
+ * only changes how many scrypt or argon2id lanes run at once, not the
+ * derived keys.
+ *
+ * With kdf GENPASS_KDF_ARGON2ID the costs are log2 of the memory in KiB
+ * (20 is 1 GiB), at least 8 KiB per lane, argon2_t is the number of passes
+ * and argon2_lanes the parallelism, scrypt_r and scrypt_p are ignored.
+ *
+ * GENPASS_KDF_YESCRYPT is yescrypt with pwxform (YESCRYPT_RW), costs are
+ * log2(N) and scrypt_r / scrypt_p its r and p as with scrypt, but the p
+ * lanes share 128 * r * N bytes, so 2^cost must be at least 2 * scrypt_p.
+ *
+ * With cache_chain != 0 the cache key is hash chained from that base cost:
+ * the key at cost k + 1 is the kdf of the key at cost k, so raising
+ * cache_cost strengthens a stored key by paying only the missing steps. The
+ * chained key at the base cost is the plain cache key of that cost. It must
+ * not be above cache_cost, chained and plain keys differ past the base.
+ *
+ * scheme GENPASS_SCHEME_V1 derives every site key with the kdf at cost.
+ * GENPASS_SCHEME_V2 derives once a root key, the kdf of the cache key (or
+ * the password with single) at cost, cached next to the cache file, and
+ * then site keys with HKDF-SHA256 from it in microseconds. The schemes give
+ * different passwords, keep the one the passwords were generated with.
+ */
+struct genpass_params {
+    size_t   keylen;
+    uint32_t cache_cost;
+    uint32_t cost;
+    uint32_t scrypt_r;
+    uint32_t scrypt_p;
+    uint32_t threads;
+    int      single;
+    int      kdf;
+    uint32_t argon2_t;
+    uint32_t argon2_lanes;
+    uint32_t cache_chain;
+    int      scheme;
+};
+
+/**
+ * Cache key backend, file is required for GENPASS_CACHE_FILE and is also
+ * used to identify the key in the keyring.
+ */
+struct genpass_cache {
+    const char *file;
+    int         flags;
+    int         keyring_timeout;
+};
+
+typedef struct genpass_ctx genpass_ctx;
+
+typedef void (*genpass_log_fn)(int level, const char *msg, void *arg);
+
+/**
+ * Stage callback, called with begin != 0 when the stage name starts and
+ * begin == 0 when it ends. Stages nest: cache-read, cache-lock, kdf-cache,
+ * kdf-chain (once per chained cost step), cache-write, kdf-root (scheme 2),
+ * kdf-site and encode, the kdf stages contain pbkdf2, smix and pbkdf2 again.
+ * smix contains a smix-fill and smix-mix pair per scrypt lane computed by
+ * the calling thread.
+ */
+typedef void (*genpass_span_fn)(const char *name, int begin, void *arg);
+
+/* Context allocator, see genpass_set_allocator() */
+typedef void *(*genpass_alloc_fn)(size_t len);
+typedef void (*genpass_release_fn)(void *p, size_t len);
+
+/**
+ * genpass_set_allocator(alloc, release):
+ * Allocate the contexts, which hold the name, the password and the keys
+ * derived from them, with alloc instead of calloc(), e.g. from locked
+ * memory. alloc must return zeroed memory and be thread safe, genpass_warm()
+ * creates contexts from its threads; release, which may be NULL, gets every
+ * block back wiped. A NULL alloc restores calloc() and free(). Call it
+ * before the first genpass_ctx_new().
+ */
+void genpass_set_allocator(genpass_alloc_fn alloc, genpass_release_fn release);
+
+/* Fill params with the default values */
+void genpass_params_init(struct genpass_params *params);
+
+/**
+ * genpass_ctx_new(name, password, params, cache):
+ * Create a derivation context for the given identity, name and password are
+ * copied and wiped on genpass_ctx_free(). cache may be NULL for no cache.
+ * The first call runs the libscrypt, yescrypt and argon2id self-tests, derivations
+ * fail with GENPASS_ERR_KDF if the selected kdf implementation is broken.
+ * Return NULL on error.
+ */
+genpass_ctx *genpass_ctx_new(const char *name, const char *password,
+    const struct genpass_params *params, const struct genpass_cache *cache);
+
+/* Receive progress (GENPASS_LOG_VERBOSE) and warning messages */
+void genpass_ctx_set_log(genpass_ctx *ctx, genpass_log_fn log, void *arg);
+
+/* Receive the begin and end of every stage, for timings */
+void genpass_ctx_set_span(genpass_ctx *ctx, genpass_span_fn span, void *arg);
+
+/**
+ * genpass_ctx_load(ctx):
+ * Load or compute (and save) the first level cache key, and with scheme 2
+ * the root key, it's called implicitly by genpass_derive(), only the first
+ * call does any work.
+ * Return 0 on success; or GENPASS_ERR_KDF on error.
+ */
+int genpass_ctx_load(genpass_ctx *ctx);
+
+/**
+ * genpass_derive(ctx, site, encoding, out, outlen):
+ * Derive the password for site and write it encoded as encoding into out
+ * (NUL-terminated). Once the cache key is loaded it's safe to call it from
+ * several threads using the same context.
+ * Return 0 on success; or GENPASS_ERR_KDF / GENPASS_ERR_ENCODING on error.
+ */
+int genpass_derive(genpass_ctx *ctx, const char *site, const char *encoding,
+    char *out, size_t outlen);
+
+/* Same as genpass_derive() but write the params->keylen raw bytes instead */
+int genpass_derive_raw(genpass_ctx *ctx, const char *site, uint8_t *out);
+
+/* Stream callback, the output in order; non-zero stops the derivation */
+typedef int (*genpass_stream_fn)(const char *buf, size_t len, void *arg);
+
+/**
+ * genpass_derive_stream(ctx, site, encoding, len, out, arg):
+ * Derive len bytes of key material for site, up to (2^32 - 1) * 32, and
+ * hand them to out encoded as encoding (not NUL-terminated), or raw with
+ * a NULL encoding, chunk after chunk with memory bounded by the threads.
+ * The first params->keylen bytes are the genpass_derive_raw() key, only
+ * the scrypt kdf with scheme 1 streams (errno ENOTSUP otherwise).
+ * Return 0 on success; or GENPASS_ERR_KDF / GENPASS_ERR_ENCODING /
+ * GENPASS_ERR_OUTPUT (errno as out left it) on error.
+ */
+int genpass_derive_stream(genpass_ctx *ctx, const char *site,
+    const char *encoding, uint64_t len, genpass_stream_fn out, void *arg);
+
+/* Wipe secrets and release the context */
+void genpass_ctx_free(genpass_ctx *ctx);
+
+/**
+ * genpass_encoding(name):
+ * The canonical name of the encoding called name, ignoring case and
+ * accepting aliases (base16 for hex, base91 for b91, ...); or NULL if
+ * there's no such encoding.
+ */
+const char *genpass_encoding(const char *name);
+
+/**
+ * genpass_encode(encoding, src, srclength, target, targsize):
+ * Encode src with one of the supported encodings: dec, hex, base64, z85,
+ * skey or b91. Encoders are stateless, any number of threads may encode at
+ * once. Return the output length; or -1 on error, targsize smaller than the
+ * worst case for srclength included.
+ */
+int genpass_encode(const char *encoding, const uint8_t *src, size_t srclength,
+    char *target, size_t targsize);
+
+/* Host figures measured by genpass_calibrate() */
+struct genpass_host {
+    int         ncpu;
+    uint64_t    ram_avail;     /* bytes */
+    double      blockmix_mbs;  /* BlockMix_salsa20/8 MB/s, one thread */
+    double      membw_mbs;     /* memory copy MB/s */
+    const char *kernel;        /* scrypt core implementation */
+};
+
+/* Recommended values for one derivation level */
+struct genpass_level {
+    double   target;           /* seconds */
+    uint32_t cost;             /* log2(N) */
+    uint32_t threads;
+    uint64_t memory;           /* bytes */
+    double   estimated;        /* seconds */
+    double   measured;         /* seconds, 0 if not measured */
+};
+
+struct genpass_calibration {
+    struct genpass_host  host;
+    uint32_t             scrypt_r;
+    uint32_t             scrypt_p;
+    struct genpass_level cache;
+    struct genpass_level site;
+};
+
+/**
+ * genpass_calibrate(cache_target, target, scrypt_r, scrypt_p, cal, log, arg):
+ * Measure this host and pick the largest cache_cost and cost (and the lane
+ * thread count) keeping the first and second level derivations under
+ * cache_target and target seconds with the given r and p. At most half of
+ * the available RAM is used. log may be NULL.
+ * Return 0 on success; or -1 on error.
+ */
+int genpass_calibrate(double cache_target, double target, uint32_t scrypt_r,
+    uint32_t scrypt_p, struct genpass_calibration *cal, genpass_log_fn log,
+    void *arg);
+
+/* Available RAM in bytes, MemAvailable on Linux */
+uint64_t genpass_ram_available(void);
+
+/* A first level key to compute ahead, see genpass_warm() */
+struct genpass_warm_job {
+    struct genpass_params params;
+    struct genpass_cache  cache;
+    int                   status;  /* genpass_ctx_load() result */
+    int                   errnum;  /* errno of a failed job */
+};
+
+/**
+ * genpass_warm(name, password, jobs, n, budget, log, arg):
+ * Load or compute and save the cache key (and the scheme 2 root key) of
+ * every job as genpass_ctx_load() does, running jobs at once while their
+ * kdf memory fits in budget bytes, 0 for half of the available RAM. A job
+ * larger than budget runs alone. Jobs sharing a cache file must share the
+ * parameters it's stored with. log may be NULL.
+ * Return the number of failed jobs; or -1 on error.
+ */
+int genpass_warm(const char *name, const char *password,
+    struct genpass_warm_job *jobs, size_t n, uint64_t budget,
+    genpass_log_fn log, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_LIBGENPASS_H_ */
@@ -0,0 +1,141 @@
+//warm: compute the first level keys ahead of interactive use
+//
+//A new machine pays every cache key once, a minute or more each, the first
+//time genpass runs with its parameters. Here they are loaded or computed
+//(and saved) up front, as genpass_ctx_load() would, several at once while
+//their kdf memory fits the budget. A job larger than the whole budget still
+//runs, alone.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "libgenpass.h"
+
+struct warm_run {
+    const char *name;
+    const char *password;
+    struct genpass_warm_job *jobs;
+    genpass_log_fn log;
+    void *log_arg;
+    pthread_mutex_t lock;
+    pthread_cond_t  done;
+    uint64_t used;     //bytes of the jobs running
+    size_t   running;
+};
+
+struct warm_thread {
+    struct warm_run *run;
+    size_t           job;
+    uint64_t         memory;
+    pthread_t        thread;
+    int              started;
+};
+
+static uint64_t _pow(const unsigned int a, const unsigned int b) {
+    return b < 64 ? (uint64_t) a << b : UINT64_MAX;
+}
+
+//the kdf memory of the largest derivation genpass_ctx_load() makes
+static uint64_t job_memory(const struct genpass_params *params) {
+    uint32_t cost  = params->cache_cost;
+    uint32_t lanes = params->threads < params->scrypt_p ?
+                     params->threads : params->scrypt_p;
+
+    //scheme 2 also derives the root key at the site cost
+    if (params->scheme == GENPASS_SCHEME_V2 && params->cost > cost)
+        cost = params->cost;
+    if (params->kdf == GENPASS_KDF_ARGON2ID)
+        return _pow(1024, cost);
+    if (params->kdf == GENPASS_KDF_YESCRYPT)
+        return 128 * (uint64_t) params->scrypt_r * _pow(1, cost);
+    return 128 * (uint64_t) params->scrypt_r * _pow(1, cost) * (lanes ? lanes : 1);
+}
+
+static void *warm_job(void *arg) {
+    struct warm_thread *t        = arg;
+    struct warm_run *run         = t->run;
+    struct genpass_warm_job *job = &run->jobs[t->job];
+    genpass_ctx *ctx;
+
+    if ((ctx = genpass_ctx_new(run->name, run->password, &job->params,
+                               &job->cache)) == NULL)
+        job->status = GENPASS_ERR_KDF;
+    else {
+        genpass_ctx_set_log(ctx, run->log, run->log_arg);
+        job->status = genpass_ctx_load(ctx);
+        genpass_ctx_free(ctx);
+    }
+    if (job->status) job->errnum = errno;
+
+    pthread_mutex_lock(&run->lock);
+    run->used -= t->memory;
+    run->running--;
+    pthread_cond_signal(&run->done);
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+int genpass_warm(const char *name, const char *password,
+                 struct genpass_warm_job *jobs, size_t n, uint64_t budget,
+                 genpass_log_fn log, void *arg) {
+    struct warm_run run;
+    struct warm_thread *threads = NULL;
+    char msg[128];
+    size_t i;
+    int failed = 0;
+
+    if (!name || !password || (n && !jobs)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n == 0) return 0;
+    if (budget == 0) budget = genpass_ram_available() / 2;
+    if ((threads = calloc(n, sizeof(*threads))) == NULL) return -1;
+
+    memset(&run, 0, sizeof(run));
+    run.name     = name;
+    run.password = password;
+    run.jobs     = jobs;
+    run.log      = log;
+    run.log_arg  = arg;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.done, NULL);
+
+    for (i = 0; i < n; i++) {
+        threads[i].run    = &run;
+        threads[i].job    = i;
+        threads[i].memory = job_memory(&jobs[i].params);
+
+        pthread_mutex_lock(&run.lock);
+        while (run.running && run.used + threads[i].memory > budget)
+            pthread_cond_wait(&run.done, &run.lock);
+        run.used += threads[i].memory;
+        run.running++;
+        pthread_mutex_unlock(&run.lock);
+
+        snprintf(msg, sizeof(msg), "Warming key length %zu, cache cost %u "
+                 "(%llu MiB) ...", jobs[i].params.keylen,
+                 jobs[i].params.cache_cost,
+                 (unsigned long long) (threads[i].memory >> 20));
+        if (log) log(GENPASS_LOG_VERBOSE, msg, arg);
+
+        //without a thread the job runs here, in order
+        if (pthread_create(&threads[i].thread, NULL, warm_job, &threads[i]) == 0)
+            threads[i].started = 1;
+        else
+            warm_job(&threads[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (threads[i].started) pthread_join(threads[i].thread, NULL);
+        if (jobs[i].status) failed++;
+    }
+
+    pthread_cond_destroy(&run.done);
+    pthread_mutex_destroy(&run.lock);
+    free(threads);
+    return failed;
+}
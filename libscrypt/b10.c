@@ -5,46 +5,35 @@
 #include <limits.h>
 #include <stdint.h>
 
-#include "crypto_scrypt-hexconvert.h"
+#include "b10.h"
 
+/* Each byte is written as "%02u" always was: two digits below 100, three
+ * from 100 on, so the output is at most 3 * srclength + 1 bytes long. It's
+ * one way, "1000" could be 10 00 or 100 0.
+ */
 int libscrypt_b10_encode(src, srclength, target, targsize)
     unsigned char const *src;
     size_t srclength;
     char *target;
     size_t targsize;
 {
-    size_t i;
-    int len = 0;
+    size_t i, len = 0;
+    unsigned int b;
 
-    if (!src || srclength < 1 || targsize < (srclength * 2 + 1))
+    if (!src || srclength < 1)
         return -1;
 
-    memset(target, 0, targsize);
-
-    for(i=0; i<=(srclength-1); i++)
+    for(i=0; i<srclength; i++)
     {
-        /* snprintf(target, srclength,"%s...", target....) has undefined results
-         * and can't be used. Using offests like this makes snprintf
-         * nontrivial. we therefore have use inescure sprintf() and
-         * lengths checked elsewhere (start of function) */
-        /*@ -bufferoverflowhigh @*/
-        len += sprintf(target+len, "%02u", (unsigned int) src[i]);
+        b = src[i];
+        if (len + (b >= 100 ? 3 : 2) >= targsize)
+            return -1;
+        if (b >= 100)
+            target[len++] = '0' + b / 100;
+        target[len++] = '0' + b / 10 % 10;
+        target[len++] = '0' + b % 10;
     }
+    memset(target + len, 0, targsize - len);
 
-    return 0;
-
-    /*if (libscrypt_hex_encode(src, srclength, target, targsize) == -1) return -1;*/
-    /*char *p;*/
-    /*errno = 0;*/
-    /*unsigned long int b10 = strtoul(target,&p,16);*/
-
-    /*if (p == target) //no digits found*/
-        /*return -1;*/
-    /*else if ((b10 == LONG_MIN || b10 == ULONG_MAX) && errno == ERANGE)*/
-        /*//value out of range*/
-        /*return -1;*/
-    /*else*/
-        /*snprintf(target, targsize, "%ld", b10);*/
-
-    /*return 0;*/
+    return (int)len;
 }
@@ -7,8 +7,37 @@
 //for generating passwords
 int	libscrypt_b64_encode(unsigned char const *src, size_t srclength,
         /*@out@*/ char *target, size_t targetsize);
+int	libscrypt_b64_decode(char const *src,
+        /*@out@*/ unsigned char *target, size_t targetsize);
 
 int	libscrypt_b64_encode_compliant(unsigned char const *src, size_t srclength,
         /*@out@*/ char *target, size_t targetsize);
 int	libscrypt_b64_decode_compliant(char const *src,
         /*@out@*/ unsigned char *target, size_t targetsize);
+
+/*
+ * A vectorized kernel, it encodes or decodes a prefix of the input and
+ * returns how much of it it consumed, the codecs above finish the job.
+ */
+struct libscrypt_b64_kernel {
+	const char *name;
+	int (*supported)(void);		/* NULL for the portable kernel */
+	size_t (*encode)(const unsigned char *src, size_t srclength,
+	    char *target, size_t targsize, const char *alphabet);
+	size_t (*decode)(const char *src, size_t srclength,
+	    unsigned char *target, size_t targsize, const char *alphabet);
+};
+
+/* NULL terminated, the first one is the portable (scalar only) kernel */
+extern const struct libscrypt_b64_kernel libscrypt_b64_kernels[];
+
+/* The fastest kernel the CPU supports, the one the codecs above use */
+const struct libscrypt_b64_kernel *libscrypt_b64_kernel(void);
+
+/* The codecs above with kernel k, the genpass alphabet unless compliant */
+int	libscrypt_b64_encode_with(const struct libscrypt_b64_kernel *k,
+        int compliant, unsigned char const *src, size_t srclength,
+        /*@out@*/ char *target, size_t targetsize);
+int	libscrypt_b64_decode_with(const struct libscrypt_b64_kernel *k,
+        int compliant, char const *src,
+        /*@out@*/ unsigned char *target, size_t targetsize);
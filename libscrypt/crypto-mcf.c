@@ -10,6 +10,8 @@
 #include <unistd.h>
 #endif
 
+#include "b64.h"
+#include "crypto_scrypt-internal.h"
 #include "libscrypt.h"
 
 /* ilog2 for powers of two */
@@ -71,3 +73,70 @@ int libscrypt_mcf(uint32_t N, uint32_t r, uint32_t p, const char *salt,
 
 	return 1;
 }	
+
+/*
+ * Copy the '$' or NUL terminated field at s into field, at most fieldsize
+ * - 1 characters.  Return the length of the field, or -1 if it's too long.
+ */
+static int
+mcf_field(const char * s, char * field, size_t fieldsize)
+{
+	size_t len = 0;
+
+	while (s[len] != '\0' && s[len] != '$') {
+		if (len + 1 >= fieldsize)
+			return (-1);
+		field[len] = s[len];
+		len++;
+	}
+	field[len] = '\0';
+
+	return ((int)len);
+}
+
+int
+libscrypt_mcf_decode(const char * mcf, struct libscrypt_mcf_fields * f)
+{
+	char field[SCRYPT_MCF_LEN];
+	uint8_t hashbuf[SCRYPT_MCF_LEN];
+	uint32_t params, t;
+	char * end;
+	int len;
+
+	if (mcf == NULL || strncmp(mcf, SCRYPT_MCF_ID "$", 4) != 0)
+		return (-1);
+	mcf += 4;
+
+	/* Work order: log2(N) << 16 | r << 8 | p, in hex. */
+	if ((len = mcf_field(mcf, field, sizeof(field))) < 1 || mcf[len] != '$')
+		return (-1);
+	params = (uint32_t)strtoul(field, &end, 16);
+	if (*end != '\0')
+		return (-1);
+	t = params >> 16;
+	f->r = (params >> 8) & 0xff;
+	f->p = params & 0xff;
+	if (t < 1 || t > SCRYPT_SAFE_N || f->r == 0 || f->p == 0)
+		return (-1);
+	f->N = (uint64_t)1 << t;
+	mcf += len + 1;
+
+	/* Salt. */
+	if ((len = mcf_field(mcf, field, sizeof(field))) < 1 || mcf[len] != '$')
+		return (-1);
+	if ((len = libscrypt_b64_decode_compliant(field, f->salt,
+	    sizeof(f->salt))) < 1)
+		return (-1);
+	f->saltlen = (size_t)len;
+	mcf += strlen(field) + 1;
+
+	/* Hash, kept encoded for slow_equals(), any length. */
+	if ((len = mcf_field(mcf, f->hash, sizeof(f->hash))) < 1)
+		return (-1);
+	if ((len = libscrypt_b64_decode_compliant(f->hash, hashbuf,
+	    sizeof(hashbuf))) < 1)
+		return (-1);
+	f->hashlen = (size_t)len;
+
+	return (0);
+}
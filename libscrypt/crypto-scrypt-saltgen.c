@@ -3,18 +3,112 @@
 #include <stdint.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #ifndef S_SPLINT_S /* Including this here triggers a known bug in splint */
 #include <unistd.h>
 #endif
 
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#include <sys/random.h>
+#define HAVE_GETRANDOM
+#endif
+
 #define RNGDEV "/dev/urandom"
 
-int libscrypt_salt_gen(uint8_t *salt, size_t len)
+/*
+ * Salts are served from a per thread pool refilled POOL_SIZE bytes at a time,
+ * one getrandom() call per refill instead of open/read/close per salt.
+ * Requests larger than half the pool bypass it.  Served bytes are wiped from
+ * the pool, a fork child never reuses its parent's bytes (MADV_WIPEONFORK, or
+ * the atfork handler without it) and the pool is wiped when its thread exits.
+ */
+#define POOL_SIZE	1024
+
+struct pool {
+	size_t avail;
+	uint8_t buf[POOL_SIZE];
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static int pool_ok;
+
+static void
+wipe(void * s, size_t len)
+{
+	volatile uint8_t * p = s;
+
+	while (len--)
+		*p++ = 0;
+}
+
+static void
+pool_destroy(void * arg)
+{
+	struct pool * pool = arg;
+
+	wipe(pool, sizeof(*pool));
+	(void)munmap(pool, sizeof(*pool));
+}
+
+/* In the child the forking thread is the only one, its pool is the stale one. */
+static void
+pool_atfork_child(void)
+{
+	struct pool * pool;
+
+	if ((pool = pthread_getspecific(pool_key)) != NULL)
+		wipe(pool, sizeof(*pool));
+}
+
+static void
+pool_init(void)
+{
+
+	if (pthread_key_create(&pool_key, pool_destroy) != 0)
+		return;
+	if (pthread_atfork(NULL, NULL, pool_atfork_child) != 0)
+		return;
+	pool_ok = 1;
+}
+
+/* The calling thread's pool, NULL if there can't be one. */
+static struct pool *
+pool_get(void)
+{
+	struct pool * pool;
+	void * p;
+
+	if (pthread_once(&pool_once, pool_init) != 0 || !pool_ok)
+		return NULL;
+	if ((pool = pthread_getspecific(pool_key)) != NULL)
+		return pool;
+
+	p = mmap(NULL, sizeof(*pool), PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+#ifdef MADV_WIPEONFORK
+	(void)madvise(p, sizeof(*pool), MADV_WIPEONFORK);
+#endif
+#ifdef MADV_DONTDUMP
+	(void)madvise(p, sizeof(*pool), MADV_DONTDUMP);
+#endif
+	pool = p;
+	if (pthread_setspecific(pool_key, pool) != 0) {
+		(void)munmap(p, sizeof(*pool));
+		return NULL;
+	}
+	return pool;
+}
+
+static int
+urandom_fill(uint8_t *buf, size_t len)
 {
-	unsigned char buf[len];
 	size_t data_read = 0;
-	int urandom = open(RNGDEV, O_RDONLY);
+	int urandom = open(RNGDEV, O_RDONLY | O_CLOEXEC);
 
 	if (urandom < 0)
 	{
@@ -27,7 +121,7 @@ int libscrypt_salt_gen(uint8_t *salt, size_t len)
 		if (result < 0)
 		{
 			if (errno == EINTR || errno == EAGAIN) {
-				continue;	
+				continue;
 			}
 
 			else {
@@ -42,7 +136,64 @@ int libscrypt_salt_gen(uint8_t *salt, size_t len)
 	/* Failures on close() shouldn't occur with O_RDONLY */
 	(void)close(urandom);
 
-	memcpy(salt, buf, len);
+	return 0;
+}
+
+/* Fills buf from the kernel, /dev/urandom only if getrandom() is missing. */
+static int
+random_fill(uint8_t *buf, size_t len)
+{
+#ifdef HAVE_GETRANDOM
+	size_t data_read = 0;
+
+	while (data_read < len) {
+		ssize_t result = getrandom(buf + data_read, len - data_read, 0);
+
+		if (result < 0)
+		{
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ENOSYS && data_read == 0) {
+				return urandom_fill(buf, len);
+			}
+			return -1;
+		}
+
+		data_read += result;
+	}
+
+	return 0;
+#else
+	return urandom_fill(buf, len);
+#endif
+}
+
+int libscrypt_salt_gen(uint8_t *salt, size_t len)
+{
+	struct pool * pool;
+	uint8_t * p;
+
+	if (len > POOL_SIZE / 2 || (pool = pool_get()) == NULL)
+	{
+		return random_fill(salt, len);
+	}
+
+	if (pool->avail < len)
+	{
+		if (random_fill(pool->buf, POOL_SIZE) == -1)
+		{
+			wipe(pool, sizeof(*pool));
+			return -1;
+		}
+		pool->avail = POOL_SIZE;
+	}
+
+	/* Served from the end, the bytes handed out don't stay behind. */
+	pool->avail -= len;
+	p = pool->buf + pool->avail;
+	memcpy(salt, p, len);
+	wipe(p, len);
 
 	return 0;
 }
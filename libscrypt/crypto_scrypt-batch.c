@@ -0,0 +1,370 @@
+/*
+ * Batch verification of "$s1$" MCF hashes, see libscrypt_check_batch().
+ *
+ * The requests of a batch are parsed without modifying them, sorted by
+ * (N, r, p) and handed out in that order to the persistent workers of a
+ * libscrypt_checker.  Each worker runs whole scrypt computations, lanes
+ * included, in scratch space of its own which only grows to the largest
+ * parameters it has seen and is kept between batches, so a steady stream of
+ * checks doesn't allocate.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha256.h"
+#include "crypto_scrypt-internal.h"
+
+#include "libscrypt.h"
+
+/* Worker threads of a checker, the calling thread included. */
+#define MAX_WORKERS	256
+
+/* A 64 byte aligned buffer which only grows. */
+struct scratch {
+	void * base;
+	void * aligned;
+	size_t size;
+};
+
+struct worker {
+	struct libscrypt_checker * checker;
+	struct scratch B;
+	struct scratch XY;
+	struct scratch V;
+	pthread_t tid;
+	int started;
+};
+
+/* A parsed request, sorted by (N, r, p). */
+struct job {
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	size_t i;
+};
+
+struct libscrypt_checker {
+	pthread_mutex_t batch;		/* one batch at a time */
+	pthread_mutex_t lock;		/* everything below */
+	pthread_cond_t work;
+	pthread_cond_t done;
+	uint64_t generation;
+	int shutdown;
+	uint32_t busy;
+	uint32_t nworkers;
+	struct worker * workers;
+
+	/* The current batch. */
+	struct libscrypt_check_req * reqs;
+	struct libscrypt_mcf_fields * fields;
+	struct job * jobs;
+	size_t njobs;
+	size_t next;
+};
+
+/**
+ * scratch_reserve(s, size):
+ * Make s at least size bytes long, its contents are lost when it grows.
+ * Return 0 on success; or -1 on error.
+ */
+static int
+scratch_reserve(struct scratch * s, size_t size)
+{
+	void * base;
+
+	if (size <= s->size)
+		return (0);
+	if (size > SIZE_MAX - 63 || (base = malloc(size + 63)) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	free(s->base);
+	s->base = base;
+	s->aligned = (void *)(((uintptr_t)(base) + 63) & ~ (uintptr_t)(63));
+	s->size = size;
+
+	return (0);
+}
+
+static void
+scratch_wipe(struct scratch * s)
+{
+
+	if (s->base != NULL)
+		memset(s->aligned, 0, s->size);
+}
+
+static void
+scratch_free(struct scratch * s)
+{
+
+	free(s->base);
+	memset(s, 0, sizeof(*s));
+}
+
+/**
+ * worker_scrypt(w, passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
+ * libscrypt_scrypt() in the scratch space of the worker w, all the lanes run
+ * in the calling thread.
+ */
+static int
+worker_scrypt(void * arg, const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+	struct worker * w = arg;
+	uint8_t * B;
+	uint32_t i;
+
+	/* Sanity-check parameters, as libscrypt_scrypt() does. */
+	if ((uint64_t)(r) * (uint64_t)(p) >= (1 << 30)) {
+		errno = EFBIG;
+		return (-1);
+	}
+	if (((N & (N - 1)) != 0) || (N < 2)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if ((r > SIZE_MAX / 128 / p) || (r > SIZE_MAX / 256) ||
+	    (N > SIZE_MAX / 128 / r)) {
+		errno = ENOMEM;
+		return (-1);
+	}
+
+	if (scratch_reserve(&w->B, 128 * r * p) ||
+	    scratch_reserve(&w->XY, 256 * r + 64) ||
+	    scratch_reserve(&w->V, 128 * r * N))
+		return (-1);
+	B = w->B.aligned;
+
+	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+	libscrypt_PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B,
+	    p * 128 * r);
+
+	/* 2: for i = 0 to p - 1 do */
+	for (i = 0; i < p; i++) {
+		/* 3: B_i <-- MF(B_i, N) */
+		libscrypt_smix(&B[i * 128 * r], r, N, w->V.aligned,
+		    w->XY.aligned);
+	}
+
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	libscrypt_PBKDF2_SHA256(passwd, passwdlen, B, p * 128 * r, 1, buf,
+	    buflen);
+
+	return (0);
+}
+
+/**
+ * run_jobs(c, w):
+ * Check the pending requests of the current batch of c on the worker w
+ * until none is left.  The scratch space holds cheap password verifiers
+ * (V_0 is PBKDF2(P, S)), it's wiped before the worker goes idle.
+ */
+static void
+run_jobs(struct libscrypt_checker * c, struct worker * w)
+{
+	struct libscrypt_check_req * req;
+	uint8_t hashbuf[SCRYPT_MCF_LEN];
+	size_t j;
+	int worked = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&c->lock);
+		j = c->next < c->njobs ? c->next++ : c->njobs;
+		pthread_mutex_unlock(&c->lock);
+		if (j == c->njobs)
+			break;
+
+		req = &c->reqs[c->jobs[j].i];
+		req->result = libscrypt_check_fields(&c->fields[c->jobs[j].i],
+		    req->password, hashbuf, worker_scrypt, w);
+		worked = 1;
+	}
+
+	if (worked) {
+		memset(hashbuf, 0, sizeof(hashbuf));
+		scratch_wipe(&w->B);
+		scratch_wipe(&w->XY);
+		scratch_wipe(&w->V);
+	}
+}
+
+static void *
+worker_main(void * arg)
+{
+	struct worker * w = arg;
+	struct libscrypt_checker * c = w->checker;
+	uint64_t seen = 0;
+
+	pthread_mutex_lock(&c->lock);
+	for (;;) {
+		while (!c->shutdown && c->generation == seen)
+			pthread_cond_wait(&c->work, &c->lock);
+		if (c->shutdown)
+			break;
+		seen = c->generation;
+		pthread_mutex_unlock(&c->lock);
+
+		run_jobs(c, w);
+
+		pthread_mutex_lock(&c->lock);
+		if (--c->busy == 0)
+			pthread_cond_signal(&c->done);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return (NULL);
+}
+
+static int
+job_cmp(const void * a, const void * b)
+{
+	const struct job * x = a;
+	const struct job * y = b;
+
+	if (x->N != y->N)
+		return (x->N < y->N ? -1 : 1);
+	if (x->r != y->r)
+		return (x->r < y->r ? -1 : 1);
+	if (x->p != y->p)
+		return (x->p < y->p ? -1 : 1);
+	return (x->i < y->i ? -1 : x->i > y->i);
+}
+
+libscrypt_checker *
+libscrypt_checker_new(uint32_t nthreads)
+{
+	struct libscrypt_checker * c;
+	uint32_t t;
+
+	if (nthreads == 0)
+		nthreads = 1;
+	if (nthreads > MAX_WORKERS)
+		nthreads = MAX_WORKERS;
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return (NULL);
+	if ((c->workers = calloc(nthreads, sizeof(struct worker))) == NULL) {
+		free(c);
+		return (NULL);
+	}
+	c->nworkers = nthreads;
+	pthread_mutex_init(&c->batch, NULL);
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->work, NULL);
+	pthread_cond_init(&c->done, NULL);
+
+	/* Worker 0 is the thread calling libscrypt_check_batch(). */
+	for (t = 0; t < nthreads; t++)
+		c->workers[t].checker = c;
+	for (t = 1; t < nthreads; t++)
+		c->workers[t].started = (pthread_create(&c->workers[t].tid,
+		    NULL, worker_main, &c->workers[t]) == 0);
+
+	return (c);
+}
+
+int
+libscrypt_check_batch(libscrypt_checker * c,
+    struct libscrypt_check_req * reqs, size_t n)
+{
+	struct libscrypt_mcf_fields * fields;
+	struct job * jobs;
+	size_t i, njobs = 0;
+	uint32_t t, started = 0;
+
+	if (c == NULL || (reqs == NULL && n > 0)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (n == 0)
+		return (0);
+	if (n > SIZE_MAX / sizeof(*fields)) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((fields = malloc(n * sizeof(*fields))) == NULL)
+		return (-1);
+	if ((jobs = malloc(n * sizeof(*jobs))) == NULL) {
+		free(fields);
+		return (-1);
+	}
+
+	/* Parse, malformed requests fail right away. */
+	for (i = 0; i < n; i++) {
+		reqs[i].result = -1;
+		if (reqs[i].password == NULL ||
+		    libscrypt_mcf_decode(reqs[i].mcf, &fields[i]) != 0)
+			continue;
+		jobs[njobs].N = fields[i].N;
+		jobs[njobs].r = fields[i].r;
+		jobs[njobs].p = fields[i].p;
+		jobs[njobs].i = i;
+		njobs++;
+	}
+	qsort(jobs, njobs, sizeof(*jobs), job_cmp);
+
+	pthread_mutex_lock(&c->batch);
+	pthread_mutex_lock(&c->lock);
+	for (t = 1; t < c->nworkers; t++)
+		started += c->workers[t].started;
+	c->reqs = reqs;
+	c->fields = fields;
+	c->jobs = jobs;
+	c->njobs = njobs;
+	c->next = 0;
+	c->busy = started;
+	c->generation++;
+	pthread_cond_broadcast(&c->work);
+	pthread_mutex_unlock(&c->lock);
+
+	run_jobs(c, &c->workers[0]);
+
+	pthread_mutex_lock(&c->lock);
+	while (c->busy > 0)
+		pthread_cond_wait(&c->done, &c->lock);
+	c->reqs = NULL;
+	c->fields = NULL;
+	c->jobs = NULL;
+	c->njobs = 0;
+	pthread_mutex_unlock(&c->lock);
+	pthread_mutex_unlock(&c->batch);
+
+	free(jobs);
+	free(fields);
+
+	return (0);
+}
+
+void
+libscrypt_checker_free(libscrypt_checker * c)
+{
+	uint32_t t;
+
+	if (c == NULL)
+		return;
+
+	pthread_mutex_lock(&c->lock);
+	c->shutdown = 1;
+	pthread_cond_broadcast(&c->work);
+	pthread_mutex_unlock(&c->lock);
+	for (t = 1; t < c->nworkers; t++)
+		if (c->workers[t].started)
+			pthread_join(c->workers[t].tid, NULL);
+
+	for (t = 0; t < c->nworkers; t++) {
+		scratch_free(&c->workers[t].B);
+		scratch_free(&c->workers[t].XY);
+		scratch_free(&c->workers[t].V);
+	}
+	pthread_cond_destroy(&c->done);
+	pthread_cond_destroy(&c->work);
+	pthread_mutex_destroy(&c->lock);
+	pthread_mutex_destroy(&c->batch);
+	free(c->workers);
+	free(c);
+}
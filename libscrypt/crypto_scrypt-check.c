@@ -5,101 +5,64 @@
 
 #include "b64.h"
 #include "slowequals.h"
+#include "crypto_scrypt-internal.h"
 #include "libscrypt.h"
 
-#ifdef _WIN32
-/* On windows, strtok uses a thread-local static variable in strtok to
- * make strtok thread-safe.  It also neglects to provide a strtok_r. */
-#define strtok_r(str, val, saveptr) strtok((str), (val))
-#endif
-
-int libscrypt_check(char *mcf, const char *password)
+int
+libscrypt_check_fields(const struct libscrypt_mcf_fields * f,
+    const char * password, uint8_t * hashbuf, libscrypt_check_fn scrypt,
+    void * arg)
 {
-	/* Return values:
-	* <0 error
-	* == 0 password incorrect
-	* >0 correct password
-	*/
-
-#ifndef _WIN32
-	char *saveptr = NULL;
-#endif
-	uint32_t params;
-	uint64_t N;
-	uint8_t r, p;
+	char outbuf[SCRYPT_MCF_LEN];
 	int retval;
-	uint8_t hashbuf[64];
-	char outbuf[128];
-	uint8_t salt[32];
-	char *tok;
-
-    if(mcf == NULL)
-    {
-        return -1;
-    }
 
-	if(memcmp(mcf, SCRYPT_MCF_ID, 3) != 0)
-	{
-		/* Only version 0 supported */
-		return -1;
-	}
-
-	tok = strtok_r(mcf, "$", &saveptr);
-	if ( !tok )
-		return -1;
+	if (scrypt(arg, (const uint8_t *)password, strlen(password), f->salt,
+	    f->saltlen, f->N, f->r, f->p, hashbuf, f->hashlen) != 0)
+		return (-1);
 
-	tok = strtok_r(NULL, "$", &saveptr);
-
-	if ( !tok )
-		return -1;
+	if (libscrypt_b64_encode_compliant(hashbuf, f->hashlen, outbuf,
+	    sizeof(outbuf)) == -1)
+		return (-1);
 
-	params = (uint32_t)strtoul(tok, NULL, 16);
-	if ( params == 0 )
-		return -1;
-
-	tok = strtok_r(NULL, "$", &saveptr);
-
-	if ( !tok )
-		return -1;
+	retval = slow_equals(f->hash, outbuf);
+	memset(outbuf, 0, sizeof(outbuf));
 
-	p = params & 0xff;
-	r = (params >> 8) & 0xff;
-	N = params >> 16;
+	return (retval);
+}
 
-	if (N > SCRYPT_SAFE_N)
-		return -1;
+static int
+check_scrypt(void * arg, const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
 
-	N = (uint64_t)1 << N;
+	(void)arg;
+	return (libscrypt_scrypt(passwd, passwdlen, salt, saltlen, N, r, p,
+	    buf, buflen));
+}
 
-	/* Useful debugging:
-	printf("We've obtained salt 'N' r p of '%s' %d %d %d\n", tok, N,r,p);
+int libscrypt_check(char *mcf, const char *password)
+{
+	/* Return values:
+	* <0 error
+	* == 0 password incorrect
+	* >0 correct password
 	*/
 
-	memset(salt, 0, sizeof(salt)); /* Keeps splint happy */
-	retval = libscrypt_b64_decode_compliant(tok, (unsigned char*)salt, sizeof(salt));
-	if (retval < 1)
-		return -1;
-
-	retval = libscrypt_scrypt((uint8_t*)password, strlen(password), salt,
-            (uint32_t)retval, N, r, p, hashbuf, sizeof(hashbuf));
-
-	if (retval != 0)
-		return -1;
-
-	retval = libscrypt_b64_encode_compliant((unsigned char*)hashbuf, sizeof(hashbuf),
-            outbuf, sizeof(outbuf));
+	struct libscrypt_mcf_fields fields;
+	uint8_t hashbuf[SCRYPT_MCF_LEN];
+	int retval;
 
-	if (retval == 0)
+	if (mcf == NULL || password == NULL)
 		return -1;
 
-	tok = strtok_r(NULL, "$", &saveptr);
-
-	if ( !tok )
+	/* mcf is left untouched, only version 0 is supported */
+	if (libscrypt_mcf_decode(mcf, &fields) != 0)
 		return -1;
 
-	if(slow_equals(tok, outbuf) == 0)
-		return 0;
+	retval = libscrypt_check_fields(&fields, password, hashbuf,
+	    check_scrypt, NULL);
+	memset(hashbuf, 0, sizeof(hashbuf));
 
-	return 1; /* This is the "else" condition */
+	return retval;
 }
-
@@ -0,0 +1,135 @@
+#ifndef _CRYPTO_SCRYPT_INTERNAL_H_
+#define _CRYPTO_SCRYPT_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The scrypt core primitives of crypto_scrypt-nosse.c, for benchmarks and
+ * tests.  They're part of libscrypt.a but not of the libscrypt.so ABI, see
+ * libscrypt.version.
+ */
+
+/**
+ * libscrypt_salsa20_8(B):
+ * Apply the salsa20/8 core to the provided block.
+ */
+void libscrypt_salsa20_8(uint32_t B[16]);
+
+/**
+ * libscrypt_salsa20(B, rounds):
+ * Apply the salsa20 core with an even number of rounds, salsa20/2 and
+ * salsa20/8 for crypto_yescrypt.c.
+ */
+void libscrypt_salsa20(uint32_t B[16], int rounds);
+
+/**
+ * libscrypt_blockmix_salsa8(Bin, Bout, X, r):
+ * Compute Bout = BlockMix_{salsa20/8, r}(Bin).  The input Bin must be 128r
+ * bytes in length; the output Bout must also be the same size.  The
+ * temporary space X must be 64 bytes.
+ */
+void libscrypt_blockmix_salsa8(uint32_t *, uint32_t *, uint32_t *, size_t);
+
+/**
+ * libscrypt_smix(B, r, N, V, XY):
+ * Compute B = SMix_r(B, N).  The input B must be 128r bytes in length;
+ * the temporary storage V must be 128rN bytes in length; the temporary
+ * storage XY must be 256r + 64 bytes in length.  The value N must be a
+ * power of 2 greater than 1.  The arrays B, V, and XY must be aligned to a
+ * multiple of 64 bytes.
+ */
+void libscrypt_smix(uint8_t *, size_t, uint64_t, uint32_t *, uint32_t *);
+
+/*
+ * The kernels and execution modes behind libscrypt_scrypt_mt(), terminated
+ * by a NULL name.  The first one is the portable single threaded path every
+ * other kernel must match, the others are its threaded execution modes, see
+ * libscrypt_selftest() and difftest.c.
+ */
+struct libscrypt_kernel {
+	const char * name;
+	int (*scrypt)(const uint8_t *, size_t, const uint8_t *, size_t,
+	    uint64_t, uint32_t, uint32_t, uint8_t *, size_t);
+};
+
+extern const struct libscrypt_kernel libscrypt_kernels[];
+
+/* Set by libscrypt_selftest() when a threaded kernel fails. */
+extern int libscrypt_threads_disabled;
+
+/*
+ * libscrypt_yescrypt() on up to nthreads threads even if the threaded lanes
+ * have been disabled, the self-test compares it with the single thread path.
+ */
+int libscrypt_yescrypt_kernel(const uint8_t *, size_t, const uint8_t *,
+    size_t, uint64_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t,
+    uint8_t *, size_t);
+
+/* Set by libscrypt_yescrypt_selftest() when the threaded lanes fail. */
+extern int libscrypt_yescrypt_threads_disabled;
+
+/* Known answers, hex encoded. */
+struct libscrypt_vector {
+	const char * passwd;
+	const char * salt;
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	const char * hex;
+};
+
+/* The RFC 7914 section 12 vectors, the last one needs 1 GiB. */
+#define LIBSCRYPT_RFC7914_VECTORS	4
+extern const struct libscrypt_vector
+    libscrypt_rfc7914[LIBSCRYPT_RFC7914_VECTORS];
+
+/* yescrypt known answers, hex encoded. */
+struct libscrypt_yescrypt_vector {
+	const char * passwd;
+	const char * salt;
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	uint32_t t;
+	uint32_t flags;
+	const char * hex;
+};
+
+/* Upstream yescrypt answers in the YESCRYPT_WORM and YESCRYPT_RW modes. */
+#define LIBSCRYPT_YESCRYPT_VECTORS	7
+extern const struct libscrypt_yescrypt_vector
+    libscrypt_yescrypt_kat[LIBSCRYPT_YESCRYPT_VECTORS];
+
+/* The fields of a "$s1$" MCF string, see libscrypt_mcf(). */
+struct libscrypt_mcf_fields {
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	uint8_t salt[128];
+	size_t saltlen;
+	char hash[128];		/* base64, NUL terminated */
+	size_t hashlen;		/* decoded length */
+};
+
+/**
+ * libscrypt_mcf_decode(mcf, fields):
+ * Parse mcf into fields without modifying it.  The salt and hash may have
+ * any length up to the MCF size.
+ * Return 0 on success; or -1 if mcf is malformed.
+ */
+int libscrypt_mcf_decode(const char *, struct libscrypt_mcf_fields *);
+
+/**
+ * libscrypt_check_fields(fields, password, hashbuf, scrypt, arg):
+ * Compute the scrypt hash of password for the decoded fields with
+ * scrypt(arg, ...) into hashbuf, which must hold fields->hashlen bytes, and
+ * compare it in constant time with the MCF one.
+ * Return >0 if password is correct, 0 if not, or <0 on error.
+ */
+typedef int (*libscrypt_check_fn)(void *, const uint8_t *, size_t,
+    const uint8_t *, size_t, uint64_t, uint32_t, uint32_t, uint8_t *, size_t);
+int libscrypt_check_fields(const struct libscrypt_mcf_fields *, const char *,
+    uint8_t *, libscrypt_check_fn, void *);
+
+#endif /* !_CRYPTO_SCRYPT_INTERNAL_H_ */
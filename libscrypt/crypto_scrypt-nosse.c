@@ -32,17 +32,32 @@
 #include <sys/mman.h>
 #endif
 #include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "sha256.h"
 #include "sysendian.h"
+#include "crypto_scrypt-internal.h"
+#include "libscrypt-sdt.h"
 
 #include "libscrypt.h"
 
+/* Per thread hook, see libscrypt_set_hook(). */
+static __thread libscrypt_hook_fn hook;
+static __thread void * hook_arg;
+
+#define HOOK(event) do {					\
+	if (hook != NULL)					\
+		hook((event), hook_arg);			\
+} while (0)
+
 static void blkcpy(void *, void *, size_t);
 static void blkxor(void *, void *, size_t);
+static void salsa20(uint32_t[16], int);
 static void salsa20_8(uint32_t[16]);
 static void blockmix_salsa8(uint32_t *, uint32_t *, uint32_t *, size_t);
 static uint64_t integerify(void *, size_t);
@@ -73,17 +88,18 @@ blkxor(void * dest, void * src, size_t len)
 }
 
 /**
- * salsa20_8(B):
- * Apply the salsa20/8 core to the provided block.
+ * salsa20(B, rounds):
+ * Apply the salsa20 core with the given even number of rounds to the
+ * provided block.
  */
-static void
-salsa20_8(uint32_t B[16])
+static inline void
+salsa20(uint32_t B[16], int rounds)
 {
 	uint32_t x[16];
-	size_t i;
+	int i;
 
 	blkcpy(x, B, 64);
-	for (i = 0; i < 8; i += 2) {
+	for (i = 0; i < rounds; i += 2) {
 #define R(a,b) (((a) << (b)) | ((a) >> (32 - (b))))
 		/* Operate on columns. */
 		x[ 4] ^= R(x[ 0]+x[12], 7);  x[ 8] ^= R(x[ 4]+x[ 0], 9);
@@ -116,6 +132,17 @@ salsa20_8(uint32_t B[16])
 		B[i] += x[i];
 }
 
+/**
+ * salsa20_8(B):
+ * Apply the salsa20/8 core to the provided block.
+ */
+static void
+salsa20_8(uint32_t B[16])
+{
+
+	salsa20(B, 8);
+}
+
 /**
  * blockmix_salsa8(Bin, Bout, X, r):
  * Compute Bout = BlockMix_{salsa20/8, r}(Bin).  The input Bin must be 128r
@@ -185,6 +212,7 @@ smix(uint8_t * B, size_t r, uint64_t N, uint32_t * V, uint32_t * XY)
 		X[k] = le32dec(&B[4 * k]);
 
 	/* 2: for i = 0 to N - 1 do */
+	HOOK(LIBSCRYPT_EV_SMIX_FILL_BEGIN);
 	for (i = 0; i < N; i += 2) {
 		/* 3: V_i <-- X */
 		blkcpy(&V[i * (32 * r)], X, 128 * r);
@@ -199,7 +227,10 @@ smix(uint8_t * B, size_t r, uint64_t N, uint32_t * V, uint32_t * XY)
 		blockmix_salsa8(Y, X, Z, r);
 	}
 
+	HOOK(LIBSCRYPT_EV_SMIX_FILL_END);
+
 	/* 6: for i = 0 to N - 1 do */
+	HOOK(LIBSCRYPT_EV_SMIX_MIX_BEGIN);
 	for (i = 0; i < N; i += 2) {
 		/* 7: j <-- Integerify(X) mod N */
 		j = integerify(X, r) & (N - 1);
@@ -216,11 +247,157 @@ smix(uint8_t * B, size_t r, uint64_t N, uint32_t * V, uint32_t * XY)
 		blockmix_salsa8(Y, X, Z, r);
 	}
 
+	HOOK(LIBSCRYPT_EV_SMIX_MIX_END);
+
 	/* 10: B' <-- X */
 	for (k = 0; k < 32 * r; k++)
 		le32enc(&B[4 * k], X[k]);
 }
 
+/**
+ * libscrypt_set_hook(fn, arg):
+ * Report the scrypt stages of the calling thread to fn, NULL disables it.
+ */
+void
+libscrypt_set_hook(libscrypt_hook_fn fn, void * arg)
+{
+
+	hook = fn;
+	hook_arg = arg;
+}
+
+/* Non-static entry points, see crypto_scrypt-internal.h. */
+void
+libscrypt_salsa20_8(uint32_t B[16])
+{
+
+	salsa20_8(B);
+}
+
+void
+libscrypt_salsa20(uint32_t B[16], int rounds)
+{
+
+	salsa20(B, rounds);
+}
+
+void
+libscrypt_blockmix_salsa8(uint32_t * Bin, uint32_t * Bout, uint32_t * X,
+    size_t r)
+{
+
+	blockmix_salsa8(Bin, Bout, X, r);
+}
+
+void
+libscrypt_smix(uint8_t * B, size_t r, uint64_t N, uint32_t * V, uint32_t * XY)
+{
+
+	smix(B, r, N, V, XY);
+}
+
+/*
+ * The SMix lanes B_first, B_{first + stride}, ... of a p-lane B, handled by
+ * one worker.
+ */
+struct smix_lanes {
+	uint8_t * B;
+	size_t r;
+	uint64_t N;
+	uint32_t p;
+	uint32_t first;
+	uint32_t stride;
+	int err;
+};
+
+/**
+ * smix_lanes(arg):
+ * Compute B_i = MF(B_i, N) for the lanes i = first, first + stride, ... < p
+ * of the struct smix_lanes pointed to by arg, using scratch space private to
+ * this call.  On failure lanes->err is set to errno.
+ */
+static void *
+smix_lanes(void * arg)
+{
+	struct smix_lanes * lanes = arg;
+	size_t r = lanes->r;
+	uint64_t N = lanes->N;
+	void * V0, * XY0;
+	uint32_t * V;
+	uint32_t * XY;
+	uint32_t i;
+
+	lanes->err = 0;
+
+	/* Allocate memory. */
+#ifdef HAVE_POSIX_MEMALIGN
+	if ((errno = posix_memalign(&XY0, 64, 256 * r + 64)) != 0)
+		goto err0;
+	XY = (uint32_t *)(XY0);
+#ifndef MAP_ANON
+	if ((errno = posix_memalign(&V0, 64, 128 * r * N)) != 0)
+		goto err1;
+	V = (uint32_t *)(V0);
+#endif
+#else
+	if ((XY0 = malloc(256 * r + 64 + 63)) == NULL)
+		goto err0;
+	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
+#ifndef MAP_ANON
+	if ((V0 = malloc(128 * r * N + 63)) == NULL)
+		goto err1;
+	V = (uint32_t *)(((uintptr_t)(V0) + 63) & ~ (uintptr_t)(63));
+#endif
+#endif
+#ifdef MAP_ANON
+	if ((V0 = mmap(NULL, 128 * r * N, PROT_READ | PROT_WRITE,
+#ifdef MAP_NOCORE
+	    MAP_ANON | MAP_PRIVATE | MAP_NOCORE,
+#else
+	    MAP_ANON | MAP_PRIVATE,
+#endif
+	    -1, 0)) == MAP_FAILED)
+		goto err1;
+	V = (uint32_t *)(V0);
+#endif
+
+	/* 2: for i = 0 to p - 1 do */
+	for (i = lanes->first; i < lanes->p; i += lanes->stride) {
+		/* 3: B_i <-- MF(B_i, N) */
+		LIBSCRYPT_PROBE3(libscrypt, lane_start, i, N, r);
+		smix(&lanes->B[i * 128 * r], r, N, V, XY);
+		LIBSCRYPT_PROBE1(libscrypt, lane_done, i);
+	}
+
+	/*
+	 * Free memory, wiping what stays in the heap; an unmapped V goes back
+	 * to the kernel, which zeroes it before handing it out again.
+	 */
+#ifdef MAP_ANON
+	if (munmap(V0, 128 * r * N))
+		goto err1;
+#else
+	memset(V, 0, 128 * r * N);
+	free(V0);
+#endif
+	memset(XY, 0, 256 * r + 64);
+	free(XY0);
+
+	/* Success! */
+	return (NULL);
+
+err1:
+	memset(XY, 0, 256 * r + 64);
+	free(XY0);
+err0:
+	/* Failure! */
+	lanes->err = errno ? errno : ENOMEM;
+	return (NULL);
+}
+
+static int scrypt_lanes(const uint8_t *, size_t, const uint8_t *, size_t,
+    uint64_t, uint32_t, uint32_t, uint32_t, uint8_t *, size_t);
+
 /**
  * crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
  * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
@@ -235,19 +412,101 @@ libscrypt_scrypt(const uint8_t * passwd, size_t passwdlen,
     const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
     uint8_t * buf, size_t buflen)
 {
-	void * B0, * V0, * XY0;
+
+	return (scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p,
+	    1, buf, buflen));
+}
+
+/**
+ * libscrypt_scrypt_mt(passwd, passwdlen, salt, saltlen, N, r, p, nthreads,
+ *     buf, buflen):
+ * Compute the same value as libscrypt_scrypt(), running the p independent
+ * SMix lanes on up to nthreads threads.  Every thread needs its own 128rN
+ * bytes of scratch space.  All the lanes run in the calling thread once the
+ * threaded kernels have been disabled by libscrypt_selftest().
+ *
+ * Return 0 on success; or -1 on error
+ */
+int
+libscrypt_scrypt_mt(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t nthreads, uint8_t * buf, size_t buflen)
+{
+
+	if (libscrypt_threads_disabled)
+		nthreads = 1;
+	return (scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p,
+	    nthreads, buf, buflen));
+}
+
+/*
+ * The execution modes of libscrypt_scrypt_mt(), see crypto_scrypt-internal.h.
+ * They bypass libscrypt_threads_disabled so a disabled kernel can still be
+ * tested.
+ */
+static int
+kernel_portable(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+
+	return (scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p,
+	    1, buf, buflen));
+}
+
+/* One thread per lane. */
+static int
+kernel_threads(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+
+	return (scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p,
+	    p, buf, buflen));
+}
+
+/* Two threads, each one running every other lane. */
+static int
+kernel_striped(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+
+	return (scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p,
+	    2, buf, buflen));
+}
+
+int libscrypt_threads_disabled;
+
+const struct libscrypt_kernel libscrypt_kernels[] = {
+	{ "portable", kernel_portable },
+	{ "threads", kernel_threads },
+	{ "threads-striped", kernel_striped },
+	{ NULL, NULL }
+};
+
+/**
+ * scrypt_B(passwd, passwdlen, salt, saltlen, N, r, p, nthreads, B0):
+ * Steps 1 to 4 of scrypt, B <-- PBKDF2(P, S, 1, p * MFLen) and then
+ * B_i <-- MF(B_i, N) with the lanes on up to nthreads threads.  Return the
+ * 128rp bytes of B, 64 byte aligned, and set *B0 to what to free(); or
+ * return NULL on error.
+ */
+static uint8_t *
+scrypt_B(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t nthreads, void ** B0)
+{
+	struct smix_lanes * lanes;
 	uint8_t * B;
-	uint32_t * V;
-	uint32_t * XY;
-	uint32_t i;
+	uint32_t t;
+	int err = 0;
+#ifndef _WIN32
+	pthread_t * tids;
+	uint32_t * started;
+#endif
 
 	/* Sanity-check parameters. */
-#if SIZE_MAX > UINT32_MAX
-	if (buflen > (((uint64_t)(1) << 32) - 1) * 32) {
-		errno = EFBIG;
-		goto err0;
-	}
-#endif
 	if ((uint64_t)(r) * (uint64_t)(p) >= (1 << 30)) {
 		errno = EFBIG;
 		goto err0;
@@ -268,75 +527,329 @@ libscrypt_scrypt(const uint8_t * passwd, size_t passwdlen,
 		errno = ENOMEM;
 		goto err0;
 	}
+	if (nthreads == 0)
+		nthreads = 1;
+	if (nthreads > p)
+		nthreads = p;
 
 	/* Allocate memory. */
 #ifdef HAVE_POSIX_MEMALIGN
-	if ((errno = posix_memalign(&B0, 64, 128 * r * p)) != 0)
+	if ((errno = posix_memalign(B0, 64, 128 * r * p)) != 0)
 		goto err0;
-	B = (uint8_t *)(B0);
-	if ((errno = posix_memalign(&XY0, 64, 256 * r + 64)) != 0)
-		goto err1;
-	XY = (uint32_t *)(XY0);
-#ifndef MAP_ANON
-	if ((errno = posix_memalign(&V0, 64, 128 * r * N)) != 0)
-		goto err2;
-	V = (uint32_t *)(V0);
-#endif
+	B = (uint8_t *)(*B0);
 #else
-	if ((B0 = malloc(128 * r * p + 63)) == NULL)
+	if ((*B0 = malloc(128 * r * p + 63)) == NULL)
 		goto err0;
-	B = (uint8_t *)(((uintptr_t)(B0) + 63) & ~ (uintptr_t)(63));
-	if ((XY0 = malloc(256 * r + 64 + 63)) == NULL)
+	B = (uint8_t *)(((uintptr_t)(*B0) + 63) & ~ (uintptr_t)(63));
+#endif
+	if ((lanes = calloc(nthreads, sizeof(struct smix_lanes))) == NULL)
 		goto err1;
-	XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
-#ifndef MAP_ANON
-	if ((V0 = malloc(128 * r * N + 63)) == NULL)
+#ifndef _WIN32
+	if ((tids = calloc(nthreads, sizeof(pthread_t))) == NULL)
 		goto err2;
-	V = (uint32_t *)(((uintptr_t)(V0) + 63) & ~ (uintptr_t)(63));
-#endif
+	if ((started = calloc(nthreads, sizeof(uint32_t))) == NULL)
+		goto err3;
 #endif
-#ifdef MAP_ANON
-	if ((V0 = mmap(NULL, 128 * r * N, PROT_READ | PROT_WRITE,
-#ifdef MAP_NOCORE
-	    MAP_ANON | MAP_PRIVATE | MAP_NOCORE,
+
+	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+	HOOK(LIBSCRYPT_EV_PBKDF2_BEGIN);
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_start, p * 128 * r);
+	libscrypt_PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B, p * 128 * r);
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_done, p * 128 * r);
+	HOOK(LIBSCRYPT_EV_PBKDF2_END);
+
+	/* 2: for i = 0 to p - 1 do, with lane i handled by worker i % nthreads */
+	HOOK(LIBSCRYPT_EV_SMIX_BEGIN);
+	for (t = 0; t < nthreads; t++) {
+		lanes[t].B = B;
+		lanes[t].r = r;
+		lanes[t].N = N;
+		lanes[t].p = p;
+		lanes[t].first = t;
+		lanes[t].stride = nthreads;
+	}
+#ifndef _WIN32
+	/* Worker 0 runs in this thread; a worker which can't be started too. */
+	for (t = 1; t < nthreads; t++)
+		started[t] = (pthread_create(&tids[t], NULL, smix_lanes,
+		    &lanes[t]) == 0);
+	smix_lanes(&lanes[0]);
+	for (t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(tids[t], NULL);
+		else
+			smix_lanes(&lanes[t]);
+	}
 #else
-	    MAP_ANON | MAP_PRIVATE,
+	for (t = 0; t < nthreads; t++)
+		smix_lanes(&lanes[t]);
 #endif
-	    -1, 0)) == MAP_FAILED)
-		goto err2;
-	V = (uint32_t *)(V0);
+	HOOK(LIBSCRYPT_EV_SMIX_END);
+	for (t = 0; t < nthreads; t++)
+		if (lanes[t].err)
+			err = lanes[t].err;
+	if (err) {
+		errno = err;
+		goto err4;
+	}
+
+	/* Free memory. */
+#ifndef _WIN32
+	free(started);
+	free(tids);
 #endif
+	free(lanes);
 
-	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
-	libscrypt_PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B, p * 128 * r);
+	/* Success! */
+	return (B);
 
-	/* 2: for i = 0 to p - 1 do */
-	for (i = 0; i < p; i++) {
-		/* 3: B_i <-- MF(B_i, N) */
-		smix(&B[i * 128 * r], r, N, V, XY);
+err4:
+#ifndef _WIN32
+	free(started);
+err3:
+	free(tids);
+err2:
+#endif
+	free(lanes);
+err1:
+	memset(B, 0, 128 * r * p);
+	free(*B0);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * scrypt_lanes(passwd, passwdlen, salt, saltlen, N, r, p, nthreads, buf,
+ *     buflen):
+ * Compute libscrypt_scrypt_mt() on up to nthreads threads, whether or not
+ * the threaded kernels are disabled.
+ */
+static int
+scrypt_lanes(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t nthreads, uint8_t * buf, size_t buflen)
+{
+	void * B0;
+	uint8_t * B;
+
+	LIBSCRYPT_PROBE4(libscrypt, derive_start, N, r, p, nthreads);
+
+	/* Sanity-check parameters. */
+#if SIZE_MAX > UINT32_MAX
+	if (buflen > (((uint64_t)(1) << 32) - 1) * 32) {
+		errno = EFBIG;
+		goto err0;
 	}
+#endif
+	if ((B = scrypt_B(passwd, passwdlen, salt, saltlen, N, r, p, nthreads,
+	    &B0)) == NULL)
+		goto err0;
 
 	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	HOOK(LIBSCRYPT_EV_PBKDF2_BEGIN);
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_start, buflen);
 	libscrypt_PBKDF2_SHA256(passwd, passwdlen, B, p * 128 * r, 1, buf, buflen);
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_done, buflen);
+	HOOK(LIBSCRYPT_EV_PBKDF2_END);
 
 	/* Free memory. */
-#ifdef MAP_ANON
-	if (munmap(V0, 128 * r * N))
+	memset(B, 0, p * 128 * r);
+	free(B0);
+
+	/* Success! */
+	LIBSCRYPT_PROBE4(libscrypt, derive_done, N, r, p, 0);
+	return (0);
+
+err0:
+	/* Failure! */
+	LIBSCRYPT_PROBE4(libscrypt, derive_done, N, r, p, errno);
+	return (-1);
+}
+
+/*
+ * The output of libscrypt_scrypt_stream() is computed STREAM_CHUNK bytes per
+ * worker at a time, and handed out in that order.
+ */
+#define STREAM_CHUNK	65536
+
+/* The 32 byte blocks T_first ... of a chunk of the final PBKDF2. */
+struct pbkdf2_chunk {
+	const HMAC_SHA256_CTX * PBhctx;
+	uint8_t * buf;
+	uint64_t first;
+	size_t len;
+};
+
+/**
+ * pbkdf2_chunk(arg):
+ * Compute the len bytes from the block first on of PBKDF2(P, B, 1, dkLen),
+ * each block being HMAC(P, B || INT(i + 1)) from the HMAC state PBhctx of
+ * the struct pbkdf2_chunk pointed to by arg, which already absorbed P and B.
+ */
+static void *
+pbkdf2_chunk(void * arg)
+{
+	struct pbkdf2_chunk * chunk = arg;
+	HMAC_SHA256_CTX hctx;
+	uint8_t ivec[4];
+	uint8_t T[32];
+	size_t i, clen;
+
+	for (i = 0; i * 32 < chunk->len; i++) {
+		be32enc(ivec, (uint32_t)(chunk->first + i + 1));
+		memcpy(&hctx, chunk->PBhctx, sizeof(HMAC_SHA256_CTX));
+		libscrypt_HMAC_SHA256_Update(&hctx, ivec, 4);
+
+		/* Only a short last block needs copying. */
+		clen = chunk->len - i * 32;
+		if (clen >= 32) {
+			libscrypt_HMAC_SHA256_Final(&chunk->buf[i * 32], &hctx);
+		} else {
+			libscrypt_HMAC_SHA256_Final(T, &hctx);
+			memcpy(&chunk->buf[i * 32], T, clen);
+		}
+	}
+
+	memset(&hctx, 0, sizeof(HMAC_SHA256_CTX));
+	memset(T, 0, sizeof(T));
+	return (NULL);
+}
+
+/**
+ * libscrypt_scrypt_stream(passwd, passwdlen, salt, saltlen, N, r, p,
+ *     nthreads, len, out, arg):
+ * Compute the len bytes of scrypt(passwd, salt, N, r, p, len) on up to
+ * nthreads threads and hand them to out(buf, buflen, arg) in order.  Only
+ * the HMAC state of the final PBKDF2 is kept once the lanes are done, its
+ * blocks are computed STREAM_CHUNK bytes per thread at a time.
+ *
+ * Return 0 on success; or -1 on error, or if out returned non-zero.
+ */
+int
+libscrypt_scrypt_stream(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t nthreads, uint64_t len, libscrypt_stream_fn out, void * arg)
+{
+	HMAC_SHA256_CTX PBhctx;
+	struct pbkdf2_chunk * chunks;
+	void * B0;
+	uint8_t * B;
+	uint8_t * buf;
+	uint64_t done;
+	uint32_t t, n;
+	int err = 0;
+#ifndef _WIN32
+	pthread_t * tids;
+	uint32_t * started;
+#endif
+
+	LIBSCRYPT_PROBE4(libscrypt, derive_start, N, r, p, nthreads);
+
+	/* Sanity-check parameters. */
+	if (len > (((uint64_t)(1) << 32) - 1) * 32) {
+		errno = EFBIG;
+		goto err0;
+	}
+	if (out == NULL) {
+		errno = EINVAL;
+		goto err0;
+	}
+	if (libscrypt_threads_disabled || nthreads == 0)
+		nthreads = 1;
+	if (nthreads > (len + STREAM_CHUNK - 1) / STREAM_CHUNK)
+		nthreads = (uint32_t)((len + STREAM_CHUNK - 1) / STREAM_CHUNK);
+	if (nthreads == 0)
+		nthreads = 1;
+
+	/* Allocate memory. */
+	if ((buf = malloc((size_t)(nthreads) * STREAM_CHUNK)) == NULL)
+		goto err0;
+	if ((chunks = calloc(nthreads, sizeof(struct pbkdf2_chunk))) == NULL)
+		goto err1;
+#ifndef _WIN32
+	if ((tids = calloc(nthreads, sizeof(pthread_t))) == NULL)
 		goto err2;
-#else
-	free(V0);
+	if ((started = calloc(nthreads, sizeof(uint32_t))) == NULL)
+		goto err3;
 #endif
-	free(XY0);
+
+	if ((B = scrypt_B(passwd, passwdlen, salt, saltlen, N, r, p, nthreads,
+	    &B0)) == NULL)
+		goto err4;
+
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen), from the state after P and B. */
+	HOOK(LIBSCRYPT_EV_PBKDF2_BEGIN);
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_start, len);
+	libscrypt_HMAC_SHA256_Init(&PBhctx, passwd, passwdlen);
+	libscrypt_HMAC_SHA256_Update(&PBhctx, B, p * 128 * r);
+	memset(B, 0, p * 128 * r);
 	free(B0);
 
+	for (done = 0; done < len && !err; ) {
+		for (n = 0; n < nthreads && done < len; n++) {
+			chunks[n].PBhctx = &PBhctx;
+			chunks[n].buf = &buf[(size_t)(n) * STREAM_CHUNK];
+			chunks[n].first = done / 32;
+			chunks[n].len = (len - done > STREAM_CHUNK) ?
+			    STREAM_CHUNK : (size_t)(len - done);
+			done += chunks[n].len;
+		}
+#ifndef _WIN32
+		for (t = 1; t < n; t++)
+			started[t] = (pthread_create(&tids[t], NULL,
+			    pbkdf2_chunk, &chunks[t]) == 0);
+		pbkdf2_chunk(&chunks[0]);
+		for (t = 1; t < n; t++) {
+			if (started[t])
+				pthread_join(tids[t], NULL);
+			else
+				pbkdf2_chunk(&chunks[t]);
+		}
+#else
+		for (t = 0; t < n; t++)
+			pbkdf2_chunk(&chunks[t]);
+#endif
+		for (t = 0; t < n && !err; t++)
+			err = out(chunks[t].buf, chunks[t].len, arg);
+	}
+	LIBSCRYPT_PROBE1(libscrypt, pbkdf2_done, done);
+	HOOK(LIBSCRYPT_EV_PBKDF2_END);
+
+	/* Clean PBhctx and the chunks, out may have failed half way. */
+	memset(&PBhctx, 0, sizeof(HMAC_SHA256_CTX));
+	memset(buf, 0, (size_t)(nthreads) * STREAM_CHUNK);
+	if (err)
+		goto err4;
+
+	/* Free memory. */
+#ifndef _WIN32
+	free(started);
+	free(tids);
+#endif
+	free(chunks);
+	free(buf);
+
 	/* Success! */
+	LIBSCRYPT_PROBE4(libscrypt, derive_done, N, r, p, 0);
 	return (0);
 
+err4:
+	/* Don't clobber the errno of out, if it failed. */
+	err = errno;
+#ifndef _WIN32
+	free(started);
+err3:
+	free(tids);
 err2:
-	free(XY0);
+#endif
+	free(chunks);
 err1:
-	free(B0);
+	free(buf);
+	if (err)
+		errno = err;
 err0:
 	/* Failure! */
+	LIBSCRYPT_PROBE4(libscrypt, derive_done, N, r, p, errno);
 	return (-1);
 }
@@ -0,0 +1,197 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crypto_scrypt-internal.h"
+#include "libscrypt.h"
+
+const struct libscrypt_vector libscrypt_rfc7914[LIBSCRYPT_RFC7914_VECTORS] = {
+	{ "", "", 16, 1, 1,
+	    "77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442"
+	    "fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906" },
+	{ "password", "NaCl", 1024, 8, 16,
+	    "fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b373162"
+	    "2eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640" },
+	{ "pleaseletmein", "SodiumChloride", 16384, 8, 1,
+	    "7023bdcb3afd7348461c06cd81fd38ebfda8fbba904f8e3ea9b543f6545da1f2"
+	    "d5432955613f0fcf62d49705242a9af9e61e85dc0d651e40dfcf017b45575887" },
+	{ "pleaseletmein", "SodiumChloride", 1048576, 8, 1,
+	    "2101cb9b6a511aaeaddbbe09cf70f881ec568d574a2ffd4dabe5ee9820adaa47"
+	    "8e56fd8f4ba5d09ffa1c6d927c40f4c337304049e8a952fbcbf45c6fa77a41a4" }
+};
+
+/* Small shapes every kernel must agree on: odd p, r > 1, odd key lengths. */
+static const struct {
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	size_t buflen;
+} shapes[] = {
+	{ 16, 1, 4, 64 },
+	{ 32, 2, 3, 37 },
+	{ 64, 3, 5, 100 },
+	{ 2, 1, 2, 1 }
+};
+
+static int
+matches_hex(const uint8_t * buf, size_t buflen, const char * hex)
+{
+	char pair[3];
+	size_t i;
+
+	if (strlen(hex) != buflen * 2)
+		return (0);
+	for (i = 0; i < buflen; i++) {
+		snprintf(pair, sizeof(pair), "%02x", buf[i]);
+		if (memcmp(pair, &hex[i * 2], 2) != 0)
+			return (0);
+	}
+	return (1);
+}
+
+/**
+ * libscrypt_selftest():
+ * Check the portable kernel against the first RFC 7914 vector and every
+ * other kernel against the portable one on a few small parameter sets.  A
+ * failing threaded kernel is disabled for the rest of the process, call this
+ * before other threads start deriving.
+ *
+ * Return 0 if all the kernels passed, 1 if a kernel was disabled, or -1 with
+ * errno set to EDOM if the portable kernel itself is broken.
+ */
+int
+libscrypt_selftest(void)
+{
+	const struct libscrypt_vector * v = &libscrypt_rfc7914[0];
+	const struct libscrypt_kernel * k;
+	uint8_t ref[100], out[100];
+	size_t i;
+	int disabled = 0;
+
+	if (libscrypt_kernels[0].scrypt((const uint8_t *)v->passwd,
+	    strlen(v->passwd), (const uint8_t *)v->salt, strlen(v->salt),
+	    v->N, v->r, v->p, ref, 64) ||
+	    !matches_hex(ref, 64, v->hex)) {
+		errno = EDOM;
+		return (-1);
+	}
+
+	for (k = &libscrypt_kernels[1]; k->name != NULL; k++) {
+		for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+			if (libscrypt_kernels[0].scrypt((const uint8_t *)"selftest",
+			    8, (const uint8_t *)"libscrypt", 9, shapes[i].N,
+			    shapes[i].r, shapes[i].p, ref, shapes[i].buflen)) {
+				errno = EDOM;
+				return (-1);
+			}
+			if (k->scrypt((const uint8_t *)"selftest", 8,
+			    (const uint8_t *)"libscrypt", 9, shapes[i].N,
+			    shapes[i].r, shapes[i].p, out, shapes[i].buflen) ||
+			    memcmp(ref, out, shapes[i].buflen) != 0)
+				break;
+		}
+		if (i < sizeof(shapes) / sizeof(shapes[0])) {
+			libscrypt_threads_disabled = 1;
+			disabled = 1;
+		}
+	}
+
+	return (disabled);
+}
+
+/*
+ * yescrypt known answers, all upstream: the YESCRYPT_WORM ones are prefixes
+ * of the yescrypt TESTS-OK vectors (a shorter output is a prefix of a
+ * longer one), the YESCRYPT_RW ones the hashes of these "$y$" crypt(3)
+ * strings, as computed by libxcrypt's copy of the upstream code:
+ *
+ *   $y$j35$$D27qXOZFgPcc0hhr/l0gkWELEu9kzqkqGHYpkAKd7PC
+ *   $y$j75/.$saltsaltsalt$v0w8.LKXSPaT2qyDsN3VPX9BoYflXbZCxneZK0/kYsA
+ *   $y$j75..$saltsaltsalt$yymW5FsTC/srNcVghF15nriJDZiI92wu9kipE0cB5F7
+ *   $y$j850//$saltsaltsalt$86vGK1bQ1prWvG6Wxup.QA4NqMWXjipQhD.WeQiLrJD
+ *
+ * with the passwords "" and "pleaseletmein".  The salt of a "$y$" string is
+ * the decoding of its base64, "saltsaltsalt" is the 9 bytes below, and the
+ * hash the encoding of the 32 byte output.  Upstream yescrypt 1.x rejects
+ * hash upgrades (g), so there are no vectors with them.
+ */
+#define Y_SALT	"\xb8\x19\xe7\xb8\x19\xe7\xb8\x19\xe7"
+
+const struct libscrypt_yescrypt_vector
+    libscrypt_yescrypt_kat[LIBSCRYPT_YESCRYPT_VECTORS] = {
+	{ "", "", 4, 1, 1, 0, LIBSCRYPT_YESCRYPT_WORM, "85dda48c9ec9de2f" },
+	{ "", "", 4, 1, 1, 1, LIBSCRYPT_YESCRYPT_WORM, "4baa8cd8608ba91f" },
+	{ "", "", 4, 1, 1, 2, LIBSCRYPT_YESCRYPT_WORM, "e6e8bba09b6412ff" },
+	{ "", "", 64, 8, 1, 0, LIBSCRYPT_YESCRYPT_DEFAULTS,
+	    "0f91d8a35646ec86a242dbde412cb0b0085d90bec0bf0ddbd244d63063a5c9e6" },
+	{ "pleaseletmein", Y_SALT, 1024, 8, 1, 1, LIBSCRYPT_YESCRYPT_DEFAULTS,
+	    "bbc02bc0658dde667e84ed3f785684dbb83434b9c6e3593afdac969610c024ce" },
+	{ "pleaseletmein", Y_SALT, 1024, 8, 2, 0, LIBSCRYPT_YESCRYPT_DEFAULTS,
+	    "be2f8b47847f4e80df191ab26d341cf3ed564fe9520bc1eb0becd69080364794" },
+	{ "pleaseletmein", Y_SALT, 2048, 8, 3, 2, LIBSCRYPT_YESCRYPT_DEFAULTS,
+	    "0ab24bd67072437d8bbb8488bd5e031c636436268eaf5b73ed03882ae75e77f5" }
+};
+
+/**
+ * libscrypt_yescrypt_selftest():
+ * Check the classic scrypt mode of libscrypt_yescrypt() against the first
+ * RFC 7914 vector, every mode against the known answers above, and the
+ * threaded YESCRYPT_RW lanes against the single thread path.  Failing
+ * threaded lanes are disabled for the rest of the process, call this before
+ * other threads start deriving.
+ *
+ * Return 0 if all passed, 1 if the threaded lanes were disabled, or -1 with
+ * errno set to EDOM if the single thread path itself is broken.
+ */
+int
+libscrypt_yescrypt_selftest(void)
+{
+	const struct libscrypt_vector * v = &libscrypt_rfc7914[0];
+	const struct libscrypt_yescrypt_vector * y;
+	uint8_t ref[64], out[64];
+	size_t i, len;
+
+	if (libscrypt_yescrypt_kernel((const uint8_t *)v->passwd,
+	    strlen(v->passwd), (const uint8_t *)v->salt, strlen(v->salt),
+	    v->N, v->r, v->p, 0, 0, 1, ref, 64) ||
+	    !matches_hex(ref, 64, v->hex)) {
+		errno = EDOM;
+		return (-1);
+	}
+
+	for (i = 0; i < LIBSCRYPT_YESCRYPT_VECTORS; i++) {
+		y = &libscrypt_yescrypt_kat[i];
+		len = strlen(y->hex) / 2;
+		if (libscrypt_yescrypt_kernel((const uint8_t *)y->passwd,
+		    strlen(y->passwd), (const uint8_t *)y->salt, strlen(y->salt),
+		    y->N, y->r, y->p, y->t, y->flags, 1, ref, len) ||
+		    !matches_hex(ref, len, y->hex)) {
+			errno = EDOM;
+			return (-1);
+		}
+	}
+
+	/* The YESCRYPT_RW lanes need N / p >= 2. */
+	for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+		if (shapes[i].N / shapes[i].p <= 1)
+			continue;
+		len = shapes[i].buflen > sizeof(ref) ? sizeof(ref) :
+		    shapes[i].buflen;
+		if (libscrypt_yescrypt_kernel((const uint8_t *)"selftest", 8,
+		    (const uint8_t *)"libscrypt", 9, shapes[i].N, shapes[i].r,
+		    shapes[i].p, 0, LIBSCRYPT_YESCRYPT_DEFAULTS, 1, ref, len)) {
+			errno = EDOM;
+			return (-1);
+		}
+		if (libscrypt_yescrypt_kernel((const uint8_t *)"selftest", 8,
+		    (const uint8_t *)"libscrypt", 9, shapes[i].N, shapes[i].r,
+		    shapes[i].p, 0, LIBSCRYPT_YESCRYPT_DEFAULTS, shapes[i].p,
+		    out, len) || memcmp(ref, out, len) != 0) {
+			libscrypt_yescrypt_threads_disabled = 1;
+			return (1);
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,819 @@
+/*
+ * yescrypt 1.x, following the structure of Solar Designer's yescrypt-ref.c:
+ * scrypt's SMix with pwxform S-box rounds in place of salsa20/8 (YESCRYPT_RW),
+ * built on the salsa20 core and SHA-256 / PBKDF2 of this library.
+ *
+ * Blocks are kept as host order words in the "SIMD shuffled" order of the
+ * reference, word i of a 64 byte sub-block holding salsa20 word i * 5 % 16,
+ * so the salsa20 diagonals line up with 128-bit lanes and pwxform works on
+ * 2 x 64-bit lanes without shuffling.
+ */
+#include <sys/types.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha256.h"
+#include "sysendian.h"
+#include "crypto_scrypt-internal.h"
+
+#include "libscrypt.h"
+
+/* Set by libscrypt_yescrypt_selftest() when the threaded lanes fail. */
+int libscrypt_yescrypt_threads_disabled;
+
+/* Internal: the pre-hashing pass of large YESCRYPT_RW derivations. */
+#define YESCRYPT_PREHASH	0x10000000
+
+/* pwxform parameters of LIBSCRYPT_YESCRYPT_DEFAULTS */
+#define PWXsimple	2
+#define PWXgather	4
+#define PWXrounds	6
+#define Swidth		8
+
+#define PWXbytes	(PWXgather * PWXsimple * 8)
+#define PWXwords	(PWXbytes / sizeof(uint32_t))
+#define Sbytes		(3 * (1 << Swidth) * PWXsimple * 8)
+#define Swords		(Sbytes / sizeof(uint32_t))
+#define Smask		(((1 << Swidth) - 1) * PWXsimple * 8)
+#define rmin		((PWXbytes + 127) / 128)
+
+/* Lanes of one derivation run on at most this many threads. */
+#define MAX_THREADS	256
+
+/* The S-boxes and write position of one lane. */
+typedef struct {
+	uint32_t (*S0)[2], (*S1)[2], (*S2)[2];
+	uint32_t * S;
+	size_t w;
+} pwxform_ctx;
+
+static void
+blkcpy(uint32_t * dst, const uint32_t * src, size_t count)
+{
+
+	while (count--)
+		*dst++ = *src++;
+}
+
+static void
+blkxor(uint32_t * dst, const uint32_t * src, size_t count)
+{
+
+	while (count--)
+		*dst++ ^= *src++;
+}
+
+/**
+ * salsa20_simd(B, rounds):
+ * Apply the salsa20 core to a block stored in the shuffled order.
+ */
+static void
+salsa20_simd(uint32_t B[16], int rounds)
+{
+	uint32_t x[16];
+	size_t i;
+
+	/* SIMD unshuffle */
+	for (i = 0; i < 16; i++)
+		x[i * 5 % 16] = B[i];
+
+	libscrypt_salsa20(x, rounds);
+
+	/* SIMD shuffle */
+	for (i = 0; i < 16; i++)
+		B[i] = x[i * 5 % 16];
+}
+
+/**
+ * blockmix_salsa8(B, Y, r):
+ * Compute B = BlockMix_{salsa20/8, r}(B).  The input B must be 128r bytes in
+ * length; the temporary space Y must also be the same size.
+ */
+static void
+blockmix_salsa8(uint32_t * B, uint32_t * Y, size_t r)
+{
+	uint32_t X[16];
+	size_t i;
+
+	/* 1: X <-- B_{2r - 1} */
+	blkcpy(X, &B[(2 * r - 1) * 16], 16);
+
+	/* 2: for i = 0 to 2r - 1 do */
+	for (i = 0; i < 2 * r; i++) {
+		/* 3: X <-- H(X xor B_i) */
+		blkxor(X, &B[i * 16], 16);
+		salsa20_simd(X, 8);
+
+		/* 4: Y_i <-- X */
+		blkcpy(&Y[i * 16], X, 16);
+	}
+
+	/* 6: B' <-- (Y_0, Y_2 ... Y_{2r-2}, Y_1, Y_3 ... Y_{2r-1}) */
+	for (i = 0; i < r; i++)
+		blkcpy(&B[i * 16], &Y[(i * 2) * 16], 16);
+	for (i = 0; i < r; i++)
+		blkcpy(&B[(i + r) * 16], &Y[(i * 2 + 1) * 16], 16);
+}
+
+/**
+ * pwxform(B, ctx):
+ * Transform the provided PWXbytes block with the lane S-boxes, writing to
+ * S2 as it goes, then rotate the S-boxes.
+ */
+static void
+pwxform(uint32_t * B, pwxform_ctx * ctx)
+{
+	uint32_t (*X)[PWXsimple][2] = (uint32_t (*)[PWXsimple][2])B;
+	uint32_t (*S0)[2] = ctx->S0, (*S1)[2] = ctx->S1, (*S2)[2] = ctx->S2;
+	size_t w = ctx->w;
+	size_t i, j, k;
+
+	/* 1: for i = 0 to PWXrounds - 1 do */
+	for (i = 0; i < PWXrounds; i++) {
+		/* 2: for j = 0 to PWXgather - 1 do */
+		for (j = 0; j < PWXgather; j++) {
+			uint32_t xl = X[j][0][0];
+			uint32_t xh = X[j][0][1];
+			uint32_t (*p0)[2], (*p1)[2];
+
+			/* 3: p0 <-- (lo(B_{j,0}) & Smask) / (PWXsimple * 8) */
+			p0 = S0 + (xl & Smask) / sizeof(*S0);
+			/* 4: p1 <-- (hi(B_{j,0}) & Smask) / (PWXsimple * 8) */
+			p1 = S1 + (xh & Smask) / sizeof(*S1);
+
+			/* 5: for k = 0 to PWXsimple - 1 do */
+			for (k = 0; k < PWXsimple; k++) {
+				uint64_t x, s0, s1;
+
+				/* 6: B_{j,k} <-- (hi(B_{j,k}) * lo(B_{j,k}) + S0_{p0,k}) xor S1_{p1,k} */
+				s0 = ((uint64_t)p0[k][1] << 32) + p0[k][0];
+				s1 = ((uint64_t)p1[k][1] << 32) + p1[k][0];
+
+				xl = X[j][k][0];
+				xh = X[j][k][1];
+
+				x = (uint64_t)xh * xl;
+				x += s0;
+				x ^= s1;
+
+				X[j][k][0] = (uint32_t)x;
+				X[j][k][1] = (uint32_t)(x >> 32);
+
+				/* 8: if (i != 0) and (i != PWXrounds - 1) */
+				if (i != 0 && i != PWXrounds - 1) {
+					/* 9: S2_w <-- B_j */
+					S2[w][0] = (uint32_t)x;
+					S2[w][1] = (uint32_t)(x >> 32);
+					/* 10: w <-- w + 1 */
+					w++;
+				}
+			}
+		}
+	}
+
+	/* 14: (S0, S1, S2) <-- (S2, S0, S1) */
+	ctx->S0 = S2;
+	ctx->S1 = S0;
+	ctx->S2 = S1;
+	/* 15: w <-- w mod 2^Swidth */
+	ctx->w = w & ((1 << Swidth) * PWXsimple - 1);
+}
+
+/**
+ * blockmix_pwxform(B, ctx, r):
+ * Compute B = BlockMix_pwxform{salsa20/2, ctx, r}(B).  The input B must be
+ * 128r bytes in length.
+ */
+static void
+blockmix_pwxform(uint32_t * B, pwxform_ctx * ctx, size_t r)
+{
+	uint32_t X[PWXwords];
+	size_t r1, i;
+
+	/* Convert 128-byte blocks to PWXbytes blocks */
+	/* 1: r_1 <-- 128r / PWXbytes */
+	r1 = 128 * r / PWXbytes;
+
+	/* 2: X <-- B'_{r_1 - 1} */
+	blkcpy(X, &B[(r1 - 1) * PWXwords], PWXwords);
+
+	/* 3: for i = 0 to r_1 - 1 do */
+	for (i = 0; i < r1; i++) {
+		/* 4: if r_1 > 1 */
+		if (r1 > 1) {
+			/* 5: X <-- X xor B'_i */
+			blkxor(X, &B[i * PWXwords], PWXwords);
+		}
+
+		/* 7: X <-- pwxform(X) */
+		pwxform(X, ctx);
+
+		/* 8: B'_i <-- X */
+		blkcpy(&B[i * PWXwords], X, PWXwords);
+	}
+
+	/* 10: i <-- floor((r_1 - 1) * PWXbytes / 64) */
+	i = (r1 - 1) * PWXbytes / 64;
+
+	/* 11: B_i <-- H(B_i) */
+	salsa20_simd(&B[i * 16], 2);
+
+	/* 12: for i = i + 1 to 2r - 1 do, a no-op with these pwxform settings */
+	for (i++; i < 2 * r; i++) {
+		/* 13: B_i <-- H(B_i xor B_{i-1}) */
+		blkxor(&B[i * 16], &B[(i - 1) * 16], 16);
+		salsa20_simd(&B[i * 16], 2);
+	}
+}
+
+static void
+blockmix(uint32_t * B, uint32_t * Y, size_t r, pwxform_ctx * ctx)
+{
+
+	if (ctx != NULL)
+		blockmix_pwxform(B, ctx, r);
+	else
+		blockmix_salsa8(B, Y, r);
+}
+
+/**
+ * integerify(B, r):
+ * Return the result of parsing B_{2r-1} as a little-endian integer, word 13
+ * is the second salsa20 word due to the shuffling.
+ */
+static uint64_t
+integerify(const uint32_t * B, size_t r)
+{
+	const uint32_t * X = &B[(2 * r - 1) * 16];
+
+	return (((uint64_t)X[13] << 32) + X[0]);
+}
+
+/**
+ * p2floor(x):
+ * Largest power of 2 not greater than the argument.
+ */
+static uint32_t
+p2floor(uint32_t x)
+{
+	uint32_t y;
+
+	while ((y = x & (x - 1)) != 0)
+		x = y;
+	return (x);
+}
+
+/**
+ * wrap(x, i):
+ * Wrap x to the range 0 to i-1.
+ */
+static uint32_t
+wrap(uint64_t x, uint32_t i)
+{
+	uint32_t n = p2floor(i);
+
+	return ((uint32_t)(x & (n - 1)) + (i - n));
+}
+
+/**
+ * smix1(B, r, N, flags, V, XY, ctx):
+ * Compute first loop of B = SMix_r(B, N).  The input B must be 128r bytes in
+ * length; the temporary storage V must be 128rN bytes in length; the
+ * temporary storage XY must be 256r bytes in length.
+ */
+static void
+smix1(uint32_t * B, size_t r, uint32_t N, uint32_t flags, uint32_t * V,
+    uint32_t * XY, pwxform_ctx * ctx)
+{
+	size_t s = 32 * r;
+	uint32_t * X = XY;
+	uint32_t * Y = &XY[s];
+	uint32_t i, j;
+	size_t k;
+
+	/* 1: X <-- B */
+	for (k = 0; k < 2 * r; k++)
+		for (i = 0; i < 16; i++)
+			X[k * 16 + i] = le32dec(&B[k * 16 + (i * 5 % 16)]);
+
+	/* 2: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i++) {
+		/* 3: V_i <-- X */
+		blkcpy(&V[i * s], X, s);
+
+		if ((flags & LIBSCRYPT_YESCRYPT_RW) && i > 1) {
+			/* j <-- Wrap(Integerify(X), i) */
+			j = wrap(integerify(X, r), i);
+
+			/* X <-- X xor V_j */
+			blkxor(X, &V[j * s], s);
+		}
+
+		/* 4: X <-- H(X) */
+		blockmix(X, Y, r, ctx);
+	}
+
+	/* B' <-- X */
+	for (k = 0; k < 2 * r; k++)
+		for (i = 0; i < 16; i++)
+			le32enc(&B[k * 16 + (i * 5 % 16)], X[k * 16 + i]);
+}
+
+/**
+ * smix2(B, r, N, Nloop, flags, V, XY, ctx):
+ * Compute second loop of B = SMix_r(B, N).  The input B must be 128r bytes
+ * in length; the temporary storage V must be 128rN bytes in length; the
+ * temporary storage XY must be 256r bytes in length.  The value N must be a
+ * power of 2 greater than 1.  V is only written to with YESCRYPT_RW.
+ */
+static void
+smix2(uint32_t * B, size_t r, uint32_t N, uint64_t Nloop, uint32_t flags,
+    uint32_t * V, uint32_t * XY, pwxform_ctx * ctx)
+{
+	size_t s = 32 * r;
+	uint32_t * X = XY;
+	uint32_t * Y = &XY[s];
+	uint64_t i;
+	uint32_t j;
+	size_t k;
+
+	/* X <-- B */
+	for (k = 0; k < 2 * r; k++)
+		for (j = 0; j < 16; j++)
+			X[k * 16 + j] = le32dec(&B[k * 16 + (j * 5 % 16)]);
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < Nloop; i++) {
+		/* 7: j <-- Integerify(X) mod N */
+		j = (uint32_t)(integerify(X, r) & (N - 1));
+
+		/* 8.1: X <-- X xor V_j */
+		blkxor(X, &V[j * s], s);
+		/* V_j <-- X */
+		if (flags & LIBSCRYPT_YESCRYPT_RW)
+			blkcpy(&V[j * s], X, s);
+
+		/* 8.2: X <-- H(X) */
+		blockmix(X, Y, r, ctx);
+	}
+
+	/* 10: B' <-- X */
+	for (k = 0; k < 2 * r; k++)
+		for (j = 0; j < 16; j++)
+			le32enc(&B[k * 16 + (j * 5 % 16)], X[k * 16 + j]);
+}
+
+/* The SMix state shared by the lanes of one derivation. */
+struct smix_shared {
+	uint32_t * B;
+	size_t r;
+	uint32_t N;
+	uint32_t p;
+	uint32_t flags;
+	uint32_t Nchunk;
+	uint64_t Nloop_all;
+	uint64_t Nloop_rw;
+	uint32_t * V;
+	pwxform_ctx * ctx;
+	uint8_t * passwd;
+	int phase;
+};
+
+/* The lanes first, first + stride, ... handled by one worker. */
+struct smix_worker {
+	struct smix_shared * shared;
+	uint32_t * XY;
+	uint32_t first;
+	uint32_t stride;
+};
+
+/**
+ * smix_lane(sh, i, XY):
+ * Run phase 1 (S-box setup, SMix1 and the read-write part of SMix2 over the
+ * lane's own chunk of V) or phase 2 (the read-only part of SMix2 over all of
+ * V) of lane i.
+ */
+static void
+smix_lane(struct smix_shared * sh, uint32_t i, uint32_t * XY)
+{
+	size_t s = 32 * sh->r;
+	uint32_t Vchunk = i * sh->Nchunk;
+	uint32_t Np = (i < sh->p - 1) ? sh->Nchunk : (sh->N - Vchunk);
+	uint32_t * Bp = &sh->B[s * i];
+	uint32_t * Vp = &sh->V[(size_t)Vchunk * s];
+	pwxform_ctx * ctx = NULL;
+	HMAC_SHA256_CTX hctx;
+
+	if (sh->flags & LIBSCRYPT_YESCRYPT_RW)
+		ctx = &sh->ctx[i];
+
+	if (sh->phase == 2) {
+		/* 31: SMix2_r(B_i, N, Nloop_all - Nloop_rw, V, flags excluding YESCRYPT_RW) */
+		smix2(Bp, sh->r, sh->N, sh->Nloop_all - sh->Nloop_rw,
+		    sh->flags & ~LIBSCRYPT_YESCRYPT_RW, sh->V, XY, ctx);
+		return;
+	}
+
+	/* 17: if YESCRYPT_RW flag is set */
+	if (ctx != NULL) {
+		/* 18: SMix1_1(B_i, Sbytes / 128, S_i, no flags) */
+		smix1(Bp, 1, Sbytes / 128, 0, ctx->S, XY, NULL);
+		/* 19: S2_i <-- S_{i,0...2^Swidth-1} */
+		ctx->S2 = (uint32_t (*)[2])ctx->S;
+		/* 20: S1_i <-- S_{i,2^Swidth...2*2^Swidth-1} */
+		ctx->S1 = ctx->S2 + (1 << Swidth) * PWXsimple;
+		/* 21: S0_i <-- S_{i,2*2^Swidth...3*2^Swidth-1} */
+		ctx->S0 = ctx->S1 + (1 << Swidth) * PWXsimple;
+		/* 22: w_i <-- 0 */
+		ctx->w = 0;
+		/* 23: if i = 0 */
+		if (i == 0) {
+			/* 24: passwd <-- HMAC-SHA256(B_{0,2r-1}, passwd) */
+			libscrypt_HMAC_SHA256_Init(&hctx, Bp + (s - 16), 64);
+			libscrypt_HMAC_SHA256_Update(&hctx, sh->passwd, 32);
+			libscrypt_HMAC_SHA256_Final(sh->passwd, &hctx);
+		}
+	}
+
+	/* 27: SMix1_r(B_i, n, V_{u..v}, flags) */
+	smix1(Bp, sh->r, Np, sh->flags, Vp, XY, ctx);
+	/* 28: SMix2_r(B_i, p2floor(n), Nloop_rw, V_{u..v}, flags) */
+	smix2(Bp, sh->r, p2floor(Np), sh->Nloop_rw, sh->flags, Vp, XY, ctx);
+}
+
+static void *
+smix_worker(void * arg)
+{
+	struct smix_worker * worker = arg;
+	uint32_t i;
+
+	for (i = worker->first; i < worker->shared->p; i += worker->stride)
+		smix_lane(worker->shared, i, worker->XY);
+	return (NULL);
+}
+
+/**
+ * smix_phase(sh, workers, nthreads):
+ * Run the current phase of every lane on up to nthreads threads, worker 0
+ * runs in the calling thread and so does a worker which can't be started.
+ */
+static void
+smix_phase(struct smix_shared * sh, struct smix_worker * workers,
+    uint32_t nthreads)
+{
+#ifndef _WIN32
+	pthread_t tids[MAX_THREADS];
+	int started[MAX_THREADS];
+	uint32_t t;
+
+	for (t = 1; t < nthreads; t++)
+		started[t] = (pthread_create(&tids[t], NULL, smix_worker,
+		    &workers[t]) == 0);
+	smix_worker(&workers[0]);
+	for (t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(tids[t], NULL);
+		else
+			smix_worker(&workers[t]);
+	}
+#else
+	uint32_t t;
+
+	for (t = 0; t < nthreads; t++)
+		smix_worker(&workers[t]);
+#endif
+}
+
+/**
+ * smix(B, r, N, p, t, flags, V, ctx, XY, nthreads, passwd):
+ * Compute B = SMix_r(B, N) over the p lanes of B.  The input B must be
+ * 128rp bytes in length; the temporary storage V must be 128rN bytes in
+ * length; XY holds 256r bytes per thread.  With YESCRYPT_RW ctx holds a
+ * S-box context per lane and passwd (32 bytes) is updated in place.
+ */
+static void
+smix(uint32_t * B, size_t r, uint32_t N, uint32_t p, uint32_t t,
+    uint32_t flags, uint32_t * V, pwxform_ctx * ctx, uint32_t * XY,
+    uint32_t nthreads, uint8_t * passwd)
+{
+	struct smix_worker workers[MAX_THREADS];
+	struct smix_shared sh;
+	uint64_t Nloop_all, Nloop_rw;
+	uint32_t Nchunk;
+	uint32_t i;
+
+	/* 1: n <-- N / p */
+	Nchunk = N / p;
+
+	/* 2: Nloop_all <-- fNloop(n, t, flags) */
+	Nloop_all = Nchunk;
+	if (flags & LIBSCRYPT_YESCRYPT_RW) {
+		if (t <= 1) {
+			if (t)
+				Nloop_all *= 2; /* 2/3 */
+			Nloop_all = (Nloop_all + 2) / 3; /* 1/3, round up */
+		} else {
+			Nloop_all *= t - 1;
+		}
+	} else if (t) {
+		if (t == 1)
+			Nloop_all += (Nloop_all + 1) / 2; /* 1.5, round up */
+		Nloop_all *= t;
+	}
+
+	/* 6: Nloop_rw <-- 0 */
+	Nloop_rw = 0;
+	/* 3: if YESCRYPT_RW flag is set */
+	if (flags & LIBSCRYPT_YESCRYPT_RW) {
+		/* 4: Nloop_rw <-- Nloop_all / p */
+		Nloop_rw = Nloop_all / p;
+	}
+
+	/* 8: n <-- n - (n mod 2) */
+	Nchunk &= ~(uint32_t)1; /* round down to even */
+	/* 9: Nloop_all <-- Nloop_all + (Nloop_all mod 2) */
+	Nloop_all++; Nloop_all &= ~(uint64_t)1; /* round up to even */
+	/* 10: Nloop_rw <-- Nloop_rw + (Nloop_rw mod 2) */
+	Nloop_rw++; Nloop_rw &= ~(uint64_t)1; /* round up to even */
+
+	sh.B = B;
+	sh.r = r;
+	sh.N = N;
+	sh.p = p;
+	sh.flags = flags;
+	sh.Nchunk = Nchunk;
+	sh.Nloop_all = Nloop_all;
+	sh.Nloop_rw = Nloop_rw;
+	sh.V = V;
+	sh.ctx = ctx;
+	sh.passwd = passwd;
+
+	if (nthreads > p)
+		nthreads = p;
+	for (i = 0; i < nthreads; i++) {
+		workers[i].shared = &sh;
+		workers[i].XY = &XY[(size_t)64 * r * i];
+		workers[i].first = i;
+		workers[i].stride = nthreads;
+	}
+
+	/* 11: for i = 0 to p - 1 do, each lane on its own chunk of V */
+	sh.phase = 1;
+	smix_phase(&sh, workers, nthreads);
+
+	/* 30: for i = 0 to p - 1 do, reading all of V */
+	sh.phase = 2;
+	smix_phase(&sh, workers, nthreads);
+}
+
+/**
+ * yescrypt_kdf_body(passwd, passwdlen, salt, saltlen, N, r, p, t, flags,
+ *     nthreads, buf, buflen):
+ * Compute yescrypt without the pre-hashing pass, see libscrypt_yescrypt().
+ *
+ * Return 0 on success; or -1 on error.
+ */
+static int
+yescrypt_kdf_body(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t t, uint32_t flags, uint32_t nthreads, uint8_t * buf,
+    size_t buflen)
+{
+	HMAC_SHA256_CTX hctx;
+	SHA256_CTX ctx;
+	uint8_t sha256[32];
+	uint8_t dk[32];
+	uint8_t * dkp;
+	pwxform_ctx * ctxs = NULL;
+	uint32_t * S = NULL;
+	uint32_t * B, * V, * XY;
+	void * V0;
+	size_t B_size, V_size, XY_size;
+	size_t clen;
+	uint32_t i;
+	int retval = -1;
+
+	/* Sanity-check parameters. */
+	if ((flags & ~YESCRYPT_PREHASH) != 0 &&
+	    (flags & ~YESCRYPT_PREHASH) != LIBSCRYPT_YESCRYPT_WORM &&
+	    (flags & ~YESCRYPT_PREHASH) != LIBSCRYPT_YESCRYPT_DEFAULTS) {
+		errno = EINVAL;
+		return (-1);
+	}
+#if SIZE_MAX > UINT32_MAX
+	if (buflen > (((uint64_t)(1) << 32) - 1) * 32) {
+		errno = EFBIG;
+		return (-1);
+	}
+#endif
+	if ((uint64_t)(r) * (uint64_t)(p) >= (1 << 30) || N > UINT32_MAX) {
+		errno = EFBIG;
+		return (-1);
+	}
+	if (((N & (N - 1)) != 0) || (N <= 1) || (r < 1) || (p < 1)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if ((r > SIZE_MAX / 256 / p) || (N > SIZE_MAX / 128 / r)) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((flags & LIBSCRYPT_YESCRYPT_RW) &&
+	    (N / p <= 1 || r < rmin || p > SIZE_MAX / Sbytes)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (nthreads == 0 || !(flags & LIBSCRYPT_YESCRYPT_RW))
+		nthreads = 1;
+	if (nthreads > p)
+		nthreads = p;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	/* Allocate memory. */
+	V_size = (size_t)128 * r * N;
+#ifdef MAP_ANON
+	if ((V0 = mmap(NULL, V_size, PROT_READ | PROT_WRITE,
+#ifdef MAP_NOCORE
+	    MAP_ANON | MAP_PRIVATE | MAP_NOCORE,
+#else
+	    MAP_ANON | MAP_PRIVATE,
+#endif
+	    -1, 0)) == MAP_FAILED)
+		return (-1);
+#else
+	if ((V0 = malloc(V_size)) == NULL)
+		return (-1);
+#endif
+	V = V0;
+	B_size = (size_t)128 * r * p;
+	if ((B = malloc(B_size)) == NULL)
+		goto err0;
+	XY_size = (size_t)256 * r * nthreads;
+	if ((XY = malloc(XY_size)) == NULL)
+		goto err1;
+	if (flags & LIBSCRYPT_YESCRYPT_RW) {
+		if ((S = malloc((size_t)Sbytes * p)) == NULL)
+			goto err2;
+		if ((ctxs = calloc(p, sizeof(*ctxs))) == NULL)
+			goto err3;
+		for (i = 0; i < p; i++)
+			ctxs[i].S = &S[(size_t)Swords * i];
+	}
+
+	if (flags) {
+		libscrypt_HMAC_SHA256_Init(&hctx, "yescrypt-prehash",
+		    (flags & YESCRYPT_PREHASH) ? 16 : 8);
+		libscrypt_HMAC_SHA256_Update(&hctx, passwd, passwdlen);
+		libscrypt_HMAC_SHA256_Final(sha256, &hctx);
+		passwd = sha256;
+		passwdlen = sizeof(sha256);
+	}
+
+	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+	libscrypt_PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1,
+	    (uint8_t *)B, B_size);
+
+	if (flags)
+		memcpy(sha256, B, sizeof(sha256));
+
+	/* 2: for i = 0 to p - 1 do: B_i <-- MF(B_i, N) */
+	if (p == 1 || (flags & LIBSCRYPT_YESCRYPT_RW)) {
+		smix(B, r, (uint32_t)N, p, t, flags, V, ctxs, XY,
+		    nthreads, sha256);
+	} else {
+		for (i = 0; i < p; i++)
+			smix(&B[(size_t)32 * r * i], r, (uint32_t)N, 1, t, flags,
+			    V, NULL, XY, 1, NULL);
+	}
+
+	dkp = buf;
+	if (flags && buflen < sizeof(dk)) {
+		libscrypt_PBKDF2_SHA256(passwd, passwdlen, (uint8_t *)B, B_size,
+		    1, dk, sizeof(dk));
+		dkp = dk;
+	}
+
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	libscrypt_PBKDF2_SHA256(passwd, passwdlen, (uint8_t *)B, B_size, 1,
+	    buf, buflen);
+
+	/*
+	 * Except for classic scrypt, finish with the SCRAM (RFC 5802) steps so
+	 * the work so far could be done by a client: StoredKey = SHA-256(
+	 * HMAC-SHA256(DK, "Client Key")) replaces the first 32 bytes.
+	 */
+	if (flags && !(flags & YESCRYPT_PREHASH)) {
+		libscrypt_HMAC_SHA256_Init(&hctx, dkp, sizeof(dk));
+		libscrypt_HMAC_SHA256_Update(&hctx, "Client Key", 10);
+		libscrypt_HMAC_SHA256_Final(sha256, &hctx);
+		clen = buflen;
+		if (clen > sizeof(dk))
+			clen = sizeof(dk);
+		libscrypt_SHA256_Init(&ctx);
+		libscrypt_SHA256_Update(&ctx, sha256, sizeof(sha256));
+		libscrypt_SHA256_Final(dk, &ctx);
+		memcpy(buf, dk, clen);
+	}
+
+	/* Success! */
+	retval = 0;
+
+	memset(sha256, 0, sizeof(sha256));
+	memset(dk, 0, sizeof(dk));
+	free(ctxs);
+err3:
+	if (S != NULL) {
+		memset(S, 0, (size_t)Sbytes * p);
+		free(S);
+	}
+err2:
+	memset(XY, 0, XY_size);
+	free(XY);
+err1:
+	memset(B, 0, B_size);
+	free(B);
+err0:
+#ifdef MAP_ANON
+	munmap(V0, V_size);
+#else
+	memset(V0, 0, V_size);
+	free(V0);
+#endif
+	return (retval);
+}
+
+/**
+ * yescrypt_kdf(passwd, passwdlen, salt, saltlen, N, r, p, t, flags,
+ *     nthreads, buf, buflen):
+ * Compute libscrypt_yescrypt() on up to nthreads threads, whether or not the
+ * threaded lanes are disabled.  Large YESCRYPT_RW derivations first replace
+ * passwd with a quick yescrypt of it at N / 64, as the reference does.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+static int
+yescrypt_kdf(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t t, uint32_t flags, uint32_t nthreads, uint8_t * buf,
+    size_t buflen)
+{
+	uint8_t dk[32];
+	int retval;
+
+	if ((flags & LIBSCRYPT_YESCRYPT_RW) && p >= 1 && N / p >= 0x100 &&
+	    N / p * r >= 0x20000) {
+		if (yescrypt_kdf_body(passwd, passwdlen, salt, saltlen, N >> 6,
+		    r, p, 0, flags | YESCRYPT_PREHASH, nthreads, dk, sizeof(dk)))
+			return (-1);
+		passwd = dk;
+		passwdlen = sizeof(dk);
+	}
+
+	retval = yescrypt_kdf_body(passwd, passwdlen, salt, saltlen, N, r, p,
+	    t, flags, nthreads, buf, buflen);
+	memset(dk, 0, sizeof(dk));
+	return (retval);
+}
+
+/**
+ * libscrypt_yescrypt(passwd, passwdlen, salt, saltlen, N, r, p, t, flags,
+ *     nthreads, buf, buflen):
+ * Compute yescrypt(passwd, salt, N, r, p, t, flags) into buf, see
+ * libscrypt.h.  All the lanes run in the calling thread once the threaded
+ * lanes have been disabled by libscrypt_yescrypt_selftest().
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+libscrypt_yescrypt(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t t, uint32_t flags, uint32_t nthreads, uint8_t * buf,
+    size_t buflen)
+{
+
+	if (libscrypt_yescrypt_threads_disabled)
+		nthreads = 1;
+	return (yescrypt_kdf(passwd, passwdlen, salt, saltlen, N, r, p, t,
+	    flags, nthreads, buf, buflen));
+}
+
+/* libscrypt_yescrypt() bypassing libscrypt_yescrypt_threads_disabled. */
+int
+libscrypt_yescrypt_kernel(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint32_t t, uint32_t flags, uint32_t nthreads, uint8_t * buf,
+    size_t buflen)
+{
+
+	return (yescrypt_kdf(passwd, passwdlen, salt, saltlen, N, r, p, t,
+	    flags, nthreads, buf, buflen));
+}
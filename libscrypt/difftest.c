@@ -0,0 +1,487 @@
+/*
+ * Differential test of the scrypt kernels: every kernel of
+ * libscrypt_kernels[] must reproduce the RFC 7914 vectors and the portable
+ * kernel's output for random passwords, salts, N, r, p and key lengths.  A
+ * mismatch is shrunk to the smallest failing input before being reported.
+ * The yescrypt engine must reproduce the upstream yescrypt known answers.
+ * The base64 and Z85 kernels the CPU supports are held to the portable one
+ * too.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "b64.h"
+#include "z85.h"
+#include "crypto_scrypt-internal.h"
+#include "libscrypt.h"
+
+#define MAX_INPUT	64
+#define MAX_BUFLEN	1024
+#define MAX_B64		1024
+#define MAX_Z85		1024
+
+struct input {
+	uint8_t passwd[MAX_INPUT];
+	size_t passwdlen;
+	uint8_t salt[MAX_INPUT];
+	size_t saltlen;
+	uint64_t N;
+	uint32_t r;
+	uint32_t p;
+	size_t buflen;
+};
+
+static uint64_t rng_state;
+static int inject;
+
+static uint64_t
+rng(void)
+{
+
+	/* xorshift64* */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 0x2545F4914F6CDD1DULL);
+}
+
+static uint32_t
+rng_range(uint32_t lo, uint32_t hi)
+{
+
+	return (lo + (uint32_t)(rng() % (hi - lo + 1)));
+}
+
+static void
+random_input(struct input * in)
+{
+	size_t i;
+
+	in->passwdlen = rng_range(0, MAX_INPUT);
+	in->saltlen = rng_range(0, MAX_INPUT);
+	for (i = 0; i < in->passwdlen; i++)
+		in->passwd[i] = (uint8_t)rng();
+	for (i = 0; i < in->saltlen; i++)
+		in->salt[i] = (uint8_t)rng();
+	in->N = (uint64_t)1 << rng_range(1, 10);
+	in->r = rng_range(1, 8);
+	in->p = rng_range(1, 6);
+	/* mostly short keys, the ones genpass uses, now and then long ones */
+	in->buflen = rng_range(0, 7) ? rng_range(1, 128) :
+	    rng_range(129, MAX_BUFLEN);
+}
+
+/*
+ * Return 1 if kernel k disagrees with the portable kernel on in, 0 if they
+ * agree, -1 if the portable kernel fails.  With -x the candidate output is
+ * corrupted whenever r > 2 and p > 1 to exercise the shrinker.
+ */
+static int
+mismatch(const struct libscrypt_kernel * k, const struct input * in,
+    uint8_t * ref, uint8_t * out)
+{
+	int kerr;
+
+	if (libscrypt_kernels[0].scrypt(in->passwd, in->passwdlen, in->salt,
+	    in->saltlen, in->N, in->r, in->p, ref, in->buflen))
+		return (-1);
+	memset(out, 0, in->buflen);
+	kerr = k->scrypt(in->passwd, in->passwdlen, in->salt, in->saltlen,
+	    in->N, in->r, in->p, out, in->buflen);
+	if (inject && in->r > 2 && in->p > 1)
+		out[in->buflen - 1] ^= 1;
+	return (kerr != 0 || memcmp(ref, out, in->buflen) != 0);
+}
+
+/* Greedily drop lengths and costs while the kernel still disagrees. */
+static void
+shrink(const struct libscrypt_kernel * k, struct input * in, uint8_t * ref,
+    uint8_t * out)
+{
+	struct input t;
+	int progress, step;
+
+	do {
+		progress = 0;
+		for (step = 0; step < 9; step++) {
+			t = *in;
+			switch (step) {
+			case 0: t.buflen = t.buflen / 2; break;
+			case 1: t.buflen = t.buflen - 1; break;
+			case 2: t.passwdlen = t.passwdlen / 2; break;
+			case 3: t.passwdlen = t.passwdlen ? t.passwdlen - 1 : 0; break;
+			case 4: t.saltlen = t.saltlen / 2; break;
+			case 5: t.saltlen = t.saltlen ? t.saltlen - 1 : 0; break;
+			case 6: t.N = t.N / 2; break;
+			case 7: t.r = t.r - 1; break;
+			case 8: t.p = t.p - 1; break;
+			}
+			if (t.buflen == 0 || t.N < 2 || t.r == 0 || t.p == 0 ||
+			    memcmp(&t, in, sizeof(t)) == 0)
+				continue;
+			if (mismatch(k, &t, ref, out) == 1) {
+				*in = t;
+				progress = 1;
+			}
+		}
+	} while (progress);
+}
+
+static void
+print_hex(const char * label, const uint8_t * buf, size_t len)
+{
+	size_t i;
+
+	printf("  %-8s ", label);
+	for (i = 0; i < len; i++)
+		printf("%02x", buf[i]);
+	printf("%s\n", len ? "" : "(empty)");
+}
+
+static void
+report(const struct libscrypt_kernel * k, struct input * in, uint8_t * ref,
+    uint8_t * out)
+{
+
+	shrink(k, in, ref, out);
+	mismatch(k, in, ref, out);
+	printf("MISMATCH: kernel %s, N = %llu, r = %u, p = %u, buflen = %zu\n",
+	    k->name, (unsigned long long)in->N, in->r, in->p, in->buflen);
+	print_hex("passwd", in->passwd, in->passwdlen);
+	print_hex("salt", in->salt, in->saltlen);
+	print_hex("expected", ref, in->buflen);
+	print_hex("got", out, in->buflen);
+}
+
+static int
+check_vectors(int large, uint8_t * out)
+{
+	const struct libscrypt_vector * v;
+	const struct libscrypt_kernel * k;
+	char hex[2 * 64 + 1];
+	int i, j, failed = 0;
+
+	for (i = 0; i < LIBSCRYPT_RFC7914_VECTORS; i++) {
+		v = &libscrypt_rfc7914[i];
+		if (v->N > 16384 && !large)
+			continue;
+		for (k = libscrypt_kernels; k->name != NULL; k++) {
+			if (k->scrypt((const uint8_t *)v->passwd,
+			    strlen(v->passwd), (const uint8_t *)v->salt,
+			    strlen(v->salt), v->N, v->r, v->p, out, 64)) {
+				printf("RFC 7914 vector %d: kernel %s failed: %s\n",
+				    i + 1, k->name, strerror(errno));
+				failed = 1;
+				continue;
+			}
+			for (j = 0; j < 64; j++)
+				snprintf(&hex[j * 2], 3, "%02x", out[j]);
+			if (strcmp(hex, v->hex) != 0) {
+				printf("RFC 7914 vector %d: kernel %s MISMATCH\n"
+				    "  expected %s\n  got      %s\n", i + 1,
+				    k->name, v->hex, hex);
+				failed = 1;
+			}
+		}
+		if (!failed)
+			printf("RFC 7914 vector %d: ok\n", i + 1);
+	}
+	return (failed);
+}
+
+/*
+ * The upstream yescrypt known answers, on a single thread and with the
+ * YESCRYPT_RW lanes on p threads.
+ */
+static int
+check_yescrypt(uint8_t * out)
+{
+	const struct libscrypt_yescrypt_vector * y;
+	char hex[2 * 64 + 1];
+	size_t len, j;
+	uint32_t nthreads;
+	int i, k, failed = 0;
+
+	for (i = 0; i < LIBSCRYPT_YESCRYPT_VECTORS; i++) {
+		y = &libscrypt_yescrypt_kat[i];
+		len = strlen(y->hex) / 2;
+		for (k = 0; k < (y->p > 1 ? 2 : 1); k++) {
+			nthreads = k ? y->p : 1;
+			if (libscrypt_yescrypt_kernel((const uint8_t *)y->passwd,
+			    strlen(y->passwd), (const uint8_t *)y->salt,
+			    strlen(y->salt), y->N, y->r, y->p, y->t, y->flags,
+			    nthreads, out, len)) {
+				printf("yescrypt vector %d: %u thread(s) failed: "
+				    "%s\n", i + 1, nthreads, strerror(errno));
+				failed = 1;
+				continue;
+			}
+			for (j = 0; j < len; j++)
+				snprintf(&hex[j * 2], 3, "%02x", out[j]);
+			if (strcmp(hex, y->hex) != 0) {
+				printf("yescrypt vector %d: %u thread(s) MISMATCH\n"
+				    "  expected %s\n  got      %s\n", i + 1,
+				    nthreads, y->hex, hex);
+				failed = 1;
+			}
+		}
+		if (!failed)
+			printf("yescrypt vector %d: ok\n", i + 1);
+	}
+	return (failed);
+}
+
+/*
+ * Encode random bytes with both alphabets, then decode the text, intact or
+ * with one character replaced by a random one, whitespace or padding.  The
+ * kernels must return the same as the portable one, and the same bytes.
+ */
+static int
+check_b64(unsigned long iterations, uint64_t seed)
+{
+	const struct libscrypt_b64_kernel * k, * portable = libscrypt_b64_kernels;
+	static uint8_t src[MAX_B64], ref[MAX_B64 + 64], out[MAX_B64 + 64];
+	static char text[b64_encode_len(MAX_B64)], ktext[sizeof(text)];
+	const char * what;
+	unsigned long i;
+	size_t len, j;
+	int compliant, rlen, klen;
+
+	for (i = 0; i < iterations; i++) {
+		len = rng_range(0, 3) ? rng_range(0, 96) :
+		    rng_range(97, MAX_B64);
+		for (j = 0; j < len; j++)
+			src[j] = (uint8_t)rng();
+		compliant = (int)(rng() & 1);
+
+		rlen = libscrypt_b64_encode_with(portable, compliant, src, len,
+		    text, sizeof(text));
+		for (k = portable + 1; k->name != NULL; k++) {
+			if (!k->supported())
+				continue;
+			what = "encode";
+			klen = libscrypt_b64_encode_with(k, compliant, src, len,
+			    ktext, sizeof(ktext));
+			if (klen != rlen || memcmp(text, ktext, sizeof(text)))
+				goto mismatch;
+
+			if (rlen > 0 && rng_range(0, 1)) {
+				what = "decode of a corrupted text";
+				j = rng_range(0, (uint32_t)rlen - 1);
+				switch (rng_range(0, 2)) {
+				case 0: ktext[j] = (char)rng_range(1, 255); break;
+				case 1: ktext[j] = ' '; break;
+				case 2: ktext[j] = '='; break;
+				}
+			} else
+				what = "decode";
+			memset(ref, 0, sizeof(ref));
+			memset(out, 0, sizeof(out));
+			rlen = libscrypt_b64_decode_with(portable, compliant,
+			    ktext, ref, sizeof(ref));
+			klen = libscrypt_b64_decode_with(k, compliant, ktext,
+			    out, sizeof(out));
+			if (klen != rlen ||
+			    (rlen > 0 && memcmp(ref, out, (size_t)rlen)))
+				goto mismatch;
+			rlen = libscrypt_b64_encode_with(portable, compliant,
+			    src, len, text, sizeof(text));
+		}
+	}
+	return (0);
+
+mismatch:
+	printf("MISMATCH: base64 kernel %s, %s, %s alphabet, %zu bytes, "
+	    "rerun with -s 0x%llx\n", k->name, what,
+	    compliant ? "compliant" : "genpass", len, (unsigned long long)seed);
+	print_hex("input", src, len);
+	printf("  %-8s %s\n", "text", ktext);
+	printf("  %-8s %d\n  %-8s %d\n", "expected", rlen, "got", klen);
+	return (1);
+}
+
+/*
+ * Encode random whole frames, then decode the text, intact or with one
+ * symbol replaced by a random byte: the kernels must give the portable
+ * kernel's output.  The same bytes also go through the streaming API in
+ * random chunks, which must give what Z85_encode_with_padding() does, and
+ * back.
+ */
+static int
+check_z85(unsigned long iterations, uint64_t seed)
+{
+	const struct Z85_kernel * k = Z85_kernels;
+	static char src[MAX_Z85], ref[MAX_Z85], out[MAX_Z85];
+	static char text[MAX_Z85 / 4 * 5 + 6], ktext[sizeof(text)];
+	const char * what;
+	char * p;
+	Z85_stream st;
+	unsigned long i;
+	size_t len, tlen, klen, j, n;
+
+	for (i = 0; i < iterations; i++) {
+		len = rng_range(0, 3) ? rng_range(0, 96) :
+		    rng_range(97, MAX_Z85);
+		for (j = 0; j < len; j++)
+			src[j] = (char)rng();
+
+		/* Kernels, on the whole frames */
+		n = len - len % 4;
+		tlen = (size_t)(Z85_encode_unsafe_with(Z85_kernels, src,
+		    src + n, text) - text);
+		for (k = Z85_kernels + 1; k->name != NULL; k++) {
+			if (!k->supported())
+				continue;
+			what = "encode";
+			klen = (size_t)(Z85_encode_unsafe_with(k, src, src + n,
+			    ktext) - ktext);
+			if (klen != tlen || memcmp(text, ktext, tlen))
+				goto mismatch;
+
+			if (tlen > 0 && rng_range(0, 1)) {
+				what = "decode of a corrupted text";
+				ktext[rng_range(0, (uint32_t)tlen - 1)] =
+				    (char)rng();
+			} else
+				what = "decode";
+			Z85_decode_unsafe_with(Z85_kernels, ktext,
+			    ktext + tlen, ref);
+			klen = (size_t)(Z85_decode_unsafe_with(k, ktext,
+			    ktext + tlen, out) - out);
+			if (klen != n || memcmp(ref, out, n))
+				goto mismatch;
+		}
+
+		/* Streaming, in chunks of 0 to 40 */
+		k = Z85_kernel();
+		what = "stream encode";
+		tlen = Z85_encode_with_padding(src, text, len);
+		p = Z85_encode_stream_begin(&st, len, ktext);
+		for (j = 0; j < len; j += n) {
+			n = rng_range(0, 40);
+			if (n > len - j)
+				n = len - j;
+			if ((p = Z85_encode_stream_update(&st, src + j, n,
+			    p)) == NULL)
+				goto mismatch;
+		}
+		if ((p = Z85_encode_stream_end(&st, p)) == NULL)
+			goto mismatch;
+		klen = (size_t)(p - ktext);
+		if (klen != tlen || memcmp(text, ktext, tlen))
+			goto mismatch;
+		if (len == 0)
+			continue;
+
+		what = "stream decode";
+		Z85_decode_stream_begin(&st);
+		p = out;
+		for (j = 0; j < tlen; j += n) {
+			n = rng_range(0, 40);
+			if (n > tlen - j)
+				n = tlen - j;
+			if ((p = Z85_decode_stream_update(&st, text + j, n,
+			    p)) == NULL)
+				goto mismatch;
+		}
+		if ((p = Z85_decode_stream_end(&st, p)) == NULL)
+			goto mismatch;
+		klen = (size_t)(p - out);
+		if (klen != len || memcmp(src, out, len))
+			goto mismatch;
+	}
+	return (0);
+
+mismatch:
+	printf("MISMATCH: Z85 kernel %s, %s, %zu bytes, rerun with -s 0x%llx\n",
+	    k->name, what, len, (unsigned long long)seed);
+	print_hex("input", (const uint8_t *)src, len);
+	printf("  %-8s %.*s\n", "text", (int)tlen, text);
+	return (1);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: difftest [-l] [-x] [-n iterations] [-s seed]\n"
+	    "  -l  also run the 1 GiB RFC 7914 vector\n"
+	    "  -x  inject a fault in the candidate kernels (r > 2, p > 1)\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char * argv[])
+{
+	const struct libscrypt_kernel * k;
+	struct input in;
+	uint8_t * ref, * out;
+	unsigned long iterations = 200, i;
+	uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+	int large = 0, ch;
+
+	while ((ch = getopt(argc, argv, "ln:s:x")) != -1) {
+		switch (ch) {
+		case 'l':
+			large = 1;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'x':
+			inject = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if ((ref = malloc(MAX_BUFLEN)) == NULL ||
+	    (out = malloc(MAX_BUFLEN)) == NULL) {
+		fprintf(stderr, "difftest: not enough memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (check_vectors(large, out))
+		exit(EXIT_FAILURE);
+	if (check_yescrypt(out))
+		exit(EXIT_FAILURE);
+
+	/* a zero state would stay zero */
+	printf("seed 0x%llx, %lu iterations\n", (unsigned long long)seed,
+	    iterations);
+	rng_state = seed ? seed : 1;
+	for (i = 0; i < iterations; i++) {
+		random_input(&in);
+		for (k = &libscrypt_kernels[1]; k->name != NULL; k++) {
+			switch (mismatch(k, &in, ref, out)) {
+			case -1:
+				printf("portable kernel failed: %s\n",
+				    strerror(errno));
+				exit(EXIT_FAILURE);
+			case 1:
+				printf("iteration %lu, rerun with -s 0x%llx\n",
+				    i, (unsigned long long)seed);
+				report(k, &in, ref, out);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	if (check_b64(iterations * 10, seed))
+		exit(EXIT_FAILURE);
+	if (check_z85(iterations * 10, seed))
+		exit(EXIT_FAILURE);
+	printf("difftest: all kernels match\n");
+
+	free(ref);
+	free(out);
+	return (0);
+}
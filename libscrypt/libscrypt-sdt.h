@@ -0,0 +1,81 @@
+#ifndef _LIBSCRYPT_SDT_H_
+#define _LIBSCRYPT_SDT_H_
+
+/*
+ * Statically defined tracepoints in the SystemTap SDT note format (v3), as
+ * read by bpftrace, perf, systemtap and bcc, e.g.:
+ *
+ *   bpftrace -e 'usdt:./genpass:libscrypt:derive_start { printf("%d\n", arg0); }'
+ *
+ * A probe site is a single nop plus a .note.stapsdt ELF note describing
+ * where its arguments live, no external header nor semaphores are used.
+ * Arguments are widened to 64 bits.  Define LIBSCRYPT_NO_SDT to compile the
+ * probes out.
+ */
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(LIBSCRYPT_NO_SDT) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+#define _SDT_ASM_BASE							\
+	".ifndef _.stapsdt.base\n"					\
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n"					\
+	".hidden _.stapsdt.base\n"					\
+	"_.stapsdt.base: .space 1\n"					\
+	".size _.stapsdt.base,1\n"					\
+	".popsection\n"							\
+	".endif\n"
+
+#define _SDT_ASM_NOTE(provider, name, args)				\
+	"990: nop\n"							\
+	".pushsection .note.stapsdt,\"?\",\"note\"\n"			\
+	".balign 4\n"							\
+	".4byte 992f-991f, 994f-993f, 3\n"				\
+	"991: .asciz \"stapsdt\"\n"					\
+	"992: .balign 4\n"						\
+	"993: .8byte 990b\n"						\
+	".8byte _.stapsdt.base\n"					\
+	".8byte 0\n"							\
+	".asciz \"" #provider "\"\n"					\
+	".asciz \"" #name "\"\n"					\
+	".asciz \"" args "\"\n"						\
+	"994: .balign 4\n"						\
+	".popsection\n"							\
+	_SDT_ASM_BASE
+
+#define _SDT_ARG(x)	((uint64_t)(uintptr_t)(x))
+
+#define LIBSCRYPT_PROBE0(provider, name)				\
+	__asm__ __volatile__(_SDT_ASM_NOTE(provider, name, ""))
+#define LIBSCRYPT_PROBE1(provider, name, a1)				\
+	__asm__ __volatile__(_SDT_ASM_NOTE(provider, name,		\
+	    "8@%[_a1]")							\
+	    :: [_a1] "nor" (_SDT_ARG(a1)))
+#define LIBSCRYPT_PROBE2(provider, name, a1, a2)			\
+	__asm__ __volatile__(_SDT_ASM_NOTE(provider, name,		\
+	    "8@%[_a1] 8@%[_a2]")					\
+	    :: [_a1] "nor" (_SDT_ARG(a1)), [_a2] "nor" (_SDT_ARG(a2)))
+#define LIBSCRYPT_PROBE3(provider, name, a1, a2, a3)			\
+	__asm__ __volatile__(_SDT_ASM_NOTE(provider, name,		\
+	    "8@%[_a1] 8@%[_a2] 8@%[_a3]")				\
+	    :: [_a1] "nor" (_SDT_ARG(a1)), [_a2] "nor" (_SDT_ARG(a2)),	\
+	    [_a3] "nor" (_SDT_ARG(a3)))
+#define LIBSCRYPT_PROBE4(provider, name, a1, a2, a3, a4)		\
+	__asm__ __volatile__(_SDT_ASM_NOTE(provider, name,		\
+	    "8@%[_a1] 8@%[_a2] 8@%[_a3] 8@%[_a4]")			\
+	    :: [_a1] "nor" (_SDT_ARG(a1)), [_a2] "nor" (_SDT_ARG(a2)),	\
+	    [_a3] "nor" (_SDT_ARG(a3)), [_a4] "nor" (_SDT_ARG(a4)))
+
+#else
+
+#define LIBSCRYPT_PROBE0(provider, name)			do { } while (0)
+#define LIBSCRYPT_PROBE1(provider, name, a1)			do { } while (0)
+#define LIBSCRYPT_PROBE2(provider, name, a1, a2)		do { } while (0)
+#define LIBSCRYPT_PROBE3(provider, name, a1, a2, a3)		do { } while (0)
+#define LIBSCRYPT_PROBE4(provider, name, a1, a2, a3, a4)	do { } while (0)
+
+#endif
+
+#endif /* !_LIBSCRYPT_SDT_H_ */
@@ -31,12 +31,107 @@ extern "C"{
 int libscrypt_scrypt(const uint8_t *, size_t, const uint8_t *, size_t, uint64_t,
     uint32_t, uint32_t, /*@out@*/ uint8_t *, size_t);
 
+/**
+ * libscrypt_scrypt_mt(passwd, passwdlen, salt, saltlen, N, r, p, nthreads,
+ *     buf, buflen):
+ * Same as libscrypt_scrypt() but run the p lanes on up to nthreads threads,
+ * the result doesn't depend on nthreads.  Memory use is nthreads * 128rN.
+ * Return 0 on success; or -1 on error.
+ */
+int libscrypt_scrypt_mt(const uint8_t *, size_t, const uint8_t *, size_t,
+    uint64_t, uint32_t, uint32_t, uint32_t, /*@out@*/ uint8_t *, size_t);
+
+typedef int (*libscrypt_stream_fn)(const uint8_t *buf, size_t len, void *arg);
+
+/**
+ * libscrypt_scrypt_stream(passwd, passwdlen, salt, saltlen, N, r, p,
+ *     nthreads, len, out, arg):
+ * Compute the len bytes of scrypt(passwd, salt, N, r, p, len), len being up
+ * to (2^32 - 1) * 32, and hand them to out(buf, buflen, arg) in order and in
+ * chunks, so any prefix is what libscrypt_scrypt() gives for its length.
+ * The lanes and then the output blocks run on up to nthreads threads, the
+ * output needs 64 KiB per thread at most.  out returns non-zero to stop.
+ * Return 0 on success; or -1 on error, or if out stopped it.
+ */
+int libscrypt_scrypt_stream(const uint8_t *, size_t, const uint8_t *, size_t,
+    uint64_t, uint32_t, uint32_t, uint32_t, uint64_t, libscrypt_stream_fn,
+    void *);
+
+/**
+ * libscrypt_selftest():
+ * Check every compiled scrypt kernel against known answers and the portable
+ * implementation, a failing threaded kernel is disabled for the process
+ * (libscrypt_scrypt_mt() then runs all the lanes in the calling thread).
+ * Call it before other threads start deriving.
+ * Return 0 if all passed, 1 if a kernel was disabled, or -1 if the portable
+ * implementation is broken.
+ */
+int libscrypt_selftest(void);
+
+/* libscrypt_yescrypt() flags */
+#define LIBSCRYPT_YESCRYPT_WORM		0x001 /* scrypt with t */
+#define LIBSCRYPT_YESCRYPT_RW		0x002
+/* YESCRYPT_RW with 6 pwxform rounds, 4 x 2 gathers and 12 KiB S-boxes */
+#define LIBSCRYPT_YESCRYPT_DEFAULTS	0x0b6
+
+/**
+ * libscrypt_yescrypt(passwd, passwdlen, salt, saltlen, N, r, p, t, flags,
+ *     nthreads, buf, buflen):
+ * Compute yescrypt(passwd, salt, N, r, p, t, flags, buflen) into buf.  flags
+ * is 0 (classic scrypt), LIBSCRYPT_YESCRYPT_WORM or
+ * LIBSCRYPT_YESCRYPT_DEFAULTS.  With YESCRYPT_RW the p lanes share the
+ * 128rN bytes of V, each one fills N / p blocks and then reads all of them,
+ * pwxform S-box lookups replacing most of the salsa20 work; N / p must be at
+ * least 2.  t adds time without memory, 0 is the standard cost.  Only the
+ * YESCRYPT_RW lanes run on up to nthreads threads, the result doesn't
+ * depend on nthreads.
+ * Return 0 on success; or -1 on error.
+ */
+int libscrypt_yescrypt(const uint8_t *, size_t, const uint8_t *, size_t,
+    uint64_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t,
+    /*@out@*/ uint8_t *, size_t);
+
+/**
+ * libscrypt_yescrypt_selftest():
+ * Check libscrypt_yescrypt() against known answers, the classic scrypt mode
+ * against RFC 7914, and its threaded lanes against the single thread path,
+ * failing threaded lanes are disabled for the process.  Call it before other
+ * threads start deriving.
+ * Return 0 if all passed, 1 if the threaded lanes were disabled, or -1 if
+ * the implementation is broken.
+ */
+int libscrypt_yescrypt_selftest(void);
+
+/* Stages reported to the libscrypt_set_hook() function */
+#define LIBSCRYPT_EV_PBKDF2_BEGIN	1
+#define LIBSCRYPT_EV_PBKDF2_END		2
+#define LIBSCRYPT_EV_SMIX_BEGIN		3 /* all the p lanes */
+#define LIBSCRYPT_EV_SMIX_END		4
+#define LIBSCRYPT_EV_SMIX_FILL_BEGIN	5 /* per lane, V_i <-- X loop */
+#define LIBSCRYPT_EV_SMIX_FILL_END	6
+#define LIBSCRYPT_EV_SMIX_MIX_BEGIN	7 /* per lane, X <-- H(X xor V_j) loop */
+#define LIBSCRYPT_EV_SMIX_MIX_END	8
+
+typedef void (*libscrypt_hook_fn)(int event, void *arg);
+
+/**
+ * libscrypt_set_hook(fn, arg):
+ * Call fn(event, arg) at the begin and end of each stage of the scrypt
+ * computations run by the calling thread, NULL disables it.  The hook is
+ * thread local and always called from the thread which called
+ * libscrypt_scrypt(); the per lane smix phases are only reported for the
+ * lanes computed by that thread.
+ */
+void libscrypt_set_hook(libscrypt_hook_fn, void *);
+
 /* Converts a series of input parameters to a MCF form for storage */
 int libscrypt_mcf(uint32_t N, uint32_t r, uint32_t p, const char *salt,
 	const char *hash, char *mcf);
 
 #ifndef _MSC_VER
-/* Generates a salt. Uses /dev/urandom/
+/* Generates a salt. Uses getrandom(), /dev/urandom if it's missing.
+ * Small requests are served from a per thread pool which is refilled
+ * in bulk, wiped as it's consumed and never inherited across fork().
  */
 int libscrypt_salt_gen(/*@out@*/ uint8_t *rand, size_t len);
 
@@ -46,9 +141,41 @@ int libscrypt_hash(char *dst, const char* passphrase, uint32_t N, uint8_t r,
   uint8_t p);
 #endif
 
-/* Checks a given MCF against a password */
+/* Checks a given MCF against a password, mcf isn't modified */
 int libscrypt_check(char *mcf, const char *password);
 
+/* A libscrypt_check_batch() request, result is set as libscrypt_check() */
+struct libscrypt_check_req {
+	const char *mcf;
+	const char *password;
+	int result;
+};
+
+typedef struct libscrypt_checker libscrypt_checker;
+
+/**
+ * libscrypt_checker_new(nthreads):
+ * Start a pool of nthreads - 1 workers for libscrypt_check_batch(), the
+ * calling thread being the last one.  Every worker keeps the scratch memory
+ * of the largest (N, r, p) it has checked, up to 128 * r * (N + p) bytes.
+ * Return NULL on error.
+ */
+libscrypt_checker *libscrypt_checker_new(uint32_t nthreads);
+
+/**
+ * libscrypt_check_batch(checker, reqs, n):
+ * Check the n requests, grouped by (N, r, p), on the workers of checker.
+ * The MCF strings are not modified and any hash length is supported, the
+ * comparison is constant time.  Batches on the same checker run one at a
+ * time.
+ * Return 0 when every result is set; or -1 on error.
+ */
+int libscrypt_check_batch(libscrypt_checker *, struct libscrypt_check_req *,
+	size_t);
+
+/* Stop the workers and release the checker */
+void libscrypt_checker_free(libscrypt_checker *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,16 +1,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "b64.h"
 #include "crypto_scrypt-hexconvert.h"
+#include "skey.h"
 #include "libscrypt.h"
 
 #define REF1 "fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640"
 
 #define REF2 "7023bdcb3afd7348461c06cd81fd38ebfda8fbba904f8e3ea9b543f6545da1f2d5432955613f0fcf62d49705242a9af9e61e85dc0d651e40dfcf017b45575887"
 
+/* Chunks of a libscrypt_scrypt_stream() appended one after the other */
+struct stream_sink {
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	size_t calls;
+};
+
+static int stream_collect(const uint8_t *buf, size_t len, void *arg)
+{
+	struct stream_sink *sink = arg;
+
+	sink->calls++;
+	if(len > sink->size - sink->len)
+	{
+		errno = ENOSPC;
+		return -1;
+	}
+	memcpy(sink->buf + sink->len, buf, len);
+	sink->len += len;
+	return 0;
+}
 
 int main()
 {
@@ -19,6 +45,24 @@ int main()
 	char mcf[SCRYPT_MCF_LEN];
 	char mcf2[SCRYPT_MCF_LEN];
 	char saltbuf[64];
+	char mcf3[SCRYPT_MCF_LEN];
+	char mcf4[SCRYPT_MCF_LEN];
+	char b64salt[64];
+	char b64hash[64];
+	uint8_t shorthash[32];
+	libscrypt_checker *checker;
+	struct libscrypt_check_req reqs[7];
+	int expected[7] = { 1, 0, 1, 1, -1, -1, 1 };
+	size_t i;
+	uint8_t salt1[SCRYPT_SALT_LEN], salt2[SCRYPT_SALT_LEN];
+	int fds[2];
+	pid_t pid;
+	uint8_t decoded[64];
+	static uint8_t skeysrc[2048 * 8], skeydecoded[2048 * 8];
+	static char skeytext[skey_encode_len(2048 * 8)];
+	size_t len, j;
+	static uint8_t streamed[3 * 65536 + 100], expect[3 * 65536 + 100];
+	struct stream_sink sink;
 	int retval;
 	/**
 	 * libscrypt_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
@@ -160,7 +204,7 @@ int main()
 
 	printf("TEST EIGHT: SUCCESSFUL, calculated mcf\n%s\n", mcf);
 
-	/* Since later calls to scrypt_check() butcher mcf, make a second */
+	/* Older scrypt_check() butchered mcf, keep a second to compare */
 	strcpy(mcf2, mcf);
 
 	/* Couldn't be simpler - for a given mcf, check is the password is valid
@@ -238,6 +282,235 @@ int main()
 	}
 
 	printf("TEST THIRTEEN: SUCCESSFUL\n");
+	strcpy(mcf4, outbuf);
+
+	printf("TEST FOURTEEN: Threaded lanes match reference hash\n");
+
+	retval = libscrypt_scrypt_mt((uint8_t*)"password",strlen("password"), (uint8_t*)"NaCl", strlen("NaCl"), 1024, 8, 16, 3, hashbuf, sizeof(hashbuf));
+
+	if(retval != 0)
+	{
+		printf("TEST FOURTEEN: FAILED to create hash of \"password\"\n");
+		exit(EXIT_FAILURE);
+	}
+
+	libscrypt_hexconvert(hashbuf, sizeof(hashbuf), outbuf, sizeof(outbuf));
+	if(strcmp(outbuf, REF1) != 0)
+	{
+		printf("TEST FOURTEEN: FAILED to match reference on hash\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST FOURTEEN: SUCCESSFUL\n");
+
+	printf("TEST FIFTEEN: Verify a 32 byte hash, MCF left untouched\n");
+
+	retval = libscrypt_scrypt((uint8_t*)"pleaseletmein", strlen("pleaseletmein"), (uint8_t*)"SodiumChloride", strlen("SodiumChloride"), 1024, 8, 2, shorthash, sizeof(shorthash));
+	if(retval != 0 ||
+	   libscrypt_b64_encode_compliant((uint8_t*)"SodiumChloride", strlen("SodiumChloride"), b64salt, sizeof(b64salt)) == -1 ||
+	   libscrypt_b64_encode_compliant(shorthash, sizeof(shorthash), b64hash, sizeof(b64hash)) == -1 ||
+	   !libscrypt_mcf(1024, 8, 2, b64salt, b64hash, mcf3))
+	{
+		printf("TEST FIFTEEN: FAILED to create the MCF\n");
+		exit(EXIT_FAILURE);
+	}
+	if(libscrypt_check(mcf3, "pleaseletmein") != 1 || libscrypt_check(mcf3, "pleasefailme") != 0)
+	{
+		printf("TEST FIFTEEN: FAILED to verify %s\n", mcf3);
+		exit(EXIT_FAILURE);
+	}
+	if(strcmp(mcf, mcf2) != 0)
+	{
+		printf("TEST FIFTEEN: FAILED, libscrypt_check() modified the MCF\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST FIFTEEN: SUCCESSFUL\n");
+
+	printf("TEST SIXTEEN: Batch verify on a worker pool\n");
+
+	reqs[0].mcf = mcf;  reqs[0].password = "pleaseletmein";
+	reqs[1].mcf = mcf;  reqs[1].password = "pleasefailme";
+	reqs[2].mcf = mcf4; reqs[2].password = "My cats's breath smells like cat food";
+	reqs[3].mcf = mcf3; reqs[3].password = "pleaseletmein";
+	reqs[4].mcf = "$s1$0e0801$bad"; reqs[4].password = "pleaseletmein";
+	reqs[5].mcf = mcf;  reqs[5].password = NULL;
+	reqs[6].mcf = mcf2; reqs[6].password = "pleaseletmein";
+
+	if((checker = libscrypt_checker_new(3)) == NULL)
+	{
+		printf("TEST SIXTEEN: FAILED to start the checker\n");
+		exit(EXIT_FAILURE);
+	}
+	/* twice, the second batch runs on the pooled scratch memory */
+	for(retval = 0; retval < 2; retval++)
+	{
+		if(libscrypt_check_batch(checker, reqs, 7) != 0)
+		{
+			printf("TEST SIXTEEN: FAILED, batch error\n");
+			exit(EXIT_FAILURE);
+		}
+		for(i = 0; i < 7; i++)
+		{
+			if(reqs[i].result != expected[i])
+			{
+				printf("TEST SIXTEEN: FAILED, request %zu returned %d\n", i, reqs[i].result);
+				exit(EXIT_FAILURE);
+			}
+			reqs[i].result = 42;
+		}
+	}
+	libscrypt_checker_free(checker);
+	if(strcmp(mcf, mcf2) != 0)
+	{
+		printf("TEST SIXTEEN: FAILED, the batch modified the MCF\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST SIXTEEN: SUCCESSFUL\n");
+
+	printf("TEST SEVENTEEN: Salts aren't shared with a fork child\n");
+
+	/* The first salt fills the pool, parent and child then draw the next */
+	if(libscrypt_salt_gen(salt1, sizeof(salt1)) == -1 || pipe(fds) == -1 ||
+	   (pid = fork()) == -1)
+	{
+		printf("TEST SEVENTEEN: FAILED to set up\n");
+		exit(EXIT_FAILURE);
+	}
+	if(pid == 0)
+	{
+		close(fds[0]);
+		if(libscrypt_salt_gen(salt2, sizeof(salt2)) == -1 ||
+		   write(fds[1], salt2, sizeof(salt2)) != sizeof(salt2))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	retval = read(fds[0], salt2, sizeof(salt2));
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+	if(retval != sizeof(salt2) || libscrypt_salt_gen(salt1, sizeof(salt1)) == -1)
+	{
+		printf("TEST SEVENTEEN: FAILED to generate salts\n");
+		exit(EXIT_FAILURE);
+	}
+	if(memcmp(salt1, salt2, sizeof(salt1)) == 0)
+	{
+		printf("TEST SEVENTEEN: FAILED, parent and child drew the same salt\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST SEVENTEEN: SUCCESSFUL\n");
+
+	printf("TEST EIGHTEEN: Encoders decode what they encode\n");
+
+	for(len = 1; len <= 32; len++)
+	{
+		if(libscrypt_hex_encode(hashbuf, len, outbuf, sizeof(outbuf)) != (int)(2 * len) ||
+		   libscrypt_hex_decode(outbuf, decoded, sizeof(decoded)) != (int)len ||
+		   memcmp(hashbuf, decoded, len) != 0)
+		{
+			printf("TEST EIGHTEEN: FAILED, hex of %zu bytes\n", len);
+			exit(EXIT_FAILURE);
+		}
+		if(libscrypt_b64_encode(hashbuf, len, outbuf, sizeof(outbuf)) == -1 ||
+		   libscrypt_b64_decode(outbuf, decoded, sizeof(decoded)) != (int)len ||
+		   memcmp(hashbuf, decoded, len) != 0)
+		{
+			printf("TEST EIGHTEEN: FAILED, base64 of %zu bytes\n", len);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(libscrypt_skey_encode(hashbuf, 16, outbuf, sizeof(outbuf)) == -1 ||
+	   libscrypt_skey_decode(outbuf, decoded, sizeof(decoded)) != 16 ||
+	   memcmp(hashbuf, decoded, 16) != 0)
+	{
+		printf("TEST EIGHTEEN: FAILED, skey\n");
+		exit(EXIT_FAILURE);
+	}
+	if(libscrypt_hex_decode("0g", decoded, sizeof(decoded)) != -1 ||
+	   libscrypt_b64_decode("A", decoded, sizeof(decoded)) != -1)
+	{
+		printf("TEST EIGHTEEN: FAILED, malformed input accepted\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST EIGHTEEN: SUCCESSFUL\n");
+
+	printf("TEST NINETEEN: S/Key dictionary lookups\n");
+
+	/* Every word of the dictionary first, in lower case the second time */
+	for(i = 0; i < 2048; i++)
+	{
+		skeysrc[8 * i] = (uint8_t)(i >> 3);
+		skeysrc[8 * i + 1] = (uint8_t)(i << 5);
+		for(j = 2; j < 8; j++)
+			skeysrc[8 * i + j] = hashbuf[(i + j) % 32];
+	}
+	for(j = 0; j < 2; j++)
+	{
+		if(libscrypt_skey_encode(skeysrc, sizeof(skeysrc), skeytext, sizeof(skeytext)) == -1)
+		{
+			printf("TEST NINETEEN: FAILED, encode\n");
+			exit(EXIT_FAILURE);
+		}
+		if(j == 1)
+			for(i = 0; skeytext[i] != '\0'; i++)
+				skeytext[i] = (char)tolower((unsigned char)skeytext[i]);
+		if(libscrypt_skey_decode(skeytext, skeydecoded, sizeof(skeydecoded)) != (int)sizeof(skeysrc) ||
+		   memcmp(skeysrc, skeydecoded, sizeof(skeysrc)) != 0)
+		{
+			printf("TEST NINETEEN: FAILED, %s words\n", j ? "lower case" : "upper case");
+			exit(EXIT_FAILURE);
+		}
+	}
+	/* A short last group comes back as long as the target asks for */
+	if(libscrypt_skey_encode(hashbuf, 13, outbuf, sizeof(outbuf)) == -1 ||
+	   libscrypt_skey_decode(outbuf, decoded, 13) != 13 ||
+	   memcmp(hashbuf, decoded, 13) != 0 ||
+	   libscrypt_skey_decode("RYE EGAN LEAR MEAL USES LUCK", decoded, 8) != 8 ||
+	   libscrypt_skey_decode("RYE EGAN LEAR MEAL USES LUCQ", decoded, 8) != -1 ||
+	   libscrypt_skey_decode("RYE EGAN LEAR MEAL USES", decoded, 8) != -1 ||
+	   libscrypt_skey_decode("RYE EGAN LEAR MEAL USES LUCKY", decoded, 8) != -1)
+	{
+		printf("TEST NINETEEN: FAILED, malformed input\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST NINETEEN: SUCCESSFUL\n");
+
+	printf("TEST TWENTY: Streamed output is the scrypt output\n");
+
+	retval = libscrypt_scrypt((uint8_t*)"password",strlen("password"), (uint8_t*)"NaCl", strlen("NaCl"), 16, 1, 3, expect, sizeof(expect));
+	/* A short last block, and chunks from several threads per round */
+	for(j = 1; j <= 3 && retval == 0; j++)
+	{
+		memset(&sink, 0, sizeof(sink));
+		sink.buf = streamed;
+		sink.size = sizeof(streamed);
+		if(libscrypt_scrypt_stream((uint8_t*)"password",strlen("password"), (uint8_t*)"NaCl", strlen("NaCl"), 16, 1, 3, (uint32_t)j, sizeof(streamed), stream_collect, &sink) != 0 ||
+		   sink.len != sizeof(streamed) || sink.calls != 4 ||
+		   memcmp(streamed, expect, sizeof(streamed)) != 0)
+		{
+			printf("TEST TWENTY: FAILED, %zu thread(s)\n", j);
+			exit(EXIT_FAILURE);
+		}
+	}
+	/* The errno of a failing sink comes back */
+	memset(&sink, 0, sizeof(sink));
+	sink.buf = streamed;
+	sink.size = 65536;
+	errno = 0;
+	if(retval != 0 ||
+	   libscrypt_scrypt_stream((uint8_t*)"password",strlen("password"), (uint8_t*)"NaCl", strlen("NaCl"), 16, 1, 3, 2, sizeof(streamed), stream_collect, &sink) != -1 ||
+	   errno != ENOSPC || sink.len != 65536)
+	{
+		printf("TEST TWENTY: FAILED, sink errors\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("TEST TWENTY: SUCCESSFUL\n");
 
 	return 0;
 }
@@ -2,23 +2,19 @@
  * available in the directory: ftp://thumper.bellcore.com/pub/nmh
  *
  * It has been modified only to remove explicit S/Key(TM) references.
+ *
+ * The codec was since rewritten around 64 bit words: each 8 bytes and their
+ * 2 bits of parity are 6 indices of 11 bits into Wp[], written out in one
+ * pass, and words are looked up through a perfect hash of Wp[].
  */
 
 #include <stdio.h>
 #include <string.h>
-#include <assert.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 
-#ifdef __STDC__
-#define __ARGS(x) x
-#else
-#define __ARGS(x) ()
-#endif
-
-static unsigned long extract __ARGS((char *s,int start,int length));
-static void standard __ARGS((char *word));
-static void insert __ARGS((char *s, int x, int start, int length));
-static int wsrch __ARGS((char *w,int low,int high));
+#include "skey.h"
 
 /* Dictionary for integer-word translations */
 char Wp[2048][4] = { "A", "ABE", "ACE", "ACT", "AD", "ADA", "ADD",
@@ -245,37 +241,362 @@ char Wp[2048][4] = { "A", "ABE", "ACE", "ACT", "AD", "ADA", "ADD",
 "YEAR", "YELL", "YOGA", "YOKE"
 };
 
+/* A minimal perfect hash of Wp[], generated offline.  A word, normalized and
+ * packed into 32 bits by wkey(), goes to bucket h >> 55 of h = key * HASH1,
+ * the bucket's seed picks its slot, ((h ^ seed) * HASH2) >> 53, and the slot
+ * holds the index of the only word that can be there.  The seeds were found
+ * by placing the buckets largest first, each with the smallest seed landing
+ * all of its words on free slots.
+ */
+#define HASH1 0x9E3779B97F4A7C15ULL
+#define HASH2 0xC2B2AE3D27D4EB4FULL
+
+static const unsigned short Wp_seed[512] = {
+    0, 67, 923, 594, 262, 13, 570, 10, 12, 5, 31, 13,
+    11, 1847, 1172, 1718, 361, 40, 0, 4, 0, 3, 870, 113,
+    169, 31, 9, 38, 8, 141, 7, 11, 52, 3, 159, 0,
+    7, 330, 126, 11, 2, 0, 267, 4, 198, 20, 2, 65,
+    12, 86, 57, 120, 1212, 682, 0, 256, 141, 21, 10, 0,
+    28, 5, 265, 23, 216, 341, 24, 0, 0, 70, 1, 4,
+    2, 16, 8, 15, 115, 160, 55, 71, 501, 118, 148, 7,
+    0, 1, 292, 38, 7946, 158, 36, 97, 24, 91, 227, 34,
+    4, 16, 43, 344, 494, 78, 166, 117, 331, 945, 12, 190,
+    0, 7, 408, 176, 2, 2, 5, 4, 44, 348, 6, 152,
+    324, 55, 46, 248, 61, 9, 27, 196, 148, 113, 76, 1936,
+    0, 512, 0, 19, 0, 38, 21, 42, 65, 13, 106, 199,
+    2, 104, 10, 1266, 5, 0, 74, 17, 211, 69, 129, 847,
+    65, 8, 12, 110, 2, 0, 5, 182, 10, 305, 31, 6,
+    4, 7, 0, 11, 130, 155, 11, 33, 51, 1788, 14, 0,
+    2, 409, 128, 2, 2, 29, 15, 77, 81, 127, 809, 949,
+    12, 1, 181, 17, 0, 9, 50, 12, 38, 1, 382, 59,
+    42, 13, 50, 24, 2, 148, 179, 123, 264, 6, 61, 2,
+    102, 127, 939, 5, 12, 6, 6, 96, 19, 1, 110, 14,
+    144, 158, 184, 133, 57, 1, 86, 2, 404, 1, 1, 1,
+    48, 0, 115, 0, 16, 50, 322, 206, 238, 36, 99, 320,
+    559, 0, 8, 121, 552, 67, 25, 3, 0, 653, 23, 0,
+    43, 9, 452, 250, 482, 0, 3, 0, 0, 0, 3, 37,
+    34, 0, 953, 34, 29, 17, 262, 74, 117, 3, 45, 8,
+    2, 177, 21, 350, 123, 213, 23, 348, 1, 11, 294, 115,
+    70, 101, 8, 1834, 78, 4, 0, 80, 0, 3020, 631, 1,
+    0, 2, 82, 13, 121, 587, 2, 2057, 359, 145, 138, 16,
+    33, 205, 435, 26, 18, 212, 48, 31, 4, 32, 18, 0,
+    14, 73, 143, 26, 118, 8, 179, 9, 373, 21, 259, 43,
+    130, 2, 222, 53, 2, 195, 314, 78, 258, 15, 44, 1,
+    152, 16, 9, 119, 0, 2, 4, 81, 63, 22, 0, 64,
+    28, 337, 95, 0, 1, 0, 80, 162, 15, 860, 5, 44,
+    404, 58, 191, 286, 67, 30, 661, 0, 1, 5, 3, 128,
+    425, 1, 0, 85, 354, 3, 404, 103, 58, 0, 152, 27,
+    8, 27, 2, 45, 75, 1764, 689, 207, 2, 139, 85, 9,
+    44, 19, 114, 1083, 11, 12, 42, 1, 1, 81, 44, 54,
+    488, 33, 1, 244, 0, 90, 267, 156, 52, 94, 48, 59,
+    49, 65, 85, 128, 43, 434, 50, 1, 523, 20, 0, 5,
+    66, 199, 0, 1659, 310, 3, 3, 184, 6, 238, 3275, 0,
+    8, 1, 1, 2243, 47, 3, 14, 432, 57, 0, 0, 1,
+    7, 11, 31, 1108, 106, 93, 1, 345, 224, 399, 12, 114,
+    1, 51, 0, 455, 0, 0, 2, 26, 0, 0, 702, 0,
+    144, 116, 1, 7, 244, 930, 18, 31
+};
+
+static const unsigned short Wp_slot[2048] = {
+    1637, 924, 396, 1258, 1888, 1784, 1193, 759, 1893, 1927, 1303, 1686,
+    407, 1699, 1243, 1974, 681, 1061, 1180, 1964, 1226, 1163, 640, 1021,
+    1825, 1177, 338, 428, 176, 550, 859, 1324, 1737, 471, 297, 601,
+    1640, 351, 1839, 1621, 280, 466, 197, 564, 1842, 1011, 265, 454,
+    1050, 1848, 240, 490, 375, 1107, 1224, 1993, 1312, 1118, 66, 260,
+    1223, 392, 726, 1692, 1284, 1531, 1732, 255, 1017, 177, 1026, 1887,
+    1063, 1546, 1600, 158, 206, 1757, 2027, 1680, 621, 1229, 1008, 1718,
+    213, 1207, 1937, 742, 1649, 860, 493, 694, 382, 1748, 790, 1285,
+    921, 1569, 1851, 1985, 1458, 972, 993, 529, 495, 1331, 791, 124,
+    1510, 1201, 596, 1683, 1494, 650, 724, 1824, 886, 2041, 507, 1471,
+    422, 180, 1979, 78, 414, 1536, 1292, 1270, 813, 689, 546, 254,
+    459, 952, 1265, 196, 590, 1463, 2044, 445, 1445, 1871, 1634, 199,
+    559, 701, 1589, 496, 1994, 183, 172, 1172, 1560, 730, 47, 143,
+    1421, 315, 1415, 452, 922, 1934, 891, 944, 1459, 2043, 874, 1499,
+    1130, 1437, 1983, 342, 33, 350, 855, 63, 426, 763, 873, 1465,
+    695, 1913, 1601, 1218, 1878, 113, 302, 1314, 1817, 1350, 725, 89,
+    818, 4, 1723, 738, 1070, 1572, 461, 1357, 534, 1407, 747, 1259,
+    1305, 1031, 1639, 1861, 1977, 1554, 1365, 1788, 717, 1277, 1552, 117,
+    1745, 431, 393, 1470, 71, 1780, 1774, 1579, 744, 44, 1702, 779,
+    539, 1294, 563, 1539, 499, 1400, 1073, 421, 1521, 940, 516, 2003,
+    1027, 111, 242, 1731, 364, 674, 300, 1754, 324, 1403, 1150, 212,
+    100, 225, 331, 795, 27, 667, 1677, 663, 1577, 489, 377, 1896,
+    234, 1237, 134, 697, 505, 1960, 678, 1404, 1803, 549, 400, 823,
+    451, 1941, 515, 1167, 282, 90, 1881, 1573, 2012, 1453, 1891, 1671,
+    1200, 1080, 1996, 1837, 761, 162, 271, 599, 1615, 1250, 1679, 618,
+    93, 152, 1703, 5, 1705, 1216, 319, 219, 487, 866, 1273, 68,
+    1496, 835, 25, 973, 1429, 416, 737, 1182, 932, 287, 1146, 950,
+    1308, 1254, 929, 28, 318, 756, 257, 927, 391, 945, 1931, 404,
+    349, 619, 1084, 1944, 472, 1570, 577, 1334, 1907, 1428, 956, 249,
+    245, 2013, 1170, 1342, 1328, 334, 664, 1366, 1574, 879, 672, 1682,
+    877, 492, 698, 1302, 1742, 826, 1411, 284, 108, 155, 83, 8,
+    50, 1473, 1971, 129, 585, 1826, 1283, 455, 774, 1035, 1379, 1607,
+    1911, 939, 1777, 700, 1132, 1992, 1279, 494, 1955, 965, 746, 326,
+    978, 2011, 1161, 1191, 655, 575, 1651, 259, 311, 1590, 398, 542,
+    699, 1078, 887, 139, 775, 1315, 1575, 1965, 433, 1776, 378, 1009,
+    251, 436, 1903, 1544, 2018, 402, 2021, 498, 397, 1623, 1506, 783,
+    1129, 22, 121, 48, 43, 996, 367, 853, 2042, 1325, 1320, 833,
+    166, 1588, 1500, 419, 1721, 2, 235, 288, 1793, 1211, 221, 1970,
+    119, 1535, 1427, 955, 36, 1472, 967, 506, 1368, 1058, 1580, 1018,
+    70, 1975, 411, 999, 1592, 1655, 1461, 1003, 1908, 532, 1693, 1658,
+    264, 2045, 1197, 923, 333, 252, 552, 1685, 1068, 820, 178, 344,
+    1697, 1608, 1770, 1818, 3, 437, 53, 11, 1105, 1136, 1768, 740,
+    1915, 1796, 1060, 2020, 1152, 1309, 812, 1844, 372, 1595, 560, 1982,
+    578, 617, 1942, 348, 693, 1313, 517, 1380, 1435, 141, 1227, 1038,
+    805, 765, 567, 920, 1956, 1905, 1252, 1863, 1838, 651, 688, 1830,
+    1738, 185, 912, 1039, 1076, 1845, 1055, 2038, 634, 464, 1678, 189,
+    911, 321, 857, 604, 1809, 1981, 481, 278, 541, 1140, 1128, 988,
+    1016, 1025, 365, 31, 1094, 138, 1015, 18, 383, 1868, 1798, 881,
+    750, 107, 1969, 114, 1423, 864, 1850, 1636, 1295, 1262, 127, 211,
+    399, 1673, 1282, 17, 1512, 1943, 1408, 1441, 513, 1246, 2016, 49,
+    1872, 2040, 843, 500, 1005, 9, 1141, 660, 543, 589, 1962, 916,
+    1729, 67, 568, 1260, 715, 870, 486, 582, 1963, 751, 1498, 1450,
+    872, 2032, 614, 1431, 625, 130, 1785, 1377, 448, 1102, 1007, 1812,
+    370, 1467, 679, 671, 465, 347, 1278, 1564, 1291, 899, 1799, 1688,
+    535, 1932, 1173, 179, 439, 522, 1758, 1958, 241, 1712, 38, 35,
+    1853, 1481, 272, 2004, 851, 739, 1760, 1582, 1370, 610, 869, 1242,
+    1397, 99, 463, 1188, 1, 1832, 1376, 1568, 1726, 1972, 467, 267,
+    1398, 1160, 1438, 1399, 1041, 511, 1097, 526, 2009, 1787, 132, 195,
+    953, 898, 1090, 106, 2030, 1725, 1657, 848, 1360, 1391, 995, 1476,
+    1630, 1006, 354, 1756, 682, 946, 475, 1740, 1432, 1087, 581, 626,
+    1935, 361, 834, 1772, 1857, 712, 685, 1089, 1378, 1515, 1904, 1449,
+    1062, 1922, 1786, 657, 1833, 624, 170, 970, 1948, 2046, 223, 1103,
+    173, 829, 1933, 1109, 1384, 1045, 1447, 719, 816, 951, 609, 1650,
+    1418, 1719, 1877, 878, 409, 497, 1503, 1613, 1022, 782, 1945, 1354,
+    943, 1643, 1333, 1807, 1374, 230, 1805, 736, 408, 456, 74, 201,
+    896, 1369, 1074, 1664, 1179, 1036, 815, 1666, 298, 1287, 1695, 1256,
+    989, 1057, 1126, 480, 157, 417, 1486, 985, 806, 1775, 14, 1394,
+    1248, 203, 239, 1147, 1597, 1537, 186, 1984, 647, 1990, 1532, 1023,
+    1124, 1701, 798, 1142, 1240, 1137, 122, 247, 2033, 360, 1192, 244,
+    1187, 531, 345, 1071, 1518, 1301, 1116, 1856, 1811, 1764, 1194, 1174,
+    1708, 587, 1293, 446, 661, 1114, 771, 285, 1735, 817, 194, 616,
+    1926, 1501, 118, 1356, 1452, 330, 1162, 735, 1627, 884, 1808, 1419,
+    1675, 233, 60, 1593, 444, 631, 1221, 458, 963, 1426, 429, 930,
+    977, 521, 1145, 1814, 936, 1155, 1523, 597, 1722, 193, 1689, 544,
+    1773, 659, 684, 352, 1138, 1953, 1968, 708, 1106, 1367, 1335, 810,
+    1244, 605, 1779, 1511, 1086, 420, 1028, 785, 1714, 1069, 1372, 415,
+    666, 1884, 1189, 1067, 469, 1999, 907, 1819, 88, 1286, 1804, 1691,
+    160, 1720, 503, 789, 772, 335, 1344, 156, 1840, 295, 536, 1386,
+    1829, 306, 1081, 760, 1341, 1954, 1750, 1171, 2019, 1852, 1332, 807,
+    1631, 1164, 1322, 1327, 508, 1233, 1632, 462, 897, 754, 514, 781,
+    1744, 1346, 1986, 1976, 637, 2001, 524, 757, 1131, 1296, 1121, 1886,
+    847, 320, 1168, 275, 1875, 850, 1425, 2014, 1912, 928, 1208, 312,
+    1166, 1662, 1489, 91, 1860, 1684, 1037, 161, 646, 37, 371, 1148,
+    906, 1381, 804, 236, 1263, 1910, 1930, 696, 819, 1917, 483, 1889,
+    1561, 1375, 821, 476, 1288, 1304, 1734, 767, 702, 1219, 224, 1336,
+    1957, 1730, 1004, 793, 356, 1854, 1396, 586, 520, 1290, 803, 979,
+    1446, 1206, 21, 1925, 1950, 137, 745, 140, 938, 389, 1268, 1448,
+    19, 675, 1540, 1545, 840, 7, 571, 1711, 1894, 1196, 435, 705,
+    1823, 1504, 1468, 198, 390, 1220, 1713, 1767, 716, 208, 1199, 1024,
+    1280, 768, 540, 1966, 1520, 909, 484, 1674, 1567, 1987, 1272, 432,
+    24, 13, 557, 292, 556, 2008, 447, 1951, 388, 1769, 460, 479,
+    890, 1122, 613, 794, 1092, 2035, 336, 1747, 1652, 1306, 1065, 1257,
+    1827, 1175, 662, 1096, 692, 61, 1339, 1469, 555, 80, 593, 1849,
+    691, 1524, 477, 935, 1687, 648, 1667, 394, 1390, 1139, 1923, 491,
+    1064, 1995, 1991, 1611, 26, 545, 325, 607, 1030, 1676, 204, 584,
+    904, 69, 332, 1749, 764, 1393, 384, 1395, 258, 686, 1195, 1352,
+    281, 649, 1628, 1046, 580, 629, 1947, 998, 250, 109, 1299, 595,
+    1123, 42, 1751, 1765, 1752, 875, 554, 1153, 1253, 1858, 253, 569,
+    1900, 608, 1477, 1362, 262, 1298, 1215, 1921, 1014, 942, 1816, 670,
+    1466, 1602, 1919, 1892, 214, 1330, 1542, 133, 1624, 1668, 314, 1289,
+    385, 327, 169, 1371, 987, 149, 1576, 358, 718, 913, 34, 528,
+    57, 1456, 1034, 353, 642, 903, 1660, 1759, 1135, 1190, 1297, 1961,
+    683, 1647, 1345, 1349, 1709, 876, 1873, 2005, 1323, 1133, 1119, 1043,
+    1165, 1939, 227, 103, 1228, 1895, 207, 328, 1513, 20, 1307, 148,
+    908, 917, 405, 2025, 1619, 322, 830, 1052, 1149, 1813, 1439, 1075,
+    266, 1638, 1300, 102, 1967, 410, 1082, 981, 1434, 1209, 1509, 1492,
+    1883, 1054, 86, 220, 147, 386, 159, 450, 1696, 551, 1559, 680,
+    677, 858, 82, 1433, 72, 293, 116, 1862, 1413, 811, 453, 627,
+    1610, 1648, 1464, 1125, 1822, 1212, 1530, 32, 95, 23, 588, 630,
+    1424, 1739, 1355, 1442, 1205, 1326, 966, 510, 1797, 1347, 1491, 1311,
+    863, 802, 1483, 188, 1920, 418, 1997, 2047, 799, 669, 784, 842,
+    1454, 1578, 215, 1522, 1091, 900, 1622, 854, 1555, 1612, 1694, 1899,
+    1281, 218, 1646, 474, 1406, 1707, 2034, 1484, 58, 105, 457, 1505,
+    45, 1583, 1763, 75, 845, 509, 720, 296, 1831, 1507, 1790, 1183,
+    1238, 40, 1002, 2037, 958, 1275, 824, 849, 658, 85, 643, 1706,
+    1443, 620, 2026, 591, 64, 1029, 1843, 1214, 468, 1033, 1231, 668,
+    1743, 572, 369, 374, 1902, 115, 1127, 778, 888, 2023, 1479, 0,
+    867, 413, 1581, 1485, 1547, 1321, 54, 1603, 1614, 1846, 2007, 844,
+    1115, 1815, 1566, 974, 731, 256, 1855, 727, 1727, 1571, 1548, 1245,
+    959, 914, 512, 1789, 1879, 994, 1898, 1587, 1998, 1625, 1781, 1586,
+    565, 1359, 1088, 1066, 576, 150, 1093, 861, 787, 1880, 882, 638,
+    1543, 1901, 1079, 709, 822, 2024, 1762, 94, 703, 29, 1348, 780,
+    1800, 222, 423, 87, 1617, 889, 232, 832, 918, 841, 1410, 277,
+    1867, 200, 656, 553, 992, 1836, 1604, 1528, 748, 915, 341, 340,
+    1225, 1387, 303, 286, 1120, 954, 504, 1794, 270, 741, 1841, 202,
+    316, 174, 2000, 30, 1013, 142, 238, 168, 1502, 248, 814, 837,
+    387, 641, 1792, 1210, 825, 380, 548, 1389, 1059, 937, 2022, 931,
+    2036, 941, 880, 2006, 1514, 710, 1508, 862, 1019, 632, 355, 570,
+    205, 478, 101, 1906, 991, 163, 1110, 55, 1234, 1801, 964, 343,
+    1329, 1495, 1056, 171, 1870, 1493, 406, 412, 1001, 926, 1529, 209,
+    611, 1766, 797, 961, 1101, 644, 1049, 836, 1083, 1821, 1117, 1478,
+    1204, 762, 1156, 1598, 852, 1444, 1973, 894, 1596, 485, 982, 1497,
+    1869, 1343, 1416, 947, 1251, 1255, 1517, 473, 1690, 603, 533, 758,
+    395, 164, 317, 635, 2015, 749, 1669, 612, 1866, 1247, 983, 442,
+    276, 1185, 1661, 687, 1202, 151, 1791, 809, 79, 144, 856, 359,
+    231, 594, 948, 190, 1924, 1338, 403, 905, 273, 1181, 925, 1134,
+    902, 1715, 769, 291, 910, 558, 1654, 1184, 1455, 1717, 579, 1938,
+    301, 2039, 602, 363, 228, 949, 1653, 112, 1557, 714, 800, 1645,
+    192, 337, 1186, 808, 1440, 263, 1874, 997, 1402, 1269, 1538, 838,
+    1475, 368, 1085, 1382, 289, 1516, 1401, 713, 10, 566, 2010, 1480,
+    786, 1724, 1383, 427, 1422, 538, 1267, 831, 1276, 1665, 2031, 96,
+    51, 470, 339, 1609, 16, 622, 56, 1490, 15, 1405, 1656, 12,
+    52, 1460, 76, 229, 518, 1620, 175, 1051, 81, 615, 226, 1681,
+    1487, 1802, 645, 788, 743, 146, 1111, 1040, 1310, 366, 1032, 792,
+    636, 704, 379, 62, 1952, 1533, 562, 1882, 308, 1835, 1112, 307,
+    968, 871, 753, 329, 975, 1527, 1217, 305, 246, 1047, 1095, 986,
+    1474, 441, 482, 1594, 1412, 1949, 1020, 2002, 1525, 1457, 883, 1176,
+    1733, 488, 1659, 6, 901, 373, 957, 984, 1241, 191, 1736, 376,
+    1704, 153, 1771, 184, 1108, 2029, 1044, 1271, 1012, 294, 1834, 1978,
+    1897, 777, 1048, 1488, 1392, 84, 283, 752, 933, 313, 592, 1213,
+    1198, 733, 1629, 1409, 1641, 1053, 1606, 1795, 268, 865, 1364, 770,
+    755, 182, 237, 1946, 1317, 796, 1157, 1556, 1417, 1316, 290, 1436,
+    1482, 892, 1605, 690, 846, 652, 766, 1104, 1266, 1385, 2028, 839,
+    1236, 357, 125, 1644, 1274, 381, 1143, 165, 1698, 104, 1563, 573,
+    440, 1618, 1642, 1820, 1098, 1462, 1551, 1936, 502, 919, 1414, 1940,
+    1584, 1388, 167, 1077, 1716, 98, 1909, 1847, 519, 654, 1549, 1319,
+    706, 131, 1778, 123, 261, 126, 976, 728, 537, 1761, 523, 1916,
+    187, 1154, 1261, 120, 1616, 776, 707, 309, 210, 598, 1151, 1806,
+    1178, 990, 1361, 1599, 561, 1337, 1249, 711, 1959, 1828, 1753, 1728,
+    1876, 243, 434, 639, 1980, 1782, 895, 1553, 628, 722, 77, 1420,
+    623, 1633, 1373, 665, 443, 128, 145, 1741, 1318, 110, 1159, 732,
+    1144, 136, 1363, 969, 1353, 1864, 653, 1351, 362, 1914, 1670, 1988,
+    1663, 868, 299, 729, 217, 1239, 1158, 827, 525, 73, 980, 583,
+    893, 1562, 2017, 154, 1929, 1340, 1700, 1746, 1099, 673, 39, 430,
+    1072, 346, 1430, 1890, 801, 1526, 1810, 1230, 1042, 527, 1203, 1534,
+    310, 773, 530, 438, 828, 1672, 1000, 971, 401, 1451, 574, 1885,
+    1100, 885, 633, 1010, 1710, 501, 1358, 59, 269, 962, 181, 1565,
+    1169, 721, 216, 1264, 547, 1859, 1626, 734, 1235, 1591, 1635, 274,
+    1113, 723, 1865, 934, 279, 1755, 960, 97, 46, 135, 41, 323,
+    1541, 1783, 1989, 1232, 92, 600, 1585, 676, 424, 1550, 606, 1558,
+    304, 1928, 65, 1222, 425, 449, 1519, 1918
+};
+
+/* Packs the up to 4 letters of a word, '\0' padded, as standard() did it
+ * in the original code: upper case, with 1, 0 and 5 read as L, O and S.
+ * Returns 0 for anything else, which no word of Wp[] packs to.
+ */
+static uint32_t wkey(const char *w, size_t len)
+{
+    uint32_t key = 0;
+    size_t i;
+    int c;
+
+    if (len < 1 || len > 4)
+        return 0;
+    for (i = 0; i < 4; i++) {
+        c = i < len ? (unsigned char) w[i] : 0;
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        else if (c == '1')
+            c = 'L';
+        else if (c == '0')
+            c = 'O';
+        else if (c == '5')
+            c = 'S';
+        else if (i < len && (c < 'A' || c > 'Z'))
+            return 0;
+        key = key << 8 | (uint32_t) c;
+    }
+    return key;
+}
+
+/* The index of a word in Wp[], or -1 */
+static int wlookup(const char *w, size_t len)
+{
+    uint32_t key = wkey(w, len);
+    uint64_t h = key * HASH1;
+    int i;
+
+    if (key == 0)
+        return -1;
+    i = Wp_slot[((h ^ Wp_seed[h >> 55]) * HASH2) >> 53];
+    return ((uint32_t) (unsigned char) Wp[i][0] << 24 |
+            (uint32_t) (unsigned char) Wp[i][1] << 16 |
+            (uint32_t) (unsigned char) Wp[i][2] << 8 |
+            (uint32_t) (unsigned char) Wp[i][3]) == key ? i : -1;
+}
+
+/* The 2 bit sum S/Key appends to 64 bits */
+static unsigned parity(uint64_t x)
+{
+    unsigned p = 0;
+    int i;
+
+    for (i = 0; i < 64; i += 2)
+        p += (x >> i) & 3;
+    return p & 3;
+}
+
+/* Writes the 6 words of the 8 bytes at 'c' to 'out', separated by spaces.
+ * Returns the end of the words, 29 characters at most are written.
+ */
+static char *encode8(char *out, const unsigned char *c)
+{
+    uint64_t x = 0;
+    unsigned v;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        x = x << 8 | c[i];
+
+    for (i = 0; i < 6; i++) {
+        v = i < 5 ? (unsigned) (x >> (53 - 11 * i)) & 2047 :
+                    (unsigned) (x & 511) << 2 | parity(x);
+        if (i > 0)
+            *out++ = ' ';
+        memcpy(out, Wp[v], 4);
+        out += Wp[v][3] ? 4 : strlen(Wp[v]);
+    }
+    return out;
+}
+
+/* Reads 6 words from '*e' into 8 bytes at 'out', words are separated by
+ * spaces, or by any whitespace with 'anyspace'.  '*e' is left after the
+ * last word.
+ * Returns 1 OK, 0 word not in data base, -1 badly formed input (a missing
+ * or > 4 char word), -2 words OK but parity is wrong.
+ */
+static int decode8(unsigned char *out, const char **e, int anyspace)
+{
+    const char *s = *e;
+    uint64_t x = 0;
+    size_t len;
+    int i, v;
+
+    /* isspace() in the C locale */
+#define SKEY_SPACE(c) ((c) == ' ' || (anyspace && (c) >= '\t' && (c) <= '\r'))
+    for (i = 0; i < 6; i++) {
+        while (*s != '\0' && SKEY_SPACE(*s))
+            s++;
+        for (len = 0; s[len] != '\0' && !SKEY_SPACE(s[len]); len++)
+            if (len == 4)
+                return -1;
+        if (len == 0)
+            return -1;
+        if ((v = wlookup(s, len)) < 0)
+            return 0;
+        s += len;
+        /* 66 bits, the first 64 in x, the parity in v */
+        x = i < 5 ? x | (uint64_t) v << (53 - 11 * i) : x | (uint64_t) v >> 2;
+    }
+#undef SKEY_SPACE
+    *e = s;
+
+    if ((unsigned) (v & 3) != parity(x))
+        return -2;
+    for (i = 7; i >= 0; i--, x >>= 8)
+        out[i] = (unsigned char) x;
+    return 1;
+}
+
 /* Encode 8 bytes in 'c' as a string of English words.
- * Returns a pointer to a static buffer
+ * Returns engout, which needs room for 30 characters
  */
 char * btoe(engout,c)
     char *engout;
     char *c;
 {
-    char cp[9]; /* add in room for the parity 2 bits*/
-    int p,i ;
-
-    engout[0] = '\0';
-    memcpy(cp, c,8);
-    /* compute parity */
-    for(p = 0,i = 0; i < 64;i += 2)
-        p += extract(cp,i,2);
-
-    cp[8] = (char)p << 6;
-    strncat(engout,&Wp[extract(cp, 0,11)][0],4);
-    strcat(engout," ");
-    strncat(engout,&Wp[extract(cp,11,11)][0],4);
-    strcat(engout," ");
-    strncat(engout,&Wp[extract(cp,22,11)][0],4);
-    strcat(engout," ");
-    strncat(engout,&Wp[extract(cp,33,11)][0],4);
-    strcat(engout," ");
-    strncat(engout,&Wp[extract(cp,44,11)][0],4);
-    strcat(engout," ");
-    strncat(engout,&Wp[extract(cp,55,11)][0],4);
-    #ifdef  debug
-    printf("engout is %s\n\r",engout);
-    #endif
+    *encode8(engout, (const unsigned char *) c) = '\0';
     return(engout);
 }
 
@@ -289,46 +610,18 @@ int etob(out, e)
     char *out;
     char *e;
 {
-    char *word;
-    int i, p, v,l, low,high;
-    char b[9];
-    char input[36];
+    const char *s = e;
+    unsigned char b[8];
+    int rc;
 
     if(e == NULL)
         return -1;
 
-    strncpy(input,e,sizeof(input));
-    memset(b, 0, sizeof(b));
     memset(out, 0, 8);
-    for(i=0,p=0;i<6;i++,p+=11){
-        if((word = strtok(i == 0 ? input : NULL," ")) == NULL)
-            return -1;
-        l = strlen(word);
-        if(l > 4 || l < 1){
-            return -1;
-        } else if(l < 4){
-            low = 0;
-            high = 570;
-        } else {
-            low = 571;
-            high = 2047;
-        }
-        standard(word);
-        if( (v = wsrch(word,low,high)) < 0 )
-            return 0;
-        insert(b,v,p,11);
-    }
-
-    /* now check the parity of what we got */
-    for(p = 0, i = 0; i < 64; i +=2)
-        p += extract(b, i, 2);
-
-    if( (p & 3) != extract(b, 64,2) )
-        return -2;
-
-    memcpy(out,b,8);
-
-    return 1;
+    if ((rc = decode8(b, &s, 0)) == 1)
+        memcpy(out, b, 8);
+    memset(b, 0, sizeof(b));
+    return rc;
 }
 /* Display 8 bytes as a series of 16-bit hex digits */
 char * put8(out,s)
@@ -341,131 +634,6 @@ char * put8(out,s)
             s[6] & 0xff,s[7] & 0xff);
     return out;
 }
-#ifdef  notdef
-/* Encode 8 bytes in 'cp' as stream of ascii letters.
- * Provided as a possible alternative to btoe()
- */
-char * btoc(cp)
-    char *cp;
-{
-    int i;
-    static char out[31];
-
-    /* code out put by characters 6 bits each added to 0x21 (!)*/
-    for(i=0;i <= 10;i++){
-        /* last one is only 4 bits not 6*/
-        out[i] = '!'+ extract(cp,6*i,i >= 10 ? 4:6);
-    }
-    out[i] = '\0';
-    return(out);
-}
-#endif
-
-/* Internal subroutines for word encoding/decoding */
-
-/* Dictionary binary search */
-static int wsrch(w,low,high)
-    char *w;
-    int low, high;
-{
-    int i,j;
-
-    for(;;){
-        i = (low + high)/2;
-        if((j = strncmp(w,Wp[i],4)) == 0)
-            return i;       /* Found it */
-        if(high == low+1){
-            /* Avoid effects of integer truncation in /2 */
-            if(strncmp(w,Wp[high],4) == 0)
-                return high;
-            else
-                return -1;
-        }
-        if(low >= high)
-            return -1;
-        /* I don't *think* this can happen...*/
-        if(j < 0)
-            high = i;  /* Search lower half */
-        else
-            low = i;   /* Search upper half */
-    }
-}
-static void
-insert(s, x, start, length)
-char *s;
-int x;
-int  start, length;
-{
-        unsigned char cl;
-        unsigned char cc;
-        unsigned char cr;
-        unsigned long y;
-        int shift;
-
-        assert(length <= 11);
-        assert(start >= 0);
-        assert(length >= 0);
-        assert(start +length <= 66);
-
-        shift = ((8  -(( start + length) % 8))%8);
-        y = (long) x << shift;
-        cl = (y >> 16) & 0xff;
-        cc = (y >> 8) & 0xff;
-        cr = y & 0xff;
-        if(shift + length > 16){
-                s[start /8] |= cl;
-                s[start/8 +1] |= cc;
-                s[start/8 +2] |= cr;
-        } else if(shift +length > 8){
-                s[start/8] |= cc;
-                s[start/8 + 1] |= cr;
-        } else {
-                s[start/8] |= cr;
-        }
-}
-static void
-standard(word)
-register char *word;
-{
-        while(*word){
-                if(!isascii(*word))
-                        break;
-                if(islower(*word))
-                        *word = toupper(*word);
-                if(*word == '1')
-                        *word = 'L';
-                if(*word == '0')
-                        *word = 'O';
-                if(*word == '5')
-                        *word = 'S';
-                word++;
-        }
-}
-
-/* Extract 'length' bits from the char array 's'
-   starting with bit 'start' */
-static unsigned long extract(s, start, length)
-    char *s;
-    int start, length;
-{
-    unsigned char cl;
-    unsigned char cc;
-    unsigned char cr;
-    unsigned long x;
-
-    assert(length <= 11);
-    assert(start >= 0);
-    assert(length >= 0);
-    assert(start +length <= 66);
-
-    cl = s[start/8];
-    cc = s[start/8 +1];
-    cr = s[start/8 +2];
-    x = ((long)(cl<<8 | cc) <<8  | cr) ;
-    x = x >> (24 - (length + (start %8)));
-    x =( x & (0xffff >> (16-length) )   );
-    return(x);
-}
 
 /* eng2key() assumes words must be separated by spaces only. Returns
    1 if succeeded
@@ -497,9 +665,11 @@ int eng2key(keyout,eng)
   return rc;
 }
 
-/* libscrypt_skey_encode() assumes string referenced by target has at
- * least 60 characters (4*12 + 11 spaces + '\0') of space.
- * Returns sucess/failure status of the operation
+/* libscrypt_skey_encode() needs skey_encode_len(srclength) characters of
+ * target: 30 for each 8 bytes (6 words of up to 4 letters, 5 spaces and a
+ * space or the '\0').  A short last group is padded with zero bytes.  The
+ * words are written in one pass, the rest of target is zeroed.
+ * Returns the length of the output, or -1 on error
  */
 int libscrypt_skey_encode(src, srclength, target, targsize)
     unsigned char const *src;
@@ -507,28 +677,74 @@ int libscrypt_skey_encode(src, srclength, target, targsize)
     char *target;
     size_t targsize;
 {
-  //btoe() works in 8 bytes (or 64 bit) chunks, so the src string is
-  //divided, encoded and concatenated at the end
-  char skey[60];
-  memset(skey, 0, 60);
-  memset(target, 0, targsize);
-
-  int total_chunks = srclength/8;
-  if (srclength % 8 != 0) {
-      total_chunks++;
-  }
-
-  //not enough data
-  if (total_chunks == 0) return (-1);
-
-  btoe(skey,src);
-  strcat(target,skey);
-
-  int i;
-  for (i = 1; i < total_chunks; i++) {
-      strcat(target," ");
-      btoe(skey,src+(8*i));
-      strcat(target,skey);
-  }
-  return 0;
+    unsigned char last[8];
+    char *out = target;
+    size_t i;
+
+    //not enough data, or not enough space
+    if (srclength == 0 || targsize < skey_encode_len(srclength) ||
+        skey_encode_len(srclength) > INT_MAX) {
+        memset(target, 0, targsize);
+        return (-1);
+    }
+
+    for (i = 0; i + 8 <= srclength; i += 8) {
+        if (i > 0)
+            *out++ = ' ';
+        out = encode8(out, src + i);
+    }
+    if (i < srclength) {
+        memset(last, 0, sizeof(last));
+        memcpy(last, src + i, srclength - i);
+        if (i > 0)
+            *out++ = ' ';
+        out = encode8(out, last);
+        memset(last, 0, sizeof(last));
+    }
+
+    memset(out, 0, targsize - (size_t) (out - target));
+    return (int) (out - target);
+}
+
+/* The reverse of libscrypt_skey_encode(), words are separated by any
+ * whitespace and each 6 of them (parity included) give 8 bytes.  The last
+ * group may be cut short by the end of target, as long as the bytes left
+ * out are zero: a target of the encoded length gets back exactly the bytes
+ * that were encoded.
+ * Returns the number of bytes, or -1 on error
+ */
+int libscrypt_skey_decode(src, target, targsize)
+    char const *src;
+    unsigned char *target;
+    size_t targsize;
+{
+    unsigned char b[8];
+    size_t n, tarindex = 0;
+    int i;
+
+    if (src == NULL)
+        return (-1);
+
+    for (;;) {
+        while (*src && isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
+        if (tarindex == targsize || tarindex > INT_MAX - 8 ||
+            decode8(b, &src, 1) != 1)
+            goto err;
+
+        n = targsize - tarindex < 8 ? targsize - tarindex : 8;
+        for (i = (int) n; i < 8; i++)
+            if (b[i] != 0)
+                goto err;
+        memcpy(target + tarindex, b, n);
+        tarindex += n;
+    }
+    memset(b, 0, sizeof(b));
+    return (int) tarindex;
+
+err:
+    memset(b, 0, sizeof(b));
+    return (-1);
 }
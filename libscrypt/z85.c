@@ -34,6 +34,11 @@
 
 #include "z85.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define Z85_SIMD
+#endif
+
 typedef unsigned int  uint32_t;
 typedef unsigned char byte;
 
@@ -116,13 +121,298 @@ int libscrypt_z85_decode(src, target, targsize)
    return datalength;
 }
 
-char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
+/*******************************************************************************
+ * Vectorized kernels                                                          *
+ *******************************************************************************/
+
+// The kernel converts whole blocks of 8 frames, then 4, and returns how many
+// frames it did, the scalar loops below finish the range.  Decoding stops at a
+// block with a symbol outside the alphabet, the scalar code maps those through
+// base256[] as it always did, so every kernel gives the very same bytes.  The
+// table is "portable" first, Z85_kernel() picks the last one the CPU supports.
+#ifdef Z85_SIMD
+
+// big-endian frames to native 32-bit lanes and back
+#define Z85_BSWAP 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+
+// n / 7225 for 32-bit n, (n * DIV7225_MAGIC) >> 44
+#define DIV7225_MAGIC 2434904643U
+
+// 4 frames per 128-bit lane: digit 0 in the low byte of each 32-bit lane (b),
+// digits 3, 4, 1, 2 in its bytes (a), to 20 symbols, 16 + 4
+#define Z85_ENC_A0 -1, 2, 3, 0, 1, -1, 6, 7, 4, 5, -1, 10, 11, 8, 9, -1
+#define Z85_ENC_B0 0, -1, -1, -1, -1, 4, -1, -1, -1, -1, 8, -1, -1, -1, -1, 12
+#define Z85_ENC_A1 14, 15, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+
+// symbol - digit for digits 62..77 and 78..84, indexed by digit - 62 and
+// digit - 78
+#define Z85_ENC_SYM0 \
+   '.' - 62, '-' - 63, ':' - 64, '+' - 65, '=' - 66, '^' - 67, '!' - 68, '/' - 69, \
+   '*' - 70, '?' - 71, '&' - 72, '<' - 73, '>' - 74, '(' - 75, ')' - 76, '[' - 77
+#define Z85_ENC_SYM1 \
+   ']' - 78, '{' - 79, '}' - 80, '@' - 81, '%' - 82, '$' - 83, '#' - 84, \
+   0, 0, 0, 0, 0, 0, 0, 0, 0
+
+// symbols 0..15 (a) and 4..19 (b) of 4 frames per 128-bit lane: digit 0 to
+// the low byte of each 32-bit lane, digits 1..4 to its bytes
+#define Z85_DEC_D0 0, -1, -1, -1, 5, -1, -1, -1, 10, -1, -1, -1, 15, -1, -1, -1
+#define Z85_DEC_A 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14, -1, -1, -1, -1
+#define Z85_DEC_B -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 13, 14, 15
+
+// symbols to digits by high nibble 2..7, indexed by the low nibble, -1 if
+// the symbol isn't in the alphabet
+static const signed char base256_nibbles[6][16] =
+{
+   { -1, 68, -1, 84, 83, 82, 72, -1, 75, 76, 70, 65, -1, 63, 62, 69 },
+   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 64, -1, 73, 66, 74, 71 },
+   { 81, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50 },
+   { 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 77, -1, 78, 67, -1 },
+   { -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24 },
+   { 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 79, -1, 80, -1, -1 }
+};
+
+#define Z85_SEL(W, S, m, x, y) \
+   _mm##S##_or_si##W(_mm##S##_and_si##W(m, x), _mm##S##_andnot_si##W(m, y))
+
+// Frames to digits.  v / 7225 with a 32x32->64 multiply on the even and the
+// odd lanes, that quotient (< 85^3) / 7225 in single precision, exact below
+// 2^20 with the 0.5 bias.  Both remainders (< 7225) fit 16-bit lanes, where
+// they are split into two digits each with a 16-bit multiply-high.
+#define Z85_ENC_BLOCK(W, S, in, bswap, a, b) \
+   do \
+   { \
+      const __m##W##i m_ = _mm##S##_set1_epi32((int)DIV7225_MAGIC); \
+      const __m##W##i k_ = _mm##S##_set1_epi32(7225); \
+      __m##W##i v_ = _mm##S##_shuffle_epi8(in, bswap), q_, r0_, r1_, t_; \
+      q_ = _mm##S##_or_si##W( \
+         _mm##S##_srli_epi64(_mm##S##_mul_epu32(v_, m_), 44), \
+         _mm##S##_slli_epi64(_mm##S##_srli_epi64(_mm##S##_mul_epu32( \
+            _mm##S##_srli_epi64(v_, 32), m_), 44), 32)); \
+      r1_ = _mm##S##_sub_epi16(v_, _mm##S##_mullo_epi16(q_, k_)); \
+      b = _mm##S##_cvttps_epi32(_mm##S##_mul_ps(_mm##S##_add_ps( \
+         _mm##S##_cvtepi32_ps(q_), _mm##S##_set1_ps(0.5f)), \
+         _mm##S##_set1_ps(1.0f / 7225))); \
+      r0_ = _mm##S##_sub_epi16(q_, _mm##S##_mullo_epi16(b, k_)); \
+      t_ = _mm##S##_or_si##W(_mm##S##_and_si##W(r1_, \
+         _mm##S##_set1_epi32(0xffff)), _mm##S##_slli_epi32(r0_, 16)); \
+      q_ = _mm##S##_srli_epi16(_mm##S##_mulhi_epu16(t_, \
+         _mm##S##_set1_epi16(12337)), 4); \
+      a = _mm##S##_or_si##W(q_, _mm##S##_slli_epi16(_mm##S##_sub_epi16(t_, \
+         _mm##S##_mullo_epi16(q_, _mm##S##_set1_epi16(85))), 8)); \
+   } while (0)
+
+// digit bytes to symbols: 0-9, a-z and A-Z are ranges, the rest a lookup,
+// all as offsets from the digit
+#define Z85_SYMBOLS(W, S, d, sym0, sym1) \
+   do \
+   { \
+      __m##W##i idx_ = _mm##S##_sub_epi8(d, _mm##S##_set1_epi8(62)); \
+      __m##W##i off_ = _mm##S##_add_epi8( \
+         _mm##S##_and_si##W(_mm##S##_cmpgt_epi8(_mm##S##_set1_epi8(62), d), \
+            _mm##S##_set1_epi8('A' - 36)), \
+         _mm##S##_and_si##W(_mm##S##_cmpgt_epi8(_mm##S##_set1_epi8(36), d), \
+            _mm##S##_set1_epi8('a' - 10 - ('A' - 36)))); \
+      off_ = _mm##S##_add_epi8(off_, _mm##S##_and_si##W( \
+         _mm##S##_cmpgt_epi8(_mm##S##_set1_epi8(10), d), \
+         _mm##S##_set1_epi8('0' - ('a' - 10)))); \
+      off_ = _mm##S##_add_epi8(off_, _mm##S##_and_si##W( \
+         _mm##S##_shuffle_epi8(sym0, idx_), \
+         _mm##S##_cmpgt_epi8(_mm##S##_set1_epi8(16), idx_))); \
+      off_ = _mm##S##_add_epi8(off_, _mm##S##_shuffle_epi8(sym1, \
+         _mm##S##_sub_epi8(idx_, _mm##S##_set1_epi8(16)))); \
+      d = _mm##S##_add_epi8(d, off_); \
+   } while (0)
+
+// symbols to digits, bad flags the ones outside the alphabet
+#define Z85_DIGITS(W, S, c, lut, bad) \
+   do \
+   { \
+      __m##W##i lo_ = _mm##S##_and_si##W(c, _mm##S##_set1_epi8(0x0f)); \
+      __m##W##i hi_ = _mm##S##_and_si##W(_mm##S##_srli_epi16(c, 4), \
+         _mm##S##_set1_epi8(0x0f)); \
+      __m##W##i r_ = _mm##S##_set1_epi8(-1); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 0, r_); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 1, r_); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 2, r_); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 3, r_); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 4, r_); \
+      Z85_DIGITS_ROW(W, S, hi_, lo_, lut, 5, r_); \
+      bad = _mm##S##_cmpeq_epi8(r_, _mm##S##_set1_epi8(-1)); \
+      c = r_; \
+   } while (0)
+#define Z85_DIGITS_ROW(W, S, hi, lo, lut, h, r) \
+   r = Z85_SEL(W, S, _mm##S##_cmpeq_epi8(hi, _mm##S##_set1_epi8((h) + 2)), \
+      _mm##S##_shuffle_epi8(lut[h], lo), r)
+
+// Digits to frames: d1 d2 d3 d4 to d1 * 85^3 + d2 * 85^2 + d3 * 85 + d4 with
+// two multiply-adds, plus d0 * 85^4, wrapping as the scalar code does.
+#define Z85_DEC_BLOCK(W, S, a, b, ga, gb, g0, bswap, out) \
+   do \
+   { \
+      __m##W##i x_ = _mm##S##_or_si##W(_mm##S##_shuffle_epi8(a, ga), \
+         _mm##S##_shuffle_epi8(b, gb)); \
+      x_ = _mm##S##_madd_epi16(_mm##S##_maddubs_epi16(x_, \
+         _mm##S##_set1_epi16(0x0155)), _mm##S##_set1_epi32(0x00011c39)); \
+      out = _mm##S##_mullo_epi32(_mm##S##_shuffle_epi8(a, g0), \
+         _mm##S##_set1_epi32(85 * 85 * 85 * 85)); \
+      out = _mm##S##_shuffle_epi8(_mm##S##_add_epi32(out, x_), bswap); \
+   } while (0)
+
+static int Z85_supported_avx2(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+
+// a 128-bit pattern in both lanes
+#define Z85_V256(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+__attribute__((target("avx2")))
+static size_t Z85_encode_avx2(const unsigned char* src, size_t frames, char* dst)
+{
+   const __m256i sym0  = Z85_V256(Z85_ENC_SYM0);
+   const __m256i sym1  = Z85_V256(Z85_ENC_SYM1);
+   const __m256i bswap = Z85_V256(Z85_BSWAP);
+   const __m256i a0    = Z85_V256(Z85_ENC_A0);
+   const __m256i b0    = Z85_V256(Z85_ENC_B0);
+   const __m256i a1    = Z85_V256(Z85_ENC_A1);
+   __m256i a, b, head;
+   __m128i a4, b4;
+   uint32_t tail;
+   size_t i;
+
+   // 32 bytes to 40 symbols, 20 per 128-bit lane
+   for (i = 0; frames - i >= 8; i += 8, src += 32, dst += 40)
+   {
+      Z85_ENC_BLOCK(256, 256, _mm256_loadu_si256((const __m256i*)src), bswap, a, b);
+      Z85_SYMBOLS(256, 256, a, sym0, sym1);
+      Z85_SYMBOLS(256, 256, b, sym0, sym1);
+      head = _mm256_or_si256(_mm256_shuffle_epi8(a, a0), _mm256_shuffle_epi8(b, b0));
+      a = _mm256_shuffle_epi8(a, a1);
+      _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(head));
+      tail = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(a));
+      memcpy(dst + 16, &tail, 4);
+      _mm_storeu_si128((__m128i*)(dst + 20), _mm256_extracti128_si256(head, 1));
+      tail = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(a, 1));
+      memcpy(dst + 36, &tail, 4);
+   }
+
+   // 16 bytes to 20 symbols
+   if (frames - i >= 4)
+   {
+      Z85_ENC_BLOCK(128, , _mm_loadu_si128((const __m128i*)src),
+         _mm256_castsi256_si128(bswap), a4, b4);
+      Z85_SYMBOLS(128, , a4, _mm256_castsi256_si128(sym0), _mm256_castsi256_si128(sym1));
+      Z85_SYMBOLS(128, , b4, _mm256_castsi256_si128(sym0), _mm256_castsi256_si128(sym1));
+      _mm_storeu_si128((__m128i*)dst, _mm_or_si128(
+         _mm_shuffle_epi8(a4, _mm256_castsi256_si128(a0)),
+         _mm_shuffle_epi8(b4, _mm256_castsi256_si128(b0))));
+      tail = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi8(a4, _mm256_castsi256_si128(a1)));
+      memcpy(dst + 16, &tail, 4);
+      i += 4;
+   }
+
+   _mm256_zeroupper();
+   return i;
+}
+
+__attribute__((target("avx2")))
+static size_t Z85_decode_avx2(const char* src, size_t frames, unsigned char* dst)
+{
+   const __m256i bswap = Z85_V256(Z85_BSWAP);
+   const __m256i ga    = Z85_V256(Z85_DEC_A);
+   const __m256i gb    = Z85_V256(Z85_DEC_B);
+   const __m256i g0    = Z85_V256(Z85_DEC_D0);
+   __m256i lut[6], a, b, bada, badb, out;
+   __m128i lut4[6], a4, b4, bada4, badb4, out4;
+   size_t i;
+   int j;
+
+   for (j = 0; j < 6; j++)
+   {
+      lut4[j] = _mm_loadu_si128((const __m128i*)base256_nibbles[j]);
+      lut[j]  = _mm256_broadcastsi128_si256(lut4[j]);
+   }
+
+   // 40 symbols to 32 bytes, 20 per 128-bit lane, read as symbols 0..15
+   // and 4..19 of each
+   for (i = 0; frames - i >= 8; i += 8, src += 40, dst += 32)
+   {
+      a = _mm256_inserti128_si256(_mm256_castsi128_si256(
+         _mm_loadu_si128((const __m128i*)src)),
+         _mm_loadu_si128((const __m128i*)(src + 20)), 1);
+      b = _mm256_inserti128_si256(_mm256_castsi128_si256(
+         _mm_loadu_si128((const __m128i*)(src + 4))),
+         _mm_loadu_si128((const __m128i*)(src + 24)), 1);
+      Z85_DIGITS(256, 256, a, lut, bada);
+      Z85_DIGITS(256, 256, b, lut, badb);
+      if (!_mm256_testz_si256(bada, bada) || !_mm256_testz_si256(badb, badb))
+         break;
+      Z85_DEC_BLOCK(256, 256, a, b, ga, gb, g0, bswap, out);
+      _mm256_storeu_si256((__m256i*)dst, out);
+   }
+
+   // 20 symbols to 16 bytes
+   if (frames - i >= 4)
+   {
+      a4 = _mm_loadu_si128((const __m128i*)src);
+      b4 = _mm_loadu_si128((const __m128i*)(src + 4));
+      Z85_DIGITS(128, , a4, lut4, bada4);
+      Z85_DIGITS(128, , b4, lut4, badb4);
+      if (_mm_testz_si128(bada4, bada4) && _mm_testz_si128(badb4, badb4))
+      {
+         Z85_DEC_BLOCK(128, , a4, b4, _mm256_castsi256_si128(ga),
+            _mm256_castsi256_si128(gb), _mm256_castsi256_si128(g0),
+            _mm256_castsi256_si128(bswap), out4);
+         _mm_storeu_si128((__m128i*)dst, out4);
+         i += 4;
+      }
+   }
+
+   _mm256_zeroupper();
+   return i;
+}
+
+#endif // Z85_SIMD
+
+const struct Z85_kernel Z85_kernels[] =
+{
+   { "portable", NULL, NULL, NULL },
+#ifdef Z85_SIMD
+   { "avx2", Z85_supported_avx2, Z85_encode_avx2, Z85_decode_avx2 },
+#endif
+   { NULL, NULL, NULL, NULL }
+};
+
+const struct Z85_kernel* Z85_kernel(void)
+{
+   const struct Z85_kernel* k;
+   const struct Z85_kernel* best = Z85_kernels;
+
+   for (k = Z85_kernels + 1; k->name; k++)
+   {
+      if (k->supported())
+         best = k;
+   }
+
+   return best;
+}
+
+char* Z85_encode_unsafe_with(const struct Z85_kernel* k, const char* source, const char* sourceEnd, char* dest)
 {
    byte* src = (byte*)source;
    byte* end = (byte*)sourceEnd;
    byte* dst = (byte*)dest;
    uint32_t value;
    uint32_t value2;
+   size_t frames;
+
+   // a kernel needs a block of 4 frames at least
+   if (k->encode && end - src >= 16)
+   {
+      frames = k->encode(src, (size_t)(end - src) / 4, (char*)dst);
+      src += frames * 4;
+      dst += frames * 5;
+   }
 
    for (; src != end; src += 4, dst += 5)
    {
@@ -139,15 +429,27 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
    return (char*)dst;
 }
 
-char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
+char* Z85_decode_unsafe_with(const struct Z85_kernel* k, const char* source, const char* sourceEnd, char* dest)
 {
    byte* src = (byte*)source;
    byte* end = (byte*)sourceEnd;
    byte* dst = (byte*)dest;
    uint32_t value;
+   size_t frames;
 
    for (; src != end; src += 5, dst += 4)
    {
+      // the kernel stops at a block it can't take, one frame of it is done
+      // here and the kernel tried again
+      if (k->decode && end - src >= 20)
+      {
+         frames = k->decode((const char*)src, (size_t)(end - src) / 5, dst);
+         src += frames * 5;
+         dst += frames * 4;
+         if (src == end)
+            break;
+      }
+
       value =              base256[(src[0] - 32) & 127];
       value = value * 85 + base256[(src[1] - 32) & 127];
       value = value * 85 + base256[(src[2] - 32) & 127];
@@ -164,6 +466,16 @@ char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
    return (char*)dst;
 }
 
+char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
+{
+   return Z85_encode_unsafe_with(Z85_kernel(), source, sourceEnd, dest);
+}
+
+char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
+{
+   return Z85_decode_unsafe_with(Z85_kernel(), source, sourceEnd, dest);
+}
+
 size_t Z85_encode_bound(size_t size)
 {
    return size * 5 / 4;
@@ -288,3 +600,165 @@ size_t Z85_decode_with_padding(const char* source, char* dest, size_t inputSize)
 
    return dst - dest + tailBytes;
 }
+
+char* Z85_encode_stream_begin(Z85_stream* stream, size_t inputSize, char* dest)
+{
+   size_t tailBytes = inputSize % 4;
+
+   assert(stream && dest);
+
+   stream->left      = inputSize;
+   stream->tailBytes = 0;
+   stream->pending   = 0;
+
+   // zero length string is not padded
+   if (inputSize == 0)
+   {
+      return dest;
+   }
+
+   (dest++)[0] = (tailBytes == 0 ? '4' : '0' + (char)tailBytes); // write tail bytes count
+   return dest;
+}
+
+char* Z85_encode_stream_update(Z85_stream* stream, const char* source, size_t size, char* dest)
+{
+   size_t n;
+
+   assert(stream && (source || size == 0) && dest);
+
+   if (size > stream->left)
+   {
+      assert(!"more bytes than announced");
+      return NULL;
+   }
+   stream->left -= size;
+
+   // complete the partial frame
+   if (stream->pending > 0)
+   {
+      n = 4 - stream->pending;
+      if (n > size)
+         n = size;
+      memcpy(stream->buf + stream->pending, source, n);
+      stream->pending += n;
+      source += n;
+      size -= n;
+      if (stream->pending < 4)
+         return dest;
+      dest = Z85_encode_unsafe(stream->buf, stream->buf + 4, dest);
+      stream->pending = 0;
+   }
+
+   // whole frames, keep the rest
+   n = size - size % 4;
+   dest = Z85_encode_unsafe(source, source + n, dest);
+   memcpy(stream->buf, source + n, size - n);
+   stream->pending = size - n;
+
+   return dest;
+}
+
+char* Z85_encode_stream_end(Z85_stream* stream, char* dest)
+{
+   assert(stream && dest);
+
+   if (stream->left != 0)
+   {
+      assert(!"less bytes than announced");
+      return NULL;
+   }
+
+   // write tail
+   if (stream->pending > 0)
+   {
+      memset(stream->buf + stream->pending, 0, 4 - stream->pending);
+      dest = Z85_encode_unsafe(stream->buf, stream->buf + 4, dest);
+      stream->pending = 0;
+   }
+   memset(stream->buf, 0, sizeof(stream->buf));
+
+   return dest;
+}
+
+void Z85_decode_stream_begin(Z85_stream* stream)
+{
+   assert(stream);
+
+   stream->left      = 0;
+   stream->tailBytes = 0;
+   stream->pending   = 0;
+}
+
+char* Z85_decode_stream_update(Z85_stream* stream, const char* source, size_t size, char* dest)
+{
+   size_t n;
+
+   assert(stream && (source || size == 0) && dest);
+
+   if (size > 0 && stream->tailBytes == 0)
+   {
+      stream->tailBytes = (source++)[0] - '0'; // possible values: 1, 2, 3 or 4
+      size--;
+      if (stream->tailBytes - 1 > 3)
+      {
+         assert(!"wrong tail bytes count");
+         stream->tailBytes = 0;
+         return NULL;
+      }
+   }
+
+   while (size > 0)
+   {
+      // a held back frame isn't the last one after all
+      if (stream->pending == 5)
+      {
+         dest = Z85_decode_unsafe(stream->buf, stream->buf + 5, dest);
+         stream->pending = 0;
+      }
+
+      // complete the partial frame
+      if (stream->pending > 0)
+      {
+         n = 5 - stream->pending;
+         if (n > size)
+            n = size;
+         memcpy(stream->buf + stream->pending, source, n);
+         stream->pending += n;
+         source += n;
+         size -= n;
+         continue;
+      }
+
+      // whole frames but the last one, keep the rest
+      n = size % 5 == 0 ? size - 5 : size - size % 5;
+      dest = Z85_decode_unsafe(source, source + n, dest);
+      memcpy(stream->buf, source + n, size - n);
+      stream->pending = size - n;
+      size = 0;
+   }
+
+   return dest;
+}
+
+char* Z85_decode_stream_end(Z85_stream* stream, char* dest)
+{
+   char tailBuf[4] = { 0 };
+
+   assert(stream && dest);
+
+   if (stream->tailBytes == 0 || stream->pending != 5)
+   {
+      assert(!"incomplete stream");
+      return NULL;
+   }
+
+   // decode last 5 bytes chunk
+   Z85_decode_unsafe(stream->buf, stream->buf + 5, tailBuf);
+   memcpy(dest, tailBuf, stream->tailBytes);
+   memset(stream->buf, 0, sizeof(stream->buf));
+   memset(tailBuf, 0, sizeof(tailBuf));
+   stream->pending = 0;
+
+   return dest + stream->tailBytes;
+}
@@ -0,0 +1,198 @@
+//perf: hardware counters around the smix phases
+//
+//Phase 1 (fill) writes V sequentially, phase 2 (mix) reads it at random,
+//comparing their IPC, LLC and dTLB misses per KiB tells whether a host is
+//bound by compute, the caches or the TLB. Memory bandwidth is estimated
+//from the LLC misses (one 64 byte line each), uncore counters usually need
+//system wide access.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+#define MAX_ROWS  128
+#define CACHELINE 64
+
+enum { CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, NCOUNTERS };
+
+static const char *counter_names[NCOUNTERS] = {
+    "cycles", "instructions", "LLC-misses", "dTLB-misses"
+};
+
+struct row {
+    char        stage[64];
+    const char *phase;
+    uint64_t    runs;
+    double      ms;
+    uint64_t    values[NCOUNTERS];
+};
+
+static int    fds[NCOUNTERS] = {-1, -1, -1, -1};
+static int    opened;
+static struct row rows[MAX_ROWS];
+static int    nrows;
+static struct row *current;
+static double started;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+#ifdef __linux__
+static int open_counter(const uint32_t type, const uint64_t config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1; //allowed up to perf_event_paranoid 2
+    attr.exclude_hv     = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_open(char *errbuf, size_t errlen) {
+    const uint64_t dtlb = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    int paranoid = -1, err = 0, i;
+    FILE *fp     = NULL;
+
+    fds[CYCLES]       = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[LLC_MISSES]   = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[DTLB_MISSES]  = open_counter(PERF_TYPE_HW_CACHE, dtlb);
+
+    for (i = 0; i < NCOUNTERS; i++) {
+        if (fds[i] != -1) opened++;
+        else if (!err) err = errno;
+    }
+
+    if (!opened && errbuf) {
+        if ((fp = fopen("/proc/sys/kernel/perf_event_paranoid", "r")) != NULL) {
+            if (fscanf(fp, "%d", &paranoid) != 1) paranoid = -1;
+            fclose(fp);
+        }
+        if (err == EACCES || err == EPERM)
+            snprintf(errbuf, errlen, "permission denied, perf_event_paranoid "
+                     "is %d, 2 or less (or CAP_PERFMON) is required", paranoid);
+        else if (err == ENOENT || err == ENODEV || err == EOPNOTSUPP)
+            snprintf(errbuf, errlen, "no hardware counters on this host");
+        else
+            snprintf(errbuf, errlen, "%s", strerror(err));
+    }
+    return opened;
+}
+
+static void counters(const unsigned long request) {
+    int i;
+    for (i = 0; i < NCOUNTERS; i++)
+        if (fds[i] != -1) ioctl(fds[i], request, 0);
+}
+
+static void read_counters(uint64_t *values) {
+    uint64_t value;
+    int i;
+    for (i = 0; i < NCOUNTERS; i++)
+        if (fds[i] != -1 && read(fds[i], &value, sizeof(value)) == sizeof(value))
+            values[i] += value;
+}
+
+void perf_phase(const char *stage, const char *phase, int begin) {
+    int i;
+
+    if (!opened) return;
+
+    if (begin) {
+        for (i = 0; i < nrows; i++)
+            if (strcmp(rows[i].stage, stage) == 0 &&
+                strcmp(rows[i].phase, phase) == 0) break;
+        if (i == nrows) {
+            if (nrows == MAX_ROWS) return;
+            snprintf(rows[nrows].stage, sizeof(rows[nrows].stage), "%s", stage);
+            rows[nrows].phase = phase;
+            nrows++;
+        }
+        current = &rows[i];
+        counters(PERF_EVENT_IOC_RESET);
+        started = now();
+        counters(PERF_EVENT_IOC_ENABLE);
+    } else if (current) {
+        counters(PERF_EVENT_IOC_DISABLE);
+        current->ms += now() - started;
+        current->runs++;
+        read_counters(current->values);
+        current = NULL;
+    }
+}
+
+void perf_close(void) {
+    int i;
+    for (i = 0; i < NCOUNTERS; i++) {
+        if (fds[i] != -1) close(fds[i]);
+        fds[i] = -1;
+    }
+    opened = 0;
+}
+#else
+int perf_open(char *errbuf, size_t errlen) {
+    if (errbuf) snprintf(errbuf, errlen, "perf_event_open is Linux only");
+    return 0;
+}
+
+void perf_phase(const char *stage, const char *phase, int begin) {
+}
+
+void perf_close(void) {
+}
+#endif
+
+static void value(char *buf, size_t len, const struct row *row, const int i) {
+    if (fds[i] == -1) snprintf(buf, len, "-");
+    else snprintf(buf, len, "%llu", (unsigned long long) row->values[i]);
+}
+
+void perf_print(FILE *fp) {
+    char v[NCOUNTERS][24], ipc[16], bw[24];
+    const struct row *row;
+    int i, j;
+
+    if (!opened) return;
+
+    fprintf(fp, "%-24s %-5s %6s %10s %14s %14s %12s %12s %5s %10s\n",
+            "stage", "phase", "runs", "ms", counter_names[CYCLES],
+            counter_names[INSTRUCTIONS], counter_names[LLC_MISSES],
+            counter_names[DTLB_MISSES], "IPC", "est. MB/s");
+    for (i = 0; i < nrows; i++) {
+        row = &rows[i];
+        for (j = 0; j < NCOUNTERS; j++) value(v[j], sizeof(v[j]), row, j);
+        if (fds[CYCLES] != -1 && fds[INSTRUCTIONS] != -1 && row->values[CYCLES])
+            snprintf(ipc, sizeof(ipc), "%.2f",
+                     (double) row->values[INSTRUCTIONS] / row->values[CYCLES]);
+        else
+            snprintf(ipc, sizeof(ipc), "-");
+        if (fds[LLC_MISSES] != -1 && row->ms > 0)
+            snprintf(bw, sizeof(bw), "%.1f", (double) row->values[LLC_MISSES] *
+                     CACHELINE / (row->ms / 1e3) / 1e6);
+        else
+            snprintf(bw, sizeof(bw), "-");
+        fprintf(fp, "%-24s %-5s %6llu %10.3f %14s %14s %12s %12s %5s %10s\n",
+                row->stage, row->phase, (unsigned long long) row->runs,
+                row->ms, v[CYCLES], v[INSTRUCTIONS], v[LLC_MISSES],
+                v[DTLB_MISSES], ipc, bw);
+    }
+}
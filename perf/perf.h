@@ -0,0 +1,29 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Hardware performance counters (Linux perf_event_open) around the smix
+ * phases: cycles, instructions, LLC misses and dTLB misses of the calling
+ * thread, user space only. Results are accumulated per stage and phase.
+ */
+
+/**
+ * perf_open(errbuf, errlen):
+ * Open the counters. Return the number of counters available; or 0 and a
+ * reason in errbuf (e.g. perf_event_paranoid) when none of them are, every
+ * other perf_ call is then a no-op.
+ */
+int perf_open(char *errbuf, size_t errlen);
+
+/* Start (begin != 0) or stop counting phase of stage, phase must be static */
+void perf_phase(const char *stage, const char *phase, int begin);
+
+/* Print a row per stage and phase with the counters and derived ratios */
+void perf_print(FILE *fp);
+
+void perf_close(void);
+
+#endif /* !_PERF_H_ */
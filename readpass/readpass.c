@@ -24,6 +24,7 @@
  * SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,93 +33,133 @@
 
 #include "warn.h"
 #include "readpass.h"
+#include "../secmem/secmem.h"
 
 #define MAXPASSLEN  2048
 #define MAXINPUTLEN 2048
 
 /**
- * tarsnap_readpass(passwd, prompt, confirmprompt, devtty)
- * If ${devtty} is non-zero, read a password from /dev/tty if possible; if
- * not, read from stdin.  If reading from a tty (either /dev/tty or stdin),
- * disable echo and prompt the user by printing ${prompt} to stderr.  If
- * ${confirmprompt} is non-NULL, read a second password (prompting if a
- * terminal is being used) and repeat until the user enters the same password
- * twice.  Return the password as a malloced NUL-terminated string via
- * ${passwd}.  The obscure name is to avoid namespace collisions due to the
- * getpass / readpass / readpassphrase / etc. functions in various libraries.
+ * tarsnap_tty_open(tty, devtty):
+ * If ${devtty} is non-zero, open /dev/tty if possible; if not, use stdin.
+ * The terminal settings are read once, every prompt of the session starts
+ * from them.
  */
 int
-tarsnap_readpass(char ** passwd, const char * prompt,
-    const char * confirmprompt, int devtty)
+tarsnap_tty_open(struct tarsnap_tty * tty, int devtty)
 {
-	FILE * readfrom;
-	char passbuf[MAXPASSLEN];
-	char confpassbuf[MAXPASSLEN];
-	struct termios term, term_old;
-	int usingtty;
 
 	/*
 	 * If devtty != 0, try to open /dev/tty; if that fails, or if devtty
-	 * is zero, we'll read the password from stdin instead.
+	 * is zero, we'll read entries from stdin instead.
 	 */
-	if ((devtty == 0) || ((readfrom = fopen("/dev/tty", "r")) == NULL))
-		readfrom = stdin;
+	if ((devtty == 0) || ((tty->readfrom = fopen("/dev/tty", "r")) == NULL))
+		tty->readfrom = stdin;
 
-	/* If we're reading from a terminal, try to disable echo. */
-	if ((usingtty = isatty(fileno(readfrom))) != 0) {
-		if (tcgetattr(fileno(readfrom), &term_old)) {
+	/* If we're reading from a terminal, save its settings. */
+	if ((tty->usingtty = isatty(fileno(tty->readfrom))) != 0) {
+		if (tcgetattr(fileno(tty->readfrom), &tty->term_old)) {
 			warn("Cannot read terminal settings");
-			goto err1;
-		}
-		memcpy(&term, &term_old, sizeof(struct termios));
-		term.c_lflag = (term.c_lflag & ~ECHO) | ECHONL;
-		if (tcsetattr(fileno(readfrom), TCSANOW, &term)) {
-			warn("Cannot set terminal settings");
-			goto err1;
+			tarsnap_tty_close(tty);
+			return (-1);
 		}
 	}
 
+	/* Success! */
+	return (0);
+}
+
+/**
+ * tarsnap_tty_close(tty):
+ * Close /dev/tty if tarsnap_tty_open() opened it.
+ */
+void
+tarsnap_tty_close(struct tarsnap_tty * tty)
+{
+
+	if (tty->readfrom != stdin)
+		fclose(tty->readfrom);
+	tty->readfrom = stdin;
+}
+
+/*
+ * Prompt for and read a line into ${buf}, and if ${confirmprompt} is non-NULL
+ * a second one into ${confbuf} until both are the same.  The line is
+ * terminated at the first "\r" or "\n" (if any).
+ */
+static int
+readline_tty(struct tarsnap_tty * tty, char * buf, char * confbuf,
+    int len, const char * prompt, const char * confirmprompt,
+    const char * what)
+{
+
 retry:
-	/* If we have a terminal, prompt the user to enter the password. */
-	if (usingtty)
+	/* If we have a terminal, prompt the user to enter the line. */
+	if (tty->usingtty)
 		fprintf(stderr, "%s: ", prompt);
 
-	/* Read the password. */
-	if (fgets(passbuf, MAXPASSLEN, readfrom) == NULL) {
-		warn("Cannot read password");
-		goto err2;
+	/* Read the line. */
+	if (fgets(buf, len, tty->readfrom) == NULL) {
+		warn("Cannot read %s", what);
+		return (-1);
 	}
 
-	/* Confirm the password if necessary. */
+	/* Confirm the line if necessary. */
 	if (confirmprompt != NULL) {
-		if (usingtty)
+		if (tty->usingtty)
 			fprintf(stderr, "%s: ", confirmprompt);
-		if (fgets(confpassbuf, MAXPASSLEN, readfrom) == NULL) {
-			warn("Cannot read password");
-			goto err2;
+		if (fgets(confbuf, len, tty->readfrom) == NULL) {
+			warn("Cannot read %s", what);
+			return (-1);
 		}
-		if (strcmp(passbuf, confpassbuf)) {
-			fprintf(stderr,
-			    "Passwords mismatch, please try again\n");
+		if (strcmp(buf, confbuf)) {
+			fprintf(stderr, "%s mismatch, please try again\n",
+			    strcmp(what, "password") ? "Input" : "Passwords");
 			goto retry;
 		}
 	}
 
 	/* Terminate the string at the first "\r" or "\n" (if any). */
-	passbuf[strcspn(passbuf, "\r\n")] = '\0';
+	buf[strcspn(buf, "\r\n")] = '\0';
 
-	/* If we changed terminal settings, reset them. */
-	if (usingtty)
-		tcsetattr(fileno(readfrom), TCSANOW, &term_old);
+	/* Success! */
+	return (0);
+}
 
-	/* Close /dev/tty if we opened it. */
-	if (readfrom != stdin)
-		fclose(readfrom);
+/**
+ * tarsnap_readpass_tty(tty, passwd, prompt, confirmprompt):
+ * Same as tarsnap_readpass(), reading from the session ${tty}.
+ */
+int
+tarsnap_readpass_tty(struct tarsnap_tty * tty, char ** passwd,
+    const char * prompt, const char * confirmprompt)
+{
+	char passbuf[MAXPASSLEN];
+	char confpassbuf[MAXPASSLEN];
+	struct termios term;
 
-	/* Copy the password out. */
-	if ((*passwd = strdup(passbuf)) == NULL) {
-		warn("Cannot allocate memory");
+	/* If we're reading from a terminal, try to disable echo. */
+	if (tty->usingtty) {
+		memcpy(&term, &tty->term_old, sizeof(struct termios));
+		term.c_lflag = (term.c_lflag & ~ECHO) | ECHONL;
+		if (tcsetattr(fileno(tty->readfrom), TCSANOW, &term)) {
+			warn("Cannot set terminal settings");
+			return (-1);
+		}
+	}
+
+	/* Read the password. */
+	if (readline_tty(tty, passbuf, confpassbuf, MAXPASSLEN, prompt,
+	    confirmprompt, "password"))
 		goto err1;
+
+	/* If we changed terminal settings, reset them. */
+	if (tty->usingtty)
+		tcsetattr(fileno(tty->readfrom), TCSANOW, &tty->term_old);
+
+	/* Copy the password out, into the secret arena. */
+	if ((*passwd = secmem_strdup(passbuf)) == NULL) {
+		warn("Cannot allocate memory");
+		goto err0;
 	}
 
 	/* Zero any stored passwords. */
@@ -128,108 +169,150 @@ retry:
 	/* Success! */
 	return (0);
 
-err2:
-	/* Reset terminal settings if necessary. */
-	if (usingtty)
-		tcsetattr(fileno(readfrom), TCSAFLUSH, &term_old);
 err1:
-	/* Close /dev/tty if we opened it. */
-	if (readfrom != stdin)
-		fclose(readfrom);
+	/* Reset terminal settings if necessary. */
+	if (tty->usingtty)
+		tcsetattr(fileno(tty->readfrom), TCSAFLUSH, &tty->term_old);
+err0:
+	memset(passbuf, 0, MAXPASSLEN);
+	memset(confpassbuf, 0, MAXPASSLEN);
 
 	/* Failure! */
 	return (-1);
 }
 
-//use termio settings as a workaround to flush stdin
+/**
+ * tarsnap_readinput_tty(tty, input, prompt, confirmprompt):
+ * Same as tarsnap_readinput(), reading from the session ${tty}.
+ */
 int
-tarsnap_readinput(char ** input, const char * prompt,
-    const char * confirmprompt, int devtty)
+tarsnap_readinput_tty(struct tarsnap_tty * tty, char ** input,
+    const char * prompt, const char * confirmprompt)
 {
-	FILE * readfrom;
 	char inputbuf[MAXINPUTLEN];
 	char confinputbuf[MAXINPUTLEN];
-	struct termios term, term_old;
-	int usingtty;
 
-	/*
-	 * If devtty != 0, try to open /dev/tty; if that fails, or if devtty
-	 * is zero, we'll read entries from stdin instead.
-	 */
-	if ((devtty == 0) || ((readfrom = fopen("/dev/tty", "r")) == NULL))
-		readfrom = stdin;
+	/* Read the input, echoed as the terminal settings were found. */
+	if (readline_tty(tty, inputbuf, confinputbuf, MAXINPUTLEN, prompt,
+	    confirmprompt, "input"))
+		goto err0;
 
-	/* If we're reading from a terminal, try to disable echo. */
-	if ((usingtty = isatty(fileno(readfrom))) != 0) {
-		if (tcgetattr(fileno(readfrom), &term_old)) {
-			warn("Cannot read terminal settings");
-			goto err1;
-		}
-		memcpy(&term, &term_old, sizeof(struct termios));
-		term.c_lflag = (term.c_lflag & ~ECHO) | ECHONL;
-		if (tcsetattr(fileno(readfrom), TCSANOW, &term)) {
-			warn("Cannot set terminal settings");
-			goto err1;
-		}
+	/* Copy the input out, into the secret arena. */
+	if ((*input = secmem_strdup(inputbuf)) == NULL) {
+		warn("Cannot allocate memory");
+		goto err0;
 	}
 
-	/* use termio settings as a workaround to flush stdin */
-	/* If we changed terminal settings, reset them. */
-	if (usingtty)
-		tcsetattr(fileno(readfrom), TCSANOW, &term_old);
-retry:
-	/* If we have a terminal, prompt the user to enter the input. */
-	if (usingtty)
-		fprintf(stderr, "%s: ", prompt);
+	/* Zero any stored input. */
+	memset(inputbuf, 0, MAXINPUTLEN);
+	memset(confinputbuf, 0, MAXINPUTLEN);
 
-	/* Read the input. */
-	if (fgets(inputbuf, MAXINPUTLEN, readfrom) == NULL) {
-		warn("Cannot read input");
-		goto err2;
-	}
+	/* Success! */
+	return (0);
 
-	/* Confirm the input if necessary. */
-	if (confirmprompt != NULL) {
-		if (usingtty)
-			fprintf(stderr, "%s: ", confirmprompt);
-		if (fgets(confinputbuf, MAXINPUTLEN, readfrom) == NULL) {
-			warn("Cannot read input");
-			goto err2;
+err0:
+	memset(inputbuf, 0, MAXINPUTLEN);
+	memset(confinputbuf, 0, MAXINPUTLEN);
+
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * tarsnap_readpass(passwd, prompt, confirmprompt, devtty)
+ * If ${devtty} is non-zero, read a password from /dev/tty if possible; if
+ * not, read from stdin.  If reading from a tty (either /dev/tty or stdin),
+ * disable echo and prompt the user by printing ${prompt} to stderr.  If
+ * ${confirmprompt} is non-NULL, read a second password (prompting if a
+ * terminal is being used) and repeat until the user enters the same password
+ * twice.  Return the password as a NUL-terminated string of the secret
+ * arena (see secmem.h), wiped at exit and not to be freed, via ${passwd}.
+ * The obscure name is to avoid namespace collisions due to the getpass /
+ * readpass / readpassphrase / etc. functions in various libraries.
+ */
+int
+tarsnap_readpass(char ** passwd, const char * prompt,
+    const char * confirmprompt, int devtty)
+{
+	struct tarsnap_tty tty;
+	int rc;
+
+	if (tarsnap_tty_open(&tty, devtty))
+		return (-1);
+	rc = tarsnap_readpass_tty(&tty, passwd, prompt, confirmprompt);
+	tarsnap_tty_close(&tty);
+
+	return (rc);
+}
+
+/* Same as tarsnap_readpass(), echoing the input. */
+int
+tarsnap_readinput(char ** input, const char * prompt,
+    const char * confirmprompt, int devtty)
+{
+	struct tarsnap_tty tty;
+	int rc;
+
+	if (tarsnap_tty_open(&tty, devtty))
+		return (-1);
+	rc = tarsnap_readinput_tty(&tty, input, prompt, confirmprompt);
+	tarsnap_tty_close(&tty);
+
+	return (rc);
+}
+
+/**
+ * tarsnap_readfd(line, fd):
+ * Read a line from the file descriptor ${fd} without prompting, one byte at
+ * a time so nothing past it is consumed and several lines can be read from
+ * the same descriptor.  Return it as a NUL-terminated string of the secret
+ * arena, without the "\r\n", via ${line}.
+ */
+int
+tarsnap_readfd(char ** line, int fd)
+{
+	char linebuf[MAXINPUTLEN];
+	size_t len = 0;
+	ssize_t r;
+
+	/* Read up to the end of the line or the file. */
+	for (;;) {
+		if ((r = read(fd, &linebuf[len], 1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			warn("Cannot read descriptor %d", fd);
+			goto err0;
 		}
-		if (strcmp(inputbuf, confinputbuf)) {
-			fprintf(stderr, "Input mismatch, please try again\n");
-			goto retry;
+		if (r == 0 || linebuf[len] == '\n')
+			break;
+		if (++len == MAXINPUTLEN) {
+			warnx("Line too long on descriptor %d", fd);
+			goto err0;
 		}
 	}
+	if (r == 0 && len == 0) {
+		warnx("Nothing to read on descriptor %d", fd);
+		goto err0;
+	}
 
 	/* Terminate the string at the first "\r" or "\n" (if any). */
-	inputbuf[strcspn(inputbuf, "\r\n")] = '\0';
+	linebuf[len] = '\0';
+	linebuf[strcspn(linebuf, "\r\n")] = '\0';
 
-	/* Close /dev/tty if we opened it. */
-	if (readfrom != stdin)
-		fclose(readfrom);
-
-	/* Copy the input out. */
-	if ((*input = strdup(inputbuf)) == NULL) {
+	/* Copy the line out, into the secret arena. */
+	if ((*line = secmem_strdup(linebuf)) == NULL) {
 		warn("Cannot allocate memory");
-		goto err1;
+		goto err0;
 	}
 
-	/* Zero any stored input. */
-	memset(inputbuf, 0, MAXINPUTLEN);
-	memset(confinputbuf, 0, MAXINPUTLEN);
+	/* Zero the stored line. */
+	memset(linebuf, 0, MAXINPUTLEN);
 
 	/* Success! */
 	return (0);
 
-err2:
-	/* Reset terminal settings if necessary. */
-	if (usingtty)
-		tcsetattr(fileno(readfrom), TCSAFLUSH, &term_old);
-err1:
-	/* Close /dev/tty if we opened it. */
-	if (readfrom != stdin)
-		fclose(readfrom);
+err0:
+	memset(linebuf, 0, MAXINPUTLEN);
 
 	/* Failure! */
 	return (-1);
@@ -29,6 +29,9 @@
 #ifndef _READPASS_H_
 #define _READPASS_H_
 
+#include <stdio.h>
+#include <termios.h>
+
 /**
  * tarsnap_getpass(passwd, prompt, confirmprompt, devtty)
  * If ${devtty} is non-zero, read a password from /dev/tty if possible; if
@@ -36,11 +39,37 @@
  * disable echo and prompt the user by printing ${prompt} to stderr.  If
  * ${confirmprompt} is non-NULL, read a second password (prompting if a
  * terminal is being used) and repeat until the user enters the same password
- * twice.  Return the password as a malloced NUL-terminated string via
- * ${passwd}.  The obscure name is to avoid namespace collisions due to the
- * getpass / readpass / readpassphrase / etc. functions in various libraries.
+ * twice.  Return the password as a NUL-terminated string of the secret
+ * arena (see secmem.h), wiped at exit and not to be freed, via ${passwd}.
+ * The obscure name is to avoid namespace collisions due to the getpass /
+ * readpass / readpassphrase / etc. functions in various libraries.
  */
 int tarsnap_readpass (char **, const char *, const char *, int);
 int tarsnap_readinput(char **, const char *, const char *, int);
 
+/**
+ * A terminal session, several prompts share the opened /dev/tty (or stdin)
+ * and its saved settings instead of opening it once per prompt.
+ */
+struct tarsnap_tty {
+	FILE * readfrom;
+	int usingtty;
+	struct termios term_old;
+};
+
+int tarsnap_tty_open(struct tarsnap_tty *, int);
+void tarsnap_tty_close(struct tarsnap_tty *);
+int tarsnap_readpass_tty(struct tarsnap_tty *, char **, const char *,
+    const char *);
+int tarsnap_readinput_tty(struct tarsnap_tty *, char **, const char *,
+    const char *);
+
+/**
+ * tarsnap_readfd(line, fd)
+ * Read a line from the file descriptor ${fd}, without prompting, up to and
+ * not past its "\n", as a NUL-terminated string of the secret arena via
+ * ${line}.
+ */
+int tarsnap_readfd(char **, int);
+
 #endif /* !_READPASS_H_ */
@@ -0,0 +1,149 @@
+//secmem: the secret arena, see secmem.h
+//
+//mmap()ed chunks for the secrets a run keeps instead of a malloc() and a
+//zeroing each, so they never land in the heap, where a realloc() or a free()
+//would leave copies of them behind. Only the short lived kdf buffers do, and
+//they are wiped before their free(). The guard pages fault an overflow past
+//either end rather than let it reach the heap.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "secmem.h"
+
+#define ALIGN 16
+
+//kept at the start of its own arena, the chunks mapped before are chained
+struct chunk {
+    struct chunk  *next;
+    unsigned char *map;       //the guard pages and the arena between them
+    size_t         mapsize;
+    size_t         size;
+    size_t         used;
+    int            locked;
+};
+
+#define CHUNK_HDR ((sizeof(struct chunk) + ALIGN - 1) & ~(size_t) (ALIGN - 1))
+
+static struct chunk   *head;  //the chunk allocations are bumped off
+static int             registered;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+//volatile, a wipe right before munmap() is a dead store to the compiler
+static void wipe(void *s, size_t len) {
+    volatile unsigned char *p = s;
+
+    while (len--) *p++ = 0;
+}
+
+//map a chunk with an arena of at least len bytes after its header
+static struct chunk *chunk_map(size_t len) {
+    const long pagesize = sysconf(_SC_PAGESIZE);
+    size_t page         = pagesize > 0 ? (size_t) pagesize : 4096;
+    unsigned char *map;
+    struct chunk *c;
+
+    if (len > SIZE_MAX - 3 * page - CHUNK_HDR) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    len = (len + CHUNK_HDR + page - 1) & ~(page - 1);
+
+    map = mmap(NULL, len + 2 * page, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (map == MAP_FAILED) return NULL;
+    if (mprotect(map + page, len, PROT_READ | PROT_WRITE) != 0) {
+        const int err = errno;
+        munmap(map, len + 2 * page);
+        errno = err;
+        return NULL;
+    }
+#ifdef MADV_DONTDUMP
+    (void) madvise(map + page, len, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+    (void) madvise(map + page, len, MADV_WIPEONFORK);
+#endif
+
+    c          = (struct chunk *) (map + page);
+    c->map     = map;
+    c->mapsize = len + 2 * page;
+    c->size    = len;
+    c->used    = CHUNK_HDR;
+    //best effort, RLIMIT_MEMLOCK may be as low as 64 KiB
+    c->locked  = mlock(map + page, len) == 0;
+    return c;
+}
+
+int secmem_init(size_t len) {
+    struct chunk *c;
+    int retval = 0;
+
+    pthread_mutex_lock(&lock);
+    if (!head) {
+        if ((c = chunk_map(len ? len : SECMEM_SIZE)) == NULL) retval = -1;
+        else {
+            head = c;
+            if (!registered) registered = atexit(secmem_destroy) == 0;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return retval;
+}
+
+void *secmem_alloc(size_t len) {
+    struct chunk *c;
+    void *p = NULL;
+
+    if (len > SIZE_MAX - ALIGN) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    len = (len + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+
+    pthread_mutex_lock(&lock);
+    //the sizes are multiples of the pages, so of ALIGN too
+    if (!head || len > head->size - head->used) {
+        if ((c = chunk_map(len > SECMEM_SIZE ? len : SECMEM_SIZE)) == NULL)
+            goto out;
+        c->next = head;
+        head    = c;
+        if (!registered) registered = atexit(secmem_destroy) == 0;
+    }
+    p           = (unsigned char *) head + head->used;
+    head->used += len;
+out:
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+char *secmem_strdup(const char *s) {
+    const size_t len = strlen(s) + 1;
+    char *p;
+
+    if ((p = secmem_alloc(len)) != NULL) memcpy(p, s, len);
+    return p;
+}
+
+void secmem_destroy(void) {
+    struct chunk *c, *next;
+
+    pthread_mutex_lock(&lock);
+    for (c = head; c; c = next) {
+        unsigned char *map    = c->map;
+        const size_t mapsize  = c->mapsize;
+        const size_t size     = c->size;
+        const int locked      = c->locked;
+
+        next = c->next;
+        wipe(c, c->used);
+        if (locked) munlock(c, size);
+        munmap(map, mapsize);
+    }
+    head = NULL;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,39 @@
+#ifndef _SECMEM_H_
+#define _SECMEM_H_
+
+#include <stddef.h>
+
+/* The arena secmem_alloc() maps on first use, when not set up before */
+#define SECMEM_SIZE (64 * 1024)
+
+/*
+ * The secret arena, mappings between two PROT_NONE guard pages each holding
+ * the secrets of a run: names, sites, passwords, the config values and what
+ * is derived from them, libgenpass contexts included. A mapping is added
+ * when the last one is exhausted. They are locked in memory when
+ * RLIMIT_MEMLOCK allows it, left out of core dumps and wiped in forked
+ * children. Allocations are bumped off them, from any thread, and never
+ * freed one by one, the whole arena is wiped and unmapped once, at exit or
+ * by secmem_destroy().
+ */
+
+/*
+ * Map a first mapping of at least size bytes, rounded up to pages, and wipe
+ * the arena at exit. Return 0 on success, or if there is an arena already;
+ * or -1 on error (errno is set).
+ */
+int secmem_init(size_t size);
+
+/*
+ * Return len zeroed bytes of the arena, 16 bytes aligned, mapping more of it
+ * if needed; or NULL when it can't be mapped (errno is set).
+ */
+void *secmem_alloc(size_t len);
+
+/* Copy s into the arena, NULL when it can't be mapped (errno is set) */
+char *secmem_strdup(const char *s);
+
+/* Wipe, unlock and unmap the arena, its pointers are no longer valid */
+void secmem_destroy(void);
+
+#endif
@@ -0,0 +1,120 @@
+//timings: per stage wall clock and resource usage spans
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "timings.h"
+
+#define MAX_SPANS 64
+#define MAX_DEPTH 16
+
+struct span {
+    const char   *name;
+    int           depth;
+    double        start;
+    double        end;
+    struct rusage ru_start;
+    struct rusage ru_end;
+};
+
+static struct span spans[MAX_SPANS];
+static int nspans;
+static int stack[MAX_DEPTH];
+static int depth;
+static int enabled;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void timings_enable(void) {
+    enabled = 1;
+}
+
+void timings_span(const char *name, int begin, void *arg) {
+    struct span *s = NULL;
+
+    if (!enabled) return;
+
+    if (begin) {
+        //too many spans are dropped, but still nest
+        if (depth < MAX_DEPTH) stack[depth] = -1;
+        if (nspans < MAX_SPANS && depth < MAX_DEPTH) {
+            s = &spans[nspans];
+            s->name  = name;
+            s->depth = depth;
+            getrusage(RUSAGE_SELF, &s->ru_start);
+            s->start = now();
+            stack[depth] = nspans++;
+        }
+        depth++;
+    } else if (depth > 0) {
+        depth--;
+        if (depth < MAX_DEPTH && stack[depth] != -1) {
+            s = &spans[stack[depth]];
+            s->end = now();
+            getrusage(RUSAGE_SELF, &s->ru_end);
+        }
+    }
+}
+
+static long faults(const struct span *s, const int major) {
+    if (major) return s->ru_end.ru_majflt - s->ru_start.ru_majflt;
+    return s->ru_end.ru_minflt - s->ru_start.ru_minflt;
+}
+
+void timings_print(FILE *fp) {
+    char name[64];
+    int i;
+
+    fprintf(fp, "%-20s %12s %12s %10s %8s %8s\n", "span", "ms", "maxrss KiB",
+            "minflt", "majflt", "nvcsw");
+    for (i = 0; i < nspans; i++) {
+        if (spans[i].end == 0) continue; //still open
+        snprintf(name, sizeof(name), "%*s%s", spans[i].depth * 2, "",
+                 spans[i].name);
+        fprintf(fp, "%-20s %12.3f %12ld %10ld %8ld %8ld\n", name,
+                spans[i].end - spans[i].start, spans[i].ru_end.ru_maxrss,
+                faults(&spans[i], 0), faults(&spans[i], 1),
+                spans[i].ru_end.ru_nvcsw - spans[i].ru_start.ru_nvcsw);
+    }
+}
+
+int timings_append_json(const char *file, const char *version) {
+    //span names are short literals, every span fits in 192 bytes
+    char line[MAX_SPANS * 192 + 128];
+    const char *sep = "";
+    size_t len      = 0;
+    int fd, i;
+
+    len = snprintf(line, sizeof(line), "{\"version\": \"%s\", \"time\": %ld, "
+                   "\"spans\": [", version, (long) time(NULL));
+    for (i = 0; i < nspans; i++) {
+        if (spans[i].end == 0) continue;
+        len += snprintf(line + len, sizeof(line) - len, "%s{\"name\": \"%s\", "
+                     "\"depth\": %d, \"ms\": %.3f, \"maxrss_kb\": %ld, "
+                     "\"minflt\": %ld, \"majflt\": %ld, \"nvcsw\": %ld}",
+                     sep, spans[i].name, spans[i].depth,
+                     spans[i].end - spans[i].start, spans[i].ru_end.ru_maxrss,
+                     faults(&spans[i], 0), faults(&spans[i], 1),
+                     spans[i].ru_end.ru_nvcsw - spans[i].ru_start.ru_nvcsw);
+        sep = ", ";
+    }
+    len += snprintf(line + len, sizeof(line) - len, "]}\n");
+
+    //a single O_APPEND write keeps lines from concurrent runs whole
+    if ((fd = open(file, O_WRONLY | O_APPEND | O_CREAT, 0600)) == -1)
+        return -1;
+    if (write(fd, line, len) != (ssize_t) len) {
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
@@ -0,0 +1,26 @@
+#ifndef _TIMINGS_H_
+#define _TIMINGS_H_
+
+#include <stdio.h>
+
+/**
+ * Nested monotonic clock spans, each one also records the peak RSS, page
+ * faults and voluntary context switches of the process (getrusage). Spans
+ * are only recorded after timings_enable(), names must be static strings.
+ */
+void timings_enable(void);
+
+/* Open (begin != 0) or close the innermost span name, arg is unused */
+void timings_span(const char *name, int begin, void *arg);
+
+/* Print a table with a row per span, nested spans are indented */
+void timings_print(FILE *fp);
+
+/**
+ * timings_append_json(file, version):
+ * Append the spans as a single JSON line to file. Return 0 on success; or
+ * -1 on error.
+ */
+int timings_append_json(const char *file, const char *version);
+
+#endif /* !_TIMINGS_H_ */